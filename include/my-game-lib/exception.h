@@ -102,6 +102,48 @@ protected:
 
 // ---------------------------------------------------
 
+class UnableToLoadFontException : public Exception
+{
+private:
+	// we use a static string to avoid dynamic memory allocation
+	boost::static_string<fname_max_length> fname;
+
+public:
+	UnableToLoadFontException (const std::source_location& location_, const char *assert_str_, const char *extra_msg_, const std::string_view fname_)
+		: Exception(location_, assert_str_, extra_msg_), fname(fname_)
+	{
+	}
+
+protected:
+	void build_mygamelib_exception_msg (std::ostringstream& str_stream) const override final
+	{
+		str_stream << "Unable to load font \"" << this->fname << "\"." << std::endl;
+	}
+};
+
+// ---------------------------------------------------
+
+class UnableToLoadMeshException : public Exception
+{
+private:
+	// we use a static string to avoid dynamic memory allocation
+	boost::static_string<fname_max_length> fname;
+
+public:
+	UnableToLoadMeshException (const std::source_location& location_, const char *assert_str_, const char *extra_msg_, const std::string_view fname_)
+		: Exception(location_, assert_str_, extra_msg_), fname(fname_)
+	{
+	}
+
+protected:
+	void build_mygamelib_exception_msg (std::ostringstream& str_stream) const override final
+	{
+		str_stream << "Unable to load mesh \"" << this->fname << "\"." << std::endl;
+	}
+};
+
+// ---------------------------------------------------
+
 class SplitTextureNotDivisibleException : public Exception
 {
 private:
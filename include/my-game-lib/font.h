@@ -0,0 +1,103 @@
+#ifndef __MY_GAME_LIB_FONT_HEADER_H__
+#define __MY_GAME_LIB_FONT_HEADER_H__
+
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
+
+#include <SDL_ttf.h>
+
+#include <my-lib/macros.h>
+#include <my-lib/std.h>
+#include <my-lib/unordered-map.h>
+
+#include <my-game-lib/graphics.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+/*
+	Each glyph is rasterized once by SDL_ttf and loaded as a regular texture,
+	so the glyphs end up in the same atlas as all other textures.
+	Therefore, fonts must be loaded between begin_texture_loading
+	and end_texture_loading.
+*/
+
+class Font
+{
+public:
+	struct Glyph {
+		TextureDescriptor texture; // info is nullptr for glyphs without pixels (e.g. space)
+		int32_t width_px;
+		int32_t height_px;
+		int32_t advance_px;
+	};
+
+	struct GlyphQuad {
+		const Glyph *glyph;
+		Vector2 pos_px; // left top corner, relative to the left top corner of the text
+	};
+
+	struct Layout {
+		std::vector<GlyphQuad> quads;
+		Vector2 size_px;
+	};
+
+protected:
+	// the cache is cleared when it gets bigger than this
+	static inline constexpr uint32_t max_cached_layouts = 4096;
+
+	TTF_Font *ttf_font;
+	std::vector<Glyph> glyphs;
+	Mylib::unordered_map_string_key<Layout> layout_cache;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, first_char)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, last_char)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(int32_t, line_height_px)
+
+public:
+	Font (Manager& manager, const std::string_view fname, const uint32_t size_px, const uint32_t first_char_ = 32, const uint32_t last_char_ = 126);
+	~Font ();
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(Font)
+
+	// returns nullptr if the font doesn't provide the glyph
+	inline const Glyph* find_glyph (const uint32_t codepoint) const noexcept
+	{
+		if (codepoint < this->first_char || codepoint > this->last_char) [[unlikely]]
+			return nullptr;
+
+		const Glyph *glyph = &this->glyphs[codepoint - this->first_char];
+
+		// glyphs without pixels (e.g. space) still advance the pen
+		if (glyph->texture.info == nullptr && glyph->advance_px == 0) [[unlikely]]
+			return nullptr;
+
+		return glyph;
+	}
+
+	// text must be utf-8
+	const Layout& get_layout (const std::string_view text);
+
+	inline void clear_layout_cache ()
+	{
+		this->layout_cache.clear();
+	}
+
+private:
+	Layout build_layout (const std::string_view text) const;
+};
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __MY_GAME_LIB_FRAME_WRITER_HEADER_H__
+#define __MY_GAME_LIB_FRAME_WRITER_HEADER_H__
+
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdint>
+
+#include <my-lib/macros.h>
+
+#include <my-game-lib/graphics.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+/*
+	Writes captured frames in its own thread, so encoding and disk
+	access never happen inside update_screen.
+	Usage:
+		FrameWriter writer("capture.y4m", FrameWriter::Format::Y4M, 60);
+		renderer->begin_frame_capture(writer.get_callback());
+		...
+		renderer->end_frame_capture();
+	The writer must outlive the capture.
+	If the thread can't keep up, new frames are dropped.
+*/
+
+class FrameWriter
+{
+public:
+	enum class Format {
+		Raw, // all frames appended to a single file, RGBA without header
+		PNG, // one file per frame, path is used as prefix
+		Y4M  // YUV4MPEG2 4:4:4 stream, readable by ffmpeg and most players
+	};
+
+protected:
+	std::string path;
+	std::ofstream file;
+	std::deque<CapturedFrame> queue;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread thread;
+	bool running = true;
+	bool header_written = false;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(Format, format)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, fps)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, max_queued_frames)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, n_written_frames, 0)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, n_dropped_frames, 0)
+
+public:
+	FrameWriter (const std::string_view path_, const Format format_, const uint32_t fps_ = 60, const uint32_t max_queued_frames_ = 8);
+
+	// waits for all queued frames to be written
+	~FrameWriter ();
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(FrameWriter)
+
+	void push (CapturedFrame&& frame);
+
+	inline Manager::FrameCaptureCallback get_callback ()
+	{
+		return [this] (CapturedFrame&& frame) -> void {
+			this->push(std::move(frame));
+		};
+	}
+
+private:
+	void thread_main ();
+	void write_frame (const CapturedFrame& frame);
+	void write_png (const CapturedFrame& frame);
+	void write_y4m (const CapturedFrame& frame);
+};
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
+
+#endif
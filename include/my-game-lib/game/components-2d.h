@@ -2,6 +2,7 @@
 #define __MY_GAME_LIB_GAME_COMPONENTS2D_HEADER_H__
 
 #include <string_view>
+#include <vector>
 
 #include <my-game-lib/game/game.h>
 #include <my-game-lib/exception.h>
@@ -54,6 +55,7 @@ public:
 private:
 	MYLIB_OO_ENCAPSULATE_OBJ_WITH_COPY_MOVE(Vector, size)
 	MYLIB_OO_ENCAPSULATE_OBJ_WITH_COPY_MOVE(TextureDescriptor, texture)
+	MYLIB_OO_ENCAPSULATE_OBJ_INIT_WITH_COPY_MOVE(Color, color, Graphics::Colors::white) // tint
 	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(float, z, 0.0f)
 
 public:
@@ -69,6 +71,74 @@ public:
 
 // ---------------------------------------------------
 
+class ParticleSystem2D : public TransformComponent2D, public UpdateInterface, public RenderInterface
+{
+public:
+	using TransformComponent = TransformComponent2D;
+	using Vector = TransformComponent::Vector;
+	using Point = TransformComponent::Point;
+
+	struct Config {
+		uint32_t max_particles = 1024; // only read by the constructor
+		float emission_rate = 100.0f; // particles per second
+		float lifetime_min = 1.0f;
+		float lifetime_max = 1.0f;
+		Vector velocity_min = Vector(-1.0f, -1.0f);
+		Vector velocity_max = Vector(1.0f, 1.0f);
+		Vector acceleration = Vector(0.0f, 0.0f);
+		float angular_velocity_min = 0.0f;
+		float angular_velocity_max = 0.0f;
+		Vector size_begin = Vector(0.1f, 0.1f);
+		Vector size_end = Vector(0.1f, 0.1f);
+		Color color_begin = Color(1.0f, 1.0f, 1.0f, 1.0f);
+		Color color_end = Color(1.0f, 1.0f, 1.0f, 0.0f);
+		TextureDescriptor texture = { nullptr }; // nullptr for untextured particles
+		uint32_t n_threads = 1; // threads used by process_update, the workers are shared by all particle systems
+	};
+
+private:
+	/*
+		Particles are stored as a structure of arrays,
+		so that each update loop touches only contiguous floats
+		and can be vectorized by the compiler.
+		Particles live in world coordinates.
+		The transform of the component only affects the emission point.
+	*/
+	struct Particles {
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> vx;
+		std::vector<float> vy;
+		std::vector<float> rotation;
+		std::vector<float> angular_velocity;
+		std::vector<float> age;
+		std::vector<float> inv_lifetime; // 1 / lifetime
+	};
+
+	MYLIB_OO_ENCAPSULATE_OBJ(Config, config)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(float, z, 0.0f)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(bool, emitting, true)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint32_t, n_alive, 0)
+
+	Particles particles;
+	float emission_accumulator = 0;
+
+public:
+	ParticleSystem2D (const Config& config_);
+
+	// spawns n particles right now, regardless of the emission rate
+	void emit (const uint32_t n);
+
+	void process_update (const float dt) override final;
+	void process_render (const float dt) override final;
+
+private:
+	void integrate (const uint32_t begin, const uint32_t end, const float dt) noexcept;
+	void remove_dead ();
+};
+
+// ---------------------------------------------------
+
 class TileMap : public Entity2D
 {
 public:
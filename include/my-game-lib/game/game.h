@@ -661,6 +661,12 @@ public:
 		bool sleep_to_save_cpu;
 		float sleep_threshold;
 		bool busy_wait_to_ensure_fps;
+
+		// Reduce the render resolution when the frame takes longer than target_dt.
+		// See Graphics::DynamicResolutionController.
+		bool dynamic_resolution = false;
+		float min_render_scale = 0.5f;
+		float upscale_sharpness = 0.0f;
 	};
 
 	enum class State {
@@ -677,6 +683,8 @@ protected:
 	MyGlib::Event::Quit::Descriptor event_quit_d;
 	MyGlib::Event::KeyDown::Descriptor event_key_down_d;
 
+	Graphics::DynamicResolutionController dynamic_resolution_controller;
+
 private:
 	static inline Main *instance = nullptr;
 
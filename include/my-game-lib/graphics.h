@@ -21,6 +21,9 @@
 #include <string>
 #include <variant>
 #include <optional>
+#include <list>
+#include <vector>
+#include <functional>
 
 #include <my-lib/std.h>
 #include <my-lib/macros.h>
@@ -201,6 +204,29 @@ struct TextureDescriptor {
 
 // ---------------------------------------------------
 
+/*
+	A logical texture with several resolution variants of the same image.
+	Draw calls select the smallest variant that still covers the
+	projected size of the object on the screen.
+*/
+
+struct TextureSetInfo {
+	std::vector<TextureDescriptor> variants; // sorted from the largest to the smallest
+
+	// Multiplies the projected size before selecting the variant.
+	// E.g., a sphere shows half of its texture around its diameter,
+	// so its textures need about pi times the projected diameter.
+	fp_t lod_bias = 1;
+
+	std::string id;
+};
+
+struct TextureSetDescriptor {
+	TextureSetInfo *info;
+};
+
+// ---------------------------------------------------
+
 struct Vertex {
 	Point pos; // local x,y,z coords
 	union {
@@ -223,6 +249,7 @@ public:
 		WireCube3D,
 		Sphere3D,
 		Line3D,
+		Mesh3D,
 		Undefined // may be useful
 	};
 
@@ -902,26 +929,156 @@ struct RenderArgs2D {
 	bool invert_y_axis; // if true, the y axis will grown downwards
 };
 
+/*
+	One view of the frame (e.g. split screen or minimap).
+	All viewports draw the same geometry, which is submitted only once.
+*/
+
+struct ViewportArgs {
+	std::variant<RenderArgs3D, RenderArgs2D> args;
+
+	/* Area of the window, in the same normalized coords of RenderArgs2D,
+	   with the y axis growing upwards.
+	   Only used by 3D viewports, since RenderArgs2D has its own clip area.
+	*/
+	Vector2 clip_init_norm;
+	Vector2 clip_end_norm;
+};
+
 // ---------------------------------------------------
 
+using PaletteDescriptor = uint32_t;
+
 struct TextureRenderOptions {
 	TextureDescriptor desc;
+	TextureSetDescriptor set; // when set, replaces desc with the variant selected for the projected size
+	std::optional<PaletteDescriptor> palette; // only for indexed textures, replaces the palette loaded with the texture
 //	bool flip_x = false;
 //	bool flip_y = false;
 };
 
 // ---------------------------------------------------
 
+/*
+	Instance types used by the bulk draw functions.
+	They are plain data, so gameplay code can keep them in
+	contiguous arrays and submit all of them with a single call.
+*/
+
+struct Line3DInstance {
+	Point from;
+	Point to;
+	Color color;
+};
+
+struct Cube3DInstance {
+	Point pos; // center
+	Vector size; // w, h, d
+	Color color;
+};
+
+struct Rect2DInstance {
+	Point pos; // center
+	Vector2 size;
+	fp_t rotation; // radians, around the z axis
+	Color color;
+};
+
+// ---------------------------------------------------
+
+class Font;
+
+struct TextRenderOptions {
+	Font *font;
+	fp_t line_height; // height of a line of text in world coords
+	Color color;
+	bool invert_y_axis; // must match RenderArgs2D::invert_y_axis
+};
+
+// ---------------------------------------------------
+
+class VoxelChunk; // voxel.h
+class Heightfield3D; // heightfield.h
+class Mesh3D; // mesh.h
+
+// ---------------------------------------------------
+
+struct CapturedFrame {
+	std::vector<uint8_t> pixels; // RGBA, 8 bits per channel, top row first
+	uint32_t width_px;
+	uint32_t height_px;
+	uint64_t frame_number; // number of update_screen calls before this frame was shown
+};
+
+// ---------------------------------------------------
+
+class Manager;
+
+/*
+	A cached layer is a texture the backend renders into
+	(a layer of the texture array attached to a FBO in Opengl,
+	a render target texture in SDL).
+	The draw function is only called when the layer is invalidated,
+	or when the camera moves further than the margin from the region
+	rendered last time.
+	In all other frames, the layer is drawn as a single textured quad.
+	Useful for static or slowly changing layers, such as tile maps,
+	parallax backgrounds and HUD panels.
+	The draw function must not draw the layer itself.
+*/
+
+class CachedLayer2D
+{
+public:
+	using DrawFunction = std::function<void (Manager&)>;
+
+protected:
+	TextureInfo texture_info; // filled by the backend
+	DrawFunction draw_function;
+
+	// added to each side of the visible area, in world coords
+	MYLIB_OO_ENCAPSULATE_OBJ(Vector2, margin)
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(bool, valid, false)
+
+	// region of the world stored in the texture
+	MYLIB_OO_ENCAPSULATE_OBJ_READONLY(Vector2, world_init)
+	MYLIB_OO_ENCAPSULATE_OBJ_READONLY(Vector2, world_size)
+
+public:
+	CachedLayer2D (const Vector2& margin_, DrawFunction draw_function_)
+		: draw_function(std::move(draw_function_)), margin(margin_)
+	{
+	}
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(CachedLayer2D)
+
+	inline TextureDescriptor get_texture () noexcept
+	{
+		return TextureDescriptor { .info = &this->texture_info };
+	}
+
+	// forces the draw function to be called again in the next draw
+	inline void invalidate () noexcept
+	{
+		this->valid = false;
+	}
+
+	friend class Manager;
+};
+
+// ---------------------------------------------------
+
 using LightPointDescriptor = uint32_t;
+using OccludeeDescriptor = uint32_t;
 
 // ---------------------------------------------------
 
 class Manager
 {
-protected:
+public:
 	static inline constexpr uint32_t max_points_light_source = 5;
 
-public:
 	enum class Type : uint32_t { // any change here will need a change in get_type_str
 	#ifdef MYGLIB_SUPPORT_SDL
 		SDL,
@@ -960,6 +1117,19 @@ protected:
 	
 	MYLIB_OO_ENCAPSULATE_OBJ_INIT(Color, background_color, Colors::black)
 
+	/*
+		Dynamic resolution.
+		The scene is rendered with render_scale times the window resolution,
+		and then upscaled to the window, optionally with sharpening.
+		Usually adjusted every frame by a DynamicResolutionController.
+		Backends without support always render with the full resolution.
+	*/
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(fp_t, render_scale, 1)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(fp_t, upscale_sharpness, 0) // 0 means plain bilinear filtering
+
+	// When disabled, all occludees are considered visible.
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(bool, occlusion_culling, false)
+
 	struct LightPointSource {
 		Point pos;
 		Color color;
@@ -971,6 +1141,22 @@ protected:
 	SDL_Window *sdl_window;
 
 	Mylib::unordered_map_string_key<TextureInfo> textures;
+	Mylib::unordered_map_string_key<TextureSetInfo> texture_sets;
+
+	/*
+		Camera used to calculate the projected size of objects,
+		updated by the backends in setup_render_3D/2D.
+		With perspective, px_per_unit is the value at distance 1.
+	*/
+	struct TextureLodCamera {
+		Point pos;
+		fp_t px_per_unit;
+		bool perspective;
+	};
+
+	TextureLodCamera texture_lod_camera = { .pos = Point::zero(), .px_per_unit = 1, .perspective = false };
+
+	std::list<CachedLayer2D> cached_layers;
 
 private:
 	uint64_t next_random_tex_id = 0;
@@ -1012,13 +1198,32 @@ public:
 	virtual void draw_cube3D (Cube3D& cube, const Vector& offset, const Color& color) = 0;
 	virtual void draw_cube3D (Cube3D& cube, const Vector& offset, const std::array<TextureRenderOptions, 6>& texture_options) = 0;
 	virtual void draw_wire_cube3D (WireCube3D& cube, const Vector& offset, const Color& color) = 0;
+	virtual void draw_voxel_chunk3D (VoxelChunk& chunk, const Vector& offset) = 0; // meshes the chunk if needed, offset is the origin of the chunk
+	virtual void draw_heightfield3D (Heightfield3D& heightfield, const Vector& offset) = 0; // offset is the origin of the heightfield
+	virtual void draw_mesh3D (Mesh3D& mesh, const Vector& offset, const Color& color) = 0;
+	virtual void draw_mesh3D (Mesh3D& mesh, const Vector& offset, const TextureRenderOptions& texture_options) = 0; // the mesh must have tex coords
 	virtual void draw_sphere3D (Sphere3D& sphere, const Vector& offset, const Color& color) = 0;
 	virtual void draw_sphere3D (Sphere3D& sphere, const Vector& offset, const TextureRenderOptions& texture_options) = 0;
 	virtual void draw_circle2D (Circle2D& circle, const Vector& offset, const Color& color) = 0;
 	virtual void draw_rect2D (Rect2D& rect, const Vector& offset, const Color& color) = 0;
 	virtual void draw_rect2D (Rect2D& rect, const Vector& offset, const TextureRenderOptions& texture_options) = 0;
+	virtual void draw_text2D (const std::string_view text, const Vector& offset, const TextRenderOptions& text_options) = 0; // offset is the left top corner of the text
+
+	// Bulk draw functions.
+	// The default implementations just call the single-shape functions.
+	// Backends should override them with something faster.
+
+	virtual void draw_lines3D (const std::span<const Line3DInstance> lines);
+	virtual void draw_cubes3D (const std::span<const Cube3DInstance> cubes);
+	virtual void draw_rects2D (const std::span<const Rect2DInstance> rects);
+
 	virtual void setup_render_3D (const RenderArgs3D& args) = 0;
 	virtual void setup_render_2D (const RenderArgs2D& args) = 0;
+
+	// Instead of a single view, render draws everything once for each viewport.
+	// Calling setup_render_3D or setup_render_2D goes back to a single view.
+	virtual void setup_viewports (const std::span<const ViewportArgs> viewports) = 0;
+
 	virtual void render () = 0;
 	virtual void update_screen () = 0;
 	virtual void clear_buffers (const uint32_t flags) = 0;
@@ -1026,6 +1231,109 @@ public:
 	virtual void begin_texture_loading () = 0;
 	virtual void end_texture_loading () = 0;
 
+	/*
+		Frame capture.
+		After update_screen, the frame is sent to the callback.
+		Backends may read the frames back asynchronously, so the callback
+		usually receives a frame a few frames after it was shown,
+		and frames may be dropped instead of stalling the renderer.
+		The callback is called from update_screen, so it should only
+		move the frame somewhere else (see FrameWriter).
+	*/
+
+	using FrameCaptureCallback = std::function<void (CapturedFrame&& frame)>;
+
+	virtual void begin_frame_capture (FrameCaptureCallback callback) = 0;
+	virtual void end_frame_capture () = 0; // frames still being read back are sent to the callback
+
+	// GPU time in seconds of a recently finished frame,
+	// or a negative value if the backend can't measure it.
+	virtual fp_t get_gpu_frame_dt () const
+	{
+		return -1;
+	}
+
+	/*
+		Occlusion culling.
+		Objects that may be hidden behind others are registered as occludees.
+		Every frame, before drawing an occludee, call is_occludee_visible
+		with its bounding box, and skip the draw if it returns false.
+		Everything drawn normally acts as an occluder, so large objects
+		should not be registered.
+		The answer comes from the GPU a few frames late, so an object
+		may show up one or two frames after it becomes visible.
+		Backends without support always return true.
+	*/
+
+	[[nodiscard]] virtual OccludeeDescriptor add_occludee ()
+	{
+		return 0;
+	}
+
+	virtual void remove_occludee (const OccludeeDescriptor desc)
+	{
+	}
+
+	virtual bool is_occludee_visible (const OccludeeDescriptor desc, const Vector& center, const Vector& half_size)
+	{
+		return true;
+	}
+
+	/*
+		Palettes of indexed (8 bits) textures.
+		A palette has up to 256 colors, and the missing ones are transparent.
+		Changing a palette recolors every texture drawn with it,
+		and a texture may be drawn with any palette (see TextureRenderOptions).
+	*/
+
+	[[nodiscard]] virtual PaletteDescriptor create_palette (const std::span<const Color> colors)
+	{
+		mylib_throw_msg(GraphicsUnsupportedException, "palettes not supported by this backend");
+	}
+
+	virtual void update_palette (const PaletteDescriptor palette, const std::span<const Color> colors)
+	{
+		mylib_throw_msg(GraphicsUnsupportedException, "palettes not supported by this backend");
+	}
+
+	// palette created from the surface of an indexed texture
+	// textures with the same colors and color key may share it
+	virtual PaletteDescriptor get_texture_palette (const TextureDescriptor& texture)
+	{
+		mylib_throw_msg(GraphicsUnsupportedException, "palettes not supported by this backend");
+	}
+
+	/*
+		Heightfields.
+		Called by the constructor and destructor of Heightfield3D,
+		so the backend can keep its own copy of the heights in Heightfield3D::data.
+		The copy must be updated when the version of the heightfield changes.
+	*/
+
+	virtual void create_heightfield (Heightfield3D& heightfield)
+	{
+		mylib_throw_msg(GraphicsUnsupportedException, "heightfields not supported by this backend");
+	}
+
+	virtual void destroy_heightfield (Heightfield3D& heightfield)
+	{
+	}
+
+	/*
+		Voxel chunks.
+		Called by the constructor and destructor of VoxelChunk,
+		so the backend can keep the mesh of the chunk in VoxelChunk::data.
+		The mesh must be updated when the mesh version of the chunk changes.
+	*/
+
+	virtual void create_voxel_chunk (VoxelChunk& chunk)
+	{
+	}
+
+	virtual void destroy_voxel_chunk (VoxelChunk& chunk)
+	{
+	}
+
 	// 3D Wrappers
 
 	void draw_line3D (Line3D&& line, const Vector& offset, const Color& color)
@@ -1113,6 +1421,39 @@ public:
 	TextureDescriptor find_texture_by_id (const std::string_view id);
 	TextureDescriptor find_texture_by_fname (const std::string_view fname);
 
+	/*
+		Asynchronous loading, after end_texture_loading.
+		The file is decoded in a worker thread and uploaded by the backend
+		in small amounts per frame.
+		Until then, the returned descriptor is drawn with the fallback
+		texture (and has its size).
+		The callback is called in the rendering thread once the texture
+		is resident, or with loaded set to false if the file can't be
+		decoded, in which case the texture keeps the fallback.
+	*/
+	using TextureLoadedCallback = std::function<void (TextureDescriptor texture, const bool loaded)>;
+
+	TextureDescriptor load_texture_async (std::string id, const std::string_view fname, const TextureDescriptor& fallback, TextureLoadedCallback callback = nullptr);
+
+	// Texture sets.
+	// The variants may be passed in any order and must have been loaded already.
+
+	TextureSetDescriptor create_texture_set (std::string id, const std::span<const TextureDescriptor> variants);
+	TextureSetDescriptor find_texture_set_by_id (const std::string_view id);
+
+	// Projected size in pixels of an object of size world_size at pos,
+	// according to the last call to setup_render_3D/2D.
+	fp_t calculate_projected_size_px (const Point& pos, const fp_t world_size) const;
+
+	// Cached layers must be created between begin_texture_loading and end_texture_loading.
+	// The texture size should be the window size plus the margin,
+	// otherwise the layer will be rendered with a different resolution.
+
+	CachedLayer2D& create_cached_layer2D (const uint32_t width_px, const uint32_t height_px, const Vector2& margin, CachedLayer2D::DrawFunction draw_function);
+
+	// args must be the same passed to setup_render_2D in this frame
+	void draw_cached_layer2D (CachedLayer2D& layer, const RenderArgs2D& args, const fp_t z = 0);
+
 	// light functions
 
 	[[nodiscard]] LightPointDescriptor add_light_point_source (const Point& pos, const Color& color);
@@ -1124,10 +1465,29 @@ public:
 	}
 
 protected:
+	void update_texture_lod_camera (const RenderArgs3D& args);
+	void update_texture_lod_camera (const RenderArgs2D& args);
+
+	// Backends must use this instead of texture_options.desc in draw calls.
+	const TextureInfo& select_texture (const TextureRenderOptions& texture_options, const Point& pos, const fp_t world_size);
+
 	virtual TextureInfo load_texture__ (SDL_Surface *surface) = 0;
+
+	// texture is already in the map, as a copy of fallback
+	virtual void load_texture_async__ (TextureInfo& texture, const std::string_view fname, TextureLoadedCallback callback)
+	{
+		mylib_throw_msg(GraphicsUnsupportedException, "asynchronous texture loading not supported by this backend");
+	}
+
 	virtual void destroy_texture__ (TextureInfo& texture) = 0;
 	virtual TextureInfo create_sub_texture__ (const TextureInfo& parent, const uint32_t x_ini, const uint32_t y_ini, const uint32_t w, const uint32_t h) = 0;
 
+	// All draw calls between begin and end are rendered to the texture,
+	// mapping world_init to its left top corner.
+	virtual TextureInfo create_render_target__ (const uint32_t width_px, const uint32_t height_px) = 0;
+	virtual void begin_render_to_texture__ (TextureInfo& texture, const Vector2& world_init, const Vector2& world_size) = 0;
+	virtual void end_render_to_texture__ (TextureInfo& texture) = 0;
+
 private:
 	TextureInfo& add_texture (std::string id, const TextureInfo& texture__);
 	std::string find_unused_texture_id ();
@@ -1135,6 +1495,46 @@ private:
 
 // ---------------------------------------------------
 
+/*
+	Chooses the render scale from the measured frame time.
+	The scale is reduced as soon as the frame gets over budget,
+	but only increased after the frame time stays below the headroom
+	for a while, to avoid oscillating between two resolutions.
+*/
+
+class DynamicResolutionController
+{
+public:
+	struct Config {
+		fp_t target_dt;
+		fp_t min_scale = 0.5;
+		fp_t max_scale = 1;
+		fp_t headroom = 0.85; // the scale only increases if the frame takes less than headroom * target_dt
+		fp_t increase_step = 0.05;
+		uint32_t frames_to_increase = 30;
+	};
+
+protected:
+	Config config;
+	fp_t smoothed_dt = 0;
+	uint32_t frames_under_budget = 0;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(fp_t, scale)
+
+public:
+	DynamicResolutionController (const Config& config_)
+		: config(config_), scale(config_.max_scale)
+	{
+	}
+
+	// Frame dt should be the gpu time when available,
+	// since the resolution doesn't change the cpu time.
+	// Returns the new scale.
+	fp_t update (const fp_t frame_dt);
+};
+
+// ---------------------------------------------------
+
 class CircleFactory
 {
 private:
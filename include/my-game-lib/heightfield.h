@@ -0,0 +1,166 @@
+#ifndef __MY_GAME_LIB_HEIGHTFIELD_HEADER_H__
+#define __MY_GAME_LIB_HEIGHTFIELD_HEADER_H__
+
+#include <array>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
+
+#include <my-lib/macros.h>
+#include <my-lib/std.h>
+#include <my-lib/any.h>
+
+#include <my-game-lib/graphics.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+/*
+	Terrain defined by a grid of heights, one sample per cell corner.
+	Sample (0, 0) is at the origin of the heightfield,
+	x grows with the columns and z with the rows.
+
+	Rendering uses chunked continuous LOD (CDLOD).
+	The cells are split in a quadtree of square nodes. Every node is drawn
+	with the same grid of patch_size x patch_size quads, scaled to the size
+	of the node, so the number of triangles depends on how many nodes are
+	selected, and not on the size of the heightfield.
+	A node is split while the camera is closer than the range of its level,
+	so the triangle count follows the area of the screen covered by the terrain.
+	Close to the end of the range, the vertices of a node morph into the
+	grid of its parent, so neighbour nodes of different levels match without cracks.
+
+	The texture repeats every tile_size world units.
+*/
+
+class Heightfield3D
+{
+public:
+	static inline constexpr uint32_t patch_size = 32; // quads per side of the grid of a node
+
+	// fraction of the range of a level where the vertices start to morph
+	static inline constexpr fp_t morph_start_ratio = fp(0.7);
+
+	struct Node {
+		uint32_t x; // first cell
+		uint32_t z;
+		uint32_t size; // in cells, patch_size << level
+		uint32_t level; // 0 is the most detailed
+		fp_t min_height;
+		fp_t max_height;
+		std::array<uint32_t, 4> children; // index in nodes, 0 if the child is outside of the heightfield (the root is never a child)
+	};
+
+	struct SelectedNode {
+		const Node *node;
+		fp_t morph_start; // distance to the camera where the vertices start to morph into the grid of the parent
+		fp_t morph_end; // fully morphed
+	};
+
+	// filled by the backend driver
+	Mylib::Any<sizeof(void*), sizeof(void*)> data;
+
+protected:
+	Manager& manager;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, size_x) // in samples
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, size_z)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(fp_t, cell_size)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, n_levels)
+
+	// range of level 0, doubled for each level
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(fp_t, lod_distance)
+
+	MYLIB_OO_ENCAPSULATE_OBJ_WITH_COPY_MOVE(TextureRenderOptions, texture)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(fp_t, tile_size, 1)
+
+	// incremented every time a height changes
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, version, 0)
+
+	std::vector<float> heights; // x varies faster
+	std::vector<Node> nodes; // nodes[0] is the root
+	std::vector<fp_t> lod_ranges; // indexed by level
+	bool bounds_dirty = false;
+
+public:
+	// Heights come from the red channel of the image, from 0 (black) to height_scale (red 255).
+	Heightfield3D (Manager& manager_, const std::string_view fname, const fp_t cell_size_, const fp_t height_scale);
+
+	Heightfield3D (Manager& manager_, std::vector<float> heights_, const uint32_t size_x_, const uint32_t size_z_, const fp_t cell_size_);
+
+	~Heightfield3D ();
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(Heightfield3D)
+
+	inline float get_height (const uint32_t x, const uint32_t z) const noexcept
+	{
+		return this->heights[this->get_sample_index(x, z)];
+	}
+
+	void set_height (const uint32_t x, const uint32_t z, const float height);
+
+	// bilinear interpolation of the samples, in local coords
+	// positions outside of the heightfield are clamped to its border
+	fp_t get_height_at (const fp_t x, const fp_t z) const noexcept;
+
+	inline std::span<const float> get_heights () const noexcept
+	{
+		return this->heights;
+	}
+
+	inline fp_t get_width () const noexcept
+	{
+		return static_cast<fp_t>(this->size_x - 1) * this->cell_size;
+	}
+
+	inline fp_t get_depth () const noexcept
+	{
+		return static_cast<fp_t>(this->size_z - 1) * this->cell_size;
+	}
+
+	void set_lod_distance (const fp_t lod_distance_);
+
+	inline bool are_bounds_dirty () const noexcept
+	{
+		return this->bounds_dirty;
+	}
+
+	// Recalculates the height bounds of the nodes after set_height.
+	// Returns true if anything changed.
+	bool update_bounds ();
+
+	/*
+		Selects the nodes to be drawn and appends them to selection.
+		offset is the origin of the heightfield, and camera_pos is in world coords.
+		Nodes outside of all frustums are skipped. The planes are in world coords,
+		and a point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0.
+		With no frustums, nothing is culled.
+	*/
+	void select_nodes (const Vector& offset, const Point& camera_pos, const std::span<const std::array<Vector4f, 6>> frustums_planes, std::vector<SelectedNode>& selection) const;
+
+private:
+	inline uint32_t get_sample_index (const uint32_t x, const uint32_t z) const noexcept
+	{
+		return x + this->size_x * z;
+	}
+
+	void build_nodes ();
+	uint32_t build_node (const uint32_t x, const uint32_t z, const uint32_t level);
+	void calculate_bounds (const uint32_t node_index);
+	void select_node (const uint32_t node_index, const Vector& offset, const Point& camera_pos, const std::span<const std::array<Vector4f, 6>> frustums_planes, std::vector<SelectedNode>& selection) const;
+};
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef __MY_GAME_LIB_MESH_HEADER_H__
+#define __MY_GAME_LIB_MESH_HEADER_H__
+
+#include <string_view>
+#include <span>
+#include <vector>
+
+#include <cstdint>
+
+#include <my-lib/macros.h>
+#include <my-lib/std.h>
+
+#include <my-game-lib/graphics.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+/*
+	Indexed triangle mesh.
+	Triangles are counter-clockwise when seen from outside.
+*/
+
+struct MeshData {
+	std::vector<Vertex> vertices;
+	std::vector<Vector2f> tex_coords; // empty, or one per vertex, (0, 0) is the left top of the texture
+	std::vector<uint32_t> indices;
+};
+
+/*
+	Binary mesh format (.mglm), little-endian:
+
+	char magic[4];          "MGLM"
+	uint32_t version;       1
+	uint32_t flags;         bit 0: has tex coords
+	uint32_t n_vertices;
+	uint32_t n_indices;
+	float positions[n_vertices][3];
+	float normals[n_vertices][3];
+	float tex_coords[n_vertices][2]; only if bit 0 of flags is set
+	uint32_t indices[n_indices];
+
+	It is just the MeshData arrays, so loading is a few fread calls.
+	Meshes should be optimized before being saved (see import_obj_mesh).
+*/
+
+MeshData load_mesh (const std::string_view fname);
+void save_mesh (const std::string_view fname, const MeshData& mesh);
+
+/*
+	Imports a Wavefront OBJ file and optimizes it.
+	Polygons are triangulated as fans.
+	Faces without normals get flat normals.
+	Materials and groups are ignored.
+*/
+
+MeshData import_obj_mesh (const std::string_view fname);
+
+/*
+	Import-time optimizations, in this order:
+	- Merges identical vertices.
+	- Orders the triangles for the post-transform vertex cache (Tipsify).
+	- Orders the clusters found by Tipsify from the outside to the inside
+	  of the mesh, so the depth test rejects more fragments.
+	- Orders the vertices by first use in the index buffer, for vertex fetch.
+*/
+
+void optimize_mesh (MeshData& mesh, const uint32_t vertex_cache_size = 16);
+
+// ---------------------------------------------------
+
+class Mesh3D : public Shape
+{
+private:
+	MeshData data; // not scaled
+	std::vector<Vertex> vertices; // scaled
+	std::vector<Vertex> rotated_vertices;
+
+protected:
+	// distance of the farthest vertex from the local origin, after scaling
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(fp_t, radius)
+
+public:
+	Mesh3D (MeshData data_)
+		: Shape(Type::Mesh3D), data(std::move(data_))
+	{
+		this->calculate_vertices();
+	}
+
+	Mesh3D (const std::string_view fname)
+		: Mesh3D(load_mesh(fname))
+	{
+	}
+
+	// copy constructor
+	Mesh3D (const Mesh3D& other)
+		: Shape(Type::Mesh3D), data(other.data)
+	{
+		this->shape_copy(other);
+		this->calculate_vertices();
+	}
+
+	// copy-assign operator
+	Mesh3D& operator= (const Mesh3D& other)
+	{
+		this->type = Type::Mesh3D;
+		this->data = other.data;
+		this->shape_copy(other);
+		this->calculate_vertices();
+
+		return *this;
+	}
+
+	// must be called after the scale changes
+	void calculate_vertices ();
+
+	inline std::span<const uint32_t> get_indices () const noexcept
+	{
+		return this->data.indices;
+	}
+
+	inline std::span<const Vector2f> get_tex_coords () const noexcept
+	{
+		return this->data.tex_coords;
+	}
+
+	inline bool has_tex_coords () const noexcept
+	{
+		return !this->data.tex_coords.empty();
+	}
+
+	inline uint32_t get_n_vertices () const noexcept
+	{
+		return this->vertices.size();
+	}
+
+	inline uint32_t get_n_indices () const noexcept
+	{
+		return this->data.indices.size();
+	}
+};
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
+
+#endif
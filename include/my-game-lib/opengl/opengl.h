@@ -20,11 +20,19 @@
 
 #include <cstring>
 
+#include <array>
+#include <algorithm>
 #include <string>
 #include <string_view>
 #include <span>
 #include <vector>
 #include <list>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <initializer_list>
+#include <utility>
 
 #include <my-lib/std.h>
 #include <my-lib/macros.h>
@@ -32,6 +40,8 @@
 
 #include <my-game-lib/graphics.h>
 #include <my-game-lib/texture-atlas.h>
+#include <my-game-lib/texture-decoder.h>
+#include <my-game-lib/heightfield.h>
 
 // ---------------------------------------------------
 
@@ -63,6 +73,42 @@ struct Opengl_TextureDescriptor
 	int32_t width_px;
 	int32_t height_px;
 	Vector2f tex_coords[4];
+
+	// Indexed textures are stored with 8 bits per pixel in the index atlas,
+	// and their colors come from a row of the palette texture.
+	bool indexed;
+	uint32_t palette; // palette loaded with the texture
+
+	// Trimmed textures only store their non-transparent part in the atlas,
+	// and width_px/height_px are the size of that part.
+	// trim_ini and trim_end are its corners, relative to the whole texture.
+	bool trimmed;
+	Vector2f trim_ini; // (0, 0) if not trimmed
+	Vector2f trim_end; // (1, 1) if not trimmed
+
+	// only used by render targets (cached layers), 0 otherwise
+	GLuint texture_id; // GL_TEXTURE_2D of the size of the target
+	GLsizei mip_levels; // up to atlas_mip_levels, regenerated after each render
+	GLuint framebuffer_id;
+	GLuint depth_renderbuffer_id;
+};
+
+// ---------------------------------------------------
+
+struct Opengl_HeightfieldDescriptor
+{
+	GLuint texture_id; // GL_R32F, one texel per sample
+	uint64_t version; // version of the heightfield stored in the texture
+};
+
+struct Opengl_VoxelChunkDescriptor
+{
+	GLuint vao;
+	GLuint vbo;
+	GLuint ebo;
+	uint32_t n_indices;
+	uint64_t mesh_version; // version of the chunk mesh stored in the buffers
+	uint64_t texture_data_version; // Renderer::texture_data_version when the buffers were filled
 };
 
 // ---------------------------------------------------
@@ -71,6 +117,92 @@ void ensure_no_error ();
 
 // ---------------------------------------------------
 
+/*
+	Thin cache of the GL state, so redundant binds and enables are skipped.
+	Only works if the state is always changed through it.
+	Code that changes the state directly (e.g. some library)
+	must call invalidate afterwards.
+	There is a single GL context, so there is a single cache (state_cache).
+*/
+
+class StateCache
+{
+public:
+	static inline constexpr GLuint unknown = 0xFFFFFFFF;
+	static inline constexpr uint32_t max_texture_units = 8;
+	static inline constexpr uint32_t max_buffer_targets = 8;
+
+protected:
+	GLuint program;
+	GLuint vertex_array;
+
+	// pairs of target and buffer
+	std::array<std::pair<GLenum, GLuint>, max_buffer_targets> buffers;
+	uint32_t n_buffer_targets;
+
+	GLenum active_texture_unit;
+	std::array<GLuint, max_texture_units> textures_2d;
+	std::array<GLuint, max_texture_units> textures_2d_array;
+
+	// 0: disabled, 1: enabled, unknown: not known
+	GLuint blend;
+	GLuint depth_test;
+	GLuint cull_face;
+	GLuint scissor_test;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, n_calls, 0)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, n_skipped_calls, 0)
+
+public:
+	StateCache ();
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(StateCache)
+
+	void use_program (const GLuint program);
+	void bind_vertex_array (const GLuint vertex_array);
+	void bind_buffer (const GLenum target, const GLuint buffer);
+	void bind_buffer_base (const GLenum target, const GLuint index, const GLuint buffer);
+	void active_texture (const GLenum unit); // GL_TEXTURE0 + i
+	void bind_texture (const GLenum target, const GLuint texture);
+	void set_capability (const GLenum capability, const bool enabled); // GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE or GL_SCISSOR_TEST
+
+	// deleted objects are unbound by GL, and their names may be reused
+	void delete_buffers (const GLsizei n, const GLuint *buffers);
+	void delete_vertex_arrays (const GLsizei n, const GLuint *vertex_arrays);
+	void delete_textures (const GLsizei n, const GLuint *textures);
+
+	void invalidate ();
+
+	inline void reset_stats () noexcept
+	{
+		this->n_calls = 0;
+		this->n_skipped_calls = 0;
+	}
+
+private:
+	GLuint& find_buffer_binding (const GLenum target);
+	GLuint& find_texture_binding (const GLenum target);
+
+	// returns true if the call must be made
+	inline bool update (GLuint& cached, const GLuint value) noexcept
+	{
+		this->n_calls++;
+
+		if (cached == value) {
+			this->n_skipped_calls++;
+			return false;
+		}
+
+		cached = value;
+
+		return true;
+	}
+};
+
+extern StateCache state_cache;
+
+// ---------------------------------------------------
+
 class Program;
 
 class Shader
@@ -79,9 +211,10 @@ protected:
 	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, shader_id)
 	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLenum, shader_type)
 	MYLIB_OO_ENCAPSULATE_OBJ_READONLY(std::string, fname)
+	MYLIB_OO_ENCAPSULATE_OBJ_READONLY(std::string, defines) // inserted after the #version line
 
 public:
-	Shader (const GLenum shader_type_, const std::string_view fname_);
+	Shader (const GLenum shader_type_, const std::string_view fname_, const std::string_view defines_ = {});
 	~Shader ();
 	void compile ();
 };
@@ -94,6 +227,51 @@ protected:
 	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, program_id)
 	MYLIB_OO_ENCAPSULATE_PTR_INIT(Shader*, vs, nullptr)
 	MYLIB_OO_ENCAPSULATE_PTR_INIT(Shader*, fs, nullptr)
+	MYLIB_OO_ENCAPSULATE_PTR_INIT(Shader*, cs, nullptr) // compute shader, only for GL 4.3+ programs
+
+	// Only enable for closed meshes with counter-clockwise winding.
+	// 2D shapes and lines may be mirrored by negative scales, so they must keep it disabled.
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(bool, cull_back_faces, false)
+
+public:
+	/*
+		Shader permutations.
+		Programs that use variants compile one GL program for each set
+		of features, lazily, the first time a draw needs it.
+		The features reach the shaders as #defines, so each variant
+		only pays for what it uses (e.g. 2D uses the unlit variant).
+		All variants share the vertex arrays, since the attrib locations are the same.
+	*/
+	enum ShaderFeature : uint32_t {
+		Lit             = 1 << 0, // ambient light plus N_POINT_LIGHTS point lights
+		AlphaTest       = 1 << 1, // discards almost transparent texels
+		TextureRotation = 1 << 2, // vertices are rotated by a quaternion
+		RenderTarget    = 1 << 3  // samples the GL_TEXTURE_2D of a render target instead of the atlas
+	};
+
+	// features in the low byte, number of point lights in the next one
+	using VariantKey = uint32_t;
+
+	static constexpr VariantKey make_variant_key (const uint32_t features, const uint32_t n_point_lights) noexcept
+	{
+		return features | (n_point_lights << 8);
+	}
+
+protected:
+	struct Variant {
+		VariantKey key;
+		GLuint program_id;
+		std::vector<GLint> uniform_locations; // -1 for uniforms the variant doesn't use
+	};
+
+	// must be set before the first select_variant
+	std::string variant_vs_fname;
+	std::string variant_fs_fname;
+	std::vector<std::string> variant_uniforms;
+
+	std::vector< std::pair<GLuint, std::string> > attrib_locations;
+	std::vector<Variant> variants;
+	uint32_t current_variant = 0;
 
 protected:
 	Program ();
@@ -103,11 +281,20 @@ protected:
 	void use_program ();
 	GLint get_uniform_location (const std::string_view name) const;
 	void bind_attrib_location (const GLuint index, const std::string_view name);
+
+	// compiles the variant if needed, and then uses it
+	void select_variant (const VariantKey key);
+
+	inline GLint get_variant_uniform_location (const uint32_t i) const
+	{
+		return this->variants[this->current_variant].uniform_locations[i];
+	}
 	void gen_vertex_arrays (const GLsizei n, GLuint *arrays);
 	void gen_buffers (const GLsizei n, GLuint *buffers);
 	void bind_vertex_array (const GLuint array);
 	void bind_buffer (const GLenum target, const GLuint buffer);
 	void enable_vertex_attrib_array (const GLuint index);
+	void vertex_attrib_divisor (const GLuint index, const GLuint divisor);
 };
 
 // ---------------------------------------------------
@@ -190,17 +377,23 @@ protected:
 		iColor
 	};
 
-	GLint u_projection_matrix;
-	GLint u_ambient_light_color;
-	GLint u_point_light_pos;
-	GLint u_point_light_color;
+	enum UniformIndex {
+		uProjectionMatrix,
+		uAmbientLightColor,
+		uPointLightPos,
+		uPointLightColor
+	};
 
 public:
+	static inline constexpr uint32_t max_point_lights = Manager::max_points_light_source;
+
 	struct Uniforms {
 		Matrix4 projection_matrix;
 		Color ambient_light_color;
-		Point point_light_pos;
-		Color point_light_color;
+		std::array<Point, max_point_lights> point_light_pos;
+		std::array<Color, max_point_lights> point_light_color; // unused lights have alpha 0
+		uint32_t n_point_lights = 0;
+		bool lit = true; // when false, lights don't change the colors
 	};
 
 	struct Vertex {
@@ -211,9 +404,11 @@ public:
 
 	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // vertex array descriptor id
 	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vbo) // vertex buffer id
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, ebo) // index buffer id
 
 protected:
 	VertexBuffer<Vertex> triangle_buffer;
+	VertexBuffer<GLuint> index_buffer; // when not empty, triangles are drawn with indices
 
 public:
 	ProgramTriangleColor ();
@@ -222,6 +417,7 @@ public:
 	inline void clear ()
 	{
 		this->triangle_buffer.clear();
+		this->index_buffer.clear();
 	}
 
 	inline std::span<Vertex> alloc_vertices (const uint32_t n)
@@ -229,6 +425,18 @@ public:
 		return this->triangle_buffer.alloc_vertices(n);
 	}
 
+	// An instance must receive only indexed or only non-indexed triangles.
+	// Returns the index of the first vertex, which must be added to the indices.
+	inline uint32_t alloc_indexed_vertices (const uint32_t n_vertices, const uint32_t n_indices, std::span<Vertex>& vertices, std::span<GLuint>& indices)
+	{
+		const uint32_t first_vertex = this->triangle_buffer.get_vertex_buffer_used();
+
+		vertices = this->triangle_buffer.alloc_vertices(n_vertices);
+		indices = this->index_buffer.alloc_vertices(n_indices);
+
+		return first_vertex;
+	}
+
 	inline bool has_vertices () const noexcept
 	{
 		return (this->triangle_buffer.get_vertex_buffer_used() > 0);
@@ -319,18 +527,25 @@ protected:
 		iTexCoords
 	};
 
-	GLint u_projection_matrix;
-	GLint u_ambient_light_color;
-	GLint u_point_light_pos;
-	GLint u_point_light_color;
-	GLint u_tx_unit;
+	enum UniformIndex {
+		uProjectionMatrix,
+		uAmbientLightColor,
+		uPointLightPos,
+		uPointLightColor,
+		uTxUnit
+	};
 
 public:
+	static inline constexpr uint32_t max_point_lights = ProgramTriangleColor::max_point_lights;
+
 	struct Uniforms {
 		Matrix4 projection_matrix;
 		Color ambient_light_color;
-		Point point_light_pos;
-		Color point_light_color;
+		std::array<Point, max_point_lights> point_light_pos;
+		std::array<Color, max_point_lights> point_light_color; // unused lights have alpha 0
+		uint32_t n_point_lights = 0;
+		bool lit = true; // when false, lights don't change the colors
+		bool alpha_test = true; // discard almost transparent texels
 	};
 
 	struct Vertex {
@@ -341,17 +556,24 @@ public:
 
 	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // vertex array descriptor id
 	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vbo) // vertex buffer id
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, ebo) // index buffer id
 
 protected:
 	VertexBuffer<Vertex> triangle_buffer;
+	VertexBuffer<GLuint> index_buffer; // when not empty, triangles are drawn with indices
+
+	// added to the features of every variant, and the unit sampled by the shader
+	uint32_t base_features;
+	GLint tx_unit;
 
 public:
-	ProgramTriangleTexture ();
+	ProgramTriangleTexture (const uint32_t base_features_ = 0, const GLint tx_unit_ = 0);
 	~ProgramTriangleTexture ();
 
 	inline void clear ()
 	{
 		this->triangle_buffer.clear();
+		this->index_buffer.clear();
 	}
 
 	inline std::span<Vertex> alloc_vertices (const uint32_t n)
@@ -359,6 +581,18 @@ public:
 		return this->triangle_buffer.alloc_vertices(n);
 	}
 
+	// An instance must receive only indexed or only non-indexed triangles.
+	// Returns the index of the first vertex, which must be added to the indices.
+	inline uint32_t alloc_indexed_vertices (const uint32_t n_vertices, const uint32_t n_indices, std::span<Vertex>& vertices, std::span<GLuint>& indices)
+	{
+		const uint32_t first_vertex = this->triangle_buffer.get_vertex_buffer_used();
+
+		vertices = this->triangle_buffer.alloc_vertices(n_vertices);
+		indices = this->index_buffer.alloc_vertices(n_indices);
+
+		return first_vertex;
+	}
+
 	inline bool has_vertices () const noexcept
 	{
 		return (this->triangle_buffer.get_vertex_buffer_used() > 0);
@@ -377,6 +611,45 @@ public:
 
 // ---------------------------------------------------
 
+/*
+	Quads textured by render targets (cached layers).
+	Each render target has its own GL_TEXTURE_2D instead of a layer of
+	the atlas, so a target is never sampled while it is being rendered.
+	The quads of each target are drawn with their own draw call,
+	with its texture bound to texture_unit.
+	tex_coords.z of the vertices is ignored.
+*/
+
+class ProgramRenderTarget : public ProgramTriangleTexture
+{
+public:
+	static inline constexpr GLint texture_unit = 5; // 0 to 4 are used by the atlas, upscale, index atlas, palettes and heights
+
+protected:
+	struct Batch {
+		GLuint texture_id;
+		uint32_t first_vertex;
+		uint32_t n_vertices;
+	};
+
+	std::vector<Batch> batches;
+
+public:
+	ProgramRenderTarget ();
+	~ProgramRenderTarget ();
+
+	inline void clear ()
+	{
+		this->ProgramTriangleTexture::clear();
+		this->batches.clear();
+	}
+
+	std::span<Vertex> alloc_vertices (const GLuint texture_id, const uint32_t n);
+	void draw ();
+};
+
+// ---------------------------------------------------
+
 class ProgramTriangleTextureRotation : public Program
 {
 protected:
@@ -388,20 +661,287 @@ protected:
 		iRotQuat
 	};
 
+	enum UniformIndex {
+		uProjectionMatrix,
+		uAmbientLightColor,
+		uPointLightPos,
+		uPointLightColor,
+		uTxUnit
+	};
+
+public:
+	using Uniforms = ProgramTriangleTexture::Uniforms;
+
+	struct Vertex {
+		Graphics::Vertex gvertex;
+		Vector offset; // global x,y,z coords, which are added to the local coords
+		Point3f tex_coords;
+		Quaternion rot_quat;
+	};
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // vertex array descriptor id
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vbo) // vertex buffer id
+
+protected:
+	VertexBuffer<Vertex> triangle_buffer;
+
+public:
+	ProgramTriangleTextureRotation ();
+	~ProgramTriangleTextureRotation ();
+
+	inline void clear ()
+	{
+		this->triangle_buffer.clear();
+	}
+
+	inline std::span<Vertex> alloc_vertices (const uint32_t n)
+	{
+		return this->triangle_buffer.alloc_vertices(n);
+	}
+
+	inline bool has_vertices () const noexcept
+	{
+		return (this->triangle_buffer.get_vertex_buffer_used() > 0);
+	}
+
+	void bind_vertex_arrays ();
+	void bind_vertex_buffers ();
+	void setup_vertex_arrays ();
+	void setup_uniforms ();
+	void upload_vertex_buffers ();
+	void upload_uniforms (const Uniforms& uniforms);
+	void draw ();
+	void load ();
+	void debug ();
+};
+
+// ---------------------------------------------------
+
+/*
+	Quads of VoxelChunk.
+	A merged quad covers many voxels, and a sub-texture of the atlas
+	can't use GL_REPEAT, so the fragment shader repeats the texture
+	with fract(tile_coords) inside tex_rect.
+	Each chunk keeps its mesh in its own buffers, which are only
+	uploaded again when the mesh changes, so drawing a chunk
+	is a single draw call with the origin of the chunk as uniform.
+*/
+
+class ProgramVoxel : public Program
+{
+protected:
+	enum AttribIndex {
+		iPosition,
+		iNormal,
+		iTileCoords,
+		iTexRect,
+		iTexDepth
+	};
+
 	GLint u_projection_matrix;
 	GLint u_ambient_light_color;
 	GLint u_point_light_pos;
 	GLint u_point_light_color;
 	GLint u_tx_unit;
+	GLint u_offset;
 
 public:
 	using Uniforms = ProgramTriangleTexture::Uniforms;
 
 	struct Vertex {
 		Graphics::Vertex gvertex;
+		Vector2f tile_coords; // (0, 0) is the left top of the quad, one unit per voxel
+		Vector4f tex_rect; // x, y: left top of the texture in the atlas, z, w: size
+		float tex_depth; // layer of the atlas
+	};
+
+	struct Batch {
+		GLuint vao; // of the chunk
+		uint32_t n_indices;
 		Vector offset; // global x,y,z coords, which are added to the local coords
-		Point3f tex_coords;
-		Quaternion rot_quat;
+	};
+
+protected:
+	std::vector<Batch> batches;
+
+public:
+	ProgramVoxel ();
+	~ProgramVoxel ();
+
+	inline void clear ()
+	{
+		this->batches.clear();
+	}
+
+	inline void add_batch (const Batch& batch)
+	{
+		this->batches.push_back(batch);
+	}
+
+	inline bool has_vertices () const noexcept
+	{
+		return !this->batches.empty();
+	}
+
+	void create_chunk_buffers (Opengl_VoxelChunkDescriptor& desc);
+	void upload_chunk_buffers (Opengl_VoxelChunkDescriptor& desc, const std::span<const Vertex> vertices, const std::span<const GLuint> indices);
+	void setup_vertex_arrays ();
+	void setup_uniforms ();
+	void upload_vertex_buffers ();
+	void upload_uniforms (const Uniforms& uniforms);
+	void draw ();
+	void load ();
+};
+
+// ---------------------------------------------------
+
+/*
+	Nodes of Heightfield3D.
+	Every node is an instance of the same grid of patch_size x patch_size
+	quads, so the grid and its indices are uploaded only once.
+	The vertex shader places the grid over the node, reads the heights
+	from the height texture of the heightfield, and morphs the odd vertices
+	into the grid of the parent node as the distance to the camera grows.
+	Each heightfield has its own height texture, so it is drawn
+	by its own instanced draw call.
+	Like ProgramVoxel, the fragment shader repeats a sub-texture of the atlas.
+*/
+
+class ProgramHeightfield : public Program
+{
+protected:
+	enum AttribIndex {
+		iGridPos,
+		iNode,
+		iMorph
+	};
+
+	GLint u_projection_matrix;
+	GLint u_ambient_light_color;
+	GLint u_point_light_pos;
+	GLint u_point_light_color;
+	GLint u_tx_unit;
+	GLint u_height_unit;
+	GLint u_camera_pos;
+	GLint u_offset;
+	GLint u_size;
+	GLint u_cell_size;
+	GLint u_tile_size;
+	GLint u_tex_rect;
+	GLint u_tex_depth;
+
+public:
+	static inline constexpr GLint height_texture_unit = 4; // 0 to 3 are used by the atlas, upscale, index atlas and palettes
+
+	using Uniforms = ProgramTriangleTexture::Uniforms;
+
+	struct Instance {
+		Vector4f node; // x, y: local x and z of the node, z: size of the node, w: unused
+		Vector2f morph; // distances to the camera where the morph starts and ends
+	};
+
+	struct Batch {
+		GLuint height_texture_id;
+		Vector offset;
+		Point camera_pos;
+		uint32_t size_x; // in samples
+		uint32_t size_z;
+		float cell_size;
+		float tile_size;
+		Vector4f tex_rect; // x, y: left top of the texture in the atlas, z, w: size
+		float tex_depth; // layer of the atlas
+		uint32_t first_instance;
+		uint32_t n_instances;
+	};
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // vertex array descriptor id
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vbo) // instance buffer id
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, grid_vbo) // static
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, grid_ebo) // static
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, n_grid_indices)
+
+protected:
+	VertexBuffer<Instance> instance_buffer;
+	std::vector<Batch> batches;
+
+public:
+	ProgramHeightfield ();
+	~ProgramHeightfield ();
+
+	inline void clear ()
+	{
+		this->instance_buffer.clear();
+		this->batches.clear();
+	}
+
+	// the instances allocated after add_batch belong to the batch
+	inline void add_batch (const Batch& batch)
+	{
+		this->batches.push_back(batch);
+		this->batches.back().first_instance = this->instance_buffer.get_vertex_buffer_used();
+		this->batches.back().n_instances = 0;
+	}
+
+	inline std::span<Instance> alloc_instances (const uint32_t n)
+	{
+		this->batches.back().n_instances += n;
+		return this->instance_buffer.alloc_vertices(n);
+	}
+
+	inline bool has_vertices () const noexcept
+	{
+		return (this->instance_buffer.get_vertex_buffer_used() > 0);
+	}
+
+	void bind_vertex_arrays ();
+	void bind_vertex_buffers ();
+	void setup_vertex_arrays ();
+	void setup_instance_arrays (const uint32_t first_instance);
+	void setup_uniforms ();
+	void upload_vertex_buffers ();
+	void upload_uniforms (const Uniforms& uniforms);
+	void draw ();
+	void load ();
+	void debug ();
+};
+
+// ---------------------------------------------------
+
+/*
+	Triangles with indexed textures (usually pixel art).
+	The index atlas uses GL_NEAREST, since indices can't be interpolated,
+	and the fragment shader looks the index up in the palette of the vertex.
+	No lighting is applied.
+*/
+
+class ProgramTriangleIndexed : public Program
+{
+public:
+	static inline constexpr GLint index_texture_unit = 2; // unit 0 is used by the atlas, 1 by the upscale
+	static inline constexpr GLint palette_texture_unit = 3;
+
+protected:
+	enum AttribIndex {
+		iPosition,
+		iOffset,
+		iTexCoords,
+		iPalette
+	};
+
+	GLint u_projection_matrix;
+	GLint u_index_unit;
+	GLint u_palette_unit;
+
+public:
+	struct Uniforms {
+		Matrix4 projection_matrix;
+	};
+
+	struct Vertex {
+		Graphics::Vertex gvertex; // the normal is not used
+		Vector offset; // global x,y,z coords, which are added to the local coords
+		Point3f tex_coords; // z is the layer of the index atlas
+		float palette; // row of the palette texture
 	};
 
 	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // vertex array descriptor id
@@ -411,8 +951,8 @@ protected:
 	VertexBuffer<Vertex> triangle_buffer;
 
 public:
-	ProgramTriangleTextureRotation ();
-	~ProgramTriangleTextureRotation ();
+	ProgramTriangleIndexed ();
+	~ProgramTriangleIndexed ();
 
 	inline void clear ()
 	{
@@ -442,6 +982,468 @@ public:
 
 // ---------------------------------------------------
 
+/*
+	Each instance is a colored and optionally textured rectangle.
+	The 6 vertices of the quad are generated in the vertex shader,
+	so the CPU only writes one Instance per quad and we issue a
+	single instanced draw call for all of them.
+	Used by 2D sprites, particle systems and text. No lighting is applied.
+*/
+
+class ProgramQuadInstanced : public Program
+{
+protected:
+	enum AttribIndex {
+		iTransformX,
+		iTransformY,
+		iZ,
+		iColor,
+		iTexRect,
+		iTexDepth
+	};
+
+	GLint u_projection_matrix;
+	GLint u_tx_unit;
+
+public:
+	struct Uniforms {
+		Matrix4 projection_matrix;
+	};
+
+	/*
+		A unit quad centered at the origin is transformed by the 2x3 affine
+		transform, which already includes the size and rotation of the quad.
+	*/
+	struct Instance {
+		Vector3f transform_x; // first row of the affine transform
+		Vector3f transform_y; // second row of the affine transform
+		float z;
+		Color color; // rgba, multiplied by the texel color
+		Vector4f tex_rect; // atlas coords of the (-x,-y) corner (xy) and of the (+x,+y) corner (zw)
+		float tex_depth; // atlas layer, negative if the quad is not textured
+
+		// rotation in radians, around the z axis
+		inline void set_transform (const Point3f& pos, const Vector2f& size, const float rotation) noexcept
+		{
+			if (rotation == 0.0f) {
+				this->transform_x.set(size.x, 0.0f, pos.x);
+				this->transform_y.set(0.0f, size.y, pos.y);
+			}
+			else {
+				const float c = std::cos(rotation);
+				const float s = std::sin(rotation);
+
+				this->transform_x.set(c * size.x, -s * size.y, pos.x);
+				this->transform_y.set(s * size.x, c * size.y, pos.y);
+			}
+
+			this->z = pos.z;
+		}
+	};
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // vertex array descriptor id
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vbo) // instance buffer id
+
+protected:
+	VertexBuffer<Instance> instance_buffer;
+
+public:
+	ProgramQuadInstanced ();
+	~ProgramQuadInstanced ();
+
+	inline void clear ()
+	{
+		this->instance_buffer.clear();
+	}
+
+	inline std::span<Instance> alloc_instances (const uint32_t n)
+	{
+		return this->instance_buffer.alloc_vertices(n);
+	}
+
+	inline bool has_vertices () const noexcept
+	{
+		return (this->instance_buffer.get_vertex_buffer_used() > 0);
+	}
+
+	void bind_vertex_arrays ();
+	void bind_vertex_buffers ();
+	void setup_vertex_arrays ();
+	void setup_uniforms ();
+	void upload_vertex_buffers ();
+	void upload_uniforms (const Uniforms& uniforms);
+	void draw ();
+	void load ();
+	void debug ();
+};
+
+// ---------------------------------------------------
+
+/*
+	Copies the scene texture to the default framebuffer when
+	rendering with dynamic resolution, filling the whole window.
+*/
+
+class ProgramUpscale : public Program
+{
+protected:
+	GLint u_tx_unit;
+	GLint u_uv_scale;
+	GLint u_texel_size;
+	GLint u_sharpness;
+
+public:
+	static inline constexpr GLint texture_unit = 1; // unit 0 is used by the atlas
+
+	struct Uniforms {
+		Vector2f uv_scale; // fraction of the scene texture that was rendered
+		Vector2f texel_size;
+		float sharpness; // 0 means plain bilinear filtering
+	};
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // empty, but required to draw
+
+public:
+	ProgramUpscale ();
+	~ProgramUpscale ();
+
+	void bind_vertex_arrays ();
+	void setup_uniforms ();
+	void upload_uniforms (const Uniforms& uniforms);
+	void draw ();
+	void load ();
+};
+
+// ---------------------------------------------------
+
+// Bounding boxes of the occlusion queries.
+
+class ProgramOcclusionBox : public Program
+{
+protected:
+	GLint u_projection_matrix;
+	GLint u_center;
+	GLint u_half_size;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // empty, but required to draw
+
+public:
+	ProgramOcclusionBox ();
+	~ProgramOcclusionBox ();
+
+	void bind_vertex_arrays ();
+	void setup_uniforms ();
+	void upload_projection_matrix (const Matrix4& projection_matrix);
+	void draw (const Vector& center, const Vector& half_size);
+	void load ();
+};
+
+// ---------------------------------------------------
+
+#ifndef __ANDROID__
+
+/*
+	The following programs are only used by IndirectMeshScene
+	when the driver supports OpenGL 4.3 (compute shaders, SSBOs and
+	multi-draw-indirect).
+*/
+
+class ProgramCullObjects : public Program
+{
+protected:
+	GLint u_frustum_planes;
+	GLint u_n_objects;
+
+public:
+	static inline constexpr uint32_t work_group_size = 64; // must match cull-objects.comp
+
+	ProgramCullObjects ();
+	~ProgramCullObjects ();
+
+	// objects, commands and visible instances must already be bound to the SSBO binding points 0, 1 and 2
+	void dispatch (const std::array<Vector4f, 6>& frustum_planes, const uint32_t n_objects);
+};
+
+class ProgramMeshIndirect : public Program
+{
+protected:
+	enum AttribIndex {
+		iPosition,
+		iNormal,
+		iObjectIndex
+	};
+
+	GLint u_projection_matrix;
+	GLint u_ambient_light_color;
+	GLint u_point_light_pos;
+	GLint u_point_light_color;
+
+public:
+	using Uniforms = ProgramTriangleColor::Uniforms;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(GLuint, vao) // vertex array descriptor id
+
+public:
+	ProgramMeshIndirect ();
+	~ProgramMeshIndirect ();
+
+	// the buffers are owned by IndirectMeshScene
+	void setup_vertex_arrays (const GLuint mesh_vbo, const GLuint visible_buffer);
+	void setup_uniforms ();
+	void upload_uniforms (const Uniforms& uniforms);
+	void draw (const GLuint commands_buffer, const uint32_t n_commands);
+	void load ();
+};
+
+#endif
+
+// ---------------------------------------------------
+
+/*
+	Retained set of colored 3D objects.
+	Meshes are registered once and objects reference them.
+	Only objects that changed since the last frame are uploaded.
+
+	With OpenGL 4.3, objects live in a SSBO, a compute shader
+	frustum-culls them and fills one DrawArraysIndirectCommand
+	per mesh, and everything is drawn with a single
+	glMultiDrawArraysIndirect.
+	Otherwise, culling is done in the CPU and the visible objects
+	are appended to ProgramTriangleColor.
+*/
+
+class IndirectMeshScene
+{
+public:
+	using Uniforms = ProgramTriangleColor::Uniforms;
+
+	struct MeshVertex {
+		Vector3f pos;
+		Vector3f normal;
+	};
+
+	// std430 layout
+	struct Object {
+		Vector4f pos_radius; // xyz: world position, w: radius of the bounding sphere
+		Color color;
+		uint32_t mesh_id;
+		uint32_t padding__[3];
+	};
+
+	// layout defined by the OpenGL spec
+	struct DrawArraysIndirectCommand {
+		GLuint count;
+		GLuint instance_count;
+		GLuint first;
+		GLuint base_instance;
+	};
+
+protected:
+	struct Mesh {
+		uint32_t first_vertex;
+		uint32_t n_vertices;
+		float radius;
+		uint32_t n_objects;
+	};
+
+	std::vector<MeshVertex> mesh_vertices;
+	std::vector<Mesh> meshes;
+	std::vector<Object> objects;
+	std::vector<DrawArraysIndirectCommand> commands;
+
+	// range of objects that must be uploaded
+	uint32_t dirty_begin = 0;
+	uint32_t dirty_end = 0;
+
+	bool meshes_dirty = false;
+	bool commands_dirty = false;
+	uint32_t objects_gpu_capacity = 0;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(bool, gpu_driven)
+
+#ifndef __ANDROID__
+	ProgramCullObjects *program_cull = nullptr;
+	ProgramMeshIndirect *program_mesh = nullptr;
+
+	GLuint mesh_vbo;
+	GLuint objects_ssbo;
+	GLuint commands_buffer;
+	GLuint visible_buffer;
+#endif
+
+public:
+	IndirectMeshScene (const bool gpu_driven_);
+	~IndirectMeshScene ();
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(IndirectMeshScene)
+
+	uint32_t register_mesh (const std::span<const Graphics::Vertex> vertices);
+
+	inline uint32_t register_mesh (Shape& shape)
+	{
+		return this->register_mesh(shape.get_local_rotated_vertices());
+	}
+
+	uint32_t add_object (const uint32_t mesh_id, const Point& pos, const Color& color);
+	void update_object (const uint32_t object_id, const Point& pos, const Color& color);
+
+	inline uint32_t get_n_objects () const noexcept
+	{
+		return this->objects.size();
+	}
+
+	void clear_objects ();
+
+	// Fallback path.
+	// Appends the visible objects to the triangle program.
+	void cpu_cull (ProgramTriangleColor& program, const std::span<const std::array<Vector4f, 6>> frustums_planes); // objects inside any of the frustums
+
+	// GPU path.
+	void gpu_cull_and_draw (const Uniforms& uniforms, const std::array<Vector4f, 6>& frustum_planes);
+
+protected:
+	inline void mark_dirty (const uint32_t object_id) noexcept
+	{
+		if (this->dirty_begin == this->dirty_end) {
+			this->dirty_begin = object_id;
+			this->dirty_end = object_id + 1;
+		}
+		else {
+			this->dirty_begin = std::min(this->dirty_begin, object_id);
+			this->dirty_end = std::max(this->dirty_end, object_id + 1);
+		}
+	}
+
+	void upload ();
+};
+
+// ---------------------------------------------------
+
+/*
+	Occlusion culling with hardware queries.
+	When an occludee is tested, we collect the result of its last query,
+	only if it is already available, so we never wait for the GPU.
+	After the scene is drawn, a GL_ANY_SAMPLES_PASSED query is issued
+	for the bounding box of each tested occludee without a pending query.
+	An occludee stays visible for visible_frames_hysteresis frames after
+	a query last saw it, which hides the latency of the results
+	and avoids flickering.
+*/
+
+class OcclusionCuller
+{
+protected:
+	struct Occludee {
+		GLuint query;
+		Vector center;
+		Vector half_size;
+		uint64_t last_visible_frame;
+		bool query_pending;
+		bool in_use;
+	};
+
+	std::vector<Occludee> occludees;
+	std::vector<OccludeeDescriptor> free_descriptors;
+	std::vector<OccludeeDescriptor> to_query; // tested since the last queries were issued
+	ProgramOcclusionBox *program;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(uint32_t, visible_frames_hysteresis, 4)
+
+public:
+	OcclusionCuller ();
+	~OcclusionCuller ();
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(OcclusionCuller)
+
+	OccludeeDescriptor add_occludee (const uint64_t frame_number);
+	void remove_occludee (const OccludeeDescriptor desc);
+	bool is_visible (const OccludeeDescriptor desc, const Vector& center, const Vector& half_size, const uint64_t frame_number);
+
+	inline bool has_queries_to_issue () const noexcept
+	{
+		return !this->to_query.empty();
+	}
+
+	// Must be called after the occluders are in the depth buffer.
+	void issue_queries (const Matrix4& projection_matrix, const Vector4f& near_plane, const uint64_t frame_number);
+};
+
+// ---------------------------------------------------
+
+/*
+	Orders the passes of a frame by the resources they read and write.
+	Usage, every time something is rendered:
+		graph.reset();
+		declare resources and passes;
+		graph.compile();
+		graph.execute(...);
+	Passes are sorted topologically, keeping the declaration order
+	when there is no dependency between them.
+	The resources are framebuffers owned by the renderer (the scene,
+	the window and the render targets), so each pass writes to a single one.
+*/
+
+class RenderGraph
+{
+public:
+	using ResourceId = uint32_t;
+	using ExecuteFunction = std::function<void (RenderGraph& graph)>;
+
+	static inline constexpr uint32_t max_pass_resources = 4;
+
+protected:
+	struct Resource {
+		const char *name;
+		GLuint framebuffer;
+		int32_t width_px;
+		int32_t height_px;
+	};
+
+	struct Pass {
+		const char *name;
+		std::array<ResourceId, max_pass_resources> inputs;
+		uint32_t n_inputs;
+		ResourceId output;
+		ExecuteFunction execute;
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<uint32_t> sorted_passes;
+
+	// scratch buffers of compile, kept so building the graph every frame doesn't allocate memory
+	// the vectors of vectors only grow, so their elements keep their capacity
+	std::vector<uint32_t> n_dependencies; // per pass
+	std::vector<std::vector<uint32_t>> dependents; // per pass
+	std::vector<uint32_t> last_writer; // per resource
+	std::vector<std::vector<uint32_t>> readers_since_write; // per resource
+	std::vector<bool> done; // per pass
+
+public:
+	RenderGraph () = default;
+	~RenderGraph () = default;
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(RenderGraph)
+
+	void reset ();
+
+	// Names must be string literals, since we don't copy them.
+	ResourceId import_framebuffer (const char *name, const GLuint framebuffer, const int32_t width_px, const int32_t height_px);
+
+	void add_pass (const char *name, const std::initializer_list<ResourceId> inputs, const ResourceId output, ExecuteFunction execute);
+
+	void compile ();
+
+	/*
+		framebuffer and the viewport size (at 0, 0) are what the caller has
+		bound before the execution, so the graph only binds what changes,
+		without querying GL.
+	*/
+	void execute (const GLuint framebuffer, const int32_t viewport_width_px, const int32_t viewport_height_px);
+};
+
+// ---------------------------------------------------
+
 class Renderer : public Manager
 {
 protected:
@@ -452,14 +1454,206 @@ protected:
 
 	ProgramTriangleColor::Uniforms program_triangle_color_uniforms;
 	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleColor*, program_triangle_color)
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleColor*, program_triangle_color_cull) // closed meshes, back faces culled
 	MYLIB_OO_ENCAPSULATE_PTR(ProgramLineColor*, program_line_color)
 
 	ProgramTriangleTexture::Uniforms program_triangle_texture_uniforms;
 	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleTexture*, program_triangle_texture)
-	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleTextureRotation*, program_triangle_texture_rotation)
-	
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleTexture*, program_triangle_texture_cull) // closed meshes, back faces culled
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramRenderTarget*, program_render_target) // cached layers
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleTextureRotation*, program_triangle_texture_rotation) // only used by spheres, back faces culled
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramVoxel*, program_voxel) // back faces culled
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramHeightfield*, program_heightfield) // back faces culled
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleColor*, program_mesh_color) // indexed, back faces culled
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleTexture*, program_mesh_texture) // indexed, back faces culled
+
+	ProgramQuadInstanced::Uniforms program_quad_instanced_uniforms;
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramQuadInstanced*, program_quad_instanced)
+
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramUpscale*, program_upscale)
+
+	ProgramTriangleIndexed::Uniforms program_triangle_indexed_uniforms;
+	MYLIB_OO_ENCAPSULATE_PTR(ProgramTriangleIndexed*, program_triangle_indexed)
+
+	// 2D doesn't use lights, so the programs with variants use the unlit ones
+	bool lighting = true;
+
+	// Disable when no texture has transparent texels, so the texture shaders
+	// don't need to discard, which keeps the early depth test.
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(bool, texture_alpha_test, true)
+
+	/*
+		Mipmapped atlas.
+		With more than one level, each texture gets a gutter of
+		2^(levels-1) pixels filled by extruding its edges, so the smaller
+		levels don't mix neighbour textures.
+		The levels must be set before end_texture_loading.
+		Render targets get the levels set when they are created.
+		Sub-textures have no gutter of their own.
+	*/
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(uint32_t, atlas_mip_levels, 1)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(GLint, atlas_min_filter, GL_LINEAR_MIPMAP_LINEAR) // only used with more than one level
+
+	/*
+		Dynamic resolution.
+		The scene framebuffer has the size of the window and is only
+		created when first needed. A smaller render scale only
+		shrinks the viewport, so changing it every frame is cheap.
+	*/
+	bool scaled_rendering = false;
+	GLuint scene_fbo = 0;
+	GLuint scene_color_texture = 0;
+	GLuint scene_depth_renderbuffer = 0;
+	int32_t scene_width_px;
+	int32_t scene_height_px;
+
+	// We read the timer query of the previous frame,
+	// so we never wait for the gpu.
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(bool, gpu_timer_supported, false)
+	std::array<GLuint, 2> gpu_timer_queries;
+	uint32_t gpu_timer_current = 0;
+	bool gpu_timer_running = false;
+	fp_t gpu_frame_dt = -1;
+
+	// state cache calls of the last frame, and how many of them were skipped
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, n_frame_state_calls, 0)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, n_frame_state_skipped_calls, 0)
+
+	/*
+		Frame capture.
+		Each frame is copied by glReadPixels to a pixel buffer object,
+		which returns immediately, and a fence is inserted after it.
+		Some frames later, when the fence is signaled, the buffer is mapped
+		and the pixels are sent to the callback.
+		If all buffers are still busy, the frame is dropped.
+	*/
+	static inline constexpr uint32_t n_capture_buffers = 3;
+
+	struct CaptureSlot {
+		GLuint pbo;
+		GLsync fence;
+		uint64_t frame_number;
+	};
+
+	std::array<CaptureSlot, n_capture_buffers> capture_slots;
+	uint32_t capture_next_slot = 0;
+	uint32_t capture_n_pending = 0;
+	FrameCaptureCallback capture_callback;
+	bool capturing = false;
+	uint64_t frame_number = 0;
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, n_dropped_capture_frames, 0)
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(bool, gl43_supported, false)
+	MYLIB_OO_ENCAPSULATE_PTR(IndirectMeshScene*, indirect_mesh_scene)
+	std::array<Vector4f, 6> frustum_planes;
+
+	/*
+		Viewports.
+		Each view has its own projection, frustum and scissor,
+		and all of them share the vertex buffers, which are uploaded once.
+	*/
+	struct View {
+		Matrix4 projection_matrix;
+		std::array<Vector4f, 6> frustum_planes;
+		Color ambient_light_color;
+		bool lighting;
+		std::array<GLint, 4> viewport_px; // x, y, w, h
+		std::array<GLint, 4> scissor_px; // x, y, w, h
+	};
+
+	std::vector<ViewportArgs> viewports; // empty when using setup_render_3D/2D
+	std::vector<View> views; // only valid inside render
+	std::array<GLint, 2> views_target_size_px;
+
+	// rebuilt every time the vertex buffers are flushed
+	MYLIB_OO_ENCAPSULATE_PTR(RenderGraph*, render_graph)
+
+	MYLIB_OO_ENCAPSULATE_PTR(OcclusionCuller*, occlusion_culler)
+
 	std::list<Opengl_AtlasDescriptor> atlases;
 	GLuint texture_array_id;
+	bool textures_loaded = false; // end_texture_loading was called
+
+	/*
+		Streaming atlas.
+		When not zero, begin_texture_loading allocates this many layers,
+		and each texture is uploaded to its slot as soon as it is loaded,
+		so its surface is freed right away instead of at end_texture_loading.
+		Textures are packed in the loading order, instead of sorted by area,
+		so they may need more layers than the default path.
+	*/
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(uint32_t, streaming_atlas_layers, 0)
+	TextureAtlasCreator *streaming_atlas_creator = nullptr; // only between begin and end_texture_loading
+
+	/*
+		Atlas space savings, applied by load_texture__ to RGBA textures.
+		trim_textures removes the fully transparent borders before packing.
+		Only draw_rect2D, draw_text2D and the 2D sprites and particles of
+		the game shrink their quads to match, so trimmed textures can't be
+		mapped on 3D shapes.
+		deduplicate_textures makes textures with the same pixels share
+		their slot in the atlas. Hashing and comparing the pixels slows
+		down loading, and it is ignored with the streaming atlas, which
+		frees the surfaces the candidates would be compared against.
+		Must be set before loading the textures.
+	*/
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(bool, trim_textures, false)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(bool, deduplicate_textures, false)
+	std::unordered_multimap<uint64_t, Opengl_TextureDescriptor*> texture_hashes; // only until end_texture_loading
+
+	/*
+		Asynchronous texture loading.
+		end_texture_loading reserves async_atlas_layers layers for the
+		textures loaded while the game runs.
+		The decoded surfaces are uploaded in wait_next_frame through a ring
+		of pixel buffer objects, up to texture_upload_budget_bytes per frame.
+		At least one texture is uploaded per frame, so big ones still get in.
+		Their mipmaps are calculated in the CPU and uploaded with them,
+		so the rest of the atlas is not touched.
+	*/
+	static inline constexpr uint32_t n_upload_buffers = 3;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(uint32_t, async_atlas_layers, 0)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(uint32_t, texture_upload_budget_bytes, 4 * 1024 * 1024)
+	TextureDecoder *texture_decoder = nullptr; // created by the first asynchronous load
+	TextureAtlasCreator *async_atlas_creator = nullptr;
+	Opengl_AtlasDescriptor *async_atlas = nullptr; // layer being filled
+	uint32_t async_atlas_layer = 0; // next layer
+	uint32_t async_atlas_end_layer = 0; // one after the last reserved layer
+	std::deque<TextureDecoder::Job> async_uploads; // decoded, waiting for the budget
+	std::array<GLuint, n_upload_buffers> upload_buffers;
+	uint32_t upload_next_buffer = 0;
+
+	/*
+		Palette-indexed textures.
+		When enabled, 8-bit paletted surfaces are kept with one byte per pixel
+		in a separate GL_R8 texture array, and their colors come from the
+		palette texture, where each row is a palette of 256 colors.
+		Swapping a palette only uploads one row.
+		Textures whose palettes have the same colors and color key share a row.
+		Must be set before loading the textures.
+	*/
+	static inline constexpr uint32_t palette_size = 256;
+	static inline constexpr uint32_t max_palettes = 256;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(bool, indexed_textures, false)
+	std::vector<std::array<SDL_Color, palette_size>> palettes;
+	std::vector<PaletteDescriptor> texture_palettes; // rows created by load_texture__, which may be shared
+	GLuint index_texture_array_id = 0;
+	GLuint palette_texture_id = 0;
+
+	// each render target has its own texture, framebuffer and depth buffer
+	std::vector<Opengl_TextureDescriptor*> render_targets;
+	Matrix4 saved_projection_matrix; // restored after rendering to a texture
+
+	std::vector<Heightfield3D::SelectedNode> heightfield_selection; // scratch buffer of draw_heightfield3D
+
+	// scratch buffers of draw_voxel_chunk3D
+	std::vector<ProgramVoxel::Vertex> voxel_vertices;
+	std::vector<GLuint> voxel_indices;
+
+	// incremented when a texture descriptor is replaced, so the chunks rebuild their buffers
+	uint64_t texture_data_version = 0;
 
 public:
 	Renderer (const InitParams& params);
@@ -470,13 +1664,22 @@ public:
 	void draw_cube3D (Cube3D& cube, const Vector& offset, const Color& color) override final;
 	void draw_cube3D (Cube3D& cube, const Vector& offset, const std::array<TextureRenderOptions, 6>& texture_options) override final;
 	void draw_wire_cube3D (WireCube3D& cube, const Vector& offset, const Color& color) override final;
+	void draw_voxel_chunk3D (VoxelChunk& chunk, const Vector& offset) override final;
+	void draw_heightfield3D (Heightfield3D& heightfield, const Vector& offset) override final;
+	void draw_mesh3D (Mesh3D& mesh, const Vector& offset, const Color& color) override final;
+	void draw_mesh3D (Mesh3D& mesh, const Vector& offset, const TextureRenderOptions& texture_options) override final;
 	void draw_sphere3D (Sphere3D& sphere, const Vector& offset, const Color& color) override final;
 	void draw_sphere3D (Sphere3D& sphere, const Vector& offset, const TextureRenderOptions& texture_options) override final;
 	void draw_circle2D (Circle2D& circle, const Vector& offset, const Color& color) override final;
 	void draw_rect2D (Rect2D& rect, const Vector& offset, const Color& color) override final;
 	void draw_rect2D (Rect2D& rect, const Vector& offset, const TextureRenderOptions& texture_optionss) override final;
+	void draw_text2D (const std::string_view text, const Vector& offset, const TextRenderOptions& text_options) override final;
+	void draw_lines3D (const std::span<const Line3DInstance> lines) override final;
+	void draw_cubes3D (const std::span<const Cube3DInstance> cubes) override final;
+	void draw_rects2D (const std::span<const Rect2DInstance> rects) override final;
 	void setup_render_3D (const RenderArgs3D& args) override final;
 	void setup_render_2D (const RenderArgs2D& args) override final;
+	void setup_viewports (const std::span<const ViewportArgs> viewports) override final;
 	void render () override final;
 	void update_screen () override final;
 	void clear_buffers (const uint32_t flags) override final;
@@ -484,12 +1687,90 @@ public:
 	void begin_texture_loading () override final;
 	void end_texture_loading () override final;
 
+	void begin_frame_capture (FrameCaptureCallback callback) override final;
+	void end_frame_capture () override final;
+
+	fp_t get_gpu_frame_dt () const override final
+	{
+		return this->gpu_frame_dt;
+	}
+
+	OccludeeDescriptor add_occludee () override final
+	{
+		return this->occlusion_culler->add_occludee(this->frame_number);
+	}
+
+	void remove_occludee (const OccludeeDescriptor desc) override final
+	{
+		this->occlusion_culler->remove_occludee(desc);
+	}
+
+	bool is_occludee_visible (const OccludeeDescriptor desc, const Vector& center, const Vector& half_size) override final
+	{
+		if (!this->occlusion_culling)
+			return true;
+		return this->occlusion_culler->is_visible(desc, center, half_size, this->frame_number);
+	}
+
+	PaletteDescriptor create_palette (const std::span<const Color> colors) override final;
+	void update_palette (const PaletteDescriptor palette, const std::span<const Color> colors) override final;
+
+	PaletteDescriptor get_texture_palette (const TextureDescriptor& texture) override final
+	{
+		const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture.info->data);
+		mylib_assert(desc->indexed)
+		return desc->palette;
+	}
+
+	void create_heightfield (Heightfield3D& heightfield) override final;
+	void destroy_heightfield (Heightfield3D& heightfield) override final;
+	void create_voxel_chunk (VoxelChunk& chunk) override final;
+	void destroy_voxel_chunk (VoxelChunk& chunk) override final;
+
+	void set_atlas_min_filter (const GLint filter);
+
 	void load_opengl_programs ();
 
 protected:
+	std::array<Vector4f, 6> calculate_frustum_planes (const Matrix4& projection_matrix) const;
+	Matrix4 calculate_projection_matrix_3D (const RenderArgs3D& args, const fp_t width_px, const fp_t height_px) const;
+	Matrix4 calculate_projection_matrix_2D (const RenderArgs2D& args) const;
+	void build_views ();
+	void apply_view (const View& view);
+	void restore_view ();
+
+	template <typename Tuniforms, typename Tdraw>
+	void draw_views (const Tuniforms& uniforms, Tdraw&& draw);
+
+	void update_light_uniforms ();
+	RenderGraph::ResourceId import_scene_target ();
+	void execute_render_graph ();
+	void add_vertex_buffer_passes (const RenderGraph::ResourceId target);
+	void set_projection_matrix (const Matrix4& projection_matrix);
+	void create_scene_framebuffer ();
+	void bind_scene_framebuffer ();
+	void upscale_scene ();
+	void capture_frame ();
+	void read_captured_frames (const bool wait);
+	void draw_indexed_rect2D (Rect2D& rect, const Vector& offset, const Opengl_TextureDescriptor *desc, const PaletteDescriptor palette);
+	void load_indexed_textures (TextureAtlasCreator& atlas_creator);
+	void upload_palette (const PaletteDescriptor palette);
+	int32_t get_atlas_gutter_px () const;
+	void upload_texture_to_atlas (Opengl_TextureDescriptor *desc, Opengl_AtlasDescriptor& atlas, const int32_t x_ini, const int32_t y_ini, const GLuint pbo = 0, const bool upload_mip_levels = false);
+	void upload_atlas_mip_levels (const SDL_Surface *surface, const GLint tex_depth, const int32_t x_ini, const int32_t y_ini, const GLuint pbo);
+	void begin_streaming_atlas ();
+	void stream_texture_to_atlas (Opengl_TextureDescriptor *desc, TextureInfo& texture);
+	Opengl_TextureDescriptor* find_duplicate_texture (Opengl_TextureDescriptor *desc);
+	void begin_async_atlas ();
+	void upload_async_texture (TextureDecoder::Job& job);
+	void upload_async_textures ();
+	void load_texture_async__ (TextureInfo& texture, const std::string_view fname, TextureLoadedCallback callback) override final;
 	TextureInfo load_texture__ (SDL_Surface *surface) override final;
 	void destroy_texture__ (TextureInfo& texture) override final;
 	TextureInfo create_sub_texture__ (const TextureInfo& parent, const uint32_t x_ini, const uint32_t y_ini, const uint32_t w, const uint32_t h) override final;
+	TextureInfo create_render_target__ (const uint32_t width_px, const uint32_t height_px) override final;
+	void begin_render_to_texture__ (TextureInfo& texture, const Vector2& world_init, const Vector2& world_size) override final;
+	void end_render_to_texture__ (TextureInfo& texture) override final;
 };
 
 // ---------------------------------------------------
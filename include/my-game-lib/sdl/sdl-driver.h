@@ -1,6 +1,9 @@
 #ifndef __MY_GAME_LIB_SDL_HEADER_H__
 #define __MY_GAME_LIB_SDL_HEADER_H__
 
+#include <vector>
+#include <span>
+
 #include <my-game-lib/my-game-lib.h>
 #include <my-game-lib/audio.h>
 
@@ -60,6 +63,28 @@ namespace Graphics
 		Matrix4 projection_matrix;
 		fp_t scale_factor;
 
+		// restored after rendering to a texture
+		Matrix4 saved_projection_matrix;
+		fp_t saved_scale_factor;
+
+		FrameCaptureCallback capture_callback;
+		uint64_t frame_number = 0;
+
+		/*
+			Draws are accumulated as triangles, and flushed with a single
+			SDL_RenderGeometry when the texture changes, or when the frame
+			(or the render to texture) ends.
+			Textures loaded between begin_texture_loading and
+			end_texture_loading are packed in atlas pages, so sprites of
+			the same page are drawn in the same batch.
+		*/
+		static inline constexpr int32_t max_atlas_size = 4096;
+
+		std::vector<SDL_Vertex> vertices;
+		SDL_Texture *vertices_texture = nullptr; // nullptr for colored triangles
+		std::vector<SDL_Texture*> atlases;
+		bool loading_textures = false;
+
 	public:
 		SDL_GraphicsDriver (const InitParams& params);
 		~SDL_GraphicsDriver ();
@@ -68,28 +93,47 @@ namespace Graphics
 		void draw_line3D (Line3D& line, const Vector& offset, const Color& color) override final;
 		void draw_cube3D (Cube3D& cube, const Vector& offset, const Color& color) override final;
 		void draw_cube3D (Cube3D& cube, const Vector& offset, const std::array<TextureRenderOptions, 6>& texture_options) override final;
+		void draw_voxel_chunk3D (VoxelChunk& chunk, const Vector& offset) override final;
+		void draw_heightfield3D (Heightfield3D& heightfield, const Vector& offset) override final;
+		void draw_mesh3D (Mesh3D& mesh, const Vector& offset, const Color& color) override final;
+		void draw_mesh3D (Mesh3D& mesh, const Vector& offset, const TextureRenderOptions& texture_options) override final;
 		void draw_wire_cube3D (WireCube3D& cube, const Vector& offset, const Color& color) override final;
 		void draw_sphere3D (Sphere3D& sphere, const Vector& offset, const Color& color) override final;
 		void draw_sphere3D (Sphere3D& sphere, const Vector& offset, const TextureRenderOptions& texture_options) override final;
 		void draw_circle2D (Circle2D& circle, const Vector& offset, const Color& color) override final;
 		void draw_rect2D (Rect2D& rect, const Vector& offset, const Color& color) override final;
 		void draw_rect2D (Rect2D& rect, const Vector& offset, const TextureRenderOptions& texture_options) override final;
+		void draw_text2D (const std::string_view text, const Vector& offset, const TextRenderOptions& text_options) override final;
 		void setup_render_3D (const RenderArgs3D& args) override final;
 		void setup_render_2D (const RenderArgs2D& args) override final;
+		void setup_viewports (const std::span<const ViewportArgs> viewports) override final;
 		void render () override final;
 		void update_screen () override final;
 		void clear_buffers (const uint32_t flags) override final;
 
 		void begin_texture_loading () override final;
 		void end_texture_loading () override final;
+
+		void begin_frame_capture (FrameCaptureCallback callback) override final;
+		void end_frame_capture () override final;
 	
 	private:
-		SDL_Rect helper_calc_sdl_rect (Rect2D& rect, const Vector& world_pos);
+		std::span<SDL_Vertex> alloc_vertices (SDL_Texture *texture, const uint32_t n);
+		void flush_vertices ();
+
+		inline SDL_FPoint project (const Vector& world_pos) const
+		{
+			const Vector4 clip_pos = this->projection_matrix * Vector4(world_pos.x, world_pos.y, 0, 1);
+			return SDL_FPoint { .x = static_cast<float>(clip_pos.x), .y = static_cast<float>(clip_pos.y) };
+		}
 	
 	protected:
 		TextureInfo load_texture__ (SDL_Surface *surface) override final;
 		void destroy_texture__ (TextureInfo& texture) override final;
 		TextureInfo create_sub_texture__ (const TextureInfo& parent, const uint32_t x_ini, const uint32_t y_ini, const uint32_t w, const uint32_t h) override final;
+		TextureInfo create_render_target__ (const uint32_t width_px, const uint32_t height_px) override final;
+		void begin_render_to_texture__ (TextureInfo& texture, const Vector2& world_init, const Vector2& world_size) override final;
+		void end_render_to_texture__ (TextureInfo& texture) override final;
 	};
 };
 
@@ -4,6 +4,7 @@
 #include <string_view>
 #include <vector>
 #include <list>
+#include <optional>
 
 #include <cstdint>
 
@@ -21,24 +22,77 @@ namespace Graphics
 
 // ---------------------------------------------------
 
+/*
+	Each texture may be surrounded by a gutter of padding_px pixels,
+	which the caller fills by extruding the texture edges,
+	so that mipmaps don't mix neighbour textures.
+	The space reserved for a texture may be smaller than the texture
+	itself, when the backend trims its transparent borders.
+*/
+
 class TextureAtlasCreator
 {
 public:
 	struct AtlasTexture {
 		TextureInfo *texture;
+		int32_t x_ini; // position of the texture itself, after the gutter
+		int32_t y_ini;
+	};
+
+	struct EmptyArea {
 		int32_t x_ini;
 		int32_t y_ini;
+		int32_t x_end;
+		int32_t y_end;
 	};
 
 protected:
-	std::list<TextureInfo*> textures;
+	struct Entry {
+		TextureInfo *texture;
+		int32_t width_px; // size stored in the atlas
+		int32_t height_px;
+	};
+
+	std::list<Entry> textures;
+	std::list<EmptyArea> empty_areas; // of the atlas being filled
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(int32_t, padding_px)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(int32_t, atlas_size, 0)
 
 public:
-	TextureAtlasCreator () = default;
+	TextureAtlasCreator (const int32_t padding_px_ = 0)
+		: padding_px(padding_px_)
+	{
+	}
+
 	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(TextureAtlasCreator)
 
-	void add_texture (TextureInfo& texture);
-	std::vector<AtlasTexture> create_atlas (const int32_t atlas_size);
+	// Batch packing: textures are added first and sorted by area before packing.
+
+	void add_texture (TextureInfo& texture, const int32_t width_px, const int32_t height_px);
+
+	inline void add_texture (TextureInfo& texture)
+	{
+		this->add_texture(texture, texture.width_px, texture.height_px);
+	}
+
+	std::vector<AtlasTexture> create_atlas (const int32_t atlas_size_);
+
+	/*
+		Incremental packing, for textures that must be placed as soon
+		as they are loaded.
+		insert_texture returns std::nullopt when the texture doesn't fit
+		in the current atlas, and begin_atlas must be called to start
+		the next one.
+	*/
+
+	void begin_atlas (const int32_t atlas_size_);
+	std::optional<AtlasTexture> insert_texture (TextureInfo& texture, const int32_t width_px, const int32_t height_px);
+
+	inline std::optional<AtlasTexture> insert_texture (TextureInfo& texture)
+	{
+		return this->insert_texture(texture, texture.width_px, texture.height_px);
+	}
 };
 
 // ---------------------------------------------------
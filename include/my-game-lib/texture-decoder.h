@@ -0,0 +1,79 @@
+#ifndef __MY_GAME_LIB_TEXTURE_DECODER_HEADER_H__
+#define __MY_GAME_LIB_TEXTURE_DECODER_HEADER_H__
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdint>
+
+#include <SDL.h>
+
+#include <my-lib/macros.h>
+
+#include <my-game-lib/graphics.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+/*
+	Decodes image files in a pool of worker threads, so texture files
+	can be loaded while the game is running without stalling the frame.
+	Surfaces are converted to the pixel format given to the constructor.
+	Only the decoding runs in the workers. The backend uploads the
+	decoded surfaces in its own thread, since that's where the
+	graphics context is.
+*/
+
+class TextureDecoder
+{
+public:
+	struct Job {
+		TextureInfo *texture;
+		std::string fname;
+		Manager::TextureLoadedCallback callback;
+		SDL_Surface *surface; // nullptr until decoded, or if the file can't be decoded
+	};
+
+protected:
+	std::deque<Job> pending;
+	std::deque<Job> decoded;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector<std::thread> threads;
+	bool running = true;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(Uint32, pixel_format)
+
+public:
+	TextureDecoder (const uint32_t n_threads, const Uint32 pixel_format_);
+
+	// pending jobs are dropped, and decoded surfaces not popped are freed
+	~TextureDecoder ();
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(TextureDecoder)
+
+	void push (TextureInfo& texture, std::string fname, Manager::TextureLoadedCallback callback);
+
+	// doesn't block, returns false if no surface is ready
+	bool pop_decoded (Job& job);
+
+private:
+	void thread_main ();
+};
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
+
+#endif
\ No newline at end of file
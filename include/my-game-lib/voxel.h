@@ -0,0 +1,156 @@
+#ifndef __MY_GAME_LIB_VOXEL_HEADER_H__
+#define __MY_GAME_LIB_VOXEL_HEADER_H__
+
+#include <array>
+#include <span>
+#include <vector>
+
+#include <cstdint>
+
+#include <my-lib/macros.h>
+#include <my-lib/std.h>
+#include <my-lib/any.h>
+
+#include <my-game-lib/graphics.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+/*
+	Dense 3D grid of materials, rendered as a single mesh.
+	Voxel (0, 0, 0) is the one with the smallest x, y and z,
+	and its left bottom front corner is at the origin of the chunk.
+
+	Meshing is greedy: only the faces between a solid voxel and an empty
+	voxel (or the border of the chunk) are generated, and coplanar faces
+	with the same material are merged into bigger quads.
+
+	The quads are stored by slice: one layer of faces perpendicular to an
+	axis, facing one direction. Editing a voxel only marks the slices around
+	it, and update_mesh only meshes the marked slices again.
+
+	update_mesh only touches the chunk, so it can run in a worker thread,
+	as long as the chunk is not edited or drawn at the same time.
+
+	Backends may keep the mesh in GPU buffers, which are only updated
+	when mesh_version changes.
+*/
+
+class VoxelChunk
+{
+public:
+	using Material = uint16_t;
+	using Surface = Cube3D::SurfacePositionIndex;
+
+	static inline constexpr Material empty = 0;
+
+	struct Quad {
+		/*
+			Local coords, counter-clockwise when seen from outside.
+			Mapped to the left top, left bottom, right bottom and right top
+			of the texture, as the quads of Rect2D.
+			The texture of side faces always has its top pointing to +y.
+		*/
+		std::array<Point, 4> corners;
+
+		Vector normal;
+		Vector2 n_tiles; // how many times the texture repeats horizontally and vertically
+		Surface surface;
+		Material material;
+	};
+
+	// filled by the backend driver
+	Mylib::Any<sizeof(void*), sizeof(void*)> data;
+
+protected:
+	Manager& manager;
+
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, size_x)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, size_y)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(uint32_t, size_z)
+	MYLIB_OO_ENCAPSULATE_SCALAR_READONLY(fp_t, voxel_size)
+
+	std::vector<Material> voxels; // x varies faster, then y, then z
+
+	// one set of textures per material, indexed by Surface
+	// index 0 (empty) is never used
+	std::vector<std::array<TextureRenderOptions, 6>> materials;
+
+	std::vector<std::vector<Quad>> slices;
+	std::vector<bool> dirty_slices;
+	uint32_t n_dirty_slices = 0;
+	std::array<uint32_t, 6> first_slice; // index in slices of the first slice of each surface
+
+	// incremented every time the mesh or the textures of the materials change
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, mesh_version, 0)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint32_t, n_quads, 0)
+
+	// scratch buffer of update_mesh
+	std::vector<Material> mask;
+
+public:
+	VoxelChunk (Manager& manager_, const uint32_t size_x_, const uint32_t size_y_, const uint32_t size_z_, const fp_t voxel_size_);
+
+	~VoxelChunk ();
+
+	MYLIB_DELETE_COPY_MOVE_CONSTRUCTOR_ASSIGN(VoxelChunk)
+
+	inline Material get_voxel (const uint32_t x, const uint32_t y, const uint32_t z) const noexcept
+	{
+		return this->voxels[this->get_voxel_index(x, y, z)];
+	}
+
+	void set_voxel (const uint32_t x, const uint32_t y, const uint32_t z, const Material material);
+
+	// fills the whole chunk, which forces a complete re-mesh
+	void fill (const Material material);
+
+	void set_material (const Material material, const std::array<TextureRenderOptions, 6>& textures);
+
+	void set_material (const Material material, const TextureRenderOptions& texture)
+	{
+		this->set_material(material, std::array<TextureRenderOptions, 6> { texture, texture, texture, texture, texture, texture });
+	}
+
+	inline const TextureRenderOptions& get_material_texture (const Material material, const Surface surface) const
+	{
+		return this->materials[material][surface];
+	}
+
+	inline bool is_mesh_dirty () const noexcept
+	{
+		return (this->n_dirty_slices > 0);
+	}
+
+	// Meshes the dirty slices again.
+	// Returns true if anything changed.
+	bool update_mesh ();
+
+	// only valid after update_mesh
+	inline std::span<const std::vector<Quad>> get_slices () const noexcept
+	{
+		return this->slices;
+	}
+
+private:
+	inline uint32_t get_voxel_index (const uint32_t x, const uint32_t y, const uint32_t z) const noexcept
+	{
+		return x + this->size_x * (y + this->size_y * z);
+	}
+
+	void mark_dirty (const Surface surface, const int32_t layer) noexcept;
+	void mesh_slice (const Surface surface, const uint32_t layer);
+};
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
+
+#endif
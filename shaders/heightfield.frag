@@ -0,0 +1,44 @@
+#version 300 es
+
+/*
+	"precision" is required by OpenGL ES 3.0.
+	Check triangles-texture.frag for details.
+*/
+precision mediump float;
+
+in vec3 world_position;
+in vec3 normal;
+in highp vec2 tile_coords; // mediump is not enough for large terrains
+
+out vec4 o_color;
+
+uniform vec4 u_ambient_light_color;
+
+uniform vec3 u_point_light_pos;
+uniform vec4 u_point_light_color;
+
+uniform highp vec4 u_tex_rect;
+uniform float u_tex_depth;
+
+uniform mediump sampler2DArray u_tx_unit;
+
+void main ()
+{
+	// repeats the texture once per tile, as in voxels.frag
+	vec2 uv = u_tex_rect.xy + fract(tile_coords) * u_tex_rect.zw;
+
+	vec2 grad_x = dFdx(tile_coords) * u_tex_rect.zw;
+	vec2 grad_y = dFdy(tile_coords) * u_tex_rect.zw;
+
+	vec4 color = textureGrad(u_tx_unit, vec3(uv, u_tex_depth), grad_x, grad_y);
+
+	vec3 n = normalize(normal);
+	vec3 light_dir = normalize(u_point_light_pos - world_position);
+	float diff = max(dot(n, light_dir), 0.0);
+	vec3 diffuse_light = u_point_light_color.rgb * diff * u_point_light_color.a;
+
+	vec3 ambient_light = u_ambient_light_color.rgb * u_ambient_light_color.a;
+
+	vec3 result = (ambient_light + diffuse_light) * color.rgb;
+	o_color = vec4(result, 1.0);
+}
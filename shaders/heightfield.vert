@@ -0,0 +1,72 @@
+#version 300 es
+
+in vec2 i_grid_pos; // from (0, 0) to (1, 1)
+in vec4 i_node; // x, y: local x and z of the node, z: size of the node
+in vec2 i_morph; // distances where the morph starts and ends
+
+out vec3 world_position;
+out vec3 normal;
+out vec2 tile_coords;
+
+uniform mat4 u_projection_matrix;
+uniform vec3 u_camera_pos;
+uniform vec3 u_offset; // origin of the heightfield
+uniform ivec2 u_size; // in samples
+uniform float u_cell_size;
+uniform float u_tile_size;
+
+uniform highp sampler2D u_height_unit;
+
+// must match Heightfield3D::patch_size
+const float patch_size = 32.0;
+
+float get_sample (ivec2 s)
+{
+	return texelFetch(u_height_unit, clamp(s, ivec2(0), u_size - 1), 0).r;
+}
+
+// GL_R32F can't be filtered, so we interpolate the samples ourselves
+float get_height (vec2 s)
+{
+	vec2 s0 = floor(s);
+	vec2 t = s - s0;
+	ivec2 i = ivec2(s0);
+
+	float h0 = mix(get_sample(i), get_sample(i + ivec2(1, 0)), t.x);
+	float h1 = mix(get_sample(i + ivec2(0, 1)), get_sample(i + ivec2(1, 1)), t.x);
+
+	return mix(h0, h1, t.y);
+}
+
+void main ()
+{
+	vec2 max_pos = vec2(u_size - 1) * u_cell_size;
+	vec2 pos = i_node.xy + i_grid_pos * i_node.z;
+
+	// the morph factor comes from the position before morphing
+	float dist = distance(u_camera_pos, vec3(pos.x, get_height(pos / u_cell_size), pos.y) + u_offset);
+	float morph = clamp((dist - i_morph.x) / (i_morph.y - i_morph.x), 0.0, 1.0);
+
+	// the odd vertices slide into their even neighbors,
+	// which are the vertices of the grid of the parent node
+	vec2 odd = fract(i_grid_pos * patch_size * 0.5) * 2.0;
+	float spacing = i_node.z / patch_size;
+
+	pos -= odd * spacing * morph;
+
+	// nodes at the border may go beyond the last sample
+	pos = clamp(pos, vec2(0.0), max_pos);
+
+	vec2 s = pos / u_cell_size;
+	float step = spacing / u_cell_size; // in samples
+
+	float height_left = get_height(s - vec2(step, 0.0));
+	float height_right = get_height(s + vec2(step, 0.0));
+	float height_back = get_height(s - vec2(0.0, step));
+	float height_front = get_height(s + vec2(0.0, step));
+
+	normal = normalize(vec3(height_left - height_right, 2.0 * spacing, height_back - height_front));
+	world_position = vec3(pos.x, get_height(s), pos.y) + u_offset;
+	tile_coords = pos / u_tile_size;
+	gl_Position = u_projection_matrix * vec4(world_position, 1.0 );
+}
@@ -0,0 +1,34 @@
+#version 430 core
+
+in vec3 i_position;
+in vec3 i_normal;
+in uint i_object_index; // per instance, written by cull-objects.comp
+
+out vec3 world_position;
+out vec3 normal;
+out vec4 color;
+
+struct Object {
+	vec4 pos_radius;
+	vec4 color;
+	uint mesh_id;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+	Object objects[];
+};
+
+uniform mat4 u_projection_matrix;
+
+void main ()
+{
+	Object object = objects[i_object_index];
+
+	color = object.color;
+	world_position = i_position + object.pos_radius.xyz;
+	normal = normalize(i_normal);
+	gl_Position = u_projection_matrix * vec4(world_position, 1.0 );
+}
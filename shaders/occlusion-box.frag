@@ -0,0 +1,15 @@
+#version 300 es
+
+/*
+	"precision" is required by OpenGL ES 3.0.
+	Check triangles-color.frag for details.
+*/
+precision mediump float;
+
+out vec4 o_color;
+
+void main ()
+{
+	// color writes are disabled, only the samples passed are counted
+	o_color = vec4(1.0);
+}
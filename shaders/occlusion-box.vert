@@ -0,0 +1,25 @@
+#version 300 es
+
+/*
+	Draws a box as a triangle strip with 14 vertices.
+	The vertices are generated from gl_VertexID,
+	so no vertex buffer is needed.
+	Only the depth test matters, so there is no color or lighting.
+*/
+
+uniform mat4 u_projection_matrix;
+uniform vec3 u_center;
+uniform vec3 u_half_size;
+
+void main ()
+{
+	int b = 1 << gl_VertexID;
+
+	vec3 corner = vec3(
+		(0x287a & b) != 0 ? 1.0 : -1.0,
+		(0x02af & b) != 0 ? 1.0 : -1.0,
+		(0x31e3 & b) != 0 ? 1.0 : -1.0
+	);
+
+	gl_Position = u_projection_matrix * vec4(u_center + corner * u_half_size, 1.0);
+}
@@ -0,0 +1,28 @@
+#version 300 es
+
+/*
+	"precision" is required by OpenGL ES 3.0.
+	Check triangles-color.frag for details.
+*/
+precision mediump float;
+
+in vec4 color;
+in vec3 tex_coord;
+
+out vec4 o_color;
+
+uniform mediump sampler2DArray u_tx_unit;
+
+void main ()
+{
+	vec4 result = color;
+
+	// negative depth means that the quad is not textured
+	if (tex_coord.z >= 0.0)
+		result *= texture(u_tx_unit, tex_coord);
+
+	if (result.a < 0.01)
+		discard;
+
+	o_color = result;
+}
@@ -0,0 +1,41 @@
+#version 300 es
+
+in vec3 i_transform_x;
+in vec3 i_transform_y;
+in float i_z;
+in vec4 i_color;
+in vec4 i_tex_rect;
+in float i_tex_depth;
+
+out vec4 color;
+out vec3 tex_coord;
+
+uniform mat4 u_projection_matrix;
+
+/*
+	The quad is generated here, so there is no per-vertex attribute.
+	We follow the same vertex order used in Rect2D::calculate_vertices.
+	The texture coordinates of the (-x,-y) corner are i_tex_rect.xy,
+	and the ones of the (+x,+y) corner are i_tex_rect.zw.
+	This way, the caller can flip the texture according to its y axis.
+	The 2x3 affine transform already includes the size and rotation of the quad.
+*/
+
+const vec2 corners[6] = vec2[6](
+	vec2(-0.5, -0.5), // upper left
+	vec2(-0.5, 0.5),  // down left
+	vec2(0.5, 0.5),   // down right
+	vec2(-0.5, -0.5), // upper left
+	vec2(0.5, 0.5),   // down right
+	vec2(0.5, -0.5)   // upper right
+);
+
+void main ()
+{
+	vec3 corner = vec3(corners[gl_VertexID], 1.0);
+	vec2 uv = corner.xy + vec2(0.5, 0.5);
+
+	color = i_color;
+	tex_coord = vec3(mix(i_tex_rect.xy, i_tex_rect.zw, uv), i_tex_depth);
+	gl_Position = u_projection_matrix * vec4(dot(i_transform_x, corner), dot(i_transform_y, corner), i_z, 1.0);
+}
@@ -14,25 +14,42 @@
 */
 precision mediump float;
 
+/*
+	Variants (check Program::select_variant):
+	- LIT: ambient light plus N_POINT_LIGHTS point lights.
+	  Without it, the color is used as it is (e.g. in 2D).
+*/
+
 in vec3 world_position;
 in vec3 normal;
 in vec4 color;
 
 out vec4 o_color;
 
+#ifdef LIT
 uniform vec4 u_ambient_light_color;
 
-uniform vec3 u_point_light_pos;
-uniform vec4 u_point_light_color;
+#if N_POINT_LIGHTS > 0
+uniform vec3 u_point_light_pos[N_POINT_LIGHTS];
+uniform vec4 u_point_light_color[N_POINT_LIGHTS];
+#endif
+#endif
 
 void main ()
 {
-	vec3 light_dir = normalize(u_point_light_pos - world_position);
-	float diff = max(dot(normal, light_dir), 0.0);
-	vec3 diffuse_light = u_point_light_color.rgb * diff * u_point_light_color.a;
-
-	vec3 ambient_light = u_ambient_light_color.rgb * u_ambient_light_color.a;
-
-	vec3 result = (ambient_light + diffuse_light) * color.rgb;
-	o_color = vec4(result, color.a);
+#ifdef LIT
+	vec3 light = u_ambient_light_color.rgb * u_ambient_light_color.a;
+
+#if N_POINT_LIGHTS > 0
+	for (int i = 0; i < N_POINT_LIGHTS; i++) {
+		vec3 light_dir = normalize(u_point_light_pos[i] - world_position);
+		float diff = max(dot(normal, light_dir), 0.0);
+		light += u_point_light_color[i].rgb * diff * u_point_light_color[i].a;
+	}
+#endif
+
+	o_color = vec4(light * color.rgb, color.a);
+#else
+	o_color = color;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 300 es
+
+precision mediump float;
+
+/*
+	The index atlas stores one byte per texel (GL_R8, normalized to [0, 1]),
+	which is the column of the palette texture.
+	Each row of the palette texture is a palette of 256 colors.
+*/
+
+in vec3 tex_coord;
+flat in float palette;
+
+out vec4 o_color;
+
+uniform mediump sampler2DArray u_index_unit;
+uniform mediump sampler2D u_palette_unit;
+
+void main ()
+{
+	int index = int(texture(u_index_unit, tex_coord).r * 255.0 + 0.5);
+	vec4 color = texelFetch(u_palette_unit, ivec2(index, int(palette)), 0);
+
+	if (color.a < 0.1)
+		discard;
+
+	o_color = color;
+}
\ No newline at end of file
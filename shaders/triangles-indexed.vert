@@ -0,0 +1,19 @@
+#version 300 es
+
+in vec3 i_position;
+in vec3 i_offset;
+in vec3 i_tex_coords;
+in float i_palette;
+
+out vec3 tex_coord;
+flat out float palette;
+
+uniform mat4 u_projection_matrix;
+
+void main ()
+{
+	tex_coord = i_tex_coords;
+	palette = i_palette;
+
+	gl_Position = u_projection_matrix * vec4(i_position + i_offset, 1.0 );
+}
\ No newline at end of file
@@ -14,32 +14,61 @@
 */
 precision mediump float;
 
+/*
+	Variants (check Program::select_variant):
+	- LIT: ambient light plus N_POINT_LIGHTS point lights.
+	  Without it, the texel is used as it is (e.g. in 2D).
+	- ALPHA_TEST: discards almost transparent texels, so they don't write depth.
+	- RENDER_TARGET: samples the texture of a render target instead of the atlas.
+*/
+
 in vec3 world_position;
 in vec3 normal;
 in vec3 tex_coord;
 
 out vec4 o_color;
 
+#ifdef LIT
 uniform vec4 u_ambient_light_color;
 
-uniform vec3 u_point_light_pos;
-uniform vec4 u_point_light_color;
+#if N_POINT_LIGHTS > 0
+uniform vec3 u_point_light_pos[N_POINT_LIGHTS];
+uniform vec4 u_point_light_color[N_POINT_LIGHTS];
+#endif
+#endif
 
+#ifdef RENDER_TARGET
+uniform mediump sampler2D u_tx_unit;
+#else
 uniform mediump sampler2DArray u_tx_unit;
+#endif
 
 void main ()
 {
+#ifdef RENDER_TARGET
+	vec4 color = texture(u_tx_unit, tex_coord.xy);
+#else
 	vec4 color = texture(u_tx_unit, tex_coord);
+#endif
 
+#ifdef ALPHA_TEST
 	if (color.a < 0.1)
 		discard;
+#endif
 
-	vec3 light_dir = normalize(u_point_light_pos - world_position);
-	float diff = max(dot(normal, light_dir), 0.0);
-	vec3 diffuse_light = u_point_light_color.rgb * diff * u_point_light_color.a;
+#ifdef LIT
+	vec3 light = u_ambient_light_color.rgb * u_ambient_light_color.a;
 
-	vec3 ambient_light = u_ambient_light_color.rgb * u_ambient_light_color.a;
+#if N_POINT_LIGHTS > 0
+	for (int i = 0; i < N_POINT_LIGHTS; i++) {
+		vec3 light_dir = normalize(u_point_light_pos[i] - world_position);
+		float diff = max(dot(normal, light_dir), 0.0);
+		light += u_point_light_color[i].rgb * diff * u_point_light_color[i].a;
+	}
+#endif
 
-	vec3 result = (ambient_light + diffuse_light) * color.rgb;
-	o_color = vec4(result, color.a);
+	o_color = vec4(light * color.rgb, color.a);
+#else
+	o_color = color;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 300 es
+
+/*
+	"precision" is required by OpenGL ES 3.0.
+	Check triangles-color.frag for details.
+*/
+precision mediump float;
+
+in vec2 tex_coord;
+
+out vec4 o_color;
+
+uniform mediump sampler2D u_tx_unit;
+uniform highp vec2 u_uv_scale; // also used by the vertex shader, so the precision must match
+uniform vec2 u_texel_size; // 1 / size of the scene texture
+uniform float u_sharpness; // 0 means plain bilinear filtering
+
+void main ()
+{
+	// don't sample texels outside of the rendered area
+	vec2 coord = min(tex_coord, u_uv_scale - u_texel_size * 0.5);
+
+	vec4 result = texture(u_tx_unit, coord);
+
+	if (u_sharpness > 0.0) {
+		// unsharp mask with the 4 direct neighbors
+		vec4 neighbors = texture(u_tx_unit, coord + vec2(u_texel_size.x, 0.0))
+			+ texture(u_tx_unit, coord - vec2(u_texel_size.x, 0.0))
+			+ texture(u_tx_unit, coord + vec2(0.0, u_texel_size.y))
+			+ texture(u_tx_unit, coord - vec2(0.0, u_texel_size.y));
+
+		result = clamp(result + (result * 4.0 - neighbors) * (u_sharpness * 0.25), 0.0, 1.0);
+	}
+
+	o_color = vec4(result.rgb, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 300 es
+
+/*
+	Draws a single triangle that covers the whole screen.
+	The vertices are generated from gl_VertexID,
+	so no vertex buffer is needed.
+*/
+
+out vec2 tex_coord;
+
+// fraction of the scene texture that was rendered
+uniform vec2 u_uv_scale;
+
+void main ()
+{
+	// (0, 0), (2, 0), (0, 2)
+	vec2 pos = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+
+	tex_coord = pos * u_uv_scale;
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
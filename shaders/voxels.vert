@@ -0,0 +1,26 @@
+#version 300 es
+
+in vec3 i_position;
+in vec3 i_normal;
+in vec2 i_tile_coords;
+in vec4 i_tex_rect;
+in float i_tex_depth;
+
+out vec3 world_position;
+out vec3 normal;
+out vec2 tile_coords;
+flat out vec4 tex_rect;
+flat out float tex_depth;
+
+uniform mat4 u_projection_matrix;
+uniform vec3 u_offset; // origin of the chunk
+
+void main ()
+{
+	tile_coords = i_tile_coords;
+	tex_rect = i_tex_rect;
+	tex_depth = i_tex_depth;
+	world_position = i_position + u_offset;
+	normal = normalize(i_normal);
+	gl_Position = u_projection_matrix * vec4(world_position, 1.0 );
+}
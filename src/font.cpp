@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <string>
+
+#include <my-game-lib/font.h>
+#include <my-game-lib/debug.h>
+#include <my-game-lib/exception.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+/*
+	Decodes the next utf-8 codepoint and advances i.
+	Invalid sequences return 0xFFFD (replacement character).
+*/
+
+static uint32_t next_utf8_codepoint (const std::string_view text, size_t& i) noexcept
+{
+	const uint8_t c = static_cast<uint8_t>(text[i++]);
+	uint32_t codepoint;
+	uint32_t n_continuation;
+
+	if (c < 0x80)
+		return c;
+	else if ((c & 0xE0) == 0xC0) {
+		codepoint = c & 0x1F;
+		n_continuation = 1;
+	}
+	else if ((c & 0xF0) == 0xE0) {
+		codepoint = c & 0x0F;
+		n_continuation = 2;
+	}
+	else if ((c & 0xF8) == 0xF0) {
+		codepoint = c & 0x07;
+		n_continuation = 3;
+	}
+	else
+		return 0xFFFD;
+
+	for (uint32_t j = 0; j < n_continuation; j++) {
+		if (i >= text.size())
+			return 0xFFFD;
+
+		const uint8_t cc = static_cast<uint8_t>(text[i]);
+
+		if ((cc & 0xC0) != 0x80)
+			return 0xFFFD;
+
+		codepoint = (codepoint << 6) | (cc & 0x3F);
+		i++;
+	}
+
+	return codepoint;
+}
+
+// ---------------------------------------------------
+
+Font::Font (Manager& manager, const std::string_view fname, const uint32_t size_px, const uint32_t first_char_, const uint32_t last_char_)
+	: first_char(first_char_),
+	  last_char(last_char_)
+{
+	mylib_assert(this->first_char <= this->last_char)
+
+	this->ttf_font = TTF_OpenFont(fname.data(), static_cast<int>(size_px));
+	mylib_assert_exception_args(this->ttf_font != nullptr, UnableToLoadFontException, fname)
+
+	this->line_height_px = TTF_FontLineSkip(this->ttf_font);
+
+	const std::string id_prefix = "font:" + std::string(fname) + ":" + std::to_string(size_px) + ":";
+	constexpr SDL_Color white = { 255, 255, 255, 255 };
+
+	this->glyphs.resize(this->last_char - this->first_char + 1);
+
+	for (uint32_t c = this->first_char; c <= this->last_char; c++) {
+		Glyph& glyph = this->glyphs[c - this->first_char];
+		int min_x = 0, max_x = 0, min_y = 0, max_y = 0, advance = 0;
+
+		glyph.texture.info = nullptr;
+		glyph.width_px = 0;
+		glyph.height_px = 0;
+		glyph.advance_px = 0;
+
+		if (!TTF_GlyphIsProvided32(this->ttf_font, c))
+			continue;
+
+		if (TTF_GlyphMetrics32(this->ttf_font, c, &min_x, &max_x, &min_y, &max_y, &advance) == 0)
+			glyph.advance_px = advance;
+
+		// the surface has the height of the font, with the glyph already placed at the baseline
+
+		SDL_Surface *surface = TTF_RenderGlyph32_Blended(this->ttf_font, c, white);
+
+		if (surface == nullptr)
+			continue;
+
+		glyph.width_px = surface->w;
+		glyph.height_px = surface->h;
+
+		if (max_x > min_x)
+			glyph.texture = manager.load_texture(id_prefix + std::to_string(c), surface);
+
+		SDL_FreeSurface(surface);
+	}
+
+	dprintln("font ", fname, " loaded with ", this->glyphs.size(), " glyphs, line height ", this->line_height_px, "px");
+}
+
+Font::~Font ()
+{
+	TTF_CloseFont(this->ttf_font);
+}
+
+// ---------------------------------------------------
+
+const Font::Layout& Font::get_layout (const std::string_view text)
+{
+	auto it = this->layout_cache.find(text);
+
+	if (it != this->layout_cache.end())
+		return it->second;
+
+	if (this->layout_cache.size() >= max_cached_layouts) [[unlikely]]
+		this->layout_cache.clear();
+
+	auto [new_it, inserted] = this->layout_cache.emplace(std::string(text), this->build_layout(text));
+
+	return new_it->second;
+}
+
+// ---------------------------------------------------
+
+Font::Layout Font::build_layout (const std::string_view text) const
+{
+	Layout layout;
+	int32_t pen_x = 0;
+	int32_t pen_y = 0;
+	int32_t max_x = 0;
+	uint32_t previous = 0;
+
+	layout.quads.reserve(text.size());
+
+	for (size_t i = 0; i < text.size(); ) {
+		uint32_t c = next_utf8_codepoint(text, i);
+
+		if (c == '\n') {
+			pen_x = 0;
+			pen_y += this->line_height_px;
+			previous = 0;
+			continue;
+		}
+
+		const Glyph *glyph = this->find_glyph(c);
+
+		// kerning must use the codepoint that is actually drawn
+		if (glyph == nullptr) [[unlikely]] {
+			c = '?';
+			glyph = this->find_glyph(c);
+		}
+
+		if (glyph == nullptr) [[unlikely]]
+			continue;
+
+		if (previous != 0)
+			pen_x += TTF_GetFontKerningSizeGlyphs32(this->ttf_font, previous, c);
+
+		if (glyph->texture.info != nullptr) {
+			layout.quads.push_back( GlyphQuad {
+				.glyph = glyph,
+				.pos_px = Vector2(static_cast<fp_t>(pen_x), static_cast<fp_t>(pen_y))
+			} );
+		}
+
+		pen_x += glyph->advance_px;
+		max_x = std::max(max_x, pen_x);
+		previous = c;
+	}
+
+	layout.size_px = Vector2(static_cast<fp_t>(max_x), static_cast<fp_t>(pen_y + this->line_height_px));
+
+	return layout;
+}
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
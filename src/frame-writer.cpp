@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <vector>
+
+#include <SDL_image.h>
+
+#include <my-game-lib/frame-writer.h>
+#include <my-game-lib/debug.h>
+#include <my-game-lib/exception.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+FrameWriter::FrameWriter (const std::string_view path_, const Format format_, const uint32_t fps_, const uint32_t max_queued_frames_)
+	: path(path_),
+	  format(format_),
+	  fps(fps_),
+	  max_queued_frames(max_queued_frames_)
+{
+	if (this->format != Format::PNG) {
+		this->file.open(this->path, std::ios::binary | std::ios::trunc);
+		mylib_assert_exception_args(this->file.is_open(), FileException, this->path)
+	}
+
+	this->thread = std::thread(&FrameWriter::thread_main, this);
+}
+
+FrameWriter::~FrameWriter ()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->running = false;
+	}
+
+	this->condition.notify_one();
+	this->thread.join();
+
+	dprintln("frame writer finished with ", this->n_written_frames, " frames written and ", this->n_dropped_frames, " dropped");
+}
+
+// ---------------------------------------------------
+
+void FrameWriter::push (CapturedFrame&& frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		if (this->queue.size() >= this->max_queued_frames) {
+			this->n_dropped_frames++;
+			return;
+		}
+
+		this->queue.push_back(std::move(frame));
+	}
+
+	this->condition.notify_one();
+}
+
+// ---------------------------------------------------
+
+void FrameWriter::thread_main ()
+{
+	while (true) {
+		CapturedFrame frame;
+
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			this->condition.wait(lock, [this] () { return !this->queue.empty() || !this->running; });
+
+			// when stopping, we still write all queued frames
+			if (this->queue.empty())
+				break;
+
+			frame = std::move(this->queue.front());
+			this->queue.pop_front();
+		}
+
+		this->write_frame(frame);
+		this->n_written_frames++;
+	}
+
+	if (this->file.is_open())
+		this->file.flush();
+}
+
+// ---------------------------------------------------
+
+void FrameWriter::write_frame (const CapturedFrame& frame)
+{
+	switch (this->format) {
+		case Format::Raw:
+			this->file.write(reinterpret_cast<const char*>(frame.pixels.data()), frame.pixels.size());
+		break;
+
+		case Format::PNG:
+			this->write_png(frame);
+		break;
+
+		case Format::Y4M:
+			this->write_y4m(frame);
+		break;
+	}
+}
+
+// ---------------------------------------------------
+
+void FrameWriter::write_png (const CapturedFrame& frame)
+{
+	// the surface only points to the pixels, nothing is copied
+	SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
+		const_cast<uint8_t*>(frame.pixels.data()),
+		frame.width_px,
+		frame.height_px,
+		32,
+		frame.width_px * 4,
+		SDL_PIXELFORMAT_RGBA32);
+
+	if (surface == nullptr) [[unlikely]] {
+		dprintln("error creating surface for frame ", frame.frame_number, '\n', SDL_GetError());
+		return;
+	}
+
+	const std::string fname = this->path + std::to_string(frame.frame_number) + ".png";
+
+	if (IMG_SavePNG(surface, fname.data()) != 0) [[unlikely]]
+		dprintln("error saving frame ", fname, '\n', IMG_GetError());
+
+	SDL_FreeSurface(surface);
+}
+
+// ---------------------------------------------------
+
+/*
+	The stream header is written with the size of the first frame.
+	We use 4:4:4 so we don't need to subsample the chroma,
+	and full range BT.601 coefficients (the same as JPEG).
+*/
+
+void FrameWriter::write_y4m (const CapturedFrame& frame)
+{
+	const uint32_t n_pixels = frame.width_px * frame.height_px;
+
+	if (!this->header_written) {
+		this->file << "YUV4MPEG2 W" << frame.width_px << " H" << frame.height_px << " F" << this->fps << ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+		this->header_written = true;
+	}
+
+	std::vector<uint8_t> planes(n_pixels * 3);
+	uint8_t *y_plane = planes.data();
+	uint8_t *u_plane = y_plane + n_pixels;
+	uint8_t *v_plane = u_plane + n_pixels;
+
+	auto to_byte = [] (const float v) -> uint8_t {
+		return static_cast<uint8_t>(std::clamp(v + 0.5f, 0.0f, 255.0f));
+	};
+
+	for (uint32_t i = 0; i < n_pixels; i++) {
+		const float r = frame.pixels[i*4 + 0];
+		const float g = frame.pixels[i*4 + 1];
+		const float b = frame.pixels[i*4 + 2];
+
+		y_plane[i] = to_byte(0.299f*r + 0.587f*g + 0.114f*b);
+		u_plane[i] = to_byte(-0.168736f*r - 0.331264f*g + 0.5f*b + 128.0f);
+		v_plane[i] = to_byte(0.5f*r - 0.418688f*g - 0.081312f*b + 128.0f);
+	}
+
+	this->file << "FRAME\n";
+	this->file.write(reinterpret_cast<const char*>(planes.data()), planes.size());
+}
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
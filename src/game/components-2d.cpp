@@ -2,6 +2,11 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 #include <my-game-lib/game/game.h>
 #include <my-game-lib/game/components-2d.h>
@@ -21,6 +26,7 @@ namespace Game
 // ---------------------------------------------------
 
 using Graphics::Opengl::Opengl_TextureDescriptor;
+using Graphics::Opengl::ProgramQuadInstanced;
 
 namespace Enums {
 	// 6 vertices counter-clockwise
@@ -93,34 +99,347 @@ void Rect2DRenderer::process_render (const float dt)
 
 // ---------------------------------------------------
 
+/*
+	Trimmed textures only have part of the image in the atlas,
+	so the quad shrinks to that part, as in draw_rect2D.
+	The unit quad goes from -0.5 to 0.5, and y goes up,
+	while the trim is in texture coords, where y goes down.
+	Not trimmed textures have trim_ini (0, 0) and trim_end (1, 1),
+	so the transform doesn't change.
+*/
+
+static void trim_quad_instance (ProgramQuadInstanced::Instance& q, const Opengl_TextureDescriptor *desc) noexcept
+{
+	const float sx = desc->trim_end.x - desc->trim_ini.x;
+	const float sy = desc->trim_end.y - desc->trim_ini.y;
+	const float ox = (desc->trim_ini.x + desc->trim_end.x) * 0.5f - 0.5f;
+	const float oy = 0.5f - (desc->trim_ini.y + desc->trim_end.y) * 0.5f;
+
+	q.transform_x.set(q.transform_x.x * sx, q.transform_x.y * sy, q.transform_x.x * ox + q.transform_x.y * oy + q.transform_x.z);
+	q.transform_y.set(q.transform_y.x * sx, q.transform_y.y * sy, q.transform_y.x * ox + q.transform_y.y * oy + q.transform_y.z);
+}
+
+// ---------------------------------------------------
+
 void Sprite2DRenderer::process_render (const float dt)
 {
 	auto *renderer = static_cast<Graphics::Opengl::Renderer*>(Game::renderer);
-	auto& program = *renderer->get_program_triangle_texture();
+	auto& program = *renderer->get_program_quad_instanced();
 
-	const Matrix3 transform = this->get_global_transform();
-	constexpr uint32_t n_vertices = 6;
-	
-	using Rect2DVertexPositionIndex = Enums::Rect2DVertexPositionIndex;
 	using TextureVertexPositionIndex = Graphics::Enums::TextureVertexPositionIndex;
 
-	std::array<Vector2, n_vertices> local_vertices = generate_local_vertices_rect2d(this->size);
+	// the unit quad is scaled by the size before the global transform
+	const Matrix3 transform = this->get_global_transform() * Matrix3::scale(this->size);
 	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(this->texture.info->data);
+	mylib_assert_msg(!desc->indexed, "indexed textures can only be drawn by draw_rect2D")
+	mylib_assert_msg(desc->texture_id == 0, "render targets can only be drawn by draw_rect2D")
 
-	auto vertices = program.alloc_vertices(n_vertices);
+	// columns of the affine transform
+	const Vector3 cx = transform * Vector3(1.0f, 0.0f, 0.0f);
+	const Vector3 cy = transform * Vector3(0.0f, 1.0f, 0.0f);
+	const Vector3 ct = transform * Vector3(0.0f, 0.0f, 1.0f);
 
-	for (uint32_t i=0; i<n_vertices; i++) {
-		vertices[i].gvertex.pos = transform * Vector3(local_vertices[i], 1);
-		vertices[i].gvertex.pos.z = this->z;
-		vertices[i].offset.set_zero();
+	auto& sprite = program.alloc_instances(1)[0];
+
+	sprite.transform_x.set(cx.x, cy.x, ct.x);
+	sprite.transform_y.set(cx.y, cy.y, ct.y);
+
+	if (desc->trimmed)
+		trim_quad_instance(sprite, desc);
+
+	// y axis goes up in game coords, so the (-x,-y) corner is the left bottom of the texture
+	sprite.tex_rect.set(desc->tex_coords[TextureVertexPositionIndex::LeftBottom].x, desc->tex_coords[TextureVertexPositionIndex::LeftBottom].y,
+	                    desc->tex_coords[TextureVertexPositionIndex::RightTop].x, desc->tex_coords[TextureVertexPositionIndex::RightTop].y);
+	sprite.tex_depth = desc->atlas->texture_depth;
+	sprite.z = this->z;
+	sprite.color = this->color;
+}
+
+// ---------------------------------------------------
+
+/*
+	Worker threads shared by all particle systems.
+	They are created the first time a system needs them and then wait
+	for work, so process_update doesn't pay for creating threads every frame.
+	run must only be called by one thread at a time (the game loop).
+*/
+
+class ParticleWorkers
+{
+private:
+	using Job = std::function<void (const uint32_t)>;
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable work_condition;
+	std::condition_variable done_condition;
+	const Job *job = nullptr;
+	uint32_t n_jobs = 0;
+	uint32_t next_job = 0;
+	uint32_t n_unfinished = 0; // jobs given to the workers that haven't finished
+	bool running = true;
+
+public:
+	~ParticleWorkers ()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->running = false;
+		}
+
+		this->work_condition.notify_all();
+
+		for (std::thread& thread : this->threads)
+			thread.join();
+	}
+
+	// Runs job(0) to job(n - 1) and returns when all of them finish.
+	// job(0) runs in the calling thread.
+	void run (const uint32_t n, const Job& job_)
+	{
+		mylib_assert(n > 0)
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+
+			while (this->threads.size() < (n - 1))
+				this->threads.emplace_back(&ParticleWorkers::thread_main, this);
+
+			this->job = &job_;
+			this->n_jobs = n;
+			this->next_job = 1;
+			this->n_unfinished = n - 1;
+		}
+
+		this->work_condition.notify_all();
+
+		job_(0);
+
+		std::unique_lock<std::mutex> lock(this->mutex);
+
+		this->done_condition.wait(lock, [this] () -> bool {
+			return (this->n_unfinished == 0);
+		});
+
+		this->job = nullptr;
+		this->n_jobs = 0;
+	}
+
+private:
+	void thread_main ()
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+
+		while (true) {
+			this->work_condition.wait(lock, [this] () -> bool {
+				return !this->running || (this->next_job < this->n_jobs);
+			});
+
+			if (!this->running)
+				return;
+
+			const uint32_t i = this->next_job++;
+			const Job& current_job = *this->job;
+
+			lock.unlock();
+			current_job(i);
+			lock.lock();
+
+			if (--this->n_unfinished == 0)
+				this->done_condition.notify_one();
+		}
+	}
+};
+
+static ParticleWorkers particle_workers;
+
+// ---------------------------------------------------
+
+ParticleSystem2D::ParticleSystem2D (const Config& config_)
+	: TransformComponent2D(),
+	  config(config_)
+{
+	const uint32_t n = this->config.max_particles;
+
+	this->particles.x.resize(n);
+	this->particles.y.resize(n);
+	this->particles.vx.resize(n);
+	this->particles.vy.resize(n);
+	this->particles.rotation.resize(n);
+	this->particles.angular_velocity.resize(n);
+	this->particles.age.resize(n);
+	this->particles.inv_lifetime.resize(n);
+}
+
+void ParticleSystem2D::emit (const uint32_t n)
+{
+	const uint32_t capacity = static_cast<uint32_t>(this->particles.x.size());
+	const uint32_t begin = this->n_alive;
+	const uint32_t end = std::min(begin + n, capacity);
+
+	if (begin == end)
+		return;
+
+	const Vector3 origin = this->get_global_transform() * Vector3(0.0f, 0.0f, 1.0f);
+	const Config& cfg = this->config;
+
+	std::uniform_real_distribution<float> dist_vx(cfg.velocity_min.x, cfg.velocity_max.x);
+	std::uniform_real_distribution<float> dist_vy(cfg.velocity_min.y, cfg.velocity_max.y);
+	std::uniform_real_distribution<float> dist_angular(cfg.angular_velocity_min, cfg.angular_velocity_max);
+	std::uniform_real_distribution<float> dist_lifetime(cfg.lifetime_min, cfg.lifetime_max);
+
+	Particles& p = this->particles;
+
+	for (uint32_t i = begin; i < end; i++) {
+		p.x[i] = origin.x;
+		p.y[i] = origin.y;
+		p.vx[i] = dist_vx(random_generator);
+		p.vy[i] = dist_vy(random_generator);
+		p.rotation[i] = 0.0f;
+		p.angular_velocity[i] = dist_angular(random_generator);
+		p.age[i] = 0.0f;
+		p.inv_lifetime[i] = 1.0f / std::max(dist_lifetime(random_generator), 0.0001f);
 	}
 
-	vertices[Rect2DVertexPositionIndex::RightBottom].tex_coords = Vector3(desc->tex_coords[TextureVertexPositionIndex::RightBottom].x, desc->tex_coords[TextureVertexPositionIndex::RightBottom].y, desc->atlas->texture_depth);
-	vertices[Rect2DVertexPositionIndex::RightTop].tex_coords = Vector3(desc->tex_coords[TextureVertexPositionIndex::RightTop].x, desc->tex_coords[TextureVertexPositionIndex::RightTop].y, desc->atlas->texture_depth);
-	vertices[Rect2DVertexPositionIndex::LeftTop].tex_coords = Vector3(desc->tex_coords[TextureVertexPositionIndex::LeftTop].x, desc->tex_coords[TextureVertexPositionIndex::LeftTop].y, desc->atlas->texture_depth);
-	vertices[Rect2DVertexPositionIndex::RightBottomAgain].tex_coords = Vector3(desc->tex_coords[TextureVertexPositionIndex::RightBottom].x, desc->tex_coords[TextureVertexPositionIndex::RightBottom].y, desc->atlas->texture_depth);
-	vertices[Rect2DVertexPositionIndex::LeftTopAgain].tex_coords = Vector3(desc->tex_coords[TextureVertexPositionIndex::LeftTop].x, desc->tex_coords[TextureVertexPositionIndex::LeftTop].y, desc->atlas->texture_depth);
-	vertices[Rect2DVertexPositionIndex::LeftBottom].tex_coords = Vector3(desc->tex_coords[TextureVertexPositionIndex::LeftBottom].x, desc->tex_coords[TextureVertexPositionIndex::LeftBottom].y, desc->atlas->texture_depth);
+	this->n_alive = end;
+}
+
+/*
+	Each loop works on a single attribute array with no branches,
+	so the compiler can turn them into SIMD instructions.
+*/
+void ParticleSystem2D::integrate (const uint32_t begin, const uint32_t end, const float dt) noexcept
+{
+	Particles& p = this->particles;
+	const float ax = this->config.acceleration.x * dt;
+	const float ay = this->config.acceleration.y * dt;
+
+	float *__restrict x = p.x.data();
+	float *__restrict y = p.y.data();
+	float *__restrict vx = p.vx.data();
+	float *__restrict vy = p.vy.data();
+	float *__restrict rotation = p.rotation.data();
+	const float *__restrict angular_velocity = p.angular_velocity.data();
+	float *__restrict age = p.age.data();
+	const float *__restrict inv_lifetime = p.inv_lifetime.data();
+
+	for (uint32_t i = begin; i < end; i++)
+		vx[i] += ax;
+
+	for (uint32_t i = begin; i < end; i++)
+		vy[i] += ay;
+
+	for (uint32_t i = begin; i < end; i++)
+		x[i] += vx[i] * dt;
+
+	for (uint32_t i = begin; i < end; i++)
+		y[i] += vy[i] * dt;
+
+	for (uint32_t i = begin; i < end; i++)
+		rotation[i] += angular_velocity[i] * dt;
+
+	// age is normalized, from 0 (born) to 1 (dead)
+	for (uint32_t i = begin; i < end; i++)
+		age[i] += inv_lifetime[i] * dt;
+}
+
+void ParticleSystem2D::remove_dead ()
+{
+	Particles& p = this->particles;
+	uint32_t i = 0;
+
+	// swap the dead particle with the last alive one
+
+	while (i < this->n_alive) {
+		if (p.age[i] < 1.0f) {
+			i++;
+			continue;
+		}
+
+		const uint32_t last = --this->n_alive;
+
+		p.x[i] = p.x[last];
+		p.y[i] = p.y[last];
+		p.vx[i] = p.vx[last];
+		p.vy[i] = p.vy[last];
+		p.rotation[i] = p.rotation[last];
+		p.angular_velocity[i] = p.angular_velocity[last];
+		p.age[i] = p.age[last];
+		p.inv_lifetime[i] = p.inv_lifetime[last];
+	}
+}
+
+void ParticleSystem2D::process_update (const float dt)
+{
+	const uint32_t n = this->n_alive;
+	const uint32_t n_threads = std::clamp(this->config.n_threads, 1u, std::max(n / 1024u, 1u));
+
+	if (n_threads == 1)
+		this->integrate(0, n, dt);
+	else {
+		const uint32_t chunk = (n + n_threads - 1) / n_threads;
+
+		particle_workers.run(n_threads, [this, chunk, n, dt] (const uint32_t t) -> void {
+			const uint32_t begin = std::min(t * chunk, n);
+			const uint32_t end = std::min(begin + chunk, n);
+			this->integrate(begin, end, dt);
+		});
+	}
+
+	this->remove_dead();
+
+	if (this->emitting) {
+		this->emission_accumulator += this->config.emission_rate * dt;
+		const uint32_t n_new = static_cast<uint32_t>(this->emission_accumulator);
+		this->emission_accumulator -= static_cast<float>(n_new);
+		this->emit(n_new);
+	}
+}
+
+void ParticleSystem2D::process_render (const float dt)
+{
+	if (this->n_alive == 0)
+		return;
+
+	auto *renderer = static_cast<Graphics::Opengl::Renderer*>(Game::renderer);
+	auto& program = *renderer->get_program_quad_instanced();
+
+	const Particles& p = this->particles;
+	const Config& cfg = this->config;
+
+	Graphics::Vector4f tex_rect(0.0f, 0.0f, 0.0f, 0.0f);
+	float tex_depth = -1.0f;
+	const Opengl_TextureDescriptor *trimmed_desc = nullptr;
+
+	if (cfg.texture.info != nullptr) {
+		using TextureVertexPositionIndex = Graphics::Enums::TextureVertexPositionIndex;
+		const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(cfg.texture.info->data);
+		mylib_assert_msg(!desc->indexed, "indexed textures can only be drawn by draw_rect2D")
+		mylib_assert_msg(desc->texture_id == 0, "render targets can only be drawn by draw_rect2D")
+
+		// y axis goes up in game coords, so the (-x,-y) corner is the left bottom of the texture
+		tex_rect = Graphics::Vector4f(desc->tex_coords[TextureVertexPositionIndex::LeftBottom].x, desc->tex_coords[TextureVertexPositionIndex::LeftBottom].y,
+		                   desc->tex_coords[TextureVertexPositionIndex::RightTop].x, desc->tex_coords[TextureVertexPositionIndex::RightTop].y);
+		tex_depth = desc->atlas->texture_depth;
+
+		if (desc->trimmed)
+			trimmed_desc = desc;
+	}
+
+	auto instances = program.alloc_instances(this->n_alive);
+
+	for (uint32_t i = 0; i < this->n_alive; i++) {
+		auto& q = instances[i];
+		const float t = p.age[i];
+
+		q.set_transform(Graphics::Point3f(p.x[i], p.y[i], this->z), cfg.size_begin + (cfg.size_end - cfg.size_begin) * t, p.rotation[i]);
+
+		if (trimmed_desc != nullptr)
+			trim_quad_instance(q, trimmed_desc);
+		q.color = cfg.color_begin + (cfg.color_end - cfg.color_begin) * t;
+		q.tex_rect = tex_rect;
+		q.tex_depth = tex_depth;
+	}
 }
 
 // ---------------------------------------------------
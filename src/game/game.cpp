@@ -27,7 +27,11 @@ void Scene2D::setup_render ()
 // ---------------------------------------------------
 
 Main::Main (const InitConfig& config_, Scene *scene_)
-	: config(config_), scene(scene_)
+	: config(config_), scene(scene_),
+	  dynamic_resolution_controller({
+		.target_dt = config_.target_dt,
+		.min_scale = config_.min_render_scale
+	  })
 {
 	this->state = State::Initializing;
 
@@ -43,6 +47,9 @@ Main::Main (const InitConfig& config_, Scene *scene_)
 	audio_manager = &game_lib->get_audio_manager();
 	renderer = &game_lib->get_graphics_manager();
 
+	if (this->config.dynamic_resolution)
+		renderer->set_upscale_sharpness(this->config.upscale_sharpness);
+
 	std::random_device rd;
 	random_generator.seed( rd() );
 
@@ -159,6 +166,14 @@ void Main::run ()
 		elapsed = trequired - tbegin;
 		required_dt = ClockDuration_to_float(elapsed);
 
+		if (this->config.dynamic_resolution) {
+			// Without the gpu time, we fall back to the cpu time of the frame.
+			// It includes waiting for the gpu in update_screen, but also the game logic,
+			// which the resolution doesn't change.
+			const float gpu_dt = renderer->get_gpu_frame_dt();
+			renderer->set_render_scale( this->dynamic_resolution_controller.update((gpu_dt >= 0.0f) ? gpu_dt : required_dt) );
+		}
+
 		if (this->config.sleep_to_save_cpu) {
 			if (required_dt < this->config.sleep_threshold) {
 				sleep_dt = this->config.sleep_threshold - required_dt; // target sleep time
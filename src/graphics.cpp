@@ -1,6 +1,8 @@
 #include <ostream>
 #include <array>
 #include <utility>
+#include <algorithm>
+#include <limits>
 
 #include <SDL_image.h>
 
@@ -156,20 +158,26 @@ void Cube3D::calculate_vertices () noexcept
 		mount(p3, normal);
 	};
 
-	// p1 and p2 should be a diagonal of the rectangle
+	/*
+		p1 and p2 should be a diagonal of the rectangle.
+		(p1, p2, p3) must be counter-clockwise when seen from outside the cube,
+		i.e., from the direction the normal points to.
+		The second triangle is (p2, p1, p4), which keeps the same winding.
+		Any change here must be reflected in Opengl::Renderer::draw_cube3D.
+	*/
 	auto mount_surface = [&mount_triangle] (const VertexPositionIndex p1, const VertexPositionIndex p2, const VertexPositionIndex p3, const VertexPositionIndex p4, const Vector& normal) -> void {
 		mount_triangle(p1, p2, p3, normal);
-		mount_triangle(p1, p2, p4, normal);
+		mount_triangle(p2, p1, p4, normal);
 	};
 
 	// bottom
-	mount_surface(LeftBottomFront, RightBottomBack, RightBottomFront, LeftBottomBack, Vector(0, -1, 0));
+	mount_surface(LeftBottomFront, RightBottomBack, LeftBottomBack, RightBottomFront, Vector(0, -1, 0));
 
 	// top
 	mount_surface(LeftTopFront, RightTopBack, RightTopFront, LeftTopBack, Vector(0, 1, 0));
 
 	// front
-	mount_surface(LeftTopFront, RightBottomFront, RightTopFront, LeftBottomFront, Vector(0, 0, -1));
+	mount_surface(LeftTopFront, RightBottomFront, LeftBottomFront, RightTopFront, Vector(0, 0, -1));
 
 	// back
 	mount_surface(LeftTopBack, RightBottomBack, RightTopBack, LeftBottomBack, Vector(0, 0, 1));
@@ -178,7 +186,7 @@ void Cube3D::calculate_vertices () noexcept
 	mount_surface(LeftTopFront, LeftBottomBack, LeftTopBack, LeftBottomFront, Vector(-1, 0, 0));
 
 	// right
-	mount_surface(RightTopFront, RightBottomBack, RightTopBack, RightBottomFront, Vector(1, 0, 0));
+	mount_surface(RightTopFront, RightBottomBack, RightBottomFront, RightTopBack, Vector(1, 0, 0));
 
 	this->force_recalculate_rotation();
 }
@@ -382,6 +390,13 @@ void Rect2D::calculate_vertices () noexcept
 	const fp_t half_h = this->size.y * fp(0.5) * this->scale.y;
 	constexpr fp_t z = 0;
 
+	/*
+		Both triangles are counter-clockwise when seen from the
+		direction of the normal (0, 0, -1).
+		Any change here must be reflected in the renderers that
+		assign texture coordinates per vertex.
+	*/
+
 	// draw first triangle
 
 	// upper left vertex
@@ -389,13 +404,13 @@ void Rect2D::calculate_vertices () noexcept
 	this->vertices[0].pos.y = -half_h;
 	this->vertices[0].pos.z = z;
 
-	// down right vertex
-	this->vertices[1].pos.x = half_w;
+	// down left vertex
+	this->vertices[1].pos.x = -half_w;
 	this->vertices[1].pos.y = half_h;
 	this->vertices[1].pos.z = z;
 
-	// down left vertex
-	this->vertices[2].pos.x = -half_w;
+	// down right vertex
+	this->vertices[2].pos.x = half_w;
 	this->vertices[2].pos.y = half_h;
 	this->vertices[2].pos.z = z;
 
@@ -406,14 +421,14 @@ void Rect2D::calculate_vertices () noexcept
 	this->vertices[3].pos.y = -half_h;
 	this->vertices[3].pos.z = z;
 
-	// upper right vertex
+	// down right vertex
 	this->vertices[4].pos.x = half_w;
-	this->vertices[4].pos.y = -half_h;
+	this->vertices[4].pos.y = half_h;
 	this->vertices[4].pos.z = z;
 
-	// down right vertex
+	// upper right vertex
 	this->vertices[5].pos.x = half_w;
-	this->vertices[5].pos.y = half_h;
+	this->vertices[5].pos.y = -half_h;
 	this->vertices[5].pos.z = z;
 
 	for (auto& v : this->vertices)
@@ -535,6 +550,127 @@ TextureInfo& Manager::add_texture (std::string id, const TextureInfo& texture__)
 
 // ---------------------------------------------------
 
+void Manager::draw_lines3D (const std::span<const Line3DInstance> lines)
+{
+	for (const Line3DInstance& instance : lines) {
+		Line3D line(instance.to - instance.from);
+		this->draw_line3D(line, instance.from, instance.color);
+	}
+}
+
+void Manager::draw_cubes3D (const std::span<const Cube3DInstance> cubes)
+{
+	for (const Cube3DInstance& instance : cubes) {
+		Cube3D cube(instance.size.x, instance.size.y, instance.size.z);
+		this->draw_cube3D(cube, instance.pos, instance.color);
+	}
+}
+
+void Manager::draw_rects2D (const std::span<const Rect2DInstance> rects)
+{
+	for (const Rect2DInstance& instance : rects) {
+		Rect2D rect(instance.size);
+		rect.rotate(instance.rotation);
+		this->draw_rect2D(rect, instance.pos, instance.color);
+	}
+}
+
+// ---------------------------------------------------
+
+CachedLayer2D& Manager::create_cached_layer2D (const uint32_t width_px, const uint32_t height_px, const Vector2& margin, CachedLayer2D::DrawFunction draw_function)
+{
+	CachedLayer2D& layer = this->cached_layers.emplace_back(margin, std::move(draw_function));
+
+	layer.texture_info = this->create_render_target__(width_px, height_px);
+	layer.texture_info.id = "cached_layer_" + std::to_string(this->cached_layers.size() - 1);
+
+	return layer;
+}
+
+// ---------------------------------------------------
+
+void Manager::draw_cached_layer2D (CachedLayer2D& layer, const RenderArgs2D& args, const fp_t z)
+{
+	// find the visible area of the world, the same way the backends do in setup_render_2D
+
+	const Vector2 clip_size = args.clip_end_norm - args.clip_init_norm;
+	const fp_t clip_aspect_ratio = clip_size.x / clip_size.y;
+	const Vector2 world_size = args.world_end - args.world_init;
+
+	const fp_t world_screen_width = std::min(args.world_screen_width, world_size.x);
+	const fp_t world_screen_height = std::min(world_screen_width / clip_aspect_ratio, world_size.y);
+	const Vector2 world_screen_size = Vector2(world_screen_width, world_screen_height);
+
+	Vector2 world_camera = args.world_camera_focus - Vector2(world_screen_size.x*fp(0.5), world_screen_size.y*fp(0.5));
+
+	if (args.force_camera_inside_world) {
+		world_camera.x = std::clamp(world_camera.x, args.world_init.x, args.world_end.x - world_screen_size.x);
+		world_camera.y = std::clamp(world_camera.y, args.world_init.y, args.world_end.y - world_screen_size.y);
+	}
+
+	const Vector2 layer_size = world_screen_size + layer.margin * fp(2);
+
+	// we only render the layer again if the visible area left the cached region,
+	// or if the zoom changed
+
+	const bool inside = world_camera.x >= layer.world_init.x
+		&& world_camera.y >= layer.world_init.y
+		&& (world_camera.x + world_screen_size.x) <= (layer.world_init.x + layer.world_size.x)
+		&& (world_camera.y + world_screen_size.y) <= (layer.world_init.y + layer.world_size.y);
+
+	if (!layer.valid || !inside || layer.world_size.x != layer_size.x || layer.world_size.y != layer_size.y) {
+		layer.world_init = world_camera - layer.margin;
+		layer.world_size = layer_size;
+
+		this->begin_render_to_texture__(layer.texture_info, layer.world_init, layer.world_size);
+		layer.draw_function(*this);
+		this->end_render_to_texture__(layer.texture_info);
+
+		layer.valid = true;
+	}
+
+	Rect2D rect(layer.world_size);
+	const Vector2 center = layer.world_init + layer.world_size * fp(0.5);
+
+	this->draw_rect2D(rect, Vector(center.x, center.y, z), TextureRenderOptions { .desc = layer.get_texture() });
+}
+
+// ---------------------------------------------------
+
+fp_t DynamicResolutionController::update (const fp_t frame_dt)
+{
+	constexpr fp_t smooth_factor = 0.2;
+
+	if (this->smoothed_dt == fp(0))
+		this->smoothed_dt = frame_dt;
+	else
+		this->smoothed_dt += (frame_dt - this->smoothed_dt) * smooth_factor;
+
+	if (this->smoothed_dt > this->config.target_dt) {
+		// The cost is roughly proportional to the number of pixels,
+		// which is proportional to the square of the scale.
+		this->scale *= std::sqrt(this->config.target_dt / this->smoothed_dt);
+		this->frames_under_budget = 0;
+
+		// wait for the new scale to show up in the measurements
+		this->smoothed_dt = this->config.target_dt;
+	}
+	else if (this->smoothed_dt < (this->config.target_dt * this->config.headroom)) {
+		if (++this->frames_under_budget >= this->config.frames_to_increase) {
+			this->scale += this->config.increase_step;
+			this->frames_under_budget = 0;
+		}
+	}
+	else
+		this->frames_under_budget = 0;
+
+	this->scale = std::clamp(this->scale, this->config.min_scale, this->config.max_scale);
+
+	return this->scale;
+}
+
+// ---------------------------------------------------
+
 TextureDescriptor Manager::load_texture (std::string id, SDL_Surface *surface)
 {
 	TextureInfo texture__ = this->load_texture__(surface);
@@ -562,6 +698,21 @@ TextureDescriptor Manager::load_texture (std::string id, const std::string_view
 
 // ---------------------------------------------------
 
+TextureDescriptor Manager::load_texture_async (std::string id, const std::string_view fname, const TextureDescriptor& fallback, TextureLoadedCallback callback)
+{
+	TextureInfo& texture = this->add_texture(std::move(id), *fallback.info);
+
+	texture.fname = fname;
+
+	this->load_texture_async__(texture, fname, std::move(callback));
+
+	return TextureDescriptor {
+		.info = &texture,
+	};
+}
+
+// ---------------------------------------------------
+
 std::string Manager::find_unused_texture_id ()
 {
 	std::string id;
@@ -651,6 +802,112 @@ TextureDescriptor Manager::find_texture_by_fname (const std::string_view fname)
 
 // ---------------------------------------------------
 
+TextureSetDescriptor Manager::create_texture_set (std::string id, const std::span<const TextureDescriptor> variants)
+{
+	mylib_assert(!variants.empty())
+
+	auto [it, inserted] = this->texture_sets.emplace(id, TextureSetInfo {
+		.variants = std::vector<TextureDescriptor>(variants.begin(), variants.end()),
+		.id = id
+	});
+
+	mylib_assert_msg(inserted, "texture set ", id, " already exists")
+
+	TextureSetInfo& set = it->second;
+
+	std::sort(set.variants.begin(), set.variants.end(),
+		[] (const TextureDescriptor& a, const TextureDescriptor& b) -> bool {
+			return std::max(a.info->width_px, a.info->height_px) > std::max(b.info->width_px, b.info->height_px);
+		});
+
+	return TextureSetDescriptor { .info = &set };
+}
+
+// ---------------------------------------------------
+
+TextureSetDescriptor Manager::find_texture_set_by_id (const std::string_view id)
+{
+	auto it = this->texture_sets.find(id);
+	mylib_assert_exception_args(it != this->texture_sets.end(), TextureNotFoundException, id)
+	return TextureSetDescriptor { .info = &it->second };
+}
+
+// ---------------------------------------------------
+
+void Manager::update_texture_lod_camera (const RenderArgs3D& args)
+{
+	this->texture_lod_camera.pos = args.world_camera_pos;
+
+	if (std::holds_alternative<PerspectiveProjectionInfo>(args.projection)) {
+		const PerspectiveProjectionInfo& perspective_info = std::get<PerspectiveProjectionInfo>(args.projection);
+
+		this->texture_lod_camera.px_per_unit = static_cast<fp_t>(this->window_height_px) / (fp(2) * std::tan(perspective_info.fov_y * fp(0.5)));
+		this->texture_lod_camera.perspective = true;
+	}
+	else {
+		const OrthogonalProjectionInfo& orthogonal_info = std::get<OrthogonalProjectionInfo>(args.projection);
+
+		this->texture_lod_camera.px_per_unit = static_cast<fp_t>(this->window_width_px) / orthogonal_info.view_width;
+		this->texture_lod_camera.perspective = false;
+	}
+}
+
+void Manager::update_texture_lod_camera (const RenderArgs2D& args)
+{
+	const fp_t max_value = static_cast<fp_t>( std::max(this->window_width_px, this->window_height_px) );
+	const fp_t clip_width_px = (args.clip_end_norm.x - args.clip_init_norm.x) * max_value;
+	const fp_t world_screen_width = std::min(args.world_screen_width, args.world_end.x - args.world_init.x);
+
+	this->texture_lod_camera.pos = Point::zero();
+	this->texture_lod_camera.px_per_unit = clip_width_px / world_screen_width;
+	this->texture_lod_camera.perspective = false;
+}
+
+// ---------------------------------------------------
+
+fp_t Manager::calculate_projected_size_px (const Point& pos, const fp_t world_size) const
+{
+	if (!this->texture_lod_camera.perspective)
+		return world_size * this->texture_lod_camera.px_per_unit;
+
+	const Vector d = pos - this->texture_lod_camera.pos;
+	const fp_t distance = std::sqrt(d.x*d.x + d.y*d.y + d.z*d.z);
+
+	// the camera is inside the object
+	if (distance <= world_size)
+		return std::numeric_limits<fp_t>::max();
+
+	return world_size * this->texture_lod_camera.px_per_unit / distance;
+}
+
+// ---------------------------------------------------
+
+const TextureInfo& Manager::select_texture (const TextureRenderOptions& texture_options, const Point& pos, const fp_t world_size)
+{
+	TextureSetInfo *set = texture_options.set.info;
+
+	if (set == nullptr)
+		return *texture_options.desc.info;
+
+	const fp_t size_px = this->calculate_projected_size_px(pos, world_size) * set->lod_bias;
+	uint32_t selected = 0;
+
+	// smallest variant that still covers the projected size
+
+	for (uint32_t i = 1; i < set->variants.size(); i++) {
+		const TextureInfo& variant = *set->variants[i].info;
+
+		if (static_cast<fp_t>(std::max(variant.width_px, variant.height_px)) < size_px)
+			break;
+
+		selected = i;
+	}
+
+	return *set->variants[selected].info;
+}
+
+// ---------------------------------------------------
+
 LightPointDescriptor Manager::add_light_point_source (const Point& pos, const Color& color)
 {
 	for (uint32_t id = 0; auto& light_source : this->light_point_sources) {
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include <cmath>
+
+#include <SDL_image.h>
+
+#include <my-game-lib/heightfield.h>
+#include <my-game-lib/debug.h>
+#include <my-game-lib/exception.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+static bool box_inside_frustum (const std::array<Vector4f, 6>& planes, const Vector& box_min, const Vector& box_max) noexcept
+{
+	for (const Vector4f& plane : planes) {
+		// corner of the box that is furthest along the normal of the plane
+		const fp_t x = (plane.x >= 0) ? box_max.x : box_min.x;
+		const fp_t y = (plane.y >= 0) ? box_max.y : box_min.y;
+		const fp_t z = (plane.z >= 0) ? box_max.z : box_min.z;
+
+		if ((plane.x * x + plane.y * y + plane.z * z + plane.w) < 0)
+			return false;
+	}
+
+	return true;
+}
+
+static fp_t box_distance (const Point& pos, const Vector& box_min, const Vector& box_max) noexcept
+{
+	const fp_t dx = std::max({ box_min.x - pos.x, fp(0), pos.x - box_max.x });
+	const fp_t dy = std::max({ box_min.y - pos.y, fp(0), pos.y - box_max.y });
+	const fp_t dz = std::max({ box_min.z - pos.z, fp(0), pos.z - box_max.z });
+
+	return std::sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+// ---------------------------------------------------
+
+Heightfield3D::Heightfield3D (Manager& manager_, const std::string_view fname, const fp_t cell_size_, const fp_t height_scale)
+	: manager(manager_),
+	  cell_size(cell_size_),
+	  texture()
+{
+	SDL_Surface *surface = IMG_Load(fname.data());
+	mylib_assert_exception_args(surface != nullptr, UnableToLoadTextureException, fname)
+
+	// RGBA32 has the same byte order on any endianness, so red is always the first byte
+	SDL_Surface *rgba_surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+	SDL_FreeSurface(surface);
+	mylib_assert_msg(rgba_surface != nullptr, "error converting surface format", '\n', SDL_GetError())
+
+	this->size_x = rgba_surface->w;
+	this->size_z = rgba_surface->h;
+	this->heights.resize(this->size_x * this->size_z);
+
+	const uint8_t *pixels = static_cast<const uint8_t*>(rgba_surface->pixels);
+
+	for (uint32_t z = 0; z < this->size_z; z++) {
+		const uint8_t *row = pixels + z * rgba_surface->pitch;
+
+		for (uint32_t x = 0; x < this->size_x; x++)
+			this->heights[this->get_sample_index(x, z)] = static_cast<float>(row[x * 4]) * (height_scale / fp(255));
+	}
+
+	SDL_FreeSurface(rgba_surface);
+
+	this->build_nodes();
+	this->manager.create_heightfield(*this);
+}
+
+Heightfield3D::Heightfield3D (Manager& manager_, std::vector<float> heights_, const uint32_t size_x_, const uint32_t size_z_, const fp_t cell_size_)
+	: manager(manager_),
+	  size_x(size_x_),
+	  size_z(size_z_),
+	  cell_size(cell_size_),
+	  texture(),
+	  heights(std::move(heights_))
+{
+	mylib_assert(this->heights.size() == (this->size_x * this->size_z))
+
+	this->build_nodes();
+	this->manager.create_heightfield(*this);
+}
+
+Heightfield3D::~Heightfield3D ()
+{
+	this->manager.destroy_heightfield(*this);
+}
+
+// ---------------------------------------------------
+
+void Heightfield3D::set_height (const uint32_t x, const uint32_t z, const float height)
+{
+	mylib_assert(x < this->size_x && z < this->size_z)
+
+	this->heights[this->get_sample_index(x, z)] = height;
+	this->version++;
+	this->bounds_dirty = true;
+}
+
+fp_t Heightfield3D::get_height_at (const fp_t x, const fp_t z) const noexcept
+{
+	const fp_t fx = std::clamp(x / this->cell_size, fp(0), static_cast<fp_t>(this->size_x - 1));
+	const fp_t fz = std::clamp(z / this->cell_size, fp(0), static_cast<fp_t>(this->size_z - 1));
+
+	const uint32_t x0 = std::min(static_cast<uint32_t>(fx), this->size_x - 2);
+	const uint32_t z0 = std::min(static_cast<uint32_t>(fz), this->size_z - 2);
+
+	const fp_t tx = fx - static_cast<fp_t>(x0);
+	const fp_t tz = fz - static_cast<fp_t>(z0);
+
+	const fp_t h0 = std::lerp(this->get_height(x0, z0), this->get_height(x0 + 1, z0), tx);
+	const fp_t h1 = std::lerp(this->get_height(x0, z0 + 1), this->get_height(x0 + 1, z0 + 1), tx);
+
+	return std::lerp(h0, h1, tz);
+}
+
+// ---------------------------------------------------
+
+void Heightfield3D::set_lod_distance (const fp_t lod_distance_)
+{
+	mylib_assert(lod_distance_ > 0)
+
+	this->lod_distance = lod_distance_;
+
+	this->lod_ranges.resize(this->n_levels);
+
+	for (uint32_t level = 0; level < this->n_levels; level++)
+		this->lod_ranges[level] = this->lod_distance * static_cast<fp_t>(1 << level);
+}
+
+// ---------------------------------------------------
+
+void Heightfield3D::build_nodes ()
+{
+	mylib_assert(this->size_x >= 2 && this->size_z >= 2)
+	mylib_assert(this->cell_size > 0)
+
+	const uint32_t n_cells = std::max(this->size_x, this->size_z) - 1;
+
+	// the root must cover all the cells
+	this->n_levels = 1;
+
+	while ((patch_size << (this->n_levels - 1)) < n_cells)
+		this->n_levels++;
+
+	this->nodes.clear();
+	this->build_node(0, 0, this->n_levels - 1);
+	this->calculate_bounds(0);
+
+	/*
+		The parent of a node must be fully unmorphed where it touches the node,
+		otherwise there are cracks between them.
+		This holds when the range of a level is a few times bigger than
+		the size of the nodes of the next level.
+	*/
+	this->set_lod_distance(fp(4) * static_cast<fp_t>(patch_size) * this->cell_size);
+}
+
+uint32_t Heightfield3D::build_node (const uint32_t x, const uint32_t z, const uint32_t level)
+{
+	const uint32_t node_index = this->nodes.size();
+	const uint32_t size = patch_size << level;
+
+	this->nodes.push_back( Node {
+		.x = x,
+		.z = z,
+		.size = size,
+		.level = level,
+		.min_height = 0,
+		.max_height = 0,
+		.children = { 0, 0, 0, 0 }
+	} );
+
+	if (level == 0)
+		return node_index;
+
+	const uint32_t half = size / 2;
+	const std::array<std::pair<uint32_t, uint32_t>, 4> children_pos = {
+		std::make_pair(x, z),
+		std::make_pair(x + half, z),
+		std::make_pair(x, z + half),
+		std::make_pair(x + half, z + half)
+	};
+
+	for (uint32_t i = 0; const auto& [child_x, child_z] : children_pos) {
+		// push_back may move the nodes, so we can't keep a reference to the parent
+		if (child_x < (this->size_x - 1) && child_z < (this->size_z - 1)) {
+			const uint32_t child_index = this->build_node(child_x, child_z, level - 1);
+			this->nodes[node_index].children[i] = child_index;
+		}
+
+		i++;
+	}
+
+	return node_index;
+}
+
+void Heightfield3D::calculate_bounds (const uint32_t node_index)
+{
+	Node& node = this->nodes[node_index];
+
+	node.min_height = std::numeric_limits<fp_t>::max();
+	node.max_height = std::numeric_limits<fp_t>::lowest();
+
+	if (node.level == 0) {
+		const uint32_t x_end = std::min(node.x + node.size, this->size_x - 1);
+		const uint32_t z_end = std::min(node.z + node.size, this->size_z - 1);
+
+		for (uint32_t z = node.z; z <= z_end; z++) {
+			for (uint32_t x = node.x; x <= x_end; x++) {
+				const fp_t height = this->get_height(x, z);
+
+				node.min_height = std::min(node.min_height, height);
+				node.max_height = std::max(node.max_height, height);
+			}
+		}
+
+		return;
+	}
+
+	for (const uint32_t child_index : node.children) {
+		if (child_index == 0)
+			continue;
+
+		this->calculate_bounds(child_index);
+
+		const Node& child = this->nodes[child_index];
+
+		node.min_height = std::min(node.min_height, child.min_height);
+		node.max_height = std::max(node.max_height, child.max_height);
+	}
+}
+
+bool Heightfield3D::update_bounds ()
+{
+	if (!this->bounds_dirty)
+		return false;
+
+	this->calculate_bounds(0);
+	this->bounds_dirty = false;
+
+	return true;
+}
+
+// ---------------------------------------------------
+
+void Heightfield3D::select_nodes (const Vector& offset, const Point& camera_pos, const std::span<const std::array<Vector4f, 6>> frustums_planes, std::vector<SelectedNode>& selection) const
+{
+	this->select_node(0, offset, camera_pos, frustums_planes, selection);
+}
+
+void Heightfield3D::select_node (const uint32_t node_index, const Vector& offset, const Point& camera_pos, const std::span<const std::array<Vector4f, 6>> frustums_planes, std::vector<SelectedNode>& selection) const
+{
+	const Node& node = this->nodes[node_index];
+
+	const Vector box_min(
+		offset.x + static_cast<fp_t>(node.x) * this->cell_size,
+		offset.y + node.min_height,
+		offset.z + static_cast<fp_t>(node.z) * this->cell_size
+	);
+
+	const Vector box_max(
+		offset.x + static_cast<fp_t>(std::min(node.x + node.size, this->size_x - 1)) * this->cell_size,
+		offset.y + node.max_height,
+		offset.z + static_cast<fp_t>(std::min(node.z + node.size, this->size_z - 1)) * this->cell_size
+	);
+
+	if (!frustums_planes.empty()) {
+		const bool visible = std::any_of(frustums_planes.begin(), frustums_planes.end(),
+			[&box_min, &box_max] (const std::array<Vector4f, 6>& planes) -> bool {
+				return box_inside_frustum(planes, box_min, box_max);
+			});
+
+		if (!visible)
+			return;
+	}
+
+	// the node is split while the camera is inside the range of its children
+
+	if (node.level > 0 && box_distance(camera_pos, box_min, box_max) < this->lod_ranges[node.level - 1]) {
+		for (const uint32_t child_index : node.children) {
+			if (child_index != 0)
+				this->select_node(child_index, offset, camera_pos, frustums_planes, selection);
+		}
+
+		return;
+	}
+
+	SelectedNode& selected = selection.emplace_back();
+
+	selected.node = &node;
+
+	if (node.level == (this->n_levels - 1)) {
+		// the root level has no parent to morph into
+		selected.morph_start = std::numeric_limits<float>::max() / fp(2);
+		selected.morph_end = std::numeric_limits<float>::max();
+	}
+	else {
+		const fp_t range_ini = (node.level > 0) ? this->lod_ranges[node.level - 1] : fp(0);
+		const fp_t range_end = this->lod_ranges[node.level];
+
+		selected.morph_start = range_ini + (range_end - range_ini) * morph_start_ratio;
+		selected.morph_end = range_end;
+	}
+}
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
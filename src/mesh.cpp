@@ -0,0 +1,643 @@
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <string>
+#include <charconv>
+#include <limits>
+#include <cmath>
+
+#include <my-game-lib/mesh.h>
+#include <my-game-lib/debug.h>
+#include <my-game-lib/exception.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+struct MeshFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t n_vertices;
+	uint32_t n_indices;
+};
+
+static_assert(sizeof(MeshFileHeader) == 20);
+
+static constexpr uint32_t mesh_file_version = 1;
+static constexpr uint32_t mesh_file_flag_tex_coords = 1 << 0;
+
+// ---------------------------------------------------
+
+static Vector cross_product (const Vector& a, const Vector& b) noexcept
+{
+	return Vector(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+}
+
+static Vector normalize (const Vector& v) noexcept
+{
+	const fp_t length = std::sqrt(v.x*v.x + v.y*v.y + v.z*v.z);
+
+	if (length > fp(0))
+		return Vector(v.x / length, v.y / length, v.z / length);
+	return v;
+}
+
+// ---------------------------------------------------
+
+MeshData load_mesh (const std::string_view fname)
+{
+	std::ifstream file(std::string(fname), std::ios::binary);
+
+	mylib_assert_exception_msg_args(file.is_open(), UnableToLoadMeshException, "Unable to open file.", fname)
+
+	MeshFileHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	mylib_assert_exception_msg_args(file.good() && std::equal(header.magic, header.magic + 4, "MGLM"), UnableToLoadMeshException, "Not a mesh file.", fname)
+	mylib_assert_exception_msg_args(header.version == mesh_file_version, UnableToLoadMeshException, "Unsupported mesh file version.", fname)
+
+	// the counts come from the file, so we check them against its size before allocating anything
+
+	const std::streampos data_begin = file.tellg();
+	file.seekg(0, std::ios::end);
+	const size_t remaining_bytes = static_cast<size_t>(file.tellg() - data_begin);
+	file.seekg(data_begin);
+
+	const size_t n = header.n_vertices;
+	const size_t n_indices = header.n_indices;
+	const size_t n_floats_per_vertex = (header.flags & mesh_file_flag_tex_coords) ? 8 : 6;
+	const size_t vertices_bytes = n * n_floats_per_vertex * sizeof(float);
+	const size_t indices_bytes = n_indices * sizeof(uint32_t);
+
+	mylib_assert_exception_msg_args(vertices_bytes <= remaining_bytes && indices_bytes <= (remaining_bytes - vertices_bytes), UnableToLoadMeshException, "Mesh file is truncated.", fname)
+	mylib_assert_exception_msg_args((n_indices % 3) == 0, UnableToLoadMeshException, "Number of indices is not a multiple of 3.", fname)
+
+	std::vector<float> positions(n * 3);
+	std::vector<float> normals(n * 3);
+	std::vector<float> tex_coords;
+	MeshData mesh;
+
+	file.read(reinterpret_cast<char*>(positions.data()), positions.size() * sizeof(float));
+	file.read(reinterpret_cast<char*>(normals.data()), normals.size() * sizeof(float));
+
+	if (header.flags & mesh_file_flag_tex_coords) {
+		tex_coords.resize(n * 2);
+		file.read(reinterpret_cast<char*>(tex_coords.data()), tex_coords.size() * sizeof(float));
+	}
+
+	mesh.indices.resize(n_indices);
+	file.read(reinterpret_cast<char*>(mesh.indices.data()), indices_bytes);
+
+	mylib_assert_exception_msg_args(file.good(), UnableToLoadMeshException, "Mesh file is truncated.", fname)
+	mylib_assert_exception_msg_args(std::all_of(mesh.indices.begin(), mesh.indices.end(), [n] (const uint32_t i) -> bool { return i < n; }), UnableToLoadMeshException, "Index out of range.", fname)
+
+	mesh.vertices.resize(n);
+
+	for (size_t i = 0; i < n; i++) {
+		mesh.vertices[i].pos = Point(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]);
+		mesh.vertices[i].normal = Vector(normals[i*3], normals[i*3 + 1], normals[i*3 + 2]);
+	}
+
+	if (!tex_coords.empty()) {
+		mesh.tex_coords.resize(n);
+
+		for (size_t i = 0; i < n; i++)
+			mesh.tex_coords[i] = Vector2f(tex_coords[i*2], tex_coords[i*2 + 1]);
+	}
+
+	dprintln("mesh ", fname, " loaded with ", n, " vertices and ", mesh.indices.size() / 3, " triangles");
+
+	return mesh;
+}
+
+// ---------------------------------------------------
+
+void save_mesh (const std::string_view fname, const MeshData& mesh)
+{
+	std::ofstream file(std::string(fname), std::ios::binary);
+
+	mylib_assert_exception_args(file.is_open(), FileException, fname)
+
+	const size_t n = mesh.vertices.size();
+
+	mylib_assert(mesh.tex_coords.empty() || mesh.tex_coords.size() == n)
+	mylib_assert(n <= std::numeric_limits<uint32_t>::max() && mesh.indices.size() <= std::numeric_limits<uint32_t>::max())
+
+	const MeshFileHeader header = {
+		.magic = { 'M', 'G', 'L', 'M' },
+		.version = mesh_file_version,
+		.flags = mesh.tex_coords.empty() ? 0 : mesh_file_flag_tex_coords,
+		.n_vertices = static_cast<uint32_t>(n),
+		.n_indices = static_cast<uint32_t>(mesh.indices.size())
+	};
+
+	std::vector<float> positions(n * 3);
+	std::vector<float> normals(n * 3);
+	std::vector<float> tex_coords(mesh.tex_coords.size() * 2);
+
+	for (size_t i = 0; i < n; i++) {
+		const Vertex& v = mesh.vertices[i];
+
+		positions[i*3] = v.pos.x;
+		positions[i*3 + 1] = v.pos.y;
+		positions[i*3 + 2] = v.pos.z;
+		normals[i*3] = v.normal.x;
+		normals[i*3 + 1] = v.normal.y;
+		normals[i*3 + 2] = v.normal.z;
+	}
+
+	for (size_t i = 0; i < mesh.tex_coords.size(); i++) {
+		tex_coords[i*2] = mesh.tex_coords[i].x;
+		tex_coords[i*2 + 1] = mesh.tex_coords[i].y;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(positions.data()), positions.size() * sizeof(float));
+	file.write(reinterpret_cast<const char*>(normals.data()), normals.size() * sizeof(float));
+	file.write(reinterpret_cast<const char*>(tex_coords.data()), tex_coords.size() * sizeof(float));
+	file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+
+	mylib_assert_exception_args(file.good(), FileException, fname)
+}
+
+// ---------------------------------------------------
+
+/*
+	OBJ indices start at 1, and negative indices are relative
+	to the end of the list.
+	Returns -1 if the index is missing.
+*/
+
+static int64_t parse_obj_index (const std::string_view str, const size_t list_size)
+{
+	if (str.empty())
+		return -1;
+
+	int64_t i = 0;
+	const auto [ptr, error] = std::from_chars(str.data(), str.data() + str.size(), i);
+
+	if (error != std::errc() || i == 0)
+		return -2;
+
+	if (i < 0)
+		i += static_cast<int64_t>(list_size);
+	else
+		i -= 1;
+
+	if (i < 0 || i >= static_cast<int64_t>(list_size))
+		return -2;
+
+	return i;
+}
+
+// ---------------------------------------------------
+
+MeshData import_obj_mesh (const std::string_view fname)
+{
+	std::ifstream file { std::string(fname) };
+
+	mylib_assert_exception_msg_args(file.is_open(), UnableToLoadMeshException, "Unable to open file.", fname)
+
+	std::vector<Point> positions;
+	std::vector<Vector> normals;
+	std::vector<Vector2f> obj_tex_coords;
+	MeshData mesh;
+	bool any_tex_coords = false;
+
+	struct Corner {
+		int64_t pos;
+		int64_t tex_coord;
+		int64_t normal;
+	};
+
+	std::vector<Corner> corners;
+	std::string line;
+
+	auto next_token = [] (std::string_view& str) -> std::string_view {
+		const size_t begin = str.find_first_not_of(" \t\r");
+
+		if (begin == std::string_view::npos) {
+			str = std::string_view();
+			return str;
+		}
+
+		const size_t end = std::min(str.find_first_of(" \t\r", begin), str.size());
+		const std::string_view token = str.substr(begin, end - begin);
+
+		str.remove_prefix(end);
+
+		return token;
+	};
+
+	auto parse_floats = [&next_token] (std::string_view& str, float *values, const uint32_t n) -> void {
+		for (uint32_t i = 0; i < n; i++) {
+			const std::string_view token = next_token(str);
+			values[i] = 0;
+			std::from_chars(token.data(), token.data() + token.size(), values[i]);
+		}
+	};
+
+	while (std::getline(file, line)) {
+		std::string_view str = line;
+		const std::string_view keyword = next_token(str);
+
+		if (keyword == "v") {
+			float v[3];
+			parse_floats(str, v, 3);
+			positions.push_back( Point(v[0], v[1], v[2]) );
+		}
+		else if (keyword == "vn") {
+			float v[3];
+			parse_floats(str, v, 3);
+			normals.push_back( normalize(Vector(v[0], v[1], v[2])) );
+		}
+		else if (keyword == "vt") {
+			float v[2];
+			parse_floats(str, v, 2);
+			obj_tex_coords.push_back( Vector2f(v[0], 1 - v[1]) ); // OBJ has (0, 0) at the left bottom
+		}
+		else if (keyword == "f") {
+			corners.clear();
+
+			for (std::string_view token = next_token(str); !token.empty(); token = next_token(str)) {
+				// v, v/vt, v//vn or v/vt/vn
+
+				const size_t slash1 = token.find('/');
+				const size_t slash2 = (slash1 == std::string_view::npos) ? std::string_view::npos : token.find('/', slash1 + 1);
+
+				const std::string_view pos_str = token.substr(0, slash1);
+				const std::string_view tex_str = (slash1 == std::string_view::npos) ? std::string_view() : token.substr(slash1 + 1, slash2 - slash1 - 1);
+				const std::string_view normal_str = (slash2 == std::string_view::npos) ? std::string_view() : token.substr(slash2 + 1);
+
+				const Corner corner = {
+					.pos = parse_obj_index(pos_str, positions.size()),
+					.tex_coord = parse_obj_index(tex_str, obj_tex_coords.size()),
+					.normal = parse_obj_index(normal_str, normals.size())
+				};
+
+				mylib_assert_exception_msg_args(corner.pos >= 0 && corner.tex_coord >= -1 && corner.normal >= -1, UnableToLoadMeshException, "Invalid face index.", fname)
+
+				corners.push_back(corner);
+			}
+
+			mylib_assert_exception_msg_args(corners.size() >= 3, UnableToLoadMeshException, "Face with less than 3 vertices.", fname)
+
+			// fan triangulation
+
+			for (uint32_t i = 1; (i + 1) < corners.size(); i++) {
+				const std::array<const Corner*, 3> triangle = { &corners[0], &corners[i], &corners[i + 1] };
+
+				const Vector flat_normal = normalize(cross_product(
+					positions[triangle[1]->pos] - positions[triangle[0]->pos],
+					positions[triangle[2]->pos] - positions[triangle[0]->pos]));
+
+				for (const Corner *corner : triangle) {
+					Vertex v;
+					v.pos = positions[corner->pos];
+					v.normal = (corner->normal >= 0) ? normals[corner->normal] : flat_normal;
+
+					mesh.indices.push_back(mesh.vertices.size());
+					mesh.vertices.push_back(v);
+
+					if (corner->tex_coord >= 0) {
+						mesh.tex_coords.push_back(obj_tex_coords[corner->tex_coord]);
+						any_tex_coords = true;
+					}
+					else
+						mesh.tex_coords.push_back(Vector2f(0, 0));
+				}
+			}
+		}
+	}
+
+	if (!any_tex_coords)
+		mesh.tex_coords.clear();
+
+	dprintln("obj ", fname, " imported with ", mesh.indices.size() / 3, " triangles");
+
+	optimize_mesh(mesh);
+
+	return mesh;
+}
+
+// ---------------------------------------------------
+
+static void deduplicate_vertices (MeshData& mesh)
+{
+	const uint32_t n = mesh.vertices.size();
+	const bool has_tex_coords = !mesh.tex_coords.empty();
+
+	auto key = [&mesh, has_tex_coords] (const uint32_t i) -> std::array<fp_t, 8> {
+		const Vertex& v = mesh.vertices[i];
+		const Vector2f tex = has_tex_coords ? mesh.tex_coords[i] : Vector2f(0, 0);
+
+		return { v.pos.x, v.pos.y, v.pos.z, v.normal.x, v.normal.y, v.normal.z, tex.x, tex.y };
+	};
+
+	std::vector<uint32_t> order(n);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&key] (const uint32_t a, const uint32_t b) -> bool {
+		return key(a) < key(b);
+	});
+
+	std::vector<uint32_t> remap(n);
+	std::vector<Vertex> vertices;
+	std::vector<Vector2f> tex_coords;
+
+	for (uint32_t i = 0; i < n; i++) {
+		if (i == 0 || key(order[i]) != key(order[i - 1])) {
+			vertices.push_back(mesh.vertices[order[i]]);
+
+			if (has_tex_coords)
+				tex_coords.push_back(mesh.tex_coords[order[i]]);
+		}
+
+		remap[order[i]] = vertices.size() - 1;
+	}
+
+	for (uint32_t& index : mesh.indices)
+		index = remap[index];
+
+	mesh.vertices = std::move(vertices);
+	mesh.tex_coords = std::move(tex_coords);
+}
+
+// ---------------------------------------------------
+
+/*
+	Tipsify, from Sander, Nehab and Barczak,
+	"Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (2007).
+	Fans around a vertex, and then moves to the vertex that is still
+	in the cache and has the most triangles to emit.
+	The index of the first triangle of each cluster (a new fan started
+	from a dead end) is stored in clusters.
+*/
+
+static std::vector<uint32_t> tipsify (const MeshData& mesh, const uint32_t cache_size, std::vector<uint32_t>& clusters)
+{
+	const uint32_t n_vertices = mesh.vertices.size();
+	const uint32_t n_triangles = mesh.indices.size() / 3;
+
+	// triangles of each vertex
+
+	std::vector<uint32_t> live(n_vertices, 0);
+
+	for (const uint32_t index : mesh.indices)
+		live[index]++;
+
+	std::vector<uint32_t> adjacency_offset(n_vertices + 1, 0);
+
+	for (uint32_t v = 0; v < n_vertices; v++)
+		adjacency_offset[v + 1] = adjacency_offset[v] + live[v];
+
+	std::vector<uint32_t> adjacency(mesh.indices.size());
+	std::vector<uint32_t> fill = adjacency_offset;
+
+	for (uint32_t t = 0; t < n_triangles; t++) {
+		for (uint32_t k = 0; k < 3; k++)
+			adjacency[ fill[ mesh.indices[t*3 + k] ]++ ] = t;
+	}
+
+	std::vector<uint32_t> cache_time(n_vertices, 0);
+	std::vector<bool> emitted(n_triangles, false);
+	std::vector<uint32_t> dead_end;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> indices;
+
+	indices.reserve(mesh.indices.size());
+
+	uint32_t time = cache_size + 1;
+	uint32_t cursor = 0;
+	int64_t fanning = (n_vertices > 0) ? 0 : -1;
+	bool new_cluster = true;
+
+	while (fanning >= 0) {
+		candidates.clear();
+
+		for (uint32_t a = adjacency_offset[fanning]; a < adjacency_offset[fanning + 1]; a++) {
+			const uint32_t t = adjacency[a];
+
+			if (emitted[t])
+				continue;
+
+			if (new_cluster) {
+				clusters.push_back(indices.size() / 3);
+				new_cluster = false;
+			}
+
+			for (uint32_t k = 0; k < 3; k++) {
+				const uint32_t v = mesh.indices[t*3 + k];
+
+				indices.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+
+				if ((time - cache_time[v]) > cache_size) {
+					cache_time[v] = time;
+					time++;
+				}
+			}
+
+			emitted[t] = true;
+		}
+
+		// next vertex: the one that will stay longer in the cache
+
+		fanning = -1;
+		int64_t best_priority = -1;
+
+		for (const uint32_t v : candidates) {
+			if (live[v] == 0)
+				continue;
+
+			int64_t priority = 0;
+
+			if ((time - cache_time[v]) + 2*live[v] <= cache_size)
+				priority = time - cache_time[v];
+
+			if (priority > best_priority) {
+				best_priority = priority;
+				fanning = v;
+			}
+		}
+
+		if (fanning >= 0)
+			continue;
+
+		// dead end: go back to recent vertices, or to the next vertex in the input order
+
+		new_cluster = true;
+
+		while (!dead_end.empty()) {
+			const uint32_t v = dead_end.back();
+			dead_end.pop_back();
+
+			if (live[v] > 0) {
+				fanning = v;
+				break;
+			}
+		}
+
+		while (fanning < 0 && cursor < n_vertices) {
+			if (live[cursor] > 0)
+				fanning = cursor;
+			cursor++;
+		}
+	}
+
+	return indices;
+}
+
+// ---------------------------------------------------
+
+/*
+	Clusters facing outwards are drawn first, since they are more
+	likely to occlude the others.
+	Simplified version of the overdraw step of the Tipsify paper:
+	clusters are not split further.
+*/
+
+static void sort_clusters_for_overdraw (MeshData& mesh, const std::vector<uint32_t>& clusters)
+{
+	const uint32_t n_triangles = mesh.indices.size() / 3;
+	const uint32_t n_clusters = clusters.size();
+
+	if (n_clusters <= 1)
+		return;
+
+	Point mesh_center = Point::zero();
+
+	for (const Vertex& v : mesh.vertices)
+		mesh_center = mesh_center + v.pos;
+
+	mesh_center = mesh_center * (fp(1) / static_cast<fp_t>(mesh.vertices.size()));
+
+	std::vector<fp_t> sort_keys(n_clusters);
+
+	for (uint32_t c = 0; c < n_clusters; c++) {
+		const uint32_t begin = clusters[c];
+		const uint32_t end = (c + 1 < n_clusters) ? clusters[c + 1] : n_triangles;
+		Point center = Point::zero();
+		Vector normal = Vector::zero();
+
+		for (uint32_t t = begin; t < end; t++) {
+			const Point& p0 = mesh.vertices[ mesh.indices[t*3] ].pos;
+			const Point& p1 = mesh.vertices[ mesh.indices[t*3 + 1] ].pos;
+			const Point& p2 = mesh.vertices[ mesh.indices[t*3 + 2] ].pos;
+
+			center = center + p0 + p1 + p2;
+			normal = normal + cross_product(p1 - p0, p2 - p0); // weighted by the area
+		}
+
+		center = center * (fp(1) / static_cast<fp_t>((end - begin) * 3));
+
+		const Vector d = center - mesh_center;
+
+		sort_keys[c] = d.x*normal.x + d.y*normal.y + d.z*normal.z;
+	}
+
+	std::vector<uint32_t> order(n_clusters);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sort_keys] (const uint32_t a, const uint32_t b) -> bool {
+		return sort_keys[a] > sort_keys[b];
+	});
+
+	std::vector<uint32_t> indices;
+	indices.reserve(mesh.indices.size());
+
+	for (const uint32_t c : order) {
+		const uint32_t begin = clusters[c];
+		const uint32_t end = (c + 1 < n_clusters) ? clusters[c + 1] : n_triangles;
+
+		indices.insert(indices.end(), mesh.indices.begin() + begin*3, mesh.indices.begin() + end*3);
+	}
+
+	mesh.indices = std::move(indices);
+}
+
+// ---------------------------------------------------
+
+static void sort_vertices_for_fetch (MeshData& mesh)
+{
+	constexpr uint32_t unused = std::numeric_limits<uint32_t>::max();
+
+	const bool has_tex_coords = !mesh.tex_coords.empty();
+	std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+	std::vector<Vertex> vertices;
+	std::vector<Vector2f> tex_coords;
+
+	vertices.reserve(mesh.vertices.size());
+
+	// vertices not used by any triangle are dropped
+
+	for (uint32_t& index : mesh.indices) {
+		if (remap[index] == unused) {
+			remap[index] = vertices.size();
+			vertices.push_back(mesh.vertices[index]);
+
+			if (has_tex_coords)
+				tex_coords.push_back(mesh.tex_coords[index]);
+		}
+
+		index = remap[index];
+	}
+
+	mesh.vertices = std::move(vertices);
+	mesh.tex_coords = std::move(tex_coords);
+}
+
+// ---------------------------------------------------
+
+void optimize_mesh (MeshData& mesh, const uint32_t vertex_cache_size)
+{
+	mylib_assert((mesh.indices.size() % 3) == 0)
+	mylib_assert(mesh.tex_coords.empty() || mesh.tex_coords.size() == mesh.vertices.size())
+
+	const uint32_t n_vertices_before = mesh.vertices.size();
+
+	deduplicate_vertices(mesh);
+
+	std::vector<uint32_t> clusters;
+	mesh.indices = tipsify(mesh, vertex_cache_size, clusters);
+
+	sort_clusters_for_overdraw(mesh, clusters);
+	sort_vertices_for_fetch(mesh);
+
+	dprintln("mesh optimized from ", n_vertices_before, " to ", mesh.vertices.size(), " vertices, ", clusters.size(), " clusters");
+}
+
+// ---------------------------------------------------
+
+void Mesh3D::calculate_vertices ()
+{
+	const Vector& scale = this->scale;
+
+	this->vertices.resize(this->data.vertices.size());
+	this->rotated_vertices.resize(this->data.vertices.size());
+	this->radius = 0;
+
+	for (uint32_t i = 0; i < this->vertices.size(); i++) {
+		const Vertex& v = this->data.vertices[i];
+		const Point& p = this->vertices[i].pos = Point(v.pos.x * scale.x, v.pos.y * scale.y, v.pos.z * scale.z);
+
+		this->radius = std::max(this->radius, std::sqrt(p.x*p.x + p.y*p.y + p.z*p.z));
+
+		// normals use the inverse scale
+		this->vertices[i].normal = normalize(Vector(v.normal.x / scale.x, v.normal.y / scale.y, v.normal.z / scale.z));
+	}
+
+	this->set_vertices_buffer(this->vertices, this->rotated_vertices);
+	this->force_recalculate_rotation();
+}
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
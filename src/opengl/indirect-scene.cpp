@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cmath>
+
+#include <my-lib/math.h>
+
+#include <my-game-lib/debug.h>
+#include <my-game-lib/opengl/opengl.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+namespace Opengl
+{
+
+// ---------------------------------------------------
+
+static inline bool sphere_inside_frustum (const std::array<Vector4f, 6>& planes, const Vector4f& pos_radius) noexcept
+{
+	for (const Vector4f& plane : planes) {
+		const float distance = plane.x * pos_radius.x + plane.y * pos_radius.y + plane.z * pos_radius.z + plane.w;
+
+		if (distance < -pos_radius.w)
+			return false;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------
+
+IndirectMeshScene::IndirectMeshScene (const bool gpu_driven_)
+	: gpu_driven(gpu_driven_)
+{
+#ifndef __ANDROID__
+	if (this->gpu_driven) {
+		this->program_cull = new ProgramCullObjects;
+		this->program_mesh = new ProgramMeshIndirect;
+
+		glGenBuffers(1, &this->mesh_vbo);
+		glGenBuffers(1, &this->objects_ssbo);
+		glGenBuffers(1, &this->commands_buffer);
+		glGenBuffers(1, &this->visible_buffer);
+		ensure_no_error();
+
+		this->program_mesh->setup_vertex_arrays(this->mesh_vbo, this->visible_buffer);
+	}
+#else
+	this->gpu_driven = false;
+#endif
+
+	dprintln("indirect mesh scene created, gpu driven: ", this->gpu_driven);
+}
+
+IndirectMeshScene::~IndirectMeshScene ()
+{
+#ifndef __ANDROID__
+	if (this->gpu_driven) {
+		state_cache.delete_buffers(1, &this->mesh_vbo);
+		state_cache.delete_buffers(1, &this->objects_ssbo);
+		state_cache.delete_buffers(1, &this->commands_buffer);
+		state_cache.delete_buffers(1, &this->visible_buffer);
+
+		delete this->program_cull;
+		delete this->program_mesh;
+	}
+#endif
+}
+
+// ---------------------------------------------------
+
+uint32_t IndirectMeshScene::register_mesh (const std::span<const Graphics::Vertex> vertices)
+{
+	const uint32_t mesh_id = this->meshes.size();
+	float radius = 0;
+
+	this->meshes.push_back( Mesh {
+		.first_vertex = static_cast<uint32_t>(this->mesh_vertices.size()),
+		.n_vertices = static_cast<uint32_t>(vertices.size()),
+		.radius = 0,
+		.n_objects = 0
+	} );
+
+	for (const Graphics::Vertex& v : vertices) {
+		this->mesh_vertices.push_back( MeshVertex {
+			.pos = v.pos,
+			.normal = v.normal
+		} );
+
+		radius = std::max(radius, std::sqrt(v.pos.x*v.pos.x + v.pos.y*v.pos.y + v.pos.z*v.pos.z));
+	}
+
+	this->meshes.back().radius = radius;
+	this->meshes_dirty = true;
+	this->commands_dirty = true;
+
+	return mesh_id;
+}
+
+// ---------------------------------------------------
+
+uint32_t IndirectMeshScene::add_object (const uint32_t mesh_id, const Point& pos, const Color& color)
+{
+	mylib_assert(mesh_id < this->meshes.size())
+
+	const uint32_t object_id = this->objects.size();
+	Mesh& mesh = this->meshes[mesh_id];
+
+	this->objects.push_back( Object {
+		.pos_radius = Vector4f(pos.x, pos.y, pos.z, mesh.radius),
+		.color = color,
+		.mesh_id = mesh_id,
+		.padding__ = { 0, 0, 0 }
+	} );
+
+	mesh.n_objects++;
+
+	this->mark_dirty(object_id);
+	this->commands_dirty = true;
+
+	return object_id;
+}
+
+void IndirectMeshScene::update_object (const uint32_t object_id, const Point& pos, const Color& color)
+{
+	Object& object = this->objects[object_id];
+
+	object.pos_radius.x = pos.x;
+	object.pos_radius.y = pos.y;
+	object.pos_radius.z = pos.z;
+	object.color = color;
+
+	this->mark_dirty(object_id);
+}
+
+void IndirectMeshScene::clear_objects ()
+{
+	this->objects.clear();
+
+	for (Mesh& mesh : this->meshes)
+		mesh.n_objects = 0;
+
+	this->dirty_begin = 0;
+	this->dirty_end = 0;
+	this->commands_dirty = true;
+}
+
+// ---------------------------------------------------
+
+void IndirectMeshScene::cpu_cull (ProgramTriangleColor& program, const std::span<const std::array<Vector4f, 6>> frustums_planes)
+{
+	for (const Object& object : this->objects) {
+		const bool visible = std::any_of(frustums_planes.begin(), frustums_planes.end(),
+			[&object] (const std::array<Vector4f, 6>& planes) -> bool {
+				return sphere_inside_frustum(planes, object.pos_radius);
+			});
+
+		if (!visible)
+			continue;
+
+		const Mesh& mesh = this->meshes[object.mesh_id];
+		const Vector offset(object.pos_radius.x, object.pos_radius.y, object.pos_radius.z);
+		std::span<ProgramTriangleColor::Vertex> vertices = program.alloc_vertices(mesh.n_vertices);
+
+		for (uint32_t i=0; i<mesh.n_vertices; i++) {
+			const MeshVertex& mv = this->mesh_vertices[mesh.first_vertex + i];
+
+			vertices[i].gvertex.pos = mv.pos;
+			vertices[i].gvertex.normal = mv.normal;
+			vertices[i].offset = offset;
+			vertices[i].color = object.color;
+		}
+	}
+
+	// nothing is uploaded in this path
+	this->dirty_begin = 0;
+	this->dirty_end = 0;
+}
+
+// ---------------------------------------------------
+
+void IndirectMeshScene::upload ()
+{
+#ifndef __ANDROID__
+	if (this->meshes_dirty) {
+		state_cache.bind_buffer(GL_ARRAY_BUFFER, this->mesh_vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(MeshVertex) * this->mesh_vertices.size(), this->mesh_vertices.data(), GL_STATIC_DRAW);
+		ensure_no_error();
+
+		this->meshes_dirty = false;
+	}
+
+	const uint32_t n_objects = this->objects.size();
+
+	if (n_objects > this->objects_gpu_capacity) {
+		// grow the buffers and upload everything
+
+		this->objects_gpu_capacity = std::max(n_objects, this->objects_gpu_capacity * 2);
+
+		state_cache.bind_buffer(GL_SHADER_STORAGE_BUFFER, this->objects_ssbo);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Object) * this->objects_gpu_capacity, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Object) * n_objects, this->objects.data());
+
+		state_cache.bind_buffer(GL_ARRAY_BUFFER, this->visible_buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * this->objects_gpu_capacity, nullptr, GL_DYNAMIC_COPY);
+		ensure_no_error();
+	}
+	else if (this->dirty_begin < this->dirty_end) {
+		// only the objects that changed
+
+		state_cache.bind_buffer(GL_SHADER_STORAGE_BUFFER, this->objects_ssbo);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+			sizeof(Object) * this->dirty_begin,
+			sizeof(Object) * (this->dirty_end - this->dirty_begin),
+			this->objects.data() + this->dirty_begin);
+		ensure_no_error();
+	}
+
+	this->dirty_begin = 0;
+	this->dirty_end = 0;
+
+	// each mesh owns a contiguous range of the visible buffer
+
+	if (this->commands_dirty) {
+		this->commands.resize(this->meshes.size());
+
+		for (uint32_t base_instance = 0, i = 0; const Mesh& mesh : this->meshes) {
+			this->commands[i] = DrawArraysIndirectCommand {
+				.count = mesh.n_vertices,
+				.instance_count = 0,
+				.first = mesh.first_vertex,
+				.base_instance = base_instance
+			};
+
+			base_instance += mesh.n_objects;
+			i++;
+		}
+
+		this->commands_dirty = false;
+	}
+
+	// instance_count must be zero before the compute shader runs,
+	// so we upload the commands every frame (they are small)
+
+	state_cache.bind_buffer(GL_DRAW_INDIRECT_BUFFER, this->commands_buffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawArraysIndirectCommand) * this->commands.size(), this->commands.data(), GL_DYNAMIC_DRAW);
+	ensure_no_error();
+#endif
+}
+
+// ---------------------------------------------------
+
+void IndirectMeshScene::gpu_cull_and_draw (const Uniforms& uniforms, const std::array<Vector4f, 6>& frustum_planes)
+{
+	mylib_assert(this->gpu_driven)
+
+#ifndef __ANDROID__
+	const uint32_t n_objects = this->objects.size();
+
+	if (n_objects == 0)
+		return;
+
+	this->upload();
+
+	state_cache.bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 0, this->objects_ssbo);
+	state_cache.bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 1, this->commands_buffer);
+	state_cache.bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 2, this->visible_buffer);
+	ensure_no_error();
+
+	this->program_cull->dispatch(frustum_planes, n_objects);
+
+	// the draw reads the commands and the visible instances written by the compute shader
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	ensure_no_error();
+
+	this->program_mesh->load();
+	this->program_mesh->upload_uniforms(uniforms);
+	this->program_mesh->draw(this->commands_buffer, this->commands.size());
+#endif
+}
+
+// ---------------------------------------------------
+
+} // end namespace Opengl
+} // end namespace Graphics
+} // end namespace MyGlib
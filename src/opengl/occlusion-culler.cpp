@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cmath>
+
+#include <my-game-lib/debug.h>
+#include <my-game-lib/opengl/opengl.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+namespace Opengl
+{
+
+// ---------------------------------------------------
+
+OcclusionCuller::OcclusionCuller ()
+{
+	this->program = new ProgramOcclusionBox;
+}
+
+OcclusionCuller::~OcclusionCuller ()
+{
+	for (const Occludee& occludee : this->occludees) {
+		if (occludee.in_use)
+			glDeleteQueries(1, &occludee.query);
+	}
+
+	delete this->program;
+}
+
+// ---------------------------------------------------
+
+OccludeeDescriptor OcclusionCuller::add_occludee (const uint64_t frame_number)
+{
+	OccludeeDescriptor desc;
+
+	if (this->free_descriptors.empty()) {
+		desc = this->occludees.size();
+		this->occludees.emplace_back();
+	}
+	else {
+		desc = this->free_descriptors.back();
+		this->free_descriptors.pop_back();
+	}
+
+	Occludee& occludee = this->occludees[desc];
+
+	// a new query object, so results of a removed occludee are never read
+	glGenQueries(1, &occludee.query);
+	ensure_no_error();
+
+	// new occludees are visible until a query says otherwise
+	occludee.center = Vector::zero();
+	occludee.half_size = Vector::zero();
+	occludee.last_visible_frame = frame_number;
+	occludee.query_pending = false;
+	occludee.in_use = true;
+
+	return desc;
+}
+
+void OcclusionCuller::remove_occludee (const OccludeeDescriptor desc)
+{
+	Occludee& occludee = this->occludees[desc];
+
+	mylib_assert(occludee.in_use)
+
+	glDeleteQueries(1, &occludee.query);
+	ensure_no_error();
+
+	occludee.in_use = false;
+
+	std::erase(this->to_query, desc);
+	this->free_descriptors.push_back(desc);
+}
+
+// ---------------------------------------------------
+
+bool OcclusionCuller::is_visible (const OccludeeDescriptor desc, const Vector& center, const Vector& half_size, const uint64_t frame_number)
+{
+	Occludee& occludee = this->occludees[desc];
+
+	mylib_assert(occludee.in_use)
+
+	if (occludee.query_pending) {
+		GLuint available = 0;
+		glGetQueryObjectuiv(occludee.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available) {
+			GLuint any_samples_passed;
+			glGetQueryObjectuiv(occludee.query, GL_QUERY_RESULT, &any_samples_passed);
+
+			if (any_samples_passed)
+				occludee.last_visible_frame = frame_number;
+
+			occludee.query_pending = false;
+		}
+	}
+
+	occludee.center = center;
+	occludee.half_size = half_size;
+
+	// may be tested more than once per frame
+	if (!occludee.query_pending && std::find(this->to_query.begin(), this->to_query.end(), desc) == this->to_query.end())
+		this->to_query.push_back(desc);
+
+	return (frame_number - occludee.last_visible_frame) <= this->visible_frames_hysteresis;
+}
+
+// ---------------------------------------------------
+
+void OcclusionCuller::issue_queries (const Matrix4& projection_matrix, const Vector4f& near_plane, const uint64_t frame_number)
+{
+	// boxes only touch the depth test, they must not show up or hide anything
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+
+	this->program->load();
+	this->program->upload_projection_matrix(projection_matrix);
+
+	for (const OccludeeDescriptor desc : this->to_query) {
+		Occludee& occludee = this->occludees[desc];
+
+		// If the box crosses the near plane, the camera may be inside it,
+		// and the box would be clipped away even though the object is visible.
+
+		const fp_t distance = near_plane.x * occludee.center.x + near_plane.y * occludee.center.y + near_plane.z * occludee.center.z + near_plane.w;
+		const fp_t extent = std::abs(near_plane.x) * occludee.half_size.x + std::abs(near_plane.y) * occludee.half_size.y + std::abs(near_plane.z) * occludee.half_size.z;
+
+		if (distance <= extent) {
+			occludee.last_visible_frame = frame_number;
+			continue;
+		}
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, occludee.query);
+		this->program->draw(occludee.center, occludee.half_size);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+		occludee.query_pending = true;
+	}
+
+	ensure_no_error();
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+
+	this->to_query.clear();
+}
+
+// ---------------------------------------------------
+
+} // end namespace Opengl
+} // end namespace Graphics
+} // end namespace MyGlib
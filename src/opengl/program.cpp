@@ -31,9 +31,10 @@ void ensure_no_error ()
 
 // ---------------------------------------------------
 
-Shader::Shader (const GLenum shader_type_, const std::string_view fname_)
+Shader::Shader (const GLenum shader_type_, const std::string_view fname_, const std::string_view defines_)
 : shader_type(shader_type_),
-  fname(fname_)
+  fname(fname_),
+  defines(defines_)
 {
 	this->shader_id = glCreateShader(this->shader_type);
 	mylib_assert_msg(this->shader_id != 0, "\tglCreateShader failed");
@@ -80,7 +81,20 @@ void Shader::compile ()
 	//dprint( buffer )
 	
 	const char *c_str = buffer.data();
-	glShaderSource(this->shader_id, 1, ( const GLchar ** )&c_str, nullptr);
+	const char *after_version = strchr(c_str, '\n');
+
+	if (this->defines.empty() || after_version == nullptr)
+		glShaderSource(this->shader_id, 1, ( const GLchar ** )&c_str, nullptr);
+	else {
+		// #version must be the first line, so the defines go right after it
+		after_version++;
+
+		const GLchar *sources[3] = { c_str, this->defines.data(), after_version };
+		const GLint lengths[3] = { static_cast<GLint>(after_version - c_str), static_cast<GLint>(this->defines.size()), -1 };
+
+		glShaderSource(this->shader_id, 3, sources, lengths);
+	}
+
 	ensure_no_error();
 	glCompileShader(this->shader_id);
 
@@ -104,6 +118,7 @@ Program::Program ()
 {
 	this->vs = nullptr;
 	this->fs = nullptr;
+	this->cs = nullptr;
 	this->program_id = glCreateProgram();
 	mylib_assert_msg(this->program_id != 0, "\tglCreateProgram failed");
 }
@@ -114,16 +129,21 @@ Program::~Program ()
 		delete this->vs;
 	if (this->fs != nullptr)
 		delete this->fs;
+	if (this->cs != nullptr)
+		delete this->cs;
 	this->vs = nullptr;
 	this->fs = nullptr;
+	this->cs = nullptr;
 }
 
 void Program::attach_shaders ()
 {
-	glAttachShader(this->program_id, this->vs->get_shader_id());
-	ensure_no_error();
-	glAttachShader(this->program_id, this->fs->get_shader_id());
-	ensure_no_error();
+	for (Shader *shader : { this->vs, this->fs, this->cs }) {
+		if (shader != nullptr) {
+			glAttachShader(this->program_id, shader->get_shader_id());
+			ensure_no_error();
+		}
+	}
 }
 
 void Program::link_program ()
@@ -134,7 +154,9 @@ void Program::link_program ()
 
 void Program::use_program ()
 {
-	glUseProgram(this->program_id);
+	state_cache.use_program(this->program_id);
+	state_cache.set_capability(GL_CULL_FACE, this->cull_back_faces);
+
 	ensure_no_error();
 }
 
@@ -149,6 +171,80 @@ void Program::bind_attrib_location (const GLuint index, const std::string_view n
 {
 	glBindAttribLocation(this->program_id, index, name.data());
 	ensure_no_error();
+
+	// the variants compiled later need them too
+	this->attrib_locations.emplace_back(index, std::string(name));
+}
+
+void Program::select_variant (const VariantKey key)
+{
+	for (uint32_t i = 0; i < this->variants.size(); i++) {
+		if (this->variants[i].key == key) {
+			this->current_variant = i;
+			this->program_id = this->variants[i].program_id;
+			this->use_program();
+			return;
+		}
+	}
+
+	std::string defines;
+
+	if (key & Lit) {
+		defines += "#define LIT 1\n";
+		defines += "#define N_POINT_LIGHTS " + std::to_string(key >> 8) + "\n";
+	}
+
+	if (key & AlphaTest)
+		defines += "#define ALPHA_TEST 1\n";
+
+	if (key & TextureRotation)
+		defines += "#define TEXTURE_ROTATION 1\n";
+
+	if (key & RenderTarget)
+		defines += "#define RENDER_TARGET 1\n";
+
+	// keeps the line numbers of the compilation errors right
+	defines += "#line 2\n";
+
+	dprintln("compiling variant ", key, " of ", this->variant_vs_fname, " and ", this->variant_fs_fname);
+
+	// the first variant uses the program created by the constructor
+	if (!this->variants.empty()) {
+		this->program_id = glCreateProgram();
+		mylib_assert_msg(this->program_id != 0, "\tglCreateProgram failed");
+	}
+
+	Shader vs(GL_VERTEX_SHADER, this->variant_vs_fname, defines);
+	vs.compile();
+
+	Shader fs(GL_FRAGMENT_SHADER, this->variant_fs_fname, defines);
+	fs.compile();
+
+	glAttachShader(this->program_id, vs.get_shader_id());
+	glAttachShader(this->program_id, fs.get_shader_id());
+
+	for (const auto& [index, name] : this->attrib_locations)
+		glBindAttribLocation(this->program_id, index, name.data());
+
+	this->link_program();
+
+	// only released when the program is deleted
+	glDeleteShader(vs.get_shader_id());
+	glDeleteShader(fs.get_shader_id());
+
+	Variant variant = {
+		.key = key,
+		.program_id = this->program_id,
+		.uniform_locations = {}
+	};
+
+	for (const std::string& name : this->variant_uniforms)
+		variant.uniform_locations.push_back(glGetUniformLocation(this->program_id, name.data()));
+
+	this->current_variant = this->variants.size();
+	this->variants.push_back(std::move(variant));
+
+	this->use_program();
 }
 
 void Program::gen_vertex_arrays (const GLsizei n, GLuint *arrays)
@@ -165,13 +261,13 @@ void Program::gen_buffers (const GLsizei n, GLuint *buffers)
 
 void Program::bind_vertex_array (const GLuint array)
 {
-	glBindVertexArray(array);
+	state_cache.bind_vertex_array(array);
 	ensure_no_error();
 }
 
 void Program::bind_buffer (const GLenum target, const GLuint buffer)
 {
-	glBindBuffer(target, buffer);
+	state_cache.bind_buffer(target, buffer);
 	ensure_no_error();
 }
 
@@ -181,6 +277,12 @@ void Program::enable_vertex_attrib_array (const GLuint index)
 	ensure_no_error();
 }
 
+void Program::vertex_attrib_divisor (const GLuint index, const GLuint divisor)
+{
+	glVertexAttribDivisor(index, divisor);
+	ensure_no_error();
+}
+
 // ---------------------------------------------------
 
 ProgramTriangleColor::ProgramTriangleColor ()
@@ -194,29 +296,24 @@ ProgramTriangleColor::ProgramTriangleColor ()
 
 	dprintln("loading opengl triangle color program...");
 
-	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/triangles-color.vert");
-	this->vs->compile();
-
-	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/triangles-color.frag");
-	this->fs->compile();
-
-	this->attach_shaders();
+	this->variant_vs_fname = "shaders/triangles-color.vert";
+	this->variant_fs_fname = "shaders/triangles-color.frag";
 
 	this->bind_attrib_location(iPosition, "i_position");
 	this->bind_attrib_location(iNormal, "i_normal");
 	this->bind_attrib_location(iOffset, "i_offset");
 	this->bind_attrib_location(iColor, "i_color");
 
-	this->link_program();
+	this->setup_uniforms();
+	this->select_variant(make_variant_key(Lit, 1));
 
 	this->gen_vertex_arrays(1, &(this->vao));
 	this->gen_buffers(1, &(this->vbo));
+	this->gen_buffers(1, &(this->ebo));
 
-	this->use_program();
 	this->bind_vertex_arrays();
 	this->bind_vertex_buffers();
 	this->setup_vertex_arrays();
-	this->setup_uniforms();
 
 	dprintln("loaded opengl triangle color program");
 }
@@ -234,6 +331,7 @@ void ProgramTriangleColor::bind_vertex_arrays ()
 void ProgramTriangleColor::bind_vertex_buffers ()
 {
 	this->bind_buffer(GL_ARRAY_BUFFER, this->vbo);
+	this->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
 }
 
 void ProgramTriangleColor::setup_vertex_arrays ()
@@ -266,10 +364,13 @@ void ProgramTriangleColor::setup_vertex_arrays ()
 
 void ProgramTriangleColor::setup_uniforms ()
 {
-	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
-	this->u_ambient_light_color = this->get_uniform_location("u_ambient_light_color");
-	this->u_point_light_pos = this->get_uniform_location("u_point_light_pos");
-	this->u_point_light_color = this->get_uniform_location("u_point_light_color");
+	// in the order of UniformIndex, queried for each variant
+	this->variant_uniforms = {
+		"u_projection_matrix",
+		"u_ambient_light_color",
+		"u_point_light_pos",
+		"u_point_light_color"
+	};
 }
 
 void ProgramTriangleColor::upload_vertex_buffers ()
@@ -277,15 +378,28 @@ void ProgramTriangleColor::upload_vertex_buffers ()
 	const uint32_t n = this->triangle_buffer.get_vertex_buffer_used();
 	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * n, this->triangle_buffer.get_vertex_buffer(), GL_DYNAMIC_DRAW);
 
+	const uint32_t n_indices = this->index_buffer.get_vertex_buffer_used();
+
+	if (n_indices > 0)
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * n_indices, this->index_buffer.get_vertex_buffer(), GL_DYNAMIC_DRAW);
+
 	ensure_no_error();
 }
 
 void ProgramTriangleColor::upload_uniforms (const Uniforms& uniforms)
 {
-	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
-	glUniform4fv(this->u_ambient_light_color, 1, uniforms.ambient_light_color.get_raw());
-	glUniform3fv(this->u_point_light_pos, 1, uniforms.point_light_pos.get_raw());
-	glUniform4fv(this->u_point_light_color, 1, uniforms.point_light_color.get_raw());
+	this->select_variant(uniforms.lit ? make_variant_key(Lit, uniforms.n_point_lights) : 0);
+
+	glUniformMatrix4fv(this->get_variant_uniform_location(uProjectionMatrix), 1, GL_TRUE, uniforms.projection_matrix.get_raw());
+
+	if (uniforms.lit) {
+		glUniform4fv(this->get_variant_uniform_location(uAmbientLightColor), 1, uniforms.ambient_light_color.get_raw());
+
+		if (uniforms.n_point_lights > 0) {
+			glUniform3fv(this->get_variant_uniform_location(uPointLightPos), uniforms.n_point_lights, uniforms.point_light_pos[0].get_raw());
+			glUniform4fv(this->get_variant_uniform_location(uPointLightColor), uniforms.n_point_lights, uniforms.point_light_color[0].get_raw());
+		}
+	}
 
 	ensure_no_error();
 }
@@ -293,7 +407,12 @@ void ProgramTriangleColor::upload_uniforms (const Uniforms& uniforms)
 void ProgramTriangleColor::draw ()
 {
 	const uint32_t n = this->triangle_buffer.get_vertex_buffer_used();
-	glDrawArrays(GL_TRIANGLES, 0, n);
+	const uint32_t n_indices = this->index_buffer.get_vertex_buffer_used();
+
+	if (n_indices > 0)
+		glDrawElements(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, nullptr);
+	else
+		glDrawArrays(GL_TRIANGLES, 0, n);
 
 	ensure_no_error();
 }
@@ -433,8 +552,8 @@ void ProgramLineColor::upload_uniforms (const Uniforms& uniforms)
 {
 	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
 	glUniform4fv(this->u_ambient_light_color, 1, uniforms.ambient_light_color.get_raw());
-	//glUniform3fv(this->u_point_light_pos, 1, uniforms.point_light_pos.get_raw());
-	glUniform4fv(this->u_point_light_color, 1, uniforms.point_light_color.get_raw());
+	//glUniform3fv(this->u_point_light_pos, 1, uniforms.point_light_pos[0].get_raw());
+	glUniform4fv(this->u_point_light_color, 1, uniforms.point_light_color[0].get_raw());
 
 	ensure_no_error();
 }
@@ -481,8 +600,10 @@ void ProgramLineColor::debug ()
 
 // ---------------------------------------------------
 
-ProgramTriangleTexture::ProgramTriangleTexture ()
-	: Program ()
+ProgramTriangleTexture::ProgramTriangleTexture (const uint32_t base_features_, const GLint tx_unit_)
+	: Program (),
+	  base_features(base_features_),
+	  tx_unit(tx_unit_)
 {
 	static_assert(sizeof(Graphics::Vertex) == sizeof(Point) + sizeof(Vector));
 	static_assert(sizeof(Vector) == sizeof(fp_t) * 3);
@@ -492,29 +613,24 @@ ProgramTriangleTexture::ProgramTriangleTexture ()
 
 	dprintln("loading opengl triangle texture program...");
 
-	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/triangles-texture.vert");
-	this->vs->compile();
-
-	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/triangles-texture.frag");
-	this->fs->compile();
-
-	this->attach_shaders();
+	this->variant_vs_fname = "shaders/triangles-texture.vert";
+	this->variant_fs_fname = "shaders/triangles-texture.frag";
 
 	this->bind_attrib_location(iPosition, "i_position");
 	this->bind_attrib_location(iNormal, "i_normal");
 	this->bind_attrib_location(iOffset, "i_offset");
 	this->bind_attrib_location(iTexCoords, "i_tex_coord");
 
-	this->link_program();
+	this->setup_uniforms();
+	this->select_variant(make_variant_key(this->base_features | Lit | AlphaTest, 1));
 
 	this->gen_vertex_arrays(1, &(this->vao));
 	this->gen_buffers(1, &(this->vbo));
+	this->gen_buffers(1, &(this->ebo));
 
-	this->use_program();
 	this->bind_vertex_arrays();
 	this->bind_vertex_buffers();
 	this->setup_vertex_arrays();
-	this->setup_uniforms();
 
 	dprintln("loaded opengl triangle texture program");
 }
@@ -532,6 +648,7 @@ void ProgramTriangleTexture::bind_vertex_arrays ()
 void ProgramTriangleTexture::bind_vertex_buffers ()
 {
 	this->bind_buffer(GL_ARRAY_BUFFER, this->vbo);
+	this->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
 }
 
 void ProgramTriangleTexture::setup_vertex_arrays ()
@@ -564,11 +681,14 @@ void ProgramTriangleTexture::setup_vertex_arrays ()
 
 void ProgramTriangleTexture::setup_uniforms ()
 {
-	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
-	this->u_ambient_light_color = this->get_uniform_location("u_ambient_light_color");
-	this->u_point_light_pos = this->get_uniform_location("u_point_light_pos");
-	this->u_point_light_color = this->get_uniform_location("u_point_light_color");
-	this->u_tx_unit = this->get_uniform_location("u_tx_unit");
+	// in the order of UniformIndex, queried for each variant
+	this->variant_uniforms = {
+		"u_projection_matrix",
+		"u_ambient_light_color",
+		"u_point_light_pos",
+		"u_point_light_color",
+		"u_tx_unit"
+	};
 }
 
 void ProgramTriangleTexture::upload_vertex_buffers ()
@@ -576,16 +696,32 @@ void ProgramTriangleTexture::upload_vertex_buffers ()
 	const uint32_t n = this->triangle_buffer.get_vertex_buffer_used();
 	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * n, this->triangle_buffer.get_vertex_buffer(), GL_DYNAMIC_DRAW);
 
+	const uint32_t n_indices = this->index_buffer.get_vertex_buffer_used();
+
+	if (n_indices > 0)
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * n_indices, this->index_buffer.get_vertex_buffer(), GL_DYNAMIC_DRAW);
+
 	ensure_no_error();
 }
 
 void ProgramTriangleTexture::upload_uniforms (const Uniforms& uniforms)
 {
-	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
-	glUniform4fv(this->u_ambient_light_color, 1, uniforms.ambient_light_color.get_raw());
-	glUniform3fv(this->u_point_light_pos, 1, uniforms.point_light_pos.get_raw());
-	glUniform4fv(this->u_point_light_color, 1, uniforms.point_light_color.get_raw());
-	glUniform1i(this->u_tx_unit, 0); // set shader to use texture unit 0
+	const uint32_t features = this->base_features | (uniforms.alpha_test ? AlphaTest : 0);
+
+	this->select_variant(uniforms.lit ? make_variant_key(features | Lit, uniforms.n_point_lights) : make_variant_key(features, 0));
+
+	glUniformMatrix4fv(this->get_variant_uniform_location(uProjectionMatrix), 1, GL_TRUE, uniforms.projection_matrix.get_raw());
+
+	if (uniforms.lit) {
+		glUniform4fv(this->get_variant_uniform_location(uAmbientLightColor), 1, uniforms.ambient_light_color.get_raw());
+
+		if (uniforms.n_point_lights > 0) {
+			glUniform3fv(this->get_variant_uniform_location(uPointLightPos), uniforms.n_point_lights, uniforms.point_light_pos[0].get_raw());
+			glUniform4fv(this->get_variant_uniform_location(uPointLightColor), uniforms.n_point_lights, uniforms.point_light_color[0].get_raw());
+		}
+	}
+
+	glUniform1i(this->get_variant_uniform_location(uTxUnit), this->tx_unit);
 
 	ensure_no_error();
 }
@@ -593,7 +729,12 @@ void ProgramTriangleTexture::upload_uniforms (const Uniforms& uniforms)
 void ProgramTriangleTexture::draw ()
 {
 	const uint32_t n = this->triangle_buffer.get_vertex_buffer_used();
-	glDrawArrays(GL_TRIANGLES, 0, n);
+	const uint32_t n_indices = this->index_buffer.get_vertex_buffer_used();
+
+	if (n_indices > 0)
+		glDrawElements(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, nullptr);
+	else
+		glDrawArrays(GL_TRIANGLES, 0, n);
 
 	ensure_no_error();
 }
@@ -630,6 +771,52 @@ void ProgramTriangleTexture::debug ()
 
 // ---------------------------------------------------
 
+ProgramRenderTarget::ProgramRenderTarget ()
+	: ProgramTriangleTexture (RenderTarget, texture_unit)
+{
+
+}
+
+ProgramRenderTarget::~ProgramRenderTarget ()
+{
+
+}
+
+std::span<ProgramRenderTarget::Vertex> ProgramRenderTarget::alloc_vertices (const GLuint texture_id, const uint32_t n)
+{
+	const uint32_t first_vertex = this->triangle_buffer.get_vertex_buffer_used();
+
+	// consecutive quads of the same target share the draw call
+
+	if (!this->batches.empty() && this->batches.back().texture_id == texture_id)
+		this->batches.back().n_vertices += n;
+	else {
+		this->batches.push_back( Batch {
+			.texture_id = texture_id,
+			.first_vertex = first_vertex,
+			.n_vertices = n
+		} );
+	}
+
+	return this->triangle_buffer.alloc_vertices(n);
+}
+
+void ProgramRenderTarget::draw ()
+{
+	state_cache.active_texture(GL_TEXTURE0 + texture_unit);
+
+	for (const Batch& batch : this->batches) {
+		state_cache.bind_texture(GL_TEXTURE_2D, batch.texture_id);
+		glDrawArrays(GL_TRIANGLES, batch.first_vertex, batch.n_vertices);
+	}
+
+	state_cache.active_texture(GL_TEXTURE0);
+
+	ensure_no_error();
+}
+
+// ---------------------------------------------------
+
 ProgramTriangleTextureRotation::ProgramTriangleTextureRotation ()
 	: Program ()
 {
@@ -642,13 +829,9 @@ ProgramTriangleTextureRotation::ProgramTriangleTextureRotation ()
 
 	dprintln("loading opengl triangle texture rotation program...");
 
-	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/triangles-texture-rotation.vert");
-	this->vs->compile();
-
-	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/triangles-texture.frag");
-	this->fs->compile();
-
-	this->attach_shaders();
+	// same shaders of ProgramTriangleTexture, with the rotation enabled
+	this->variant_vs_fname = "shaders/triangles-texture.vert";
+	this->variant_fs_fname = "shaders/triangles-texture.frag";
 
 	this->bind_attrib_location(iPosition, "i_position");
 	this->bind_attrib_location(iNormal, "i_normal");
@@ -656,16 +839,15 @@ ProgramTriangleTextureRotation::ProgramTriangleTextureRotation ()
 	this->bind_attrib_location(iTexCoords, "i_tex_coord");
 	this->bind_attrib_location(iRotQuat, "i_rot_quat");
 
-	this->link_program();
+	this->setup_uniforms();
+	this->select_variant(make_variant_key(Lit | AlphaTest | TextureRotation, 1));
 
 	this->gen_vertex_arrays(1, &(this->vao));
 	this->gen_buffers(1, &(this->vbo));
 
-	this->use_program();
 	this->bind_vertex_arrays();
 	this->bind_vertex_buffers();
 	this->setup_vertex_arrays();
-	this->setup_uniforms();
 
 	dprintln("loaded opengl triangle texture rotation program");
 }
@@ -720,11 +902,14 @@ void ProgramTriangleTextureRotation::setup_vertex_arrays ()
 
 void ProgramTriangleTextureRotation::setup_uniforms ()
 {
-	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
-	this->u_ambient_light_color = this->get_uniform_location("u_ambient_light_color");
-	this->u_point_light_pos = this->get_uniform_location("u_point_light_pos");
-	this->u_point_light_color = this->get_uniform_location("u_point_light_color");
-	this->u_tx_unit = this->get_uniform_location("u_tx_unit");
+	// in the order of UniformIndex, queried for each variant
+	this->variant_uniforms = {
+		"u_projection_matrix",
+		"u_ambient_light_color",
+		"u_point_light_pos",
+		"u_point_light_color",
+		"u_tx_unit"
+	};
 }
 
 void ProgramTriangleTextureRotation::upload_vertex_buffers ()
@@ -737,11 +922,22 @@ void ProgramTriangleTextureRotation::upload_vertex_buffers ()
 
 void ProgramTriangleTextureRotation::upload_uniforms (const Uniforms& uniforms)
 {
-	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
-	glUniform4fv(this->u_ambient_light_color, 1, uniforms.ambient_light_color.get_raw());
-	glUniform3fv(this->u_point_light_pos, 1, uniforms.point_light_pos.get_raw());
-	glUniform4fv(this->u_point_light_color, 1, uniforms.point_light_color.get_raw());
-	glUniform1i(this->u_tx_unit, 0); // set shader to use texture unit 0
+	const uint32_t features = static_cast<uint32_t>(TextureRotation) | (uniforms.alpha_test ? AlphaTest : 0);
+
+	this->select_variant(uniforms.lit ? make_variant_key(features | Lit, uniforms.n_point_lights) : make_variant_key(features, 0));
+
+	glUniformMatrix4fv(this->get_variant_uniform_location(uProjectionMatrix), 1, GL_TRUE, uniforms.projection_matrix.get_raw());
+
+	if (uniforms.lit) {
+		glUniform4fv(this->get_variant_uniform_location(uAmbientLightColor), 1, uniforms.ambient_light_color.get_raw());
+
+		if (uniforms.n_point_lights > 0) {
+			glUniform3fv(this->get_variant_uniform_location(uPointLightPos), uniforms.n_point_lights, uniforms.point_light_pos[0].get_raw());
+			glUniform4fv(this->get_variant_uniform_location(uPointLightColor), uniforms.n_point_lights, uniforms.point_light_color[0].get_raw());
+		}
+	}
+
+	glUniform1i(this->get_variant_uniform_location(uTxUnit), 0); // set shader to use texture unit 0
 
 	ensure_no_error();
 }
@@ -786,6 +982,960 @@ void ProgramTriangleTextureRotation::debug ()
 
 // ---------------------------------------------------
 
+ProgramVoxel::ProgramVoxel ()
+	: Program ()
+{
+	static_assert(sizeof(Graphics::Vertex) == sizeof(Point) + sizeof(Vector));
+	static_assert(sizeof(Vector) == sizeof(fp_t) * 3);
+	static_assert(sizeof(Vertex) == (sizeof(Graphics::Vertex) + sizeof(Vector2f) + sizeof(Vector4f) + sizeof(float)));
+
+	dprintln("loading opengl voxel program...");
+
+	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/voxels.vert");
+	this->vs->compile();
+
+	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/voxels.frag");
+	this->fs->compile();
+
+	this->attach_shaders();
+
+	this->bind_attrib_location(iPosition, "i_position");
+	this->bind_attrib_location(iNormal, "i_normal");
+	this->bind_attrib_location(iTileCoords, "i_tile_coords");
+	this->bind_attrib_location(iTexRect, "i_tex_rect");
+	this->bind_attrib_location(iTexDepth, "i_tex_depth");
+
+	this->link_program();
+
+	// the buffers belong to the chunks, see create_chunk_buffers
+
+	this->use_program();
+	this->setup_uniforms();
+
+	dprintln("loaded opengl voxel program");
+}
+
+ProgramVoxel::~ProgramVoxel ()
+{
+
+}
+
+void ProgramVoxel::create_chunk_buffers (Opengl_VoxelChunkDescriptor& desc)
+{
+	this->gen_vertex_arrays(1, &desc.vao);
+	this->gen_buffers(1, &desc.vbo);
+	this->gen_buffers(1, &desc.ebo);
+
+	this->bind_vertex_array(desc.vao);
+	this->bind_buffer(GL_ARRAY_BUFFER, desc.vbo);
+
+	// the element buffer binding is stored in the vao
+	this->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, desc.ebo);
+
+	this->setup_vertex_arrays();
+
+	desc.n_indices = 0;
+}
+
+void ProgramVoxel::upload_chunk_buffers (Opengl_VoxelChunkDescriptor& desc, const std::span<const Vertex> vertices, const std::span<const GLuint> indices)
+{
+	this->bind_vertex_array(desc.vao);
+	this->bind_buffer(GL_ARRAY_BUFFER, desc.vbo);
+	this->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, desc.ebo);
+
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	desc.n_indices = indices.size();
+
+	ensure_no_error();
+}
+
+// the vertex array of the chunk and its buffers must be bound
+
+void ProgramVoxel::setup_vertex_arrays ()
+{
+	uint32_t pos, length;
+
+	this->enable_vertex_attrib_array(iPosition);
+	this->enable_vertex_attrib_array(iNormal);
+	this->enable_vertex_attrib_array(iTileCoords);
+	this->enable_vertex_attrib_array(iTexRect);
+	this->enable_vertex_attrib_array(iTexDepth);
+
+	pos = 0;
+	length = 3;
+	glVertexAttribPointer(iPosition, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 3;
+	glVertexAttribPointer(iNormal, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 2;
+	glVertexAttribPointer(iTileCoords, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 4;
+	glVertexAttribPointer(iTexRect, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 1;
+	glVertexAttribPointer(iTexDepth, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	ensure_no_error();
+}
+
+void ProgramVoxel::setup_uniforms ()
+{
+	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
+	this->u_ambient_light_color = this->get_uniform_location("u_ambient_light_color");
+	this->u_point_light_pos = this->get_uniform_location("u_point_light_pos");
+	this->u_point_light_color = this->get_uniform_location("u_point_light_color");
+	this->u_tx_unit = this->get_uniform_location("u_tx_unit");
+	this->u_offset = this->get_uniform_location("u_offset");
+}
+
+void ProgramVoxel::upload_vertex_buffers ()
+{
+	// the chunks upload their buffers only when their mesh changes
+}
+
+void ProgramVoxel::upload_uniforms (const Uniforms& uniforms)
+{
+	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
+	glUniform4fv(this->u_ambient_light_color, 1, uniforms.ambient_light_color.get_raw());
+	glUniform3fv(this->u_point_light_pos, 1, uniforms.point_light_pos[0].get_raw());
+	glUniform4fv(this->u_point_light_color, 1, uniforms.point_light_color[0].get_raw());
+	glUniform1i(this->u_tx_unit, 0); // set shader to use texture unit 0
+
+	ensure_no_error();
+}
+
+void ProgramVoxel::draw ()
+{
+	for (const Batch& batch : this->batches) {
+		this->bind_vertex_array(batch.vao);
+		glUniform3fv(this->u_offset, 1, batch.offset.get_raw());
+		glDrawElements(GL_TRIANGLES, batch.n_indices, GL_UNSIGNED_INT, nullptr);
+	}
+
+	ensure_no_error();
+}
+
+void ProgramVoxel::load ()
+{
+	this->use_program();
+}
+
+// ---------------------------------------------------
+
+ProgramHeightfield::ProgramHeightfield ()
+	: Program ()
+{
+	static_assert(sizeof(Vector2f) == sizeof(float) * 2);
+	static_assert(sizeof(Vector4f) == sizeof(float) * 4);
+	static_assert(sizeof(Instance) == (sizeof(Vector4f) + sizeof(Vector2f)));
+
+	dprintln("loading opengl heightfield program...");
+
+	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/heightfield.vert");
+	this->vs->compile();
+
+	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/heightfield.frag");
+	this->fs->compile();
+
+	this->attach_shaders();
+
+	this->bind_attrib_location(iGridPos, "i_grid_pos");
+	this->bind_attrib_location(iNode, "i_node");
+	this->bind_attrib_location(iMorph, "i_morph");
+
+	this->link_program();
+
+	this->gen_vertex_arrays(1, &(this->vao));
+	this->gen_buffers(1, &(this->vbo));
+	this->gen_buffers(1, &(this->grid_vbo));
+	this->gen_buffers(1, &(this->grid_ebo));
+
+	this->use_program();
+	this->bind_vertex_arrays();
+
+	// the grid is the same for every node, so it is uploaded only once
+
+	constexpr uint32_t patch_size = Heightfield3D::patch_size;
+	constexpr uint32_t n_grid_vertices_per_side = patch_size + 1;
+
+	std::vector<Vector2f> grid;
+	std::vector<GLuint> indices;
+
+	grid.reserve(n_grid_vertices_per_side * n_grid_vertices_per_side);
+	indices.reserve(patch_size * patch_size * 6);
+
+	for (uint32_t z = 0; z < n_grid_vertices_per_side; z++) {
+		for (uint32_t x = 0; x < n_grid_vertices_per_side; x++)
+			grid.push_back( Vector2f(static_cast<float>(x) / static_cast<float>(patch_size), static_cast<float>(z) / static_cast<float>(patch_size)) );
+	}
+
+	for (uint32_t z = 0; z < patch_size; z++) {
+		for (uint32_t x = 0; x < patch_size; x++) {
+			const GLuint v00 = x + z * n_grid_vertices_per_side;
+			const GLuint v10 = v00 + 1;
+			const GLuint v01 = v00 + n_grid_vertices_per_side;
+			const GLuint v11 = v01 + 1;
+
+			// counter-clockwise when seen from above (+y)
+			indices.insert(indices.end(), { v00, v01, v11, v00, v11, v10 });
+		}
+	}
+
+	this->n_grid_indices = indices.size();
+
+	this->bind_buffer(GL_ARRAY_BUFFER, this->grid_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Vector2f) * grid.size(), grid.data(), GL_STATIC_DRAW);
+
+	// the element buffer binding is stored in the vao
+	this->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, this->grid_ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	ensure_no_error();
+
+	this->setup_vertex_arrays();
+	this->setup_uniforms();
+
+	dprintln("loaded opengl heightfield program");
+}
+
+ProgramHeightfield::~ProgramHeightfield ()
+{
+
+}
+
+void ProgramHeightfield::bind_vertex_arrays ()
+{
+	this->bind_vertex_array(this->vao);
+}
+
+void ProgramHeightfield::bind_vertex_buffers ()
+{
+	this->bind_buffer(GL_ARRAY_BUFFER, this->vbo);
+}
+
+void ProgramHeightfield::setup_vertex_arrays ()
+{
+	this->bind_buffer(GL_ARRAY_BUFFER, this->grid_vbo);
+
+	this->enable_vertex_attrib_array(iGridPos);
+	glVertexAttribPointer(iGridPos, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2f), ( void * )0 );
+
+	this->bind_vertex_buffers();
+
+	this->enable_vertex_attrib_array(iNode);
+	this->enable_vertex_attrib_array(iMorph);
+
+	this->setup_instance_arrays(0);
+
+	// the node attributes advance once per node, not once per vertex
+
+	this->vertex_attrib_divisor(iNode, 1);
+	this->vertex_attrib_divisor(iMorph, 1);
+
+	ensure_no_error();
+}
+
+/*
+	OpenGL ES 3.0 has no base instance, so before drawing a batch
+	we point the instance attributes to its first instance.
+	The instance buffer must be bound.
+*/
+
+void ProgramHeightfield::setup_instance_arrays (const uint32_t first_instance)
+{
+	const uintptr_t base = static_cast<uintptr_t>(first_instance) * sizeof(Instance);
+	uint32_t pos, length;
+
+	pos = 0;
+	length = 4;
+	glVertexAttribPointer(iNode, length, GL_FLOAT, GL_FALSE, sizeof(Instance), ( void * )(base + pos * sizeof(float)) );
+
+	pos += length;
+	length = 2;
+	glVertexAttribPointer(iMorph, length, GL_FLOAT, GL_FALSE, sizeof(Instance), ( void * )(base + pos * sizeof(float)) );
+
+	ensure_no_error();
+}
+
+void ProgramHeightfield::setup_uniforms ()
+{
+	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
+	this->u_ambient_light_color = this->get_uniform_location("u_ambient_light_color");
+	this->u_point_light_pos = this->get_uniform_location("u_point_light_pos");
+	this->u_point_light_color = this->get_uniform_location("u_point_light_color");
+	this->u_tx_unit = this->get_uniform_location("u_tx_unit");
+	this->u_height_unit = this->get_uniform_location("u_height_unit");
+	this->u_camera_pos = this->get_uniform_location("u_camera_pos");
+	this->u_offset = this->get_uniform_location("u_offset");
+	this->u_size = this->get_uniform_location("u_size");
+	this->u_cell_size = this->get_uniform_location("u_cell_size");
+	this->u_tile_size = this->get_uniform_location("u_tile_size");
+	this->u_tex_rect = this->get_uniform_location("u_tex_rect");
+	this->u_tex_depth = this->get_uniform_location("u_tex_depth");
+}
+
+void ProgramHeightfield::upload_vertex_buffers ()
+{
+	const uint32_t n = this->instance_buffer.get_vertex_buffer_used();
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * n, this->instance_buffer.get_vertex_buffer(), GL_DYNAMIC_DRAW);
+
+	ensure_no_error();
+}
+
+void ProgramHeightfield::upload_uniforms (const Uniforms& uniforms)
+{
+	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
+	glUniform4fv(this->u_ambient_light_color, 1, uniforms.ambient_light_color.get_raw());
+	glUniform3fv(this->u_point_light_pos, 1, uniforms.point_light_pos[0].get_raw());
+	glUniform4fv(this->u_point_light_color, 1, uniforms.point_light_color[0].get_raw());
+	glUniform1i(this->u_tx_unit, 0); // set shader to use texture unit 0
+	glUniform1i(this->u_height_unit, height_texture_unit);
+
+	ensure_no_error();
+}
+
+void ProgramHeightfield::draw ()
+{
+	this->bind_vertex_buffers();
+
+	for (const Batch& batch : this->batches) {
+		if (batch.n_instances == 0)
+			continue;
+
+		glUniform3fv(this->u_camera_pos, 1, batch.camera_pos.get_raw());
+		glUniform3fv(this->u_offset, 1, batch.offset.get_raw());
+		glUniform2i(this->u_size, batch.size_x, batch.size_z);
+		glUniform1f(this->u_cell_size, batch.cell_size);
+		glUniform1f(this->u_tile_size, batch.tile_size);
+		glUniform4fv(this->u_tex_rect, 1, batch.tex_rect.get_raw());
+		glUniform1f(this->u_tex_depth, batch.tex_depth);
+
+		state_cache.active_texture(GL_TEXTURE0 + height_texture_unit);
+		state_cache.bind_texture(GL_TEXTURE_2D, batch.height_texture_id);
+		state_cache.active_texture(GL_TEXTURE0);
+
+		this->setup_instance_arrays(batch.first_instance);
+
+		glDrawElementsInstanced(GL_TRIANGLES, this->n_grid_indices, GL_UNSIGNED_INT, nullptr, batch.n_instances);
+	}
+
+	ensure_no_error();
+}
+
+void ProgramHeightfield::load ()
+{
+	this->use_program();
+	this->bind_vertex_arrays();
+	this->bind_vertex_buffers();
+}
+
+void ProgramHeightfield::debug ()
+{
+	for (const Batch& batch : this->batches) {
+		dprintln("batch texture=", batch.height_texture_id,
+			" first_instance=", batch.first_instance,
+			" n_instances=", batch.n_instances
+		);
+
+		for (uint32_t i = 0; i < batch.n_instances; i++) {
+			const Instance& instance = this->instance_buffer.get_vertex(batch.first_instance + i);
+
+			dprintln("\tinstance[", i,
+				"] x=", instance.node.x,
+				" z=", instance.node.y,
+				" size=", instance.node.z,
+				" morph_start=", instance.morph.x,
+				" morph_end=", instance.morph.y
+			);
+		}
+	}
+}
+
+// ---------------------------------------------------
+
+ProgramTriangleIndexed::ProgramTriangleIndexed ()
+	: Program ()
+{
+	static_assert(sizeof(Graphics::Vertex) == sizeof(Point) + sizeof(Vector));
+	static_assert(sizeof(Vector) == sizeof(fp_t) * 3);
+	static_assert(sizeof(Vertex) == (sizeof(Graphics::Vertex) + sizeof(Vector) + sizeof(Point3f) + sizeof(float)));
+
+	dprintln("loading opengl program triangle indexed...");
+
+	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/triangles-indexed.vert");
+	this->vs->compile();
+
+	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/triangles-indexed.frag");
+	this->fs->compile();
+
+	this->attach_shaders();
+
+	this->bind_attrib_location(iPosition, "i_position");
+	this->bind_attrib_location(iOffset, "i_offset");
+	this->bind_attrib_location(iTexCoords, "i_tex_coords");
+	this->bind_attrib_location(iPalette, "i_palette");
+
+	this->link_program();
+
+	this->gen_vertex_arrays(1, &(this->vao));
+	this->gen_buffers(1, &(this->vbo));
+
+	this->use_program();
+	this->bind_vertex_arrays();
+	this->bind_vertex_buffers();
+	this->setup_vertex_arrays();
+	this->setup_uniforms();
+
+	dprintln("loaded opengl triangle indexed program");
+}
+
+ProgramTriangleIndexed::~ProgramTriangleIndexed ()
+{
+
+}
+
+void ProgramTriangleIndexed::bind_vertex_arrays ()
+{
+	this->bind_vertex_array(this->vao);
+}
+
+void ProgramTriangleIndexed::bind_vertex_buffers ()
+{
+	this->bind_buffer(GL_ARRAY_BUFFER, this->vbo);
+}
+
+void ProgramTriangleIndexed::setup_vertex_arrays ()
+{
+	uint32_t pos, length;
+
+	this->enable_vertex_attrib_array(iPosition);
+	this->enable_vertex_attrib_array(iOffset);
+	this->enable_vertex_attrib_array(iTexCoords);
+	this->enable_vertex_attrib_array(iPalette);
+
+	pos = 0;
+	length = 3;
+	glVertexAttribPointer(iPosition, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	pos += length + 3; // skip the normal
+	length = 3;
+	glVertexAttribPointer(iOffset, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 3;
+	glVertexAttribPointer(iTexCoords, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 1;
+	glVertexAttribPointer(iPalette, length, GL_FLOAT, GL_FALSE, sizeof(Vertex), ( void * )(pos * sizeof(float)) );
+
+	ensure_no_error();
+}
+
+void ProgramTriangleIndexed::setup_uniforms ()
+{
+	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
+	this->u_index_unit = this->get_uniform_location("u_index_unit");
+	this->u_palette_unit = this->get_uniform_location("u_palette_unit");
+}
+
+void ProgramTriangleIndexed::upload_vertex_buffers ()
+{
+	const uint32_t n = this->triangle_buffer.get_vertex_buffer_used();
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * n, this->triangle_buffer.get_vertex_buffer(), GL_DYNAMIC_DRAW);
+
+	ensure_no_error();
+}
+
+void ProgramTriangleIndexed::upload_uniforms (const Uniforms& uniforms)
+{
+	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
+	glUniform1i(this->u_index_unit, index_texture_unit);
+	glUniform1i(this->u_palette_unit, palette_texture_unit);
+
+	ensure_no_error();
+}
+
+void ProgramTriangleIndexed::draw ()
+{
+	const uint32_t n = this->triangle_buffer.get_vertex_buffer_used();
+	glDrawArrays(GL_TRIANGLES, 0, n);
+
+	ensure_no_error();
+}
+
+void ProgramTriangleIndexed::load ()
+{
+	this->use_program();
+	this->bind_vertex_arrays();
+	this->bind_vertex_buffers();
+}
+
+void ProgramTriangleIndexed::debug ()
+{
+	const uint32_t n = this->triangle_buffer.get_vertex_buffer_used();
+
+	for (uint32_t i=0; i<n; i++) {
+		const Vertex& v = this->triangle_buffer.get_vertex(i);
+
+		if ((i % 3) == 0)
+			dprintln();
+
+		dprintln("vertex[", i,
+			"] x=", v.gvertex.pos.x,
+			" y=", v.gvertex.pos.y,
+			" z=", v.gvertex.pos.z,
+			" tex_x=", v.tex_coords.x,
+			" tex_y=", v.tex_coords.y,
+			" tex_z=", v.tex_coords.z,
+			" palette=", v.palette
+		);
+	}
+}
+
+// ---------------------------------------------------
+
+ProgramQuadInstanced::ProgramQuadInstanced ()
+	: Program ()
+{
+	static_assert(sizeof(Vector3f) == sizeof(float) * 3);
+	static_assert(sizeof(Vector4f) == sizeof(float) * 4);
+	static_assert(sizeof(Color) == sizeof(float) * 4);
+	static_assert(sizeof(Instance) == (sizeof(Vector3f) * 2 + sizeof(float) + sizeof(Color) + sizeof(Vector4f) + sizeof(float)));
+
+	dprintln("loading opengl quad instanced program...");
+
+	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/quads-instanced.vert");
+	this->vs->compile();
+
+	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/quads-instanced.frag");
+	this->fs->compile();
+
+	this->attach_shaders();
+
+	this->bind_attrib_location(iTransformX, "i_transform_x");
+	this->bind_attrib_location(iTransformY, "i_transform_y");
+	this->bind_attrib_location(iZ, "i_z");
+	this->bind_attrib_location(iColor, "i_color");
+	this->bind_attrib_location(iTexRect, "i_tex_rect");
+	this->bind_attrib_location(iTexDepth, "i_tex_depth");
+
+	this->link_program();
+
+	this->gen_vertex_arrays(1, &(this->vao));
+	this->gen_buffers(1, &(this->vbo));
+
+	this->use_program();
+	this->bind_vertex_arrays();
+	this->bind_vertex_buffers();
+	this->setup_vertex_arrays();
+	this->setup_uniforms();
+
+	dprintln("loaded opengl quad instanced program");
+}
+
+ProgramQuadInstanced::~ProgramQuadInstanced ()
+{
+
+}
+
+void ProgramQuadInstanced::bind_vertex_arrays ()
+{
+	this->bind_vertex_array(this->vao);
+}
+
+void ProgramQuadInstanced::bind_vertex_buffers ()
+{
+	this->bind_buffer(GL_ARRAY_BUFFER, this->vbo);
+}
+
+void ProgramQuadInstanced::setup_vertex_arrays ()
+{
+	uint32_t pos, length;
+
+	this->enable_vertex_attrib_array(iTransformX);
+	this->enable_vertex_attrib_array(iTransformY);
+	this->enable_vertex_attrib_array(iZ);
+	this->enable_vertex_attrib_array(iColor);
+	this->enable_vertex_attrib_array(iTexRect);
+	this->enable_vertex_attrib_array(iTexDepth);
+
+	pos = 0;
+	length = 3;
+	glVertexAttribPointer(iTransformX, length, GL_FLOAT, GL_FALSE, sizeof(Instance), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 3;
+	glVertexAttribPointer(iTransformY, length, GL_FLOAT, GL_FALSE, sizeof(Instance), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 1;
+	glVertexAttribPointer(iZ, length, GL_FLOAT, GL_FALSE, sizeof(Instance), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 4;
+	glVertexAttribPointer(iColor, length, GL_FLOAT, GL_FALSE, sizeof(Instance), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 4;
+	glVertexAttribPointer(iTexRect, length, GL_FLOAT, GL_FALSE, sizeof(Instance), ( void * )(pos * sizeof(float)) );
+
+	pos += length;
+	length = 1;
+	glVertexAttribPointer(iTexDepth, length, GL_FLOAT, GL_FALSE, sizeof(Instance), ( void * )(pos * sizeof(float)) );
+
+	// all the attributes advance once per quad, not once per vertex
+
+	this->vertex_attrib_divisor(iTransformX, 1);
+	this->vertex_attrib_divisor(iTransformY, 1);
+	this->vertex_attrib_divisor(iZ, 1);
+	this->vertex_attrib_divisor(iColor, 1);
+	this->vertex_attrib_divisor(iTexRect, 1);
+	this->vertex_attrib_divisor(iTexDepth, 1);
+
+	ensure_no_error();
+}
+
+void ProgramQuadInstanced::setup_uniforms ()
+{
+	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
+	this->u_tx_unit = this->get_uniform_location("u_tx_unit");
+}
+
+void ProgramQuadInstanced::upload_vertex_buffers ()
+{
+	const uint32_t n = this->instance_buffer.get_vertex_buffer_used();
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * n, this->instance_buffer.get_vertex_buffer(), GL_DYNAMIC_DRAW);
+
+	ensure_no_error();
+}
+
+void ProgramQuadInstanced::upload_uniforms (const Uniforms& uniforms)
+{
+	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
+	glUniform1i(this->u_tx_unit, 0); // set shader to use texture unit 0
+
+	ensure_no_error();
+}
+
+void ProgramQuadInstanced::draw ()
+{
+	const uint32_t n = this->instance_buffer.get_vertex_buffer_used();
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, n); // 2 triangles per quad
+
+	ensure_no_error();
+}
+
+void ProgramQuadInstanced::load ()
+{
+	this->use_program();
+	this->bind_vertex_arrays();
+	this->bind_vertex_buffers();
+}
+
+void ProgramQuadInstanced::debug ()
+{
+	const uint32_t n = this->instance_buffer.get_vertex_buffer_used();
+
+	for (uint32_t i=0; i<n; i++) {
+		const Instance& q = this->instance_buffer.get_vertex(i);
+
+		dprintln("instance[", i,
+			"] a=", q.transform_x.x,
+			" b=", q.transform_x.y,
+			" tx=", q.transform_x.z,
+			" c=", q.transform_y.x,
+			" d=", q.transform_y.y,
+			" ty=", q.transform_y.z,
+			" z=", q.z,
+			" r=", q.color.r,
+			" g=", q.color.g,
+			" b=", q.color.b,
+			" a=", q.color.a,
+			" tex_depth=", q.tex_depth
+		);
+	}
+}
+
+// ---------------------------------------------------
+
+ProgramUpscale::ProgramUpscale ()
+	: Program ()
+{
+	dprintln("loading opengl upscale program...");
+
+	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/upscale.vert");
+	this->vs->compile();
+
+	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/upscale.frag");
+	this->fs->compile();
+
+	this->attach_shaders();
+
+	this->link_program();
+
+	this->gen_vertex_arrays(1, &(this->vao));
+
+	this->use_program();
+	this->bind_vertex_arrays();
+	this->setup_uniforms();
+
+	dprintln("loaded opengl upscale program");
+}
+
+ProgramUpscale::~ProgramUpscale ()
+{
+
+}
+
+void ProgramUpscale::bind_vertex_arrays ()
+{
+	this->bind_vertex_array(this->vao);
+}
+
+void ProgramUpscale::setup_uniforms ()
+{
+	this->u_tx_unit = this->get_uniform_location("u_tx_unit");
+	this->u_uv_scale = this->get_uniform_location("u_uv_scale");
+	this->u_texel_size = this->get_uniform_location("u_texel_size");
+	this->u_sharpness = this->get_uniform_location("u_sharpness");
+}
+
+void ProgramUpscale::upload_uniforms (const Uniforms& uniforms)
+{
+	glUniform1i(this->u_tx_unit, texture_unit);
+	glUniform2f(this->u_uv_scale, uniforms.uv_scale.x, uniforms.uv_scale.y);
+	glUniform2f(this->u_texel_size, uniforms.texel_size.x, uniforms.texel_size.y);
+	glUniform1f(this->u_sharpness, uniforms.sharpness);
+
+	ensure_no_error();
+}
+
+void ProgramUpscale::draw ()
+{
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	ensure_no_error();
+}
+
+void ProgramUpscale::load ()
+{
+	this->use_program();
+	this->bind_vertex_arrays();
+}
+
+// ---------------------------------------------------
+
+ProgramOcclusionBox::ProgramOcclusionBox ()
+	: Program ()
+{
+	dprintln("loading opengl occlusion box program...");
+
+	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/occlusion-box.vert");
+	this->vs->compile();
+
+	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/occlusion-box.frag");
+	this->fs->compile();
+
+	this->attach_shaders();
+
+	this->link_program();
+
+	this->gen_vertex_arrays(1, &(this->vao));
+
+	this->use_program();
+	this->bind_vertex_arrays();
+	this->setup_uniforms();
+
+	dprintln("loaded opengl occlusion box program");
+}
+
+ProgramOcclusionBox::~ProgramOcclusionBox ()
+{
+
+}
+
+void ProgramOcclusionBox::bind_vertex_arrays ()
+{
+	this->bind_vertex_array(this->vao);
+}
+
+void ProgramOcclusionBox::setup_uniforms ()
+{
+	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
+	this->u_center = this->get_uniform_location("u_center");
+	this->u_half_size = this->get_uniform_location("u_half_size");
+}
+
+void ProgramOcclusionBox::upload_projection_matrix (const Matrix4& projection_matrix)
+{
+	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, projection_matrix.get_raw());
+
+	ensure_no_error();
+}
+
+void ProgramOcclusionBox::draw (const Vector& center, const Vector& half_size)
+{
+	glUniform3fv(this->u_center, 1, center.get_raw());
+	glUniform3fv(this->u_half_size, 1, half_size.get_raw());
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 14);
+
+	ensure_no_error();
+}
+
+void ProgramOcclusionBox::load ()
+{
+	this->use_program();
+	this->bind_vertex_arrays();
+}
+
+// ---------------------------------------------------
+
+#ifndef __ANDROID__
+
+ProgramCullObjects::ProgramCullObjects ()
+	: Program ()
+{
+	dprintln("loading opengl cull objects compute program...");
+
+	this->cs = new Shader(GL_COMPUTE_SHADER, "shaders/cull-objects.comp");
+	this->cs->compile();
+
+	this->attach_shaders();
+	this->link_program();
+	this->use_program();
+
+	this->u_frustum_planes = this->get_uniform_location("u_frustum_planes");
+	this->u_n_objects = this->get_uniform_location("u_n_objects");
+
+	dprintln("loaded opengl cull objects compute program");
+}
+
+ProgramCullObjects::~ProgramCullObjects ()
+{
+
+}
+
+void ProgramCullObjects::dispatch (const std::array<Vector4f, 6>& frustum_planes, const uint32_t n_objects)
+{
+	static_assert(sizeof(Vector4f) == sizeof(float) * 4);
+
+	this->use_program();
+
+	glUniform4fv(this->u_frustum_planes, frustum_planes.size(), frustum_planes[0].get_raw());
+	glUniform1ui(this->u_n_objects, n_objects);
+	ensure_no_error();
+
+	glDispatchCompute((n_objects + work_group_size - 1) / work_group_size, 1, 1);
+	ensure_no_error();
+}
+
+// ---------------------------------------------------
+
+ProgramMeshIndirect::ProgramMeshIndirect ()
+	: Program ()
+{
+	dprintln("loading opengl mesh indirect program...");
+
+	this->vs = new Shader(GL_VERTEX_SHADER, "shaders/mesh-indirect.vert");
+	this->vs->compile();
+
+	this->fs = new Shader(GL_FRAGMENT_SHADER, "shaders/mesh-indirect.frag");
+	this->fs->compile();
+
+	this->attach_shaders();
+
+	this->bind_attrib_location(iPosition, "i_position");
+	this->bind_attrib_location(iNormal, "i_normal");
+	this->bind_attrib_location(iObjectIndex, "i_object_index");
+
+	this->link_program();
+
+	this->gen_vertex_arrays(1, &(this->vao));
+
+	this->use_program();
+	this->setup_uniforms();
+
+	dprintln("loaded opengl mesh indirect program");
+}
+
+ProgramMeshIndirect::~ProgramMeshIndirect ()
+{
+
+}
+
+void ProgramMeshIndirect::setup_vertex_arrays (const GLuint mesh_vbo, const GLuint visible_buffer)
+{
+	using MeshVertex = IndirectMeshScene::MeshVertex;
+
+	static_assert(sizeof(MeshVertex) == sizeof(float) * 6);
+
+	this->bind_vertex_array(this->vao);
+
+	this->enable_vertex_attrib_array(iPosition);
+	this->enable_vertex_attrib_array(iNormal);
+	this->enable_vertex_attrib_array(iObjectIndex);
+
+	this->bind_buffer(GL_ARRAY_BUFFER, mesh_vbo);
+	glVertexAttribPointer(iPosition, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), ( void * )0 );
+	glVertexAttribPointer(iNormal, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), ( void * )(3 * sizeof(float)) );
+
+	/*
+		The compute shader writes the indices of the visible objects
+		starting at the base_instance of each mesh's command.
+		Since base_instance offsets instanced attributes,
+		each instance reads the index of its own object.
+	*/
+	this->bind_buffer(GL_ARRAY_BUFFER, visible_buffer);
+	glVertexAttribIPointer(iObjectIndex, 1, GL_UNSIGNED_INT, sizeof(GLuint), ( void * )0 );
+	this->vertex_attrib_divisor(iObjectIndex, 1);
+
+	ensure_no_error();
+}
+
+void ProgramMeshIndirect::setup_uniforms ()
+{
+	this->u_projection_matrix = this->get_uniform_location("u_projection_matrix");
+	this->u_ambient_light_color = this->get_uniform_location("u_ambient_light_color");
+	this->u_point_light_pos = this->get_uniform_location("u_point_light_pos");
+	this->u_point_light_color = this->get_uniform_location("u_point_light_color");
+}
+
+void ProgramMeshIndirect::upload_uniforms (const Uniforms& uniforms)
+{
+	glUniformMatrix4fv(this->u_projection_matrix, 1, GL_TRUE, uniforms.projection_matrix.get_raw());
+	glUniform4fv(this->u_ambient_light_color, 1, uniforms.ambient_light_color.get_raw());
+	glUniform3fv(this->u_point_light_pos, 1, uniforms.point_light_pos[0].get_raw());
+	glUniform4fv(this->u_point_light_color, 1, uniforms.point_light_color[0].get_raw());
+
+	ensure_no_error();
+}
+
+void ProgramMeshIndirect::draw (const GLuint commands_buffer, const uint32_t n_commands)
+{
+	this->bind_buffer(GL_DRAW_INDIRECT_BUFFER, commands_buffer);
+
+	glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, n_commands, 0);
+	ensure_no_error();
+}
+
+void ProgramMeshIndirect::load ()
+{
+	this->use_program();
+	this->bind_vertex_array(this->vao);
+}
+
+#endif
+
+// ---------------------------------------------------
+
 } // namespace Graphics
 } // namespace Opengl
 } // namespace MyGlib
\ No newline at end of file
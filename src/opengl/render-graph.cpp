@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <limits>
+
+#include <my-game-lib/debug.h>
+#include <my-game-lib/opengl/opengl.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+namespace Opengl
+{
+
+// ---------------------------------------------------
+
+void RenderGraph::reset ()
+{
+	// clear keeps the capacity, so building the graph every frame doesn't allocate memory
+	this->resources.clear();
+	this->passes.clear();
+	this->sorted_passes.clear();
+}
+
+// ---------------------------------------------------
+
+RenderGraph::ResourceId RenderGraph::import_framebuffer (const char *name, const GLuint framebuffer, const int32_t width_px, const int32_t height_px)
+{
+	this->resources.push_back( Resource {
+		.name = name,
+		.framebuffer = framebuffer,
+		.width_px = width_px,
+		.height_px = height_px
+	} );
+
+	return this->resources.size() - 1;
+}
+
+// ---------------------------------------------------
+
+void RenderGraph::add_pass (const char *name, const std::initializer_list<ResourceId> inputs, const ResourceId output, ExecuteFunction execute)
+{
+	mylib_assert(inputs.size() <= max_pass_resources)
+
+	Pass& pass = this->passes.emplace_back();
+
+	pass.name = name;
+	pass.n_inputs = inputs.size();
+	pass.output = output;
+	pass.execute = std::move(execute);
+
+	std::copy(inputs.begin(), inputs.end(), pass.inputs.begin());
+}
+
+// ---------------------------------------------------
+
+void RenderGraph::compile ()
+{
+	const uint32_t n_passes = this->passes.size();
+	const uint32_t n_resources = this->resources.size();
+	constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+	/*
+		Topological sort (Kahn).
+		A pass depends on the last previous writer of each resource it reads or writes,
+		and on the previous readers of the resource it writes.
+		Among the passes ready to run, we always pick the one declared first.
+	*/
+
+	this->n_dependencies.assign(n_passes, 0);
+	this->last_writer.assign(n_resources, none);
+	this->done.assign(n_passes, false);
+
+	if (this->dependents.size() < n_passes)
+		this->dependents.resize(n_passes);
+
+	if (this->readers_since_write.size() < n_resources)
+		this->readers_since_write.resize(n_resources);
+
+	for (uint32_t p = 0; p < n_passes; p++)
+		this->dependents[p].clear();
+
+	for (uint32_t id = 0; id < n_resources; id++)
+		this->readers_since_write[id].clear();
+
+	auto add_dependency = [this] (const uint32_t from, const uint32_t to) -> void {
+		if (std::find(this->dependents[from].begin(), this->dependents[from].end(), to) == this->dependents[from].end()) {
+			this->dependents[from].push_back(to);
+			this->n_dependencies[to]++;
+		}
+	};
+
+	for (uint32_t p = 0; p < n_passes; p++) {
+		const Pass& pass = this->passes[p];
+
+		for (uint32_t i = 0; i < pass.n_inputs; i++) {
+			const ResourceId id = pass.inputs[i];
+
+			if (this->last_writer[id] != none)
+				add_dependency(this->last_writer[id], p);
+
+			this->readers_since_write[id].push_back(p);
+		}
+
+		const ResourceId id = pass.output;
+
+		if (this->last_writer[id] != none && this->last_writer[id] != p)
+			add_dependency(this->last_writer[id], p);
+
+		for (const uint32_t reader : this->readers_since_write[id]) {
+			if (reader != p)
+				add_dependency(reader, p);
+		}
+
+		this->readers_since_write[id].clear();
+		this->last_writer[id] = p;
+	}
+
+	while (true) {
+		uint32_t next = none;
+
+		for (uint32_t p = 0; p < n_passes; p++) {
+			if (!this->done[p] && this->n_dependencies[p] == 0) {
+				next = p;
+				break;
+			}
+		}
+
+		if (next == none)
+			break;
+
+		this->done[next] = true;
+		this->sorted_passes.push_back(next);
+
+		for (const uint32_t dependent : this->dependents[next])
+			this->n_dependencies[dependent]--;
+	}
+}
+
+// ---------------------------------------------------
+
+void RenderGraph::execute (const GLuint framebuffer, const int32_t viewport_width_px, const int32_t viewport_height_px)
+{
+	// we only change the framebuffer and viewport when they actually change
+
+	GLuint current_framebuffer = framebuffer;
+	int32_t current_width_px = viewport_width_px;
+	int32_t current_height_px = viewport_height_px;
+
+	for (const uint32_t p : this->sorted_passes) {
+		Pass& pass = this->passes[p];
+		const Resource& output = this->resources[pass.output];
+
+		if (current_framebuffer != output.framebuffer) {
+			glBindFramebuffer(GL_FRAMEBUFFER, output.framebuffer);
+			current_framebuffer = output.framebuffer;
+		}
+
+		if (current_width_px != output.width_px || current_height_px != output.height_px) {
+			glViewport(0, 0, output.width_px, output.height_px);
+			current_width_px = output.width_px;
+			current_height_px = output.height_px;
+		}
+
+		ensure_no_error();
+
+		pass.execute(*this);
+	}
+}
+
+// ---------------------------------------------------
+
+} // end namespace Opengl
+} // end namespace Graphics
+} // end namespace MyGlib
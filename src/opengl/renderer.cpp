@@ -3,6 +3,7 @@
 #include <sstream>
 #include <numbers>
 #include <utility>
+#include <limits>
 
 #include <cstdlib>
 #include <cmath>
@@ -13,6 +14,10 @@
 
 #include <my-game-lib/debug.h>
 #include <my-game-lib/opengl/opengl.h>
+#include <my-game-lib/font.h>
+#include <my-game-lib/voxel.h>
+#include <my-game-lib/heightfield.h>
+#include <my-game-lib/mesh.h>
 
 // ---------------------------------------------------
 
@@ -29,6 +34,170 @@ namespace Opengl
 
 // ---------------------------------------------------
 
+/*
+	Copies the surface (ABGR8888) to a buffer with a border of gutter_px
+	pixels on each side, where each border pixel repeats the nearest
+	edge pixel of the texture.
+*/
+
+static std::vector<Uint32> extrude_surface (const SDL_Surface *surface, const int32_t left_px, const int32_t top_px, const int32_t right_px, const int32_t bottom_px)
+{
+	const int32_t w = surface->w;
+	const int32_t h = surface->h;
+	const int32_t padded_w = w + left_px + right_px;
+	const int32_t padded_h = h + top_px + bottom_px;
+
+	std::vector<Uint32> padded(padded_w * padded_h);
+
+	for (int32_t y = 0; y < padded_h; y++) {
+		const int32_t src_y = std::clamp(y - top_px, 0, h - 1);
+		const Uint32 *src_row = reinterpret_cast<const Uint32*>(static_cast<const uint8_t*>(surface->pixels) + src_y * surface->pitch);
+		Uint32 *dst_row = padded.data() + y * padded_w;
+
+		std::fill(dst_row, dst_row + left_px, src_row[0]);
+		std::copy(src_row, src_row + w, dst_row + left_px);
+		std::fill(dst_row + left_px + w, dst_row + padded_w, src_row[w - 1]);
+	}
+
+	return padded;
+}
+
+static std::vector<Uint32> extrude_surface (const SDL_Surface *surface, const int32_t gutter_px)
+{
+	return extrude_surface(surface, gutter_px, gutter_px, gutter_px, gutter_px);
+}
+
+// ---------------------------------------------------
+
+/*
+	Box filter of 32-bit pixels, each byte is a channel.
+	width_px and height_px must be even.
+*/
+
+static std::vector<Uint32> downsample_pixels (const std::vector<Uint32>& pixels, const int32_t width_px, const int32_t height_px)
+{
+	const int32_t half_w = width_px / 2;
+	const int32_t half_h = height_px / 2;
+
+	std::vector<Uint32> half(half_w * half_h);
+
+	for (int32_t y = 0; y < half_h; y++) {
+		const Uint32 *row0 = pixels.data() + (y * 2) * width_px;
+		const Uint32 *row1 = row0 + width_px;
+
+		for (int32_t x = 0; x < half_w; x++) {
+			const std::array<Uint32, 4> block = { row0[x*2], row0[x*2 + 1], row1[x*2], row1[x*2 + 1] };
+			Uint32 result = 0;
+
+			for (uint32_t shift = 0; shift < 32; shift += 8) {
+				Uint32 sum = 0;
+
+				for (const Uint32 pixel : block)
+					sum += (pixel >> shift) & 0xFF;
+
+				result |= ((sum + 2) / 4) << shift;
+			}
+
+			half[y * half_w + x] = result;
+		}
+	}
+
+	return half;
+}
+
+// ---------------------------------------------------
+
+/*
+	Replaces the surface (ABGR8888) of the texture by its smallest
+	part with non-transparent pixels.
+	Fully transparent textures are kept as they are.
+*/
+
+static void trim_texture (Opengl_TextureDescriptor *desc)
+{
+	SDL_Surface *surface = desc->surface;
+	const Uint32 amask = surface->format->Amask;
+	int32_t x_ini = surface->w;
+	int32_t y_ini = surface->h;
+	int32_t x_end = 0;
+	int32_t y_end = 0;
+
+	for (int32_t y = 0; y < surface->h; y++) {
+		const Uint32 *row = reinterpret_cast<const Uint32*>(static_cast<const uint8_t*>(surface->pixels) + y * surface->pitch);
+
+		for (int32_t x = 0; x < surface->w; x++) {
+			if (row[x] & amask) {
+				x_ini = std::min(x_ini, x);
+				x_end = std::max(x_end, x + 1);
+				y_ini = std::min(y_ini, y);
+				y_end = y + 1;
+			}
+		}
+	}
+
+	if (x_end == 0) // fully transparent
+		return;
+	
+	if (x_ini == 0 && y_ini == 0 && x_end == surface->w && y_end == surface->h)
+		return;
+
+	SDL_Surface *trimmed = SDL_CreateRGBSurfaceWithFormat(0, x_end - x_ini, y_end - y_ini, 32, SDL_PIXELFORMAT_ABGR8888);
+	mylib_assert_msg(trimmed != nullptr, "error creating surface", '\n', SDL_GetError())
+
+	for (int32_t y = y_ini; y < y_end; y++) {
+		const Uint32 *src_row = reinterpret_cast<const Uint32*>(static_cast<const uint8_t*>(surface->pixels) + y * surface->pitch);
+		Uint32 *dst_row = reinterpret_cast<Uint32*>(static_cast<uint8_t*>(trimmed->pixels) + (y - y_ini) * trimmed->pitch);
+
+		std::copy(src_row + x_ini, src_row + x_end, dst_row);
+	}
+
+	desc->trimmed = true;
+	desc->trim_ini = Vector2f(static_cast<fp_t>(x_ini) / static_cast<fp_t>(surface->w), static_cast<fp_t>(y_ini) / static_cast<fp_t>(surface->h));
+	desc->trim_end = Vector2f(static_cast<fp_t>(x_end) / static_cast<fp_t>(surface->w), static_cast<fp_t>(y_end) / static_cast<fp_t>(surface->h));
+	desc->surface = trimmed;
+	desc->width_px = trimmed->w;
+	desc->height_px = trimmed->h;
+
+	SDL_FreeSurface(surface);
+}
+
+// ---------------------------------------------------
+
+// hashes the pixels (ABGR8888) row by row, since rows may be padded
+
+static uint64_t hash_surface_pixels (const SDL_Surface *surface)
+{
+	const std::hash<std::string_view> hasher;
+	uint64_t hash = (static_cast<uint64_t>(surface->w) << 32) | static_cast<uint64_t>(surface->h);
+
+	for (int32_t y = 0; y < surface->h; y++) {
+		const char *row = static_cast<const char*>(surface->pixels) + y * surface->pitch;
+
+		// multiplying by the 64-bit FNV prime makes the result depend on the order of the rows
+		hash = (hash ^ hasher(std::string_view(row, surface->w * 4))) * 0x100000001B3;
+	}
+
+	return hash;
+}
+
+static bool same_surface_pixels (const SDL_Surface *a, const SDL_Surface *b)
+{
+	if (a->w != b->w || a->h != b->h)
+		return false;
+
+	for (int32_t y = 0; y < a->h; y++) {
+		const uint8_t *row_a = static_cast<const uint8_t*>(a->pixels) + y * a->pitch;
+		const uint8_t *row_b = static_cast<const uint8_t*>(b->pixels) + y * b->pitch;
+
+		if (std::memcmp(row_a, row_b, a->w * 4) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------
+
 Renderer::Renderer (const InitParams& params)
 	: Manager (params)
 {
@@ -91,14 +260,32 @@ Renderer::Renderer (const InitParams& params)
 	}
 
 	dprintln("Status: Using GLEW ", glewGetString(GLEW_VERSION));
+
+	// new context, nothing we knew is valid anymore
+	state_cache.invalidate();
+
+	// compute shaders, SSBOs and multi-draw-indirect
+	this->gl43_supported = GLEW_VERSION_4_3;
+
+	// GL_TIME_ELAPSED queries, not available in OpenGL ES 3.0
+	this->gpu_timer_supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+
+	if (this->gpu_timer_supported)
+		glGenQueries(this->gpu_timer_queries.size(), this->gpu_timer_queries.data());
 #endif
 
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
+	dprintln("OpenGL version: ", glGetString(GL_VERSION), " GL 4.3 path: ", this->gl43_supported);
+
+	state_cache.set_capability(GL_DEPTH_TEST, true);
+	state_cache.set_capability(GL_BLEND, true);
 	glEnable(GL_TEXTURE_2D);
 
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	// GL_CULL_FACE itself is enabled per program (see Program::cull_back_faces)
+	glFrontFace(GL_CCW);
+	glCullFace(GL_BACK);
+
 	glClearColor(this->background_color.r, this->background_color.g, this->background_color.b, 1);
 	glViewport(0, 0, this->window_width_px, this->window_height_px);
 
@@ -116,10 +303,32 @@ void Renderer::load_opengl_programs ()
 	dprintln("loading opengl programs...");
 
 	this->program_triangle_color = new ProgramTriangleColor;
+	this->program_triangle_color_cull = new ProgramTriangleColor;
 	this->program_line_color = new ProgramLineColor;
 	this->program_triangle_texture = new ProgramTriangleTexture;
+	this->program_triangle_texture_cull = new ProgramTriangleTexture;
 	this->program_triangle_texture_rotation = new ProgramTriangleTextureRotation;
 
+	this->program_triangle_color_cull->set_cull_back_faces(true);
+	this->program_triangle_texture_cull->set_cull_back_faces(true);
+	this->program_triangle_texture_rotation->set_cull_back_faces(true);
+	this->program_voxel = new ProgramVoxel;
+	this->program_voxel->set_cull_back_faces(true);
+	this->program_heightfield = new ProgramHeightfield;
+	this->program_heightfield->set_cull_back_faces(true);
+	this->program_mesh_color = new ProgramTriangleColor;
+	this->program_mesh_color->set_cull_back_faces(true);
+	this->program_mesh_texture = new ProgramTriangleTexture;
+	this->program_mesh_texture->set_cull_back_faces(true);
+	this->program_quad_instanced = new ProgramQuadInstanced;
+	this->program_render_target = new ProgramRenderTarget;
+	this->program_upscale = new ProgramUpscale;
+	this->program_triangle_indexed = new ProgramTriangleIndexed;
+
+	this->indirect_mesh_scene = new IndirectMeshScene(this->gl43_supported);
+	this->render_graph = new RenderGraph;
+	this->occlusion_culler = new OcclusionCuller;
+
 	dprintln("all opengl programs loaded");
 }
 
@@ -128,9 +337,55 @@ void Renderer::load_opengl_programs ()
 Renderer::~Renderer ()
 {
 	delete this->program_triangle_color;
+	delete this->program_triangle_color_cull;
 	delete this->program_line_color;
 	delete this->program_triangle_texture;
+	delete this->program_triangle_texture_cull;
 	delete this->program_triangle_texture_rotation;
+	delete this->program_voxel;
+	delete this->program_heightfield;
+	delete this->program_mesh_color;
+	delete this->program_mesh_texture;
+	delete this->program_quad_instanced;
+	delete this->program_render_target;
+	delete this->program_upscale;
+	delete this->program_triangle_indexed;
+	delete this->indirect_mesh_scene;
+	delete this->render_graph;
+	delete this->occlusion_culler;
+	delete this->streaming_atlas_creator; // texture loading may not have finished
+	delete this->async_atlas_creator;
+
+	if (this->texture_decoder != nullptr) {
+		delete this->texture_decoder;
+
+		for (TextureDecoder::Job& job : this->async_uploads) {
+			if (job.surface != nullptr)
+				SDL_FreeSurface(job.surface);
+		}
+
+		state_cache.delete_buffers(n_upload_buffers, this->upload_buffers.data());
+	}
+
+	for (Opengl_TextureDescriptor *desc : this->render_targets) {
+		glDeleteFramebuffers(1, &desc->framebuffer_id);
+		glDeleteRenderbuffers(1, &desc->depth_renderbuffer_id);
+		state_cache.delete_textures(1, &desc->texture_id);
+	}
+
+	if (this->capturing)
+		this->end_frame_capture();
+
+	if (this->scene_fbo != 0) {
+		glDeleteFramebuffers(1, &this->scene_fbo);
+		state_cache.delete_textures(1, &this->scene_color_texture);
+		glDeleteRenderbuffers(1, &this->scene_depth_renderbuffer);
+	}
+
+#ifndef __ANDROID__
+	if (this->gpu_timer_supported)
+		glDeleteQueries(this->gpu_timer_queries.size(), this->gpu_timer_queries.data());
+#endif
 
 	SDL_GL_DeleteContext(this->sdl_gl_context);
 	SDL_DestroyWindow(this->sdl_window);
@@ -140,11 +395,111 @@ Renderer::~Renderer ()
 
 void Renderer::wait_next_frame ()
 {
+	this->upload_async_textures();
+
+	const fp_t render_scale = std::clamp(this->render_scale, fp(0.25), fp(1));
+
+	this->scaled_rendering = (render_scale < fp(1)) || (this->upscale_sharpness > fp(0));
+
+	if (this->scaled_rendering) {
+		if (this->scene_fbo == 0) [[unlikely]]
+			this->create_scene_framebuffer();
+
+		this->scene_width_px = std::max(1, static_cast<int32_t>(static_cast<fp_t>(this->window_width_px) * render_scale));
+		this->scene_height_px = std::max(1, static_cast<int32_t>(static_cast<fp_t>(this->window_height_px) * render_scale));
+	}
+
+#ifndef __ANDROID__
+	if (this->gpu_timer_supported && !this->gpu_timer_running) {
+		glBeginQuery(GL_TIME_ELAPSED, this->gpu_timer_queries[this->gpu_timer_current]);
+		this->gpu_timer_running = true;
+	}
+#endif
+
+	this->bind_scene_framebuffer();
 	this->clear_buffers(ColorBufferBit | DepthBufferBit | VertexBufferBit);
 }
 
 // ---------------------------------------------------
 
+void Renderer::create_scene_framebuffer ()
+{
+	glGenTextures(1, &this->scene_color_texture);
+	state_cache.active_texture(GL_TEXTURE0 + ProgramUpscale::texture_unit);
+	state_cache.bind_texture(GL_TEXTURE_2D, this->scene_color_texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, this->window_width_px, this->window_height_px);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	state_cache.active_texture(GL_TEXTURE0);
+	ensure_no_error();
+
+	glGenRenderbuffers(1, &this->scene_depth_renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->scene_depth_renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, this->window_width_px, this->window_height_px);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	ensure_no_error();
+
+	glGenFramebuffers(1, &this->scene_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->scene_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->scene_color_texture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->scene_depth_renderbuffer);
+	ensure_no_error();
+
+	mylib_assert_msg(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "incomplete scene framebuffer")
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	dprintln("scene framebuffer created for dynamic resolution");
+}
+
+// ---------------------------------------------------
+
+void Renderer::bind_scene_framebuffer ()
+{
+	if (this->scaled_rendering) {
+		glBindFramebuffer(GL_FRAMEBUFFER, this->scene_fbo);
+		glViewport(0, 0, this->scene_width_px, this->scene_height_px);
+	}
+	else {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, this->window_width_px, this->window_height_px);
+	}
+
+	ensure_no_error();
+}
+
+// ---------------------------------------------------
+
+// The render graph has already bound the default framebuffer.
+
+void Renderer::upscale_scene ()
+{
+	state_cache.active_texture(GL_TEXTURE0 + ProgramUpscale::texture_unit);
+	state_cache.bind_texture(GL_TEXTURE_2D, this->scene_color_texture);
+	state_cache.active_texture(GL_TEXTURE0);
+
+	// the triangle covers the whole window
+	state_cache.set_capability(GL_DEPTH_TEST, false);
+	state_cache.set_capability(GL_BLEND, false);
+	ensure_no_error();
+
+	this->program_upscale->load();
+	this->program_upscale->upload_uniforms( ProgramUpscale::Uniforms {
+		.uv_scale = Vector2f(static_cast<float>(this->scene_width_px) / static_cast<float>(this->window_width_px), static_cast<float>(this->scene_height_px) / static_cast<float>(this->window_height_px)),
+		.texel_size = Vector2f(1.0f / static_cast<float>(this->window_width_px), 1.0f / static_cast<float>(this->window_height_px)),
+		.sharpness = static_cast<float>(this->upscale_sharpness)
+	} );
+	this->program_upscale->draw();
+
+	state_cache.set_capability(GL_DEPTH_TEST, true);
+	state_cache.set_capability(GL_BLEND, true);
+	ensure_no_error();
+}
+
+// ---------------------------------------------------
+
 void Renderer::draw_line3D (Line3D& line, const Vector& offset, const Color& color)
 {
 	constexpr uint32_t n_vertices = Line3D::get_n_vertices();
@@ -193,7 +548,7 @@ void Renderer::draw_cube3D (Cube3D& cube, const Vector& offset, const Color& col
 //exit(1);
 #endif
 
-	std::span<ProgramTriangleColor::Vertex> vertices = this->program_triangle_color->alloc_vertices(n_vertices);
+	std::span<ProgramTriangleColor::Vertex> vertices = this->program_triangle_color_cull->alloc_vertices(n_vertices);
 	std::span<Vertex> shape_vertices = cube.get_local_rotated_vertices();
 
 /*	dprintln("rendering cube with offset=", offset, " color=", color, " w=", cube.get_w(), " h=", cube.get_h(), " d=", cube.get_d());
@@ -216,7 +571,7 @@ void Renderer::draw_cube3D (Cube3D& cube, const Vector& offset, const Color& col
 void Renderer::draw_cube3D (Cube3D& cube, const Vector& offset, const std::array<TextureRenderOptions, 6>& texture_options)
 {
 	constexpr uint32_t n_vertices = Cube3D::get_n_vertices();
-	std::span<ProgramTriangleTexture::Vertex> vertices = this->program_triangle_texture->alloc_vertices(n_vertices);
+	std::span<ProgramTriangleTexture::Vertex> vertices = this->program_triangle_texture_cull->alloc_vertices(n_vertices);
 	std::span<Vertex> shape_vertices = cube.get_local_rotated_vertices();
 
 	mylib_assert(shape_vertices.size() == n_vertices)
@@ -236,45 +591,320 @@ void Renderer::draw_cube3D (Cube3D& cube, const Vector& offset, const std::array
 	using enum Cube3D::SurfacePositionIndex;
 	using TextureVertexPositionIndex = Enums::TextureVertexPositionIndex;
 
-	auto mount = [&i, vertices] (const VertexPositionIndex p, const Vector3f& v, const TextureRenderOptions& texture_options) -> void {
-		const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture_options.desc.info->data);
+	auto mount = [&i, vertices] (const VertexPositionIndex p, const Vector3f& v, const Opengl_TextureDescriptor *desc) -> void {
 		const Opengl_AtlasDescriptor *atlas = desc->atlas;
 
 		vertices[i].tex_coords = Vector3f(v.x, v.y, atlas->texture_depth);
 		i++;
 	};
 
-	auto mount_triangle = [&mount] (const VertexPositionIndex p1, const VertexPositionIndex p2, const VertexPositionIndex p3, const Vector3f& v1, const Vector3f& v2, const Vector3f& v3, const TextureRenderOptions& texture_options) -> void {
-		mount(p1, v1, texture_options);
-		mount(p2, v2, texture_options);
-		mount(p3, v3, texture_options);
+	auto mount_triangle = [&mount] (const VertexPositionIndex p1, const VertexPositionIndex p2, const VertexPositionIndex p3, const Vector3f& v1, const Vector3f& v2, const Vector3f& v3, const Opengl_TextureDescriptor *desc) -> void {
+		mount(p1, v1, desc);
+		mount(p2, v2, desc);
+		mount(p3, v3, desc);
 	};
 
-	// p1 and p2 should be a diagonal of the rectangle
-	auto mount_surface = [&mount_triangle] (const VertexPositionIndex p1, const VertexPositionIndex p2, const VertexPositionIndex p3, const VertexPositionIndex p4, const TextureRenderOptions& texture_options) -> void {
-		const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture_options.desc.info->data);
+	const fp_t cube_size = std::max({cube.get_w(), cube.get_h(), cube.get_d()});
 
-		mount_triangle(p1, p2, p3, desc->tex_coords[TextureVertexPositionIndex::LeftTop], desc->tex_coords[TextureVertexPositionIndex::RightBottom], desc->tex_coords[TextureVertexPositionIndex::RightTop], texture_options);
-		mount_triangle(p1, p2, p4, desc->tex_coords[TextureVertexPositionIndex::LeftTop], desc->tex_coords[TextureVertexPositionIndex::RightBottom], desc->tex_coords[TextureVertexPositionIndex::LeftBottom], texture_options);
+	// p1 and p2 should be a diagonal of the rectangle
+	// p1 is mapped to the left top of the texture, and p2 to the right bottom
+	auto mount_surface = [this, &mount_triangle, &offset, cube_size] (const VertexPositionIndex p1, const VertexPositionIndex p2, const VertexPositionIndex p3, const VertexPositionIndex p4, const TextureVertexPositionIndex t3, const TextureVertexPositionIndex t4, const TextureRenderOptions& texture_options) -> void {
+		const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(this->select_texture(texture_options, offset, cube_size).data);
+		mylib_assert_msg(!desc->indexed, "indexed textures can only be drawn by draw_rect2D")
+		mylib_assert_msg(!desc->trimmed, "trimmed textures can only be drawn by draw_rect2D and draw_text2D")
+		mylib_assert_msg(desc->texture_id == 0, "render targets can only be drawn by draw_rect2D")
+
+		mount_triangle(p1, p2, p3, desc->tex_coords[TextureVertexPositionIndex::LeftTop], desc->tex_coords[TextureVertexPositionIndex::RightBottom], desc->tex_coords[t3], desc);
+		mount_triangle(p2, p1, p4, desc->tex_coords[TextureVertexPositionIndex::RightBottom], desc->tex_coords[TextureVertexPositionIndex::LeftTop], desc->tex_coords[t4], desc);
 	};
 
+	using TextureVertexPositionIndex::LeftBottom;
+	using TextureVertexPositionIndex::RightTop;
+
 	// bottom
-	mount_surface(LeftBottomFront, RightBottomBack, RightBottomFront, LeftBottomBack, texture_options[Bottom]);
+	mount_surface(LeftBottomFront, RightBottomBack, LeftBottomBack, RightBottomFront, LeftBottom, RightTop, texture_options[Bottom]);
 
 	// top
-	mount_surface(LeftTopFront, RightTopBack, RightTopFront, LeftTopBack, texture_options[Top]);
+	mount_surface(LeftTopFront, RightTopBack, RightTopFront, LeftTopBack, RightTop, LeftBottom, texture_options[Top]);
 
 	// front
-	mount_surface(LeftTopFront, RightBottomFront, RightTopFront, LeftBottomFront, texture_options[Front]);
+	mount_surface(LeftTopFront, RightBottomFront, LeftBottomFront, RightTopFront, LeftBottom, RightTop, texture_options[Front]);
 
 	// back
-	mount_surface(LeftTopBack, RightBottomBack, RightTopBack, LeftBottomBack, texture_options[Back]);
+	mount_surface(LeftTopBack, RightBottomBack, RightTopBack, LeftBottomBack, RightTop, LeftBottom, texture_options[Back]);
 
 	// left
-	mount_surface(LeftTopFront, LeftBottomBack, LeftTopBack, LeftBottomFront, texture_options[Left]);
+	mount_surface(LeftTopFront, LeftBottomBack, LeftTopBack, LeftBottomFront, RightTop, LeftBottom, texture_options[Left]);
 
 	// right
-	mount_surface(RightTopFront, RightBottomBack, RightTopBack, RightBottomFront, texture_options[Right]);
+	mount_surface(RightTopFront, RightBottomBack, RightBottomFront, RightTopBack, LeftBottom, RightTop, texture_options[Right]);
+}
+
+// ---------------------------------------------------
+
+void Renderer::draw_mesh3D (Mesh3D& mesh, const Vector& offset, const Color& color)
+{
+	std::span<Vertex> shape_vertices = mesh.get_local_rotated_vertices();
+	std::span<const uint32_t> shape_indices = mesh.get_indices();
+	std::span<ProgramTriangleColor::Vertex> vertices;
+	std::span<GLuint> indices;
+
+	const uint32_t first_vertex = this->program_mesh_color->alloc_indexed_vertices(shape_vertices.size(), shape_indices.size(), vertices, indices);
+
+	for (uint32_t i = 0; i < shape_vertices.size(); i++) {
+		vertices[i].gvertex = shape_vertices[i];
+		vertices[i].offset = offset;
+		vertices[i].color = color;
+	}
+
+	for (uint32_t i = 0; i < shape_indices.size(); i++)
+		indices[i] = first_vertex + shape_indices[i];
+}
+
+void Renderer::draw_mesh3D (Mesh3D& mesh, const Vector& offset, const TextureRenderOptions& texture_options)
+{
+	mylib_assert_msg(mesh.has_tex_coords(), "mesh has no tex coords")
+
+	std::span<Vertex> shape_vertices = mesh.get_local_rotated_vertices();
+	std::span<const uint32_t> shape_indices = mesh.get_indices();
+	std::span<const Vector2f> tex_coords = mesh.get_tex_coords();
+	std::span<ProgramTriangleTexture::Vertex> vertices;
+	std::span<GLuint> indices;
+
+	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(this->select_texture(texture_options, offset, mesh.get_radius() * fp(2)).data);
+	mylib_assert_msg(!desc->indexed, "indexed textures can only be drawn by draw_rect2D")
+	mylib_assert_msg(!desc->trimmed, "trimmed textures can only be drawn by draw_rect2D and draw_text2D")
+	mylib_assert_msg(desc->texture_id == 0, "render targets can only be drawn by draw_rect2D")
+	const Vector2f& tex_left_top = desc->tex_coords[Enums::TextureVertexPositionIndex::LeftTop];
+	const Vector2f& tex_right_bottom = desc->tex_coords[Enums::TextureVertexPositionIndex::RightBottom];
+	const Vector2f tex_size = tex_right_bottom - tex_left_top;
+
+	const uint32_t first_vertex = this->program_mesh_texture->alloc_indexed_vertices(shape_vertices.size(), shape_indices.size(), vertices, indices);
+
+	// mesh tex coords are relative to the texture, so we map them into the atlas
+
+	for (uint32_t i = 0; i < shape_vertices.size(); i++) {
+		vertices[i].gvertex = shape_vertices[i];
+		vertices[i].offset = offset;
+		vertices[i].tex_coords = Vector3f(
+			tex_left_top.x + tex_coords[i].x * tex_size.x,
+			tex_left_top.y + tex_coords[i].y * tex_size.y,
+			desc->atlas->texture_depth);
+	}
+
+	for (uint32_t i = 0; i < shape_indices.size(); i++)
+		indices[i] = first_vertex + shape_indices[i];
+}
+
+// ---------------------------------------------------
+
+void Renderer::draw_voxel_chunk3D (VoxelChunk& chunk, const Vector& offset)
+{
+	chunk.update_mesh();
+
+	Opengl_VoxelChunkDescriptor *chunk_desc = Mylib::any_cast<Opengl_VoxelChunkDescriptor*>(chunk.data);
+
+	if (chunk_desc->mesh_version != chunk.get_mesh_version() || chunk_desc->texture_data_version != this->texture_data_version) {
+		this->voxel_vertices.clear();
+		this->voxel_indices.clear();
+
+		for (const std::vector<VoxelChunk::Quad>& slice : chunk.get_slices()) {
+			for (const VoxelChunk::Quad& quad : slice) {
+				const TextureRenderOptions& texture_options = chunk.get_material_texture(quad.material, quad.surface);
+				mylib_assert_msg(texture_options.set.info == nullptr, "voxel materials don't support texture sets")
+				const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture_options.desc.info->data);
+				mylib_assert_msg(!desc->indexed, "indexed textures can only be drawn by draw_rect2D")
+				mylib_assert_msg(!desc->trimmed, "trimmed textures can only be drawn by draw_rect2D and draw_text2D")
+				mylib_assert_msg(desc->texture_id == 0, "render targets can only be drawn by draw_rect2D")
+
+				using enum Enums::TextureVertexPositionIndex;
+
+				const Vector2f& tex_left_top = desc->tex_coords[LeftTop];
+				const Vector2f& tex_right_bottom = desc->tex_coords[RightBottom];
+				const Vector4f tex_rect(tex_left_top.x, tex_left_top.y, tex_right_bottom.x - tex_left_top.x, tex_right_bottom.y - tex_left_top.y);
+
+				// corners are left top, left bottom, right bottom and right top
+				const std::array<Vector2f, 4> tile_coords = {
+					Vector2f(0, 0),
+					Vector2f(0, quad.n_tiles.y),
+					Vector2f(quad.n_tiles.x, quad.n_tiles.y),
+					Vector2f(quad.n_tiles.x, 0)
+				};
+
+				const GLuint first_vertex = this->voxel_vertices.size();
+
+				for (uint32_t corner = 0; corner < 4; corner++) {
+					ProgramVoxel::Vertex& v = this->voxel_vertices.emplace_back();
+
+					v.gvertex.pos = quad.corners[corner];
+					v.gvertex.normal = quad.normal;
+					v.tile_coords = tile_coords[corner];
+					v.tex_rect = tex_rect;
+					v.tex_depth = desc->atlas->texture_depth;
+				}
+
+				// same order as Rect2D, counter-clockwise
+				for (const GLuint i : { 0, 1, 2, 0, 2, 3 })
+					this->voxel_indices.push_back(first_vertex + i);
+			}
+		}
+
+		this->program_voxel->upload_chunk_buffers(*chunk_desc, this->voxel_vertices, this->voxel_indices);
+
+		chunk_desc->mesh_version = chunk.get_mesh_version();
+		chunk_desc->texture_data_version = this->texture_data_version;
+	}
+
+	if (chunk_desc->n_indices == 0)
+		return;
+
+	this->program_voxel->add_batch( ProgramVoxel::Batch {
+		.vao = chunk_desc->vao,
+		.n_indices = chunk_desc->n_indices,
+		.offset = offset
+	} );
+}
+
+void Renderer::create_voxel_chunk (VoxelChunk& chunk)
+{
+	Opengl_VoxelChunkDescriptor *desc = new(this->memory_manager.allocate_type<Opengl_VoxelChunkDescriptor>(1)) Opengl_VoxelChunkDescriptor;
+
+	this->program_voxel->create_chunk_buffers(*desc);
+
+	// the mesh is uploaded by the first draw
+	desc->mesh_version = std::numeric_limits<uint64_t>::max();
+	desc->texture_data_version = this->texture_data_version;
+
+	chunk.data = desc;
+}
+
+void Renderer::destroy_voxel_chunk (VoxelChunk& chunk)
+{
+	Opengl_VoxelChunkDescriptor *desc = Mylib::any_cast<Opengl_VoxelChunkDescriptor*>(chunk.data);
+
+	state_cache.delete_vertex_arrays(1, &desc->vao);
+	state_cache.delete_buffers(1, &desc->vbo);
+	state_cache.delete_buffers(1, &desc->ebo);
+	this->memory_manager.deallocate_type(desc, 1);
+}
+
+// ---------------------------------------------------
+
+void Renderer::draw_heightfield3D (Heightfield3D& heightfield, const Vector& offset)
+{
+	heightfield.update_bounds();
+
+	const TextureRenderOptions& texture_options = heightfield.get_texture();
+	mylib_assert_msg(texture_options.set.info == nullptr, "heightfields don't support texture sets")
+	mylib_assert_msg(texture_options.desc.info != nullptr, "heightfield has no texture")
+	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture_options.desc.info->data);
+	mylib_assert_msg(!desc->indexed, "indexed textures can only be drawn by draw_rect2D")
+	mylib_assert_msg(!desc->trimmed, "trimmed textures can only be drawn by draw_rect2D and draw_text2D")
+	mylib_assert_msg(desc->texture_id == 0, "render targets can only be drawn by draw_rect2D")
+
+	Opengl_HeightfieldDescriptor *heightfield_desc = Mylib::any_cast<Opengl_HeightfieldDescriptor*>(heightfield.data);
+
+	if (heightfield_desc->version != heightfield.get_version()) {
+		state_cache.active_texture(GL_TEXTURE0 + ProgramHeightfield::height_texture_unit);
+		state_cache.bind_texture(GL_TEXTURE_2D, heightfield_desc->texture_id);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, heightfield.get_size_x(), heightfield.get_size_z(), GL_RED, GL_FLOAT, heightfield.get_heights().data());
+		state_cache.active_texture(GL_TEXTURE0);
+		ensure_no_error();
+
+		heightfield_desc->version = heightfield.get_version();
+	}
+
+	// With viewports, the frustums are only known in render,
+	// so the nodes are only culled without viewports.
+
+	std::array<Vector4f, 6> view_frustum_planes;
+	std::span<const std::array<Vector4f, 6>> frustums_planes;
+
+	if (this->viewports.empty()) {
+		view_frustum_planes = this->calculate_frustum_planes(this->program_triangle_texture_uniforms.projection_matrix);
+		frustums_planes = std::span(&view_frustum_planes, 1);
+	}
+
+	// the morph distances are relative to the camera used to select the texture lods
+	const Point& camera_pos = this->texture_lod_camera.pos;
+
+	this->heightfield_selection.clear();
+	heightfield.select_nodes(offset, camera_pos, frustums_planes, this->heightfield_selection);
+
+	if (this->heightfield_selection.empty())
+		return;
+
+	using enum Enums::TextureVertexPositionIndex;
+
+	const Vector2f& tex_left_top = desc->tex_coords[LeftTop];
+	const Vector2f& tex_right_bottom = desc->tex_coords[RightBottom];
+
+	this->program_heightfield->add_batch( ProgramHeightfield::Batch {
+		.height_texture_id = heightfield_desc->texture_id,
+		.offset = offset,
+		.camera_pos = camera_pos,
+		.size_x = heightfield.get_size_x(),
+		.size_z = heightfield.get_size_z(),
+		.cell_size = static_cast<float>(heightfield.get_cell_size()),
+		.tile_size = static_cast<float>(heightfield.get_tile_size()),
+		.tex_rect = Vector4f(tex_left_top.x, tex_left_top.y, tex_right_bottom.x - tex_left_top.x, tex_right_bottom.y - tex_left_top.y),
+		.tex_depth = static_cast<float>(desc->atlas->texture_depth),
+		.first_instance = 0,
+		.n_instances = 0
+	} );
+
+	std::span<ProgramHeightfield::Instance> instances = this->program_heightfield->alloc_instances(this->heightfield_selection.size());
+	const fp_t cell_size = heightfield.get_cell_size();
+
+	for (uint32_t i = 0; const Heightfield3D::SelectedNode& selected : this->heightfield_selection) {
+		ProgramHeightfield::Instance& instance = instances[i++];
+
+		instance.node = Vector4f(
+			static_cast<fp_t>(selected.node->x) * cell_size,
+			static_cast<fp_t>(selected.node->z) * cell_size,
+			static_cast<fp_t>(selected.node->size) * cell_size,
+			0
+		);
+
+		instance.morph = Vector2f(selected.morph_start, selected.morph_end);
+	}
+}
+
+// ---------------------------------------------------
+
+void Renderer::create_heightfield (Heightfield3D& heightfield)
+{
+	Opengl_HeightfieldDescriptor *desc = new(this->memory_manager.allocate_type<Opengl_HeightfieldDescriptor>(1)) Opengl_HeightfieldDescriptor;
+
+	glGenTextures(1, &desc->texture_id);
+
+	state_cache.active_texture(GL_TEXTURE0 + ProgramHeightfield::height_texture_unit);
+	state_cache.bind_texture(GL_TEXTURE_2D, desc->texture_id);
+
+	// GL_R32F can't be filtered in OpenGL ES, the vertex shader interpolates the samples with texelFetch
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, heightfield.get_size_x(), heightfield.get_size_z());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, heightfield.get_size_x(), heightfield.get_size_z(), GL_RED, GL_FLOAT, heightfield.get_heights().data());
+
+	state_cache.active_texture(GL_TEXTURE0);
+	ensure_no_error();
+
+	desc->version = heightfield.get_version();
+
+	heightfield.data = desc;
+
+	dprintln("heightfield created, size ", heightfield.get_size_x(), "x", heightfield.get_size_z(), ", ", heightfield.get_n_levels(), " levels");
+}
+
+void Renderer::destroy_heightfield (Heightfield3D& heightfield)
+{
+	Opengl_HeightfieldDescriptor *desc = Mylib::any_cast<Opengl_HeightfieldDescriptor*>(heightfield.data);
+
+	state_cache.delete_textures(1, &desc->texture_id);
+	this->memory_manager.deallocate_type(desc, 1);
 }
 
 // ---------------------------------------------------
@@ -306,7 +936,7 @@ void Renderer::draw_sphere3D (Sphere3D& sphere, const Vector& offset, const Colo
 
 	//dprintln("circle_size_per_cent_of_screen: ", circle_size_per_cent_of_screen, " n_triangles: ", n_vertices / 3);
 
-	std::span<ProgramTriangleColor::Vertex> vertices = this->program_triangle_color->alloc_vertices(n_vertices);
+	std::span<ProgramTriangleColor::Vertex> vertices = this->program_triangle_color_cull->alloc_vertices(n_vertices);
 
 	for (uint32_t i=0; i<n_vertices; i++) {
 		vertices[i].gvertex = shape_vertices[i];
@@ -324,7 +954,10 @@ void Renderer::draw_sphere3D (Sphere3D& sphere, const Vector& offset, const Text
 
 	mylib_assert(shape_vertices.size() == n_vertices)
 
-	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture_options.desc.info->data);
+	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(this->select_texture(texture_options, offset, sphere.get_radius() * fp(2)).data);
+	mylib_assert_msg(!desc->indexed, "indexed textures can only be drawn by draw_rect2D")
+	mylib_assert_msg(!desc->trimmed, "trimmed textures can only be drawn by draw_rect2D and draw_text2D")
+	mylib_assert_msg(desc->texture_id == 0, "render targets can only be drawn by draw_rect2D")
 	const Opengl_AtlasDescriptor *atlas = desc->atlas;
 
 	auto fill_vertices = [&sphere, &offset, &texture_options, n_vertices, shape_vertices, desc, atlas] (auto& program) -> void {
@@ -389,7 +1022,7 @@ void Renderer::draw_sphere3D (Sphere3D& sphere, const Vector& offset, const Text
 	};
 
 	if (sphere.get_rotation_angle() == fp(0))
-		fill_vertices(*this->program_triangle_texture);
+		fill_vertices(*this->program_triangle_texture_cull);
 	else
 		fill_vertices(*this->program_triangle_texture_rotation);
 }
@@ -453,11 +1086,20 @@ void Renderer::draw_rect2D (Rect2D& rect, const Vector& offset, const Color& col
 
 void Renderer::draw_rect2D (Rect2D& rect, const Vector& offset, const TextureRenderOptions& texture_options)
 {
-	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture_options.desc.info->data);
-	const Opengl_AtlasDescriptor *atlas = desc->atlas;
+	const Vector2& size = rect.get_size();
+	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(this->select_texture(texture_options, offset, std::max(size.x, size.y)).data);
+
+	if (desc->indexed) {
+		this->draw_indexed_rect2D(rect, offset, desc, texture_options.palette.value_or(desc->palette));
+		return;
+	}
 
 	constexpr uint32_t n_vertices = Rect2D::get_n_vertices();
-	std::span<ProgramTriangleTexture::Vertex> vertices = this->program_triangle_texture->alloc_vertices(n_vertices);
+
+	// render targets are not in the atlas, they are sampled from their own texture
+	std::span<ProgramTriangleTexture::Vertex> vertices = (desc->texture_id != 0)
+		? this->program_render_target->alloc_vertices(desc->texture_id, n_vertices)
+		: this->program_triangle_texture->alloc_vertices(n_vertices);
 	std::span<Vertex> shape_vertices = rect.get_local_rotated_vertices();
 
 	static_assert(n_vertices == 6);
@@ -468,58 +1110,265 @@ void Renderer::draw_rect2D (Rect2D& rect, const Vector& offset, const TextureRen
 		vertices[i].offset = offset;
 	}
 
+	// the quad shrinks to the part of the texture stored in the atlas
+
+	if (desc->trimmed) {
+		const Point& left_top = shape_vertices[0].pos;
+		const Vector right = shape_vertices[5].pos - left_top;
+		const Vector down = shape_vertices[1].pos - left_top;
+
+		auto corner = [&left_top, &right, &down] (const fp_t u, const fp_t v) -> Point {
+			return left_top + right * u + down * v;
+		};
+
+		vertices[0].gvertex.pos = corner(desc->trim_ini.x, desc->trim_ini.y); // upper left
+		vertices[1].gvertex.pos = corner(desc->trim_ini.x, desc->trim_end.y); // down left
+		vertices[2].gvertex.pos = corner(desc->trim_end.x, desc->trim_end.y); // down right
+		vertices[3].gvertex.pos = vertices[0].gvertex.pos; // upper left
+		vertices[4].gvertex.pos = vertices[2].gvertex.pos; // down right
+		vertices[5].gvertex.pos = corner(desc->trim_end.x, desc->trim_ini.y); // upper right
+	}
+
 	// we have to follow the same order used in Rect2D::calculate_vertices
 
 	using enum Enums::TextureVertexPositionIndex;
 
-	vertices[0].tex_coords = Vector3f(desc->tex_coords[LeftTop].x, desc->tex_coords[LeftTop].y, atlas->texture_depth); // upper left
-	vertices[1].tex_coords = Vector3f(desc->tex_coords[RightBottom].x, desc->tex_coords[RightBottom].y, atlas->texture_depth); // down right
-	vertices[2].tex_coords = Vector3f(desc->tex_coords[LeftBottom].x, desc->tex_coords[LeftBottom].y, atlas->texture_depth); // down left
-	vertices[3].tex_coords = Vector3f(desc->tex_coords[LeftTop].x, desc->tex_coords[LeftTop].y, atlas->texture_depth); // upper left
-	vertices[4].tex_coords = Vector3f(desc->tex_coords[RightTop].x, desc->tex_coords[RightTop].y, atlas->texture_depth); // upper right
-	vertices[5].tex_coords = Vector3f(desc->tex_coords[RightBottom].x, desc->tex_coords[RightBottom].y, atlas->texture_depth); // down right
+	const float tex_depth = (desc->atlas != nullptr) ? desc->atlas->texture_depth : 0; // render targets have no atlas
+
+	vertices[0].tex_coords = Vector3f(desc->tex_coords[LeftTop].x, desc->tex_coords[LeftTop].y, tex_depth); // upper left
+	vertices[1].tex_coords = Vector3f(desc->tex_coords[LeftBottom].x, desc->tex_coords[LeftBottom].y, tex_depth); // down left
+	vertices[2].tex_coords = Vector3f(desc->tex_coords[RightBottom].x, desc->tex_coords[RightBottom].y, tex_depth); // down right
+	vertices[3].tex_coords = Vector3f(desc->tex_coords[LeftTop].x, desc->tex_coords[LeftTop].y, tex_depth); // upper left
+	vertices[4].tex_coords = Vector3f(desc->tex_coords[RightBottom].x, desc->tex_coords[RightBottom].y, tex_depth); // down right
+	vertices[5].tex_coords = Vector3f(desc->tex_coords[RightTop].x, desc->tex_coords[RightTop].y, tex_depth); // upper right
 }
 
 // ---------------------------------------------------
 
-void Renderer::setup_render_3D (const RenderArgs3D& args)
+void Renderer::draw_indexed_rect2D (Rect2D& rect, const Vector& offset, const Opengl_TextureDescriptor *desc, const PaletteDescriptor palette)
 {
-	Matrix4 projection_matrix;
+	const Opengl_AtlasDescriptor *atlas = desc->atlas;
 
-	if (std::holds_alternative<PerspectiveProjectionInfo>(args.projection)) {
-		const PerspectiveProjectionInfo& perspective_info = std::get<PerspectiveProjectionInfo>(args.projection);
+	mylib_assert(palette < this->palettes.size())
 
-		projection_matrix.set_perspective(
-			perspective_info.fov_y,
-			static_cast<fp_t>(this->window_width_px),
-			static_cast<fp_t>(this->window_height_px),
-			perspective_info.z_near,
-			perspective_info.z_far
-		);
-	}
-	else if (std::holds_alternative<OrthogonalProjectionInfo>(args.projection)) {
-		const OrthogonalProjectionInfo& orthogonal_info = std::get<OrthogonalProjectionInfo>(args.projection);
+	constexpr uint32_t n_vertices = Rect2D::get_n_vertices();
+	std::span<ProgramTriangleIndexed::Vertex> vertices = this->program_triangle_indexed->alloc_vertices(n_vertices);
+	std::span<Vertex> shape_vertices = rect.get_local_rotated_vertices();
 
-		projection_matrix.set_orthogonal(
-			orthogonal_info.view_width,
-			static_cast<fp_t>(this->window_width_px),
-			static_cast<fp_t>(this->window_height_px),
-			orthogonal_info.z_near,
-			orthogonal_info.z_far
+	static_assert(n_vertices == 6);
+	mylib_assert(shape_vertices.size() == n_vertices)
+
+	for (uint32_t i=0; i<n_vertices; i++) {
+		vertices[i].gvertex = shape_vertices[i];
+		vertices[i].offset = offset;
+		vertices[i].palette = static_cast<float>(palette);
+	}
+
+	// same order used in Rect2D::calculate_vertices
+
+	using enum Enums::TextureVertexPositionIndex;
+
+	vertices[0].tex_coords = Vector3f(desc->tex_coords[LeftTop].x, desc->tex_coords[LeftTop].y, atlas->texture_depth); // upper left
+	vertices[1].tex_coords = Vector3f(desc->tex_coords[LeftBottom].x, desc->tex_coords[LeftBottom].y, atlas->texture_depth); // down left
+	vertices[2].tex_coords = Vector3f(desc->tex_coords[RightBottom].x, desc->tex_coords[RightBottom].y, atlas->texture_depth); // down right
+	vertices[3].tex_coords = Vector3f(desc->tex_coords[LeftTop].x, desc->tex_coords[LeftTop].y, atlas->texture_depth); // upper left
+	vertices[4].tex_coords = Vector3f(desc->tex_coords[RightBottom].x, desc->tex_coords[RightBottom].y, atlas->texture_depth); // down right
+	vertices[5].tex_coords = Vector3f(desc->tex_coords[RightTop].x, desc->tex_coords[RightTop].y, atlas->texture_depth); // upper right
+}
+
+// ---------------------------------------------------
+
+void Renderer::draw_text2D (const std::string_view text, const Vector& offset, const TextRenderOptions& text_options)
+{
+	const Font::Layout& layout = text_options.font->get_layout(text);
+	const uint32_t n_quads = layout.quads.size();
+
+	if (n_quads == 0)
+		return;
+
+	const fp_t scale = text_options.line_height / static_cast<fp_t>(text_options.font->get_line_height_px());
+	const fp_t y_dir = text_options.invert_y_axis ? fp(1) : fp(-1); // text lines always go down the screen
+
+	auto instances = this->program_quad_instanced->alloc_instances(n_quads);
+
+	using enum Enums::TextureVertexPositionIndex;
+
+	for (uint32_t i=0; i<n_quads; i++) {
+		const Font::GlyphQuad& glyph_quad = layout.quads[i];
+		const Font::Glyph& glyph = *glyph_quad.glyph;
+		const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(glyph.texture.info->data);
+		mylib_assert_msg(desc->texture_id == 0, "render targets can only be drawn by draw_rect2D")
+		auto& q = instances[i];
+
+		// only the trimmed part of the glyph is drawn
+
+		const fp_t x = (glyph_quad.pos_px.x + static_cast<fp_t>(glyph.width_px) * desc->trim_ini.x) * scale;
+		const fp_t y = (glyph_quad.pos_px.y + static_cast<fp_t>(glyph.height_px) * desc->trim_ini.y) * scale;
+		const fp_t w = static_cast<fp_t>(glyph.width_px) * (desc->trim_end.x - desc->trim_ini.x) * scale;
+		const fp_t h = static_cast<fp_t>(glyph.height_px) * (desc->trim_end.y - desc->trim_ini.y) * scale;
+
+		q.set_transform(Point3f(offset.x + x + w * fp(0.5),
+		                        offset.y + (y + h * fp(0.5)) * y_dir,
+		                        offset.z),
+		                Vector2f(w, h), 0);
+		q.color = text_options.color;
+
+		// the (-x,-y) corner is the left top of the glyph only when y grows downwards
+
+		if (text_options.invert_y_axis)
+			q.tex_rect = Vector4f(desc->tex_coords[LeftTop].x, desc->tex_coords[LeftTop].y, desc->tex_coords[RightBottom].x, desc->tex_coords[RightBottom].y);
+		else
+			q.tex_rect = Vector4f(desc->tex_coords[LeftBottom].x, desc->tex_coords[LeftBottom].y, desc->tex_coords[RightTop].x, desc->tex_coords[RightTop].y);
+
+		q.tex_depth = desc->atlas->texture_depth;
+	}
+}
+
+// ---------------------------------------------------
+
+void Renderer::draw_lines3D (const std::span<const Line3DInstance> lines)
+{
+	const uint32_t n_lines = lines.size();
+	std::span<ProgramLineColor::Vertex> vertices = this->program_line_color->alloc_vertices(n_lines * Line3D::get_n_vertices());
+
+	for (uint32_t i=0; i<n_lines; i++) {
+		const Line3DInstance& line = lines[i];
+		const Vector direction = line.to - line.from;
+		ProgramLineColor::Vertex *v = &vertices[i * 2];
+
+		v[0].gvertex.pos = line.from;
+		v[0].gvertex.direction = direction;
+		v[0].offset.set_zero();
+		v[0].color = line.color;
+
+		v[1].gvertex.pos = line.to;
+		v[1].gvertex.direction = direction;
+		v[1].offset.set_zero();
+		v[1].color = line.color;
+	}
+}
+
+void Renderer::draw_cubes3D (const std::span<const Cube3DInstance> cubes)
+{
+	constexpr uint32_t n_vertices = Cube3D::get_n_vertices();
+
+	// Cubes are axis-aligned, so we just scale the vertices of a unit cube.
+	// The normals are not affected by the scale.
+	static Cube3D unit_cube(1);
+	const std::span<Vertex> unit_vertices = unit_cube.get_local_vertices();
+
+	const uint32_t n_cubes = cubes.size();
+	std::span<ProgramTriangleColor::Vertex> vertices = this->program_triangle_color_cull->alloc_vertices(n_cubes * n_vertices);
+
+	for (uint32_t i=0; i<n_cubes; i++) {
+		const Cube3DInstance& cube = cubes[i];
+		ProgramTriangleColor::Vertex *v = &vertices[i * n_vertices];
+
+		for (uint32_t j=0; j<n_vertices; j++) {
+			const Vertex& uv = unit_vertices[j];
+
+			v[j].gvertex.pos = Vector(uv.pos.x * cube.size.x, uv.pos.y * cube.size.y, uv.pos.z * cube.size.z);
+			v[j].gvertex.normal = uv.normal;
+			v[j].offset = cube.pos;
+			v[j].color = cube.color;
+		}
+	}
+}
+
+void Renderer::draw_rects2D (const std::span<const Rect2DInstance> rects)
+{
+	/*
+		Same vertices as draw_rect2D, so the rects are lit and layered like it,
+		but without building a Rect2D and rotating it with a quaternion for each one.
+		We have to follow the same order used in Rect2D::calculate_vertices.
+	*/
+
+	constexpr uint32_t n_vertices = Rect2D::get_n_vertices();
+	static_assert(n_vertices == 6);
+
+	static constexpr std::array<std::pair<fp_t, fp_t>, n_vertices> corners = {
+		std::make_pair(fp(-0.5), fp(-0.5)), // upper left
+		std::make_pair(fp(-0.5), fp(0.5)),  // down left
+		std::make_pair(fp(0.5), fp(0.5)),   // down right
+		std::make_pair(fp(-0.5), fp(-0.5)), // upper left
+		std::make_pair(fp(0.5), fp(0.5)),   // down right
+		std::make_pair(fp(0.5), fp(-0.5))   // upper right
+	};
+
+	const uint32_t n_rects = rects.size();
+	std::span<ProgramTriangleColor::Vertex> vertices = this->program_triangle_color->alloc_vertices(n_rects * n_vertices);
+
+	for (uint32_t i=0; i<n_rects; i++) {
+		const Rect2DInstance& rect = rects[i];
+		ProgramTriangleColor::Vertex *v = &vertices[i * n_vertices];
+
+		// rotation around the z axis
+		const fp_t c = std::cos(rect.rotation);
+		const fp_t s = std::sin(rect.rotation);
+
+		for (uint32_t j=0; j<n_vertices; j++) {
+			const fp_t x = corners[j].first * rect.size.x;
+			const fp_t y = corners[j].second * rect.size.y;
+
+			v[j].gvertex.pos = Vector(x*c - y*s, x*s + y*c, 0);
+			v[j].gvertex.normal = Vector(0, 0, -1);
+			v[j].offset = rect.pos;
+			v[j].color = rect.color;
+		}
+	}
+}
+
+// ---------------------------------------------------
+
+void Renderer::setup_render_3D (const RenderArgs3D& args)
+{
+	this->viewports.clear();
+
+	this->set_projection_matrix(this->calculate_projection_matrix_3D(args, static_cast<fp_t>(this->window_width_px), static_cast<fp_t>(this->window_height_px)));
+
+	this->program_triangle_color_uniforms.ambient_light_color = args.ambient_light_color;
+	this->program_triangle_texture_uniforms.ambient_light_color = this->program_triangle_color_uniforms.ambient_light_color;
+
+	this->lighting = true;
+
+	this->update_texture_lod_camera(args);
+}
+
+// ---------------------------------------------------
+
+Matrix4 Renderer::calculate_projection_matrix_3D (const RenderArgs3D& args, const fp_t width_px, const fp_t height_px) const
+{
+	Matrix4 projection_matrix;
+
+	if (std::holds_alternative<PerspectiveProjectionInfo>(args.projection)) {
+		const PerspectiveProjectionInfo& perspective_info = std::get<PerspectiveProjectionInfo>(args.projection);
+
+		projection_matrix.set_perspective(
+			perspective_info.fov_y,
+			width_px,
+			height_px,
+			perspective_info.z_near,
+			perspective_info.z_far
+		);
+	}
+	else if (std::holds_alternative<OrthogonalProjectionInfo>(args.projection)) {
+		const OrthogonalProjectionInfo& orthogonal_info = std::get<OrthogonalProjectionInfo>(args.projection);
+
+		projection_matrix.set_orthogonal(
+			orthogonal_info.view_width,
+			width_px,
+			height_px,
+			orthogonal_info.z_near,
+			orthogonal_info.z_far
 		);
 	}
 
-	this->program_triangle_color_uniforms.projection_matrix = projection_matrix
+	return projection_matrix
 		* Matrix4::look_at(
 			args.world_camera_pos,
 			args.world_camera_target,
 			args.world_camera_up);
 
-	this->program_triangle_color_uniforms.ambient_light_color = args.ambient_light_color;
-
-	this->program_triangle_texture_uniforms.projection_matrix = this->program_triangle_color_uniforms.projection_matrix;
-	this->program_triangle_texture_uniforms.ambient_light_color = this->program_triangle_color_uniforms.ambient_light_color;
-
 #if 0
 	dprintln("projection matrix:");
 	dprintln(this->uniforms.projection_matrix);
@@ -538,6 +1387,23 @@ void Renderer::setup_render_3D (const RenderArgs3D& args)
 // ---------------------------------------------------
 
 void Renderer::setup_render_2D (const RenderArgs2D& args)
+{
+	this->viewports.clear();
+
+	this->set_projection_matrix(this->calculate_projection_matrix_2D(args));
+
+	// programs without variants (e.g. lines) still apply the ambient light
+	this->program_triangle_color_uniforms.ambient_light_color = {1, 1, 1, 1};
+	this->program_triangle_texture_uniforms.ambient_light_color = this->program_triangle_color_uniforms.ambient_light_color;
+
+	this->lighting = false;
+
+	this->update_texture_lod_camera(args);
+}
+
+// ---------------------------------------------------
+
+Matrix4 Renderer::calculate_projection_matrix_2D (const RenderArgs2D& args) const
 {
 #ifndef MYGLIB_OPENGL_SOFTWARE_CALCULATE_MATRIX
 	const Vector2 normalized_clip_init = args.clip_init_norm;
@@ -633,121 +1499,1003 @@ void Renderer::setup_render_2D (const RenderArgs2D& args)
 	const Matrix4 translate_camera = Matrix4::translate(-world_camera);
 //	dprintln( "translation matrix:" ) translate_camera.println();
 
-	this->program_triangle_color_uniforms.projection_matrix = 
-		(((translate_subtract_one
+	//dprintln( "final matrix:" ) this->projection_matrix.println();
+
+	return (((translate_subtract_one
 		* opengl_scale_mirror)
 		* translate_to_normalized_clip_init)
 		* scale_normalized)
 		* translate_camera;
-	//this->projection_matrix = scale * translate_camera;
-	//dprintln( "final matrix:" ) this->projection_matrix.println();
+#else
+	return Mylib::Math::gen_identity_matrix<fp_t, 4>();
+#endif
+}
 
-	this->program_triangle_color_uniforms.ambient_light_color = {1, 1, 1, 1};
+// ---------------------------------------------------
 
-	this->light_point_sources[0].pos = Vector3(0, 0, -1);
-	this->light_point_sources[0].color = {1, 1, 1, 0};
+void Renderer::setup_viewports (const std::span<const ViewportArgs> viewports)
+{
+	mylib_assert(!viewports.empty())
 
-	this->program_triangle_texture_uniforms.projection_matrix = this->program_triangle_color_uniforms.projection_matrix;
-	this->program_triangle_texture_uniforms.ambient_light_color = this->program_triangle_color_uniforms.ambient_light_color;
-#else
-	this->projection_matrix = Mylib::Math::gen_identity_matrix<fp_t, 4>();
-#endif
+	this->viewports.assign(viewports.begin(), viewports.end());
 
-#if 0
-	dprintln("projection matrix:");
-	dprintln(this->projection_matrix);
-	dprintln();
-#endif
+	// texture sets are selected for the first view
+	std::visit([this] (const auto& args) -> void {
+		this->update_texture_lod_camera(args);
+	}, viewports.front().args);
+}
+
+// ---------------------------------------------------
+
+/*
+	The views are rebuilt in every render, since the size
+	of the scene target changes with the render scale.
+	Lights, occlusion queries and the draw functions see the first view.
+*/
+
+void Renderer::build_views ()
+{
+	this->views.clear();
+
+	if (this->viewports.empty())
+		return;
+
+	const int32_t target_width_px = this->scaled_rendering ? this->scene_width_px : this->window_width_px;
+	const int32_t target_height_px = this->scaled_rendering ? this->scene_height_px : this->window_height_px;
+
+	// same normalized coords of RenderArgs2D
+	const fp_t norm_to_px = static_cast<fp_t>(std::max(target_width_px, target_height_px));
+
+	auto to_px = [norm_to_px] (const fp_t v) -> GLint {
+		return static_cast<GLint>(std::lround(v * norm_to_px));
+	};
+
+	this->views_target_size_px = { target_width_px, target_height_px };
+	this->lighting = false;
+
+	for (const ViewportArgs& viewport : this->viewports) {
+		View view;
+
+		if (std::holds_alternative<RenderArgs3D>(viewport.args)) {
+			const RenderArgs3D& args = std::get<RenderArgs3D>(viewport.args);
+			const GLint x = to_px(viewport.clip_init_norm.x);
+			const GLint y = to_px(viewport.clip_init_norm.y);
+			const GLint w = to_px(viewport.clip_end_norm.x) - x;
+			const GLint h = to_px(viewport.clip_end_norm.y) - y;
+
+			mylib_assert_msg(w > 0 && h > 0, "viewport with empty area");
+
+			view.viewport_px = { x, y, w, h };
+			view.scissor_px = view.viewport_px;
+			view.projection_matrix = this->calculate_projection_matrix_3D(args, static_cast<fp_t>(w), static_cast<fp_t>(h));
+			view.ambient_light_color = args.ambient_light_color;
+			view.lighting = true;
+
+			this->lighting = true;
+		}
+		else {
+			const RenderArgs2D& args = std::get<RenderArgs2D>(viewport.args);
+			const GLint x = to_px(args.clip_init_norm.x);
+			const GLint w = to_px(args.clip_end_norm.x) - x;
+			const GLint h = to_px(args.clip_end_norm.y) - to_px(args.clip_init_norm.y);
+
+			// with the y axis inverted, clip_init_norm is at the top of the window
+			const GLint y = args.invert_y_axis ? (target_height_px - to_px(args.clip_end_norm.y)) : to_px(args.clip_init_norm.y);
+
+			// the 2D projection already maps the world to the clip area of the whole target
+			view.viewport_px = { 0, 0, target_width_px, target_height_px };
+			view.scissor_px = { x, y, w, h };
+			view.projection_matrix = this->calculate_projection_matrix_2D(args);
+			view.ambient_light_color = {1, 1, 1, 1};
+			view.lighting = false;
+		}
+
+		view.frustum_planes = this->calculate_frustum_planes(view.projection_matrix);
+
+		this->views.push_back(view);
+	}
+
+	this->set_projection_matrix(this->views.front().projection_matrix);
+	this->program_triangle_color_uniforms.ambient_light_color = this->views.front().ambient_light_color;
+	this->program_triangle_texture_uniforms.ambient_light_color = this->views.front().ambient_light_color;
+}
+
+void Renderer::apply_view (const View& view)
+{
+	glViewport(view.viewport_px[0], view.viewport_px[1], view.viewport_px[2], view.viewport_px[3]);
+	glScissor(view.scissor_px[0], view.scissor_px[1], view.scissor_px[2], view.scissor_px[3]);
+	state_cache.set_capability(GL_SCISSOR_TEST, true);
+}
+
+void Renderer::restore_view ()
+{
+	// the render graph only sets the viewport when the target changes
+	glViewport(0, 0, this->views_target_size_px[0], this->views_target_size_px[1]);
+	state_cache.set_capability(GL_SCISSOR_TEST, false);
+}
+
+/*
+	Calls draw once for each view, with the uniforms of the view.
+	Without viewports, calls it once with the uniforms as they are.
+*/
+
+template <typename Tuniforms, typename Tdraw>
+void Renderer::draw_views (const Tuniforms& uniforms, Tdraw&& draw)
+{
+	if (this->views.empty()) {
+		draw(uniforms, this->frustum_planes);
+		return;
+	}
+
+	Tuniforms view_uniforms = uniforms;
+
+	for (const View& view : this->views) {
+		this->apply_view(view);
+
+		view_uniforms.projection_matrix = view.projection_matrix;
+
+		if constexpr (requires { view_uniforms.lit; }) {
+			view_uniforms.lit = view.lighting;
+			view_uniforms.ambient_light_color = view.ambient_light_color;
+		}
+
+		draw(view_uniforms, view.frustum_planes);
+	}
+
+	this->restore_view();
 }
 
 // ---------------------------------------------------
 
 void Renderer::render ()
 {
-	this->program_triangle_color_uniforms.point_light_pos = this->light_point_sources[0].pos;
-	this->program_triangle_color_uniforms.point_light_color = this->light_point_sources[0].color;
+	this->build_views();
+	this->update_light_uniforms();
+	this->frustum_planes = this->calculate_frustum_planes(this->program_triangle_color_uniforms.projection_matrix);
+
+	// The cpu path only fills the vertex buffer of program_triangle_color.
+	// With viewports, an object is kept if any view sees it.
+	if (!this->indirect_mesh_scene->get_gpu_driven()) {
+		if (this->views.empty())
+			this->indirect_mesh_scene->cpu_cull(*this->program_triangle_color, std::span(&this->frustum_planes, 1));
+		else {
+			std::vector< std::array<Vector4f, 6> > views_frustum_planes;
+
+			for (const View& view : this->views)
+				views_frustum_planes.push_back(view.frustum_planes);
+
+			this->indirect_mesh_scene->cpu_cull(*this->program_triangle_color, views_frustum_planes);
+		}
+	}
+
+	/*
+		The graph is executed right away instead of at the end of the frame,
+		since render may be called several times per frame with different projections.
+	*/
+
+	this->render_graph->reset();
+
+	const RenderGraph::ResourceId scene = this->import_scene_target();
+
+	// meshes of the indirect scene are opaque, so they can be drawn before the vertex buffers
+
+	if (this->indirect_mesh_scene->get_gpu_driven() && this->indirect_mesh_scene->get_n_objects() > 0) {
+		this->render_graph->add_pass("indirect-meshes", {}, scene, [this] (RenderGraph&) -> void {
+			this->draw_views(this->program_triangle_color_uniforms, [this] (const auto& uniforms, const auto& frustum_planes) -> void {
+				this->indirect_mesh_scene->gpu_cull_and_draw(uniforms, frustum_planes);
+			});
+		});
+	}
+
+	this->add_vertex_buffer_passes(scene);
+
+	// the queries need the whole scene in the depth buffer
+
+	if (this->occlusion_culler->has_queries_to_issue()) {
+		this->render_graph->add_pass("occlusion-queries", {scene}, scene, [this] (RenderGraph&) -> void {
+			// only the first view is queried
+			if (!this->views.empty())
+				this->apply_view(this->views.front());
+
+			this->occlusion_culler->issue_queries(this->program_triangle_color_uniforms.projection_matrix, this->frustum_planes[4], this->frame_number);
+
+			if (!this->views.empty())
+				this->restore_view();
+		});
+	}
+
+	this->render_graph->compile();
+	this->execute_render_graph();
+
+	// the vertex buffers flushed outside render (e.g. by cached layers) don't use the views
+	this->views.clear();
+}
+
+// ---------------------------------------------------
+
+/*
+	The lights in use are packed at the start of the arrays.
+	The other ones get alpha 0, since programs without variants
+	always read the first light.
+*/
+
+void Renderer::update_light_uniforms ()
+{
+	ProgramTriangleColor::Uniforms& color_uniforms = this->program_triangle_color_uniforms;
+	ProgramTriangleTexture::Uniforms& texture_uniforms = this->program_triangle_texture_uniforms;
+	uint32_t n = 0;
+
+	if (this->lighting) {
+		for (const LightPointSource& light_source : this->light_point_sources) {
+			if (light_source.busy) {
+				color_uniforms.point_light_pos[n] = light_source.pos;
+				color_uniforms.point_light_color[n] = light_source.color;
+				n++;
+			}
+		}
+	}
+
+	color_uniforms.n_point_lights = n;
+	color_uniforms.lit = this->lighting;
+
+	for (; n < ProgramTriangleColor::max_point_lights; n++) {
+		color_uniforms.point_light_pos[n] = Vector3(0, 0, 0);
+		color_uniforms.point_light_color[n] = {0, 0, 0, 0};
+	}
+
+	texture_uniforms.point_light_pos = color_uniforms.point_light_pos;
+	texture_uniforms.point_light_color = color_uniforms.point_light_color;
+	texture_uniforms.n_point_lights = color_uniforms.n_point_lights;
+	texture_uniforms.lit = color_uniforms.lit;
+	texture_uniforms.alpha_test = this->texture_alpha_test;
+}
+
+// ---------------------------------------------------
+
+void Renderer::set_projection_matrix (const Matrix4& projection_matrix)
+{
+	this->program_triangle_color_uniforms.projection_matrix = projection_matrix;
+	this->program_triangle_texture_uniforms.projection_matrix = projection_matrix;
+	this->program_quad_instanced_uniforms.projection_matrix = projection_matrix;
+	this->program_triangle_indexed_uniforms.projection_matrix = projection_matrix;
+}
+
+// ---------------------------------------------------
+
+// The framebuffer where the scene is being rendered, as seen by the render graph.
+
+RenderGraph::ResourceId Renderer::import_scene_target ()
+{
+	if (this->scaled_rendering)
+		return this->render_graph->import_framebuffer("scene", this->scene_fbo, this->scene_width_px, this->scene_height_px);
+	else
+		return this->render_graph->import_framebuffer("backbuffer", 0, this->window_width_px, this->window_height_px);
+}
+
+// Outside of the graph, the scene target is always bound with its full viewport.
+
+void Renderer::execute_render_graph ()
+{
+	if (this->scaled_rendering)
+		this->render_graph->execute(this->scene_fbo, this->scene_width_px, this->scene_height_px);
+	else
+		this->render_graph->execute(0, this->window_width_px, this->window_height_px);
+}
+
+// ---------------------------------------------------
+
+/*
+	Adds one pass for each program that has something in its vertex buffer.
+	All of them blend over the target, so they read and write it,
+	which keeps them in the order they are added.
+	Doesn't clear the buffers.
+*/
+
+void Renderer::add_vertex_buffer_passes (const RenderGraph::ResourceId target)
+{
+	auto add_program_pass = [this, target] (const char *name, auto *program, const auto& uniforms) -> void {
+		if (!program->has_vertices())
+			return;
+
+		// with viewports, the vertex buffers are uploaded once and drawn once for each view
+
+		this->render_graph->add_pass(name, {target}, target, [this, program, &uniforms] (RenderGraph&) -> void {
+			program->load();
+			program->upload_vertex_buffers();
+
+			this->draw_views(uniforms, [program] (const auto& view_uniforms, const auto&) -> void {
+				program->upload_uniforms(view_uniforms);
+				program->draw();
+			});
+		});
+	};
+
+	add_program_pass("triangles-color", this->program_triangle_color, this->program_triangle_color_uniforms);
+	add_program_pass("triangles-color-cull", this->program_triangle_color_cull, this->program_triangle_color_uniforms);
+	add_program_pass("meshes-color", this->program_mesh_color, this->program_triangle_color_uniforms);
+	add_program_pass("lines-color", this->program_line_color, this->program_triangle_color_uniforms);
+	add_program_pass("triangles-texture", this->program_triangle_texture, this->program_triangle_texture_uniforms);
+	add_program_pass("render-targets", this->program_render_target, this->program_triangle_texture_uniforms);
+	add_program_pass("triangles-indexed", this->program_triangle_indexed, this->program_triangle_indexed_uniforms);
+	add_program_pass("triangles-texture-cull", this->program_triangle_texture_cull, this->program_triangle_texture_uniforms);
+	add_program_pass("meshes-texture", this->program_mesh_texture, this->program_triangle_texture_uniforms);
+	add_program_pass("triangles-texture-rotation", this->program_triangle_texture_rotation, this->program_triangle_texture_uniforms);
+	add_program_pass("voxels", this->program_voxel, this->program_triangle_texture_uniforms);
+	add_program_pass("heightfields", this->program_heightfield, this->program_triangle_texture_uniforms);
+
+	// quads are usually transparent (sprites and particles), so they are rendered last
+
+	add_program_pass("quads-instanced", this->program_quad_instanced, this->program_quad_instanced_uniforms);
+}
+
+// ---------------------------------------------------
+
+/*
+	Extracts the 6 frustum planes from the projection matrix
+	(Gribb & Hartmann), in world coords.
+	A point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0.
+*/
+
+std::array<Vector4f, 6> Renderer::calculate_frustum_planes (const Matrix4& projection_matrix) const
+{
+	const fp_t *m = projection_matrix.get_raw(); // row-major
+
+	auto row = [m] (const uint32_t i) -> Vector4f {
+		return Vector4f(m[i*4 + 0], m[i*4 + 1], m[i*4 + 2], m[i*4 + 3]);
+	};
+
+	const Vector4f r0 = row(0);
+	const Vector4f r1 = row(1);
+	const Vector4f r2 = row(2);
+	const Vector4f r3 = row(3);
+
+	std::array<Vector4f, 6> planes = {
+		r3 + r0, // left
+		r3 - r0, // right
+		r3 + r1, // bottom
+		r3 - r1, // top
+		r3 + r2, // near
+		r3 - r2  // far
+	};
+
+	for (Vector4f& plane : planes) {
+		const fp_t length = std::sqrt(plane.x*plane.x + plane.y*plane.y + plane.z*plane.z);
+
+		if (length > fp(0))
+			plane = plane * (fp(1) / length);
+	}
+
+	return planes;
+}
+
+// ---------------------------------------------------
+
+void Renderer::update_screen ()
+{
+	this->render_graph->reset();
+
+	const RenderGraph::ResourceId backbuffer = this->render_graph->import_framebuffer("backbuffer", 0, this->window_width_px, this->window_height_px);
+
+	if (this->scaled_rendering) {
+		const RenderGraph::ResourceId scene = this->render_graph->import_framebuffer("scene", this->scene_fbo, this->scene_width_px, this->scene_height_px);
+
+		this->render_graph->add_pass("upscale", {scene}, backbuffer, [this] (RenderGraph&) -> void {
+			this->upscale_scene();
+		});
+	}
+
+	// after the upscale, the default framebuffer has the final image
+
+	if (this->capturing) {
+		this->render_graph->add_pass("capture", {backbuffer}, backbuffer, [this] (RenderGraph&) -> void {
+			this->capture_frame();
+		});
+	}
+
+	this->render_graph->compile();
+	this->execute_render_graph();
+
+#ifndef __ANDROID__
+	if (this->gpu_timer_running) {
+		glEndQuery(GL_TIME_ELAPSED);
+		this->gpu_timer_running = false;
+
+		// read the previous frame, which is usually already available
+
+		this->gpu_timer_current = (this->gpu_timer_current + 1) % this->gpu_timer_queries.size();
+
+		const GLuint query = this->gpu_timer_queries[this->gpu_timer_current];
+		GLint available = 0;
+
+		if (glIsQuery(query))
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available) {
+			GLuint64 elapsed_ns;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_ns);
+			this->gpu_frame_dt = static_cast<fp_t>(elapsed_ns) * fp(1e-9);
+		}
+	}
+#endif
+
+	SDL_GL_SwapWindow(this->sdl_window);
+
+	this->n_frame_state_calls = state_cache.get_n_calls();
+	this->n_frame_state_skipped_calls = state_cache.get_n_skipped_calls();
+	state_cache.reset_stats();
+
+	this->frame_number++;
+}
+
+// ---------------------------------------------------
+
+void Renderer::begin_frame_capture (FrameCaptureCallback callback)
+{
+	mylib_assert_msg(!this->capturing, "frame capture already started")
+
+	const GLsizeiptr size = static_cast<GLsizeiptr>(this->window_width_px) * static_cast<GLsizeiptr>(this->window_height_px) * 4;
+
+	for (CaptureSlot& slot : this->capture_slots) {
+		glGenBuffers(1, &slot.pbo);
+		state_cache.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		slot.fence = nullptr;
+	}
+
+	state_cache.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	ensure_no_error();
+
+	this->capture_callback = std::move(callback);
+	this->capture_next_slot = 0;
+	this->capture_n_pending = 0;
+	this->n_dropped_capture_frames = 0;
+	this->capturing = true;
+
+	dprintln("frame capture started with ", n_capture_buffers, " pixel buffers of ", size, " bytes");
+}
+
+// ---------------------------------------------------
+
+void Renderer::end_frame_capture ()
+{
+	mylib_assert_msg(this->capturing, "frame capture not started")
+
+	// recording is over, so it is fine to wait for the last frames
+	this->read_captured_frames(true);
+
+	for (CaptureSlot& slot : this->capture_slots)
+		state_cache.delete_buffers(1, &slot.pbo);
+
+	ensure_no_error();
+
+	this->capture_callback = nullptr;
+	this->capturing = false;
+
+	dprintln("frame capture finished, ", this->n_dropped_capture_frames, " frames dropped");
+}
+
+// ---------------------------------------------------
+
+void Renderer::capture_frame ()
+{
+	this->read_captured_frames(false);
+
+	if (this->capture_n_pending == n_capture_buffers) {
+		// the gpu is too far behind, never block the renderer
+		this->n_dropped_capture_frames++;
+		return;
+	}
+
+	CaptureSlot& slot = this->capture_slots[this->capture_next_slot];
+
+	// the render graph has already bound the default framebuffer
+	state_cache.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	// with a pack buffer bound, the last argument is an offset in the buffer
+	glReadPixels(0, 0, this->window_width_px, this->window_height_px, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	state_cache.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame_number = this->frame_number;
+	ensure_no_error();
+
+	this->capture_next_slot = (this->capture_next_slot + 1) % n_capture_buffers;
+	this->capture_n_pending++;
+}
+
+// ---------------------------------------------------
+
+void Renderer::read_captured_frames (const bool wait)
+{
+	constexpr GLuint64 wait_timeout_ns = 1'000'000'000;
+
+	const uint32_t row_size = this->window_width_px * 4;
+
+	while (this->capture_n_pending > 0) {
+		// frames are read in the same order they were captured
+		CaptureSlot& slot = this->capture_slots[(this->capture_next_slot + n_capture_buffers - this->capture_n_pending) % n_capture_buffers];
+
+		const GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? wait_timeout_ns : 0);
+
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+		this->capture_n_pending--;
+
+		CapturedFrame frame = {
+			.pixels = std::vector<uint8_t>(row_size * this->window_height_px),
+			.width_px = this->window_width_px,
+			.height_px = this->window_height_px,
+			.frame_number = slot.frame_number
+		};
+
+		state_cache.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+
+		const uint8_t *mapped = static_cast<const uint8_t*>( glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame.pixels.size(), GL_MAP_READ_BIT) );
+
+		if (mapped != nullptr) {
+			// opengl returns the bottom row first
+			for (uint32_t y = 0; y < this->window_height_px; y++)
+				std::memcpy(frame.pixels.data() + y * row_size, mapped + (this->window_height_px - 1 - y) * row_size, row_size);
+
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+
+		state_cache.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+		ensure_no_error();
+
+		if (mapped != nullptr)
+			this->capture_callback(std::move(frame));
+	}
+}
+
+// ---------------------------------------------------
+
+void Renderer::clear_buffers (const uint32_t flags)
+{
+	GLbitfield mask = 0;
+
+	if (flags & VertexBufferBit) {
+		this->program_triangle_color->clear();
+		this->program_triangle_color_cull->clear();
+		this->program_line_color->clear();
+		this->program_triangle_texture->clear();
+		this->program_triangle_texture_cull->clear();
+		this->program_triangle_texture_rotation->clear();
+		this->program_voxel->clear();
+		this->program_heightfield->clear();
+		this->program_mesh_color->clear();
+		this->program_mesh_texture->clear();
+		this->program_quad_instanced->clear();
+		this->program_render_target->clear();
+		this->program_triangle_indexed->clear();
+	}
+
+	if (flags & ColorBufferBit)
+		mask |= GL_COLOR_BUFFER_BIT;
+	if (flags & DepthBufferBit)
+		mask |= GL_DEPTH_BUFFER_BIT;
+	if (flags & StencilBufferBit)
+		mask |= GL_STENCIL_BUFFER_BIT;
+
+	if (mask)
+		glClear(mask);
+}
+
+// ---------------------------------------------------
+
+void Renderer::set_atlas_min_filter (const GLint filter)
+{
+	this->atlas_min_filter = filter;
+
+	// otherwise, it is applied in end_texture_loading
+	if (this->atlas_mip_levels > 1 && this->textures_loaded) {
+		state_cache.active_texture(GL_TEXTURE0);
+		state_cache.bind_texture(GL_TEXTURE_2D_ARRAY, this->texture_array_id);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+		ensure_no_error();
+	}
 
-	this->program_triangle_texture_uniforms.point_light_pos = this->program_triangle_color_uniforms.point_light_pos;
-	this->program_triangle_texture_uniforms.point_light_color = this->program_triangle_color_uniforms.point_light_color;
+	for (const Opengl_TextureDescriptor *desc : this->render_targets) {
+		if (desc->mip_levels > 1) {
+			state_cache.active_texture(GL_TEXTURE0 + ProgramRenderTarget::texture_unit);
+			state_cache.bind_texture(GL_TEXTURE_2D, desc->texture_id);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+			state_cache.active_texture(GL_TEXTURE0);
+			ensure_no_error();
+		}
+	}
+}
+
+// ---------------------------------------------------
+
+void Renderer::begin_texture_loading ()
+{
+	mylib_assert(this->textures.empty())
+
+	if (this->streaming_atlas_layers > 0) {
+		state_cache.active_texture(GL_TEXTURE0);
+
+		glGenTextures(1, &this->texture_array_id);
+		state_cache.bind_texture(GL_TEXTURE_2D_ARRAY, this->texture_array_id);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, this->atlas_mip_levels, GL_RGBA8, max_texture_size, max_texture_size, this->streaming_atlas_layers);
+		ensure_no_error();
+
+		this->streaming_atlas_creator = new TextureAtlasCreator(this->get_atlas_gutter_px());
+		this->begin_streaming_atlas();
+	}
+}
+
+// ---------------------------------------------------
+
+int32_t Renderer::get_atlas_gutter_px () const
+{
+	return (this->atlas_mip_levels > 1) ? (1 << (this->atlas_mip_levels - 1)) : 0;
+}
+
+// ---------------------------------------------------
+
+/*
+	Uploads the surface to its slot and frees it.
+	Both the streaming and the batch paths use it, so the
+	texture coordinates are calculated the same way.
+	Those paths generate the mipmaps of the whole atlas once in
+	end_texture_loading, otherwise upload_mip_levels must be set.
+*/
+
+void Renderer::upload_texture_to_atlas (Opengl_TextureDescriptor *desc, Opengl_AtlasDescriptor& atlas, const int32_t x_ini, const int32_t y_ini, const GLuint pbo, const bool upload_mip_levels)
+{
+	const int32_t gutter_px = this->get_atlas_gutter_px();
+	const GLint tex_depth = static_cast<GLint>(atlas.texture_depth);
+	const GLsizei width_px = desc->width_px + gutter_px * 2;
+	const GLsizei height_px = desc->height_px + gutter_px * 2;
+	std::vector<Uint32> padded;
+	const void *pixels = desc->surface->pixels;
+
+	if (gutter_px > 0) {
+		padded = extrude_surface(desc->surface, gutter_px);
+		pixels = padded.data();
+	}
+
+	state_cache.active_texture(GL_TEXTURE0);
+	state_cache.bind_texture(GL_TEXTURE_2D_ARRAY, this->texture_array_id);
+
+	/*
+		With a pixel buffer object, glTexSubImage3D returns without
+		waiting for the transfer.
+		glBufferData orphans the previous storage of the buffer, so it
+		never waits for an upload still in flight.
+	*/
+	if (pbo != 0) {
+		state_cache.bind_buffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(width_px) * height_px * 4, pixels, GL_STREAM_DRAW);
+		pixels = nullptr; // offset in the buffer
+	}
+
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+		0,
+		x_ini - gutter_px,
+		y_ini - gutter_px,
+		tex_depth,
+		width_px,
+		height_px,
+		1,
+		GL_RGBA,
+		GL_UNSIGNED_BYTE,
+		pixels);
+
+	if (upload_mip_levels && this->atlas_mip_levels > 1)
+		this->upload_atlas_mip_levels(desc->surface, tex_depth, x_ini, y_ini, pbo);
+
+	// otherwise, the other uploads would read from the buffer
+	if (pbo != 0)
+		state_cache.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
 	
-	if (this->program_triangle_color->has_vertices()) {
-		this->program_triangle_color->load();
-		this->program_triangle_color->upload_uniforms(this->program_triangle_color_uniforms);
-		this->program_triangle_color->upload_vertex_buffers();
-		this->program_triangle_color->draw();
+	ensure_no_error();
+
+	SDL_FreeSurface(desc->surface);
+	desc->surface = nullptr;
+
+	desc->atlas = &atlas;
+
+	desc->x_init_px = x_ini;
+	desc->y_init_px = y_ini;
+
+	using enum Enums::TextureVertexPositionIndex;
+
+	desc->tex_coords[LeftTop] = Vector2f(static_cast<fp_t>(desc->x_init_px) / static_cast<fp_t>(max_texture_size), static_cast<fp_t>(desc->y_init_px) / static_cast<fp_t>(max_texture_size));
+	desc->tex_coords[LeftBottom] = Vector2f(static_cast<fp_t>(desc->x_init_px) / static_cast<fp_t>(max_texture_size), static_cast<fp_t>(desc->y_init_px + desc->height_px) / static_cast<fp_t>(max_texture_size));
+	desc->tex_coords[RightTop] = Vector2f(static_cast<fp_t>(desc->x_init_px + desc->width_px) / static_cast<fp_t>(max_texture_size), static_cast<fp_t>(desc->y_init_px) / static_cast<fp_t>(max_texture_size));
+	desc->tex_coords[RightBottom] = Vector2f(static_cast<fp_t>(desc->x_init_px + desc->width_px) / static_cast<fp_t>(max_texture_size), static_cast<fp_t>(desc->y_init_px + desc->height_px) / static_cast<fp_t>(max_texture_size));
+}
+
+/*
+	Uploads the levels from 1 on of the slot of a texture, with the
+	same box filter as glGenerateMipmap.
+	The region is aligned to the texels of the last level, so every level
+	covers whole texels. The alignment is smaller than the gutter, so the
+	texels shared with the neighbours only have their gutters.
+	The pbo must be bound, if any.
+*/
+
+void Renderer::upload_atlas_mip_levels (const SDL_Surface *surface, const GLint tex_depth, const int32_t x_ini, const int32_t y_ini, const GLuint pbo)
+{
+	const int32_t gutter_px = this->get_atlas_gutter_px();
+	const int32_t align_px = 1 << (this->atlas_mip_levels - 1);
+	const int32_t x0 = ((x_ini - gutter_px) / align_px) * align_px;
+	const int32_t y0 = ((y_ini - gutter_px) / align_px) * align_px;
+	const int32_t x1 = ((x_ini + surface->w + gutter_px + align_px - 1) / align_px) * align_px;
+	const int32_t y1 = ((y_ini + surface->h + gutter_px + align_px - 1) / align_px) * align_px;
+	int32_t width_px = x1 - x0;
+	int32_t height_px = y1 - y0;
+
+	std::vector<Uint32> pixels = extrude_surface(surface, x_ini - x0, y_ini - y0, x1 - x_ini - surface->w, y1 - y_ini - surface->h);
+
+	for (uint32_t level = 1; level < this->atlas_mip_levels; level++) {
+		pixels = downsample_pixels(pixels, width_px, height_px);
+		width_px /= 2;
+		height_px /= 2;
+
+		const void *data = pixels.data();
+
+		// orphans the storage of the previous level, like upload_texture_to_atlas
+		if (pbo != 0) {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(pixels.size()) * sizeof(Uint32), data, GL_STREAM_DRAW);
+			data = nullptr; // offset in the buffer
+		}
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+			static_cast<GLint>(level),
+			x0 >> level,
+			y0 >> level,
+			tex_depth,
+			width_px,
+			height_px,
+			1,
+			GL_RGBA,
+			GL_UNSIGNED_BYTE,
+			data);
 	}
 
-	if (this->program_line_color->has_vertices()) {
-		this->program_line_color->load();
-		this->program_line_color->upload_uniforms(this->program_triangle_color_uniforms);
-		this->program_line_color->upload_vertex_buffers();
-		this->program_line_color->draw();
+	ensure_no_error();
+}
+
+// ---------------------------------------------------
+
+void Renderer::begin_streaming_atlas ()
+{
+	mylib_assert_msg(this->atlases.size() < this->streaming_atlas_layers, "streaming atlas is full, increase streaming_atlas_layers")
+
+	this->atlases.push_back( Opengl_AtlasDescriptor {
+		.texture_depth = static_cast<float>(this->atlases.size()),
+		.width_px = max_texture_size,
+		.height_px = max_texture_size
+	} );
+
+	this->streaming_atlas_creator->begin_atlas(max_texture_size);
+
+	dprintln("Streaming atlas layer ", this->atlases.size() - 1, " started");
+}
+
+void Renderer::stream_texture_to_atlas (Opengl_TextureDescriptor *desc, TextureInfo& texture)
+{
+	std::optional<TextureAtlasCreator::AtlasTexture> atlas_tex = this->streaming_atlas_creator->insert_texture(texture, desc->width_px, desc->height_px);
+
+	if (!atlas_tex) {
+		this->begin_streaming_atlas();
+		atlas_tex = this->streaming_atlas_creator->insert_texture(texture, desc->width_px, desc->height_px);
+
+		mylib_assert_msg(atlas_tex.has_value(), "texture of size ", desc->width_px, "x", desc->height_px, " does not fit in the atlas")
 	}
 
-	if (this->program_triangle_texture->has_vertices()) {
-		this->program_triangle_texture->load();
-		this->program_triangle_texture->upload_uniforms(this->program_triangle_texture_uniforms);
-		this->program_triangle_texture->upload_vertex_buffers();
-		this->program_triangle_texture->draw();
+	this->upload_texture_to_atlas(desc, this->atlases.back(), atlas_tex->x_ini, atlas_tex->y_ini);
+}
+
+// ---------------------------------------------------
+
+/*
+	Returns the texture with the same pixels as desc, if one was already
+	loaded, otherwise desc is registered for the next textures.
+	A hash match is always confirmed by comparing the pixels, so
+	the surfaces must still exist (no streaming atlas).
+*/
+
+Opengl_TextureDescriptor* Renderer::find_duplicate_texture (Opengl_TextureDescriptor *desc)
+{
+	const uint64_t hash = hash_surface_pixels(desc->surface);
+	auto [it, end] = this->texture_hashes.equal_range(hash);
+
+	for (; it != end; it++) {
+		Opengl_TextureDescriptor *other = it->second;
+
+		if (other->width_px != desc->width_px || other->height_px != desc->height_px)
+			continue;
+		
+		// the same pixels, trimmed from different borders, can't share the quad
+		if (other->trim_ini.x != desc->trim_ini.x || other->trim_ini.y != desc->trim_ini.y
+		    || other->trim_end.x != desc->trim_end.x || other->trim_end.y != desc->trim_end.y)
+			continue;
+
+		if (same_surface_pixels(other->surface, desc->surface))
+			return other;
 	}
 
-	if (this->program_triangle_texture_rotation->has_vertices()) {
-		this->program_triangle_texture_rotation->load();
-		this->program_triangle_texture_rotation->upload_uniforms(this->program_triangle_texture_uniforms);
-		this->program_triangle_texture_rotation->upload_vertex_buffers();
-		this->program_triangle_texture_rotation->draw();
+	this->texture_hashes.emplace(hash, desc);
+
+	return nullptr;
+}
+
+// ---------------------------------------------------
+
+void Renderer::begin_async_atlas ()
+{
+	mylib_assert_msg(this->async_atlas_layer < this->async_atlas_end_layer, "no atlas layers left for asynchronous textures, increase async_atlas_layers")
+
+	this->atlases.push_back( Opengl_AtlasDescriptor {
+		.texture_depth = static_cast<float>(this->async_atlas_layer),
+		.width_px = max_texture_size,
+		.height_px = max_texture_size
+	} );
+
+	this->async_atlas = &this->atlases.back();
+	this->async_atlas_creator->begin_atlas(max_texture_size);
+
+	dprintln("Asynchronous atlas layer ", this->async_atlas_layer, " started");
+
+	this->async_atlas_layer++;
+}
+
+// ---------------------------------------------------
+
+void Renderer::load_texture_async__ (TextureInfo& texture, const std::string_view fname, TextureLoadedCallback callback)
+{
+	mylib_assert_msg(this->async_atlas_creator != nullptr, "asynchronous texture loading requires async_atlas_layers to be set before end_texture_loading")
+
+	if (this->texture_decoder == nullptr) {
+		const uint32_t n_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+		this->texture_decoder = new TextureDecoder(n_threads, SDL_PIXELFORMAT_ABGR8888);
+
+		glGenBuffers(n_upload_buffers, this->upload_buffers.data());
+		ensure_no_error();
 	}
+
+	this->texture_decoder->push(texture, std::string(fname), std::move(callback));
 }
 
 // ---------------------------------------------------
 
-void Renderer::update_screen ()
-{
-	SDL_GL_SwapWindow(this->sdl_window);
-}
+void Renderer::upload_async_texture (TextureDecoder::Job& job)
+{
+	Opengl_TextureDescriptor *desc = new(this->memory_manager.allocate_type<Opengl_TextureDescriptor>(1)) Opengl_TextureDescriptor;
+	TextureInfo& texture = *job.texture;
+
+	desc->surface = job.surface;
+	desc->atlas = nullptr;
+	desc->width_px = job.surface->w;
+	desc->height_px = job.surface->h;
+	desc->texture_id = 0;
+	desc->mip_levels = 0;
+	desc->framebuffer_id = 0;
+	desc->depth_renderbuffer_id = 0;
+	desc->indexed = false;
+	desc->palette = 0;
+	desc->trimmed = false;
+	desc->trim_ini = Vector2f(0, 0);
+	desc->trim_end = Vector2f(1, 1);
+
+	job.surface = nullptr; // freed by upload_texture_to_atlas
+
+	// the atlas creator needs the real size, not the one of the fallback
+
+	texture.width_px = desc->width_px;
+	texture.height_px = desc->height_px;
+	texture.aspect_ratio = static_cast<fp_t>(desc->width_px) / static_cast<fp_t>(desc->height_px);
+
+	std::optional<TextureAtlasCreator::AtlasTexture> atlas_tex = this->async_atlas_creator->insert_texture(texture);
+
+	if (!atlas_tex) {
+		this->begin_async_atlas();
+		atlas_tex = this->async_atlas_creator->insert_texture(texture);
+
+		mylib_assert_exception_msg_args(atlas_tex.has_value(), UnableToLoadTextureException, "texture does not fit in the atlas", job.fname)
+	}
+
+	this->upload_texture_to_atlas(desc, *this->async_atlas, atlas_tex->x_ini, atlas_tex->y_ini, this->upload_buffers[this->upload_next_buffer], true);
+	this->upload_next_buffer = (this->upload_next_buffer + 1) % n_upload_buffers;
+
+	// from now on, draws use the new texture instead of the fallback
+	texture.data = desc;
+	this->texture_data_version++;
+}
+
+/*
+	Called once per frame.
+	The budget limits how long the frame waits for texture uploads.
+*/
+
+void Renderer::upload_async_textures ()
+{
+	if (this->texture_decoder == nullptr)
+		return;
+
+	TextureDecoder::Job job;
+
+	while (this->texture_decoder->pop_decoded(job))
+		this->async_uploads.push_back(std::move(job));
+
+	const int32_t gutter_px = this->get_atlas_gutter_px();
+	uint64_t uploaded_bytes = 0;
+	std::vector<TextureDecoder::Job> completed;
+	std::vector<TextureDecoder::Job> failed;
+
+	while (!this->async_uploads.empty()) {
+		TextureDecoder::Job& next = this->async_uploads.front();
+
+		// the texture keeps the fallback, and the other uploads go on
+		if (next.surface == nullptr) {
+			dprintln("unable to decode texture ", next.fname, ", keeping the fallback");
+
+			failed.push_back(std::move(next));
+			this->async_uploads.pop_front();
+			continue;
+		}
+
+		const uint64_t bytes = static_cast<uint64_t>(next.surface->w + gutter_px * 2) * static_cast<uint64_t>(next.surface->h + gutter_px * 2) * 4;
 
-// ---------------------------------------------------
+		// at least one texture per frame, otherwise a texture bigger than the budget would never be uploaded
+		if (uploaded_bytes > 0 && (uploaded_bytes + bytes) > this->texture_upload_budget_bytes)
+			break;
 
-void Renderer::clear_buffers (const uint32_t flags)
-{
-	GLbitfield mask = 0;
+		this->upload_async_texture(next);
+		uploaded_bytes += bytes;
 
-	if (flags & VertexBufferBit) {
-		this->program_triangle_color->clear();
-		this->program_line_color->clear();
-		this->program_triangle_texture->clear();
-		this->program_triangle_texture_rotation->clear();
+		completed.push_back(std::move(next));
+		this->async_uploads.pop_front();
 	}
 
-	if (flags & ColorBufferBit)
-		mask |= GL_COLOR_BUFFER_BIT;
-	if (flags & DepthBufferBit)
-		mask |= GL_DEPTH_BUFFER_BIT;
-	if (flags & StencilBufferBit)
-		mask |= GL_STENCIL_BUFFER_BIT;
+	for (TextureDecoder::Job& done : completed) {
+		if (done.callback)
+			done.callback(TextureDescriptor { .info = done.texture }, true);
+	}
 
-	if (mask)
-		glClear(mask);
+	for (TextureDecoder::Job& done : failed) {
+		if (done.callback)
+			done.callback(TextureDescriptor { .info = done.texture }, false);
+	}
 }
 
 // ---------------------------------------------------
 
-void Renderer::begin_texture_loading ()
+void Renderer::end_texture_loading ()
 {
-	mylib_assert(this->textures.empty())
-}
+	mylib_assert(this->atlas_mip_levels >= 1)
 
-// ---------------------------------------------------
+	const int32_t gutter_px = this->get_atlas_gutter_px();
 
-void Renderer::end_texture_loading ()
-{
-	TextureAtlasCreator atlas_creator;
+	TextureAtlasCreator atlas_creator(gutter_px);
+	TextureAtlasCreator index_atlas_creator;
+	std::unordered_set<const Opengl_TextureDescriptor*> added; // duplicate textures share the descriptor
 
 	for (auto& pair : this->textures) {
 		TextureInfo& tex_desc = pair.second;
-		atlas_creator.add_texture(tex_desc);
+		const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(tex_desc.data);
+
+		if (!added.insert(desc).second)
+			continue;
+
+		if (desc->indexed)
+			index_atlas_creator.add_texture(tex_desc);
+		else if (desc->atlas == nullptr) // not streamed yet
+			atlas_creator.add_texture(tex_desc, desc->width_px, desc->height_px);
 	}
 
+	this->texture_hashes.clear();
+
 	std::list< std::vector<TextureAtlasCreator::AtlasTexture> > atlas_list;
 
 	while (true) {
@@ -759,17 +2507,29 @@ void Renderer::end_texture_loading ()
 		atlas_list.push_back(std::move(atlas));
 	}
 
-	glActiveTexture(GL_TEXTURE0); // activate the texture unit first before binding texture
+	state_cache.active_texture(GL_TEXTURE0); // activate the texture unit first before binding texture
 	ensure_no_error();
 
-	glGenTextures(1, &this->texture_array_id);
-	ensure_no_error();
+	if (this->streaming_atlas_creator == nullptr) {
+		glGenTextures(1, &this->texture_array_id);
+		ensure_no_error();
 
-	glBindTexture(GL_TEXTURE_2D_ARRAY, this->texture_array_id);
-	ensure_no_error();
+		state_cache.bind_texture(GL_TEXTURE_2D_ARRAY, this->texture_array_id);
+		ensure_no_error();
 
-	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, max_texture_size, max_texture_size, atlas_list.size());
-	ensure_no_error();
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, this->atlas_mip_levels, GL_RGBA8, max_texture_size, max_texture_size, atlas_list.size() + this->async_atlas_layers);
+		ensure_no_error();
+	}
+	else {
+		// everything was already uploaded
+
+		mylib_assert_msg(this->atlases.size() + this->async_atlas_layers <= this->streaming_atlas_layers, "streaming atlas has no layers left for async_atlas_layers, increase streaming_atlas_layers")
+
+		delete this->streaming_atlas_creator;
+		this->streaming_atlas_creator = nullptr;
+
+		state_cache.bind_texture(GL_TEXTURE_2D_ARRAY, this->texture_array_id);
+	}
 
 	for (GLint tex_depth = 0; auto& atlas : atlas_list) {
 		this->atlases.push_back( Opengl_AtlasDescriptor {
@@ -809,6 +2569,112 @@ void Renderer::end_texture_loading ()
 
 			SDL_BlitSurface(desc->surface, nullptr, atlas_surface, &rect);
 #else
+			this->upload_texture_to_atlas(desc, atlas_desc, atlas_tex_desc.x_ini, atlas_tex_desc.y_ini);
+#endif
+		}
+
+#if 0
+		{ static int i = 0; std::string fname = "atlas" + std::to_string(i++) + ".png"; IMG_SavePNG(atlas_surface, fname.data()); }
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+		                0,
+						0,
+						0,
+						tex_depth,
+						atlas_surface->w,
+						atlas_surface->h,
+						1,
+						GL_RGBA,
+						GL_UNSIGNED_BYTE,
+						atlas_surface->pixels);
+
+		ensure_no_error();
+
+		SDL_FreeSurface(atlas_surface);
+#endif
+
+		tex_depth++;
+	};
+
+	if (this->atlas_mip_levels > 1) {
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, this->atlas_min_filter);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		ensure_no_error();
+
+		dprintln("Atlas mipmaps generated with ", this->atlas_mip_levels, " levels and gutter of ", gutter_px, "px");
+	}
+
+	// the layers reserved for asynchronous loading come after the atlases
+
+	if (this->async_atlas_layers > 0) {
+		this->async_atlas_layer = this->atlases.size();
+		this->async_atlas_end_layer = this->async_atlas_layer + this->async_atlas_layers;
+		this->async_atlas_creator = new TextureAtlasCreator(gutter_px);
+		this->begin_async_atlas();
+	}
+
+	if (this->indexed_textures)
+		this->load_indexed_textures(index_atlas_creator);
+
+	this->textures_loaded = true;
+}
+
+// ---------------------------------------------------
+
+/*
+	Indexed textures are packed in their own texture array,
+	with one byte per texel.
+	Their layers are also added to this->atlases, so sub-textures work
+	the same way.
+*/
+
+void Renderer::load_indexed_textures (TextureAtlasCreator& atlas_creator)
+{
+	std::list< std::vector<TextureAtlasCreator::AtlasTexture> > atlas_list;
+
+	while (true) {
+		std::vector<TextureAtlasCreator::AtlasTexture> atlas = atlas_creator.create_atlas(max_texture_size);
+
+		if (atlas.empty())
+			break;
+		
+		atlas_list.push_back(std::move(atlas));
+	}
+
+	state_cache.active_texture(GL_TEXTURE0 + ProgramTriangleIndexed::index_texture_unit);
+
+	glGenTextures(1, &this->index_texture_array_id);
+	state_cache.bind_texture(GL_TEXTURE_2D_ARRAY, this->index_texture_array_id);
+	ensure_no_error();
+
+	// GL_TEXTURE_2D_ARRAY requires at least one layer
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8, max_texture_size, max_texture_size, std::max<GLsizei>(atlas_list.size(), 1));
+
+	// indices can't be interpolated
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	ensure_no_error();
+
+	// rows of 8-bit surfaces are padded to 4 bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (GLint tex_depth = 0; auto& atlas : atlas_list) {
+		this->atlases.push_back( Opengl_AtlasDescriptor {
+			.texture_depth = static_cast<float>(tex_depth),
+			.width_px = max_texture_size,
+			.height_px = max_texture_size
+		} );
+
+		Opengl_AtlasDescriptor& atlas_desc = this->atlases.back();
+
+		dprintln("Index atlas created with ", atlas.size(), " textures");
+
+		for (auto& atlas_tex_desc : atlas) {
+			TextureInfo& tex_desc = *atlas_tex_desc.texture;
+			Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(tex_desc.data);
+
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, desc->surface->pitch);
+
 			glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
 				0,
 				atlas_tex_desc.x_ini,
@@ -817,12 +2683,12 @@ void Renderer::end_texture_loading ()
 				tex_desc.width_px,
 				tex_desc.height_px,
 				1,
-				GL_RGBA,
+				GL_RED,
 				GL_UNSIGNED_BYTE,
 				desc->surface->pixels);
-			
+
 			ensure_no_error();
-#endif
+
 			SDL_FreeSurface(desc->surface);
 			desc->surface = nullptr;
 
@@ -839,28 +2705,86 @@ void Renderer::end_texture_loading ()
 			desc->tex_coords[RightBottom] = Vector2f(static_cast<fp_t>(desc->x_init_px + desc->width_px) / static_cast<fp_t>(max_texture_size), static_cast<fp_t>(desc->y_init_px + desc->height_px) / static_cast<fp_t>(max_texture_size));
 		}
 
-#if 0
-		{ static int i = 0; std::string fname = "atlas" + std::to_string(i++) + ".png"; IMG_SavePNG(atlas_surface, fname.data()); }
+		tex_depth++;
+	}
 
-		glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
-		                0,
-						0,
-						0,
-						tex_depth,
-						atlas_surface->w,
-						atlas_surface->h,
-						1,
-						GL_RGBA,
-						GL_UNSIGNED_BYTE,
-						atlas_surface->pixels);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-		ensure_no_error();
+	// palettes created so far are uploaded now, the others when created
 
-		SDL_FreeSurface(atlas_surface);
-#endif
+	state_cache.active_texture(GL_TEXTURE0 + ProgramTriangleIndexed::palette_texture_unit);
 
-		tex_depth++;
-	};
+	glGenTextures(1, &this->palette_texture_id);
+	state_cache.bind_texture(GL_TEXTURE_2D, this->palette_texture_id);
+	ensure_no_error();
+
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, palette_size, max_palettes);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	ensure_no_error();
+
+	for (PaletteDescriptor palette = 0; palette < this->palettes.size(); palette++)
+		this->upload_palette(palette);
+
+	state_cache.active_texture(GL_TEXTURE0);
+
+	dprintln("Indexed textures loaded in ", atlas_list.size(), " layers, with ", this->palettes.size(), " palettes");
+}
+
+// ---------------------------------------------------
+
+PaletteDescriptor Renderer::create_palette (const std::span<const Color> colors)
+{
+	mylib_assert_msg(this->palettes.size() < max_palettes, "at most ", max_palettes, " palettes are supported")
+
+	const PaletteDescriptor palette = this->palettes.size();
+
+	this->palettes.emplace_back();
+	this->update_palette(palette, colors);
+
+	return palette;
+}
+
+void Renderer::update_palette (const PaletteDescriptor palette, const std::span<const Color> colors)
+{
+	mylib_assert(palette < this->palettes.size())
+	mylib_assert(colors.size() <= palette_size)
+
+	auto& palette_colors = this->palettes[palette];
+
+	for (uint32_t i = 0; i < palette_size; i++) {
+		if (i < colors.size()) {
+			const Color& c = colors[i];
+			palette_colors[i] = SDL_Color {
+				.r = static_cast<Uint8>(c.r * fp(255)),
+				.g = static_cast<Uint8>(c.g * fp(255)),
+				.b = static_cast<Uint8>(c.b * fp(255)),
+				.a = static_cast<Uint8>(c.a * fp(255))
+			};
+		}
+		else
+			palette_colors[i] = SDL_Color { .r = 0, .g = 0, .b = 0, .a = 0 };
+	}
+
+	this->upload_palette(palette);
+}
+
+// Only one row of the palette texture is uploaded.
+
+void Renderer::upload_palette (const PaletteDescriptor palette)
+{
+	// created in end_texture_loading, which uploads all palettes
+	if (this->palette_texture_id == 0)
+		return;
+
+	state_cache.active_texture(GL_TEXTURE0 + ProgramTriangleIndexed::palette_texture_unit);
+	state_cache.bind_texture(GL_TEXTURE_2D, this->palette_texture_id);
+
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, palette, palette_size, 1, GL_RGBA, GL_UNSIGNED_BYTE, this->palettes[palette].data());
+	ensure_no_error();
+
+	state_cache.active_texture(GL_TEXTURE0);
 }
 
 // ---------------------------------------------------
@@ -868,14 +2792,88 @@ void Renderer::end_texture_loading ()
 TextureInfo Renderer::load_texture__ (SDL_Surface *surface)
 {
 	Opengl_TextureDescriptor *desc = new(this->memory_manager.allocate_type<Opengl_TextureDescriptor>(1)) Opengl_TextureDescriptor;
+	SDL_Surface *treated_surface;
+
+	desc->indexed = this->indexed_textures
+		&& surface->format->format == SDL_PIXELFORMAT_INDEX8
+		&& surface->format->palette != nullptr;
+
+	if (desc->indexed) {
+		// the pixels are kept as they are, and the surface palette becomes a palette of the renderer
+
+		treated_surface = SDL_DuplicateSurface(surface);
+		mylib_assert_msg(treated_surface != nullptr, "error duplicating surface", '\n', SDL_GetError())
+
+		const SDL_Palette *sdl_palette = surface->format->palette;
+		std::array<SDL_Color, palette_size> palette_colors;
+		Uint32 colorkey;
+
+		for (uint32_t i = 0; i < palette_size; i++) {
+			if (i < static_cast<uint32_t>(sdl_palette->ncolors))
+				palette_colors[i] = sdl_palette->colors[i];
+			else
+				palette_colors[i] = SDL_Color { .r = 0, .g = 0, .b = 0, .a = 0 };
+		}
 
-	SDL_Surface *treated_surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ABGR8888, 0);
-	mylib_assert_msg(treated_surface != nullptr, "error converting surface format", '\n', SDL_GetError())
+		if (SDL_GetColorKey(surface, &colorkey) == 0 && colorkey < palette_size)
+			palette_colors[colorkey].a = 0;
+
+		// sprite sheets usually share their palette, so we reuse the row
+		// palettes created with create_palette are never shared
+
+		auto it = std::find_if(this->texture_palettes.begin(), this->texture_palettes.end(),
+			[this, &palette_colors] (const PaletteDescriptor palette) -> bool {
+				return std::memcmp(this->palettes[palette].data(), palette_colors.data(), sizeof(palette_colors)) == 0;
+			});
+
+		if (it != this->texture_palettes.end())
+			desc->palette = *it;
+		else {
+			mylib_assert_msg(this->palettes.size() < max_palettes, "at most ", max_palettes, " palettes are supported")
+
+			desc->palette = this->palettes.size();
+			this->palettes.push_back(palette_colors);
+			this->texture_palettes.push_back(desc->palette);
+			this->upload_palette(desc->palette);
+		}
+	}
+	else {
+		treated_surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ABGR8888, 0);
+		mylib_assert_msg(treated_surface != nullptr, "error converting surface format", '\n', SDL_GetError())
+
+		desc->palette = 0;
+	}
 
 	desc->surface = treated_surface;
 	desc->atlas = nullptr;
 	desc->width_px = treated_surface->w;
 	desc->height_px = treated_surface->h;
+	desc->texture_id = 0;
+	desc->mip_levels = 0;
+	desc->framebuffer_id = 0;
+	desc->depth_renderbuffer_id = 0;
+	desc->trimmed = false;
+	desc->trim_ini = Vector2f(0, 0);
+	desc->trim_end = Vector2f(1, 1);
+
+	// the size seen by the game, even if the texture is trimmed
+	const int32_t width_px = treated_surface->w;
+	const int32_t height_px = treated_surface->h;
+
+	if (!desc->indexed) {
+		if (this->trim_textures)
+			trim_texture(desc);
+
+		if (this->deduplicate_textures && this->streaming_atlas_layers == 0) {
+			Opengl_TextureDescriptor *original = this->find_duplicate_texture(desc);
+
+			if (original != nullptr) {
+				SDL_FreeSurface(desc->surface);
+				this->memory_manager.deallocate_type(desc, 1);
+				desc = original;
+			}
+		}
+	}
 	
 /*	glActiveTexture(GL_TEXTURE0); // activate the texture unit first before binding texture
 	ensure_no_error();
@@ -900,10 +2898,15 @@ TextureInfo Renderer::load_texture__ (SDL_Surface *surface)
 
 	TextureInfo tex_info = {
 		.data = desc,
-		.width_px = desc->width_px,
-		.height_px = desc->height_px,
-		.aspect_ratio = static_cast<fp_t>(desc->width_px) / static_cast<fp_t>(desc->height_px)
+		.width_px = width_px,
+		.height_px = height_px,
+		.aspect_ratio = static_cast<fp_t>(width_px) / static_cast<fp_t>(height_px)
 		};
+
+	// indexed textures go to their own texture array in end_texture_loading,
+	// and duplicates were already streamed with the original texture
+	if (this->streaming_atlas_creator != nullptr && !desc->indexed && desc->atlas == nullptr)
+		this->stream_texture_to_atlas(desc, tex_info);
 		
 	return tex_info;
 }
@@ -924,12 +2927,22 @@ TextureInfo Renderer::create_sub_texture__ (const TextureInfo& parent, const uin
 
 	desc->surface = nullptr;
 	desc->atlas = parent_desc->atlas;
+	desc->indexed = parent_desc->indexed;
+	desc->palette = parent_desc->palette;
 	desc->x_init_px = parent_desc->x_init_px + x_ini;
 	desc->y_init_px = parent_desc->y_init_px + y_ini;
 	desc->width_px = w;
 	desc->height_px = h;
+	desc->texture_id = 0;
+	desc->mip_levels = 0;
+	desc->framebuffer_id = 0;
+	desc->depth_renderbuffer_id = 0;
+	desc->trimmed = false;
+	desc->trim_ini = Vector2f(0, 0);
+	desc->trim_end = Vector2f(1, 1);
 
 	mylib_assert(parent_desc->atlas != nullptr)
+	mylib_assert_msg(!parent_desc->trimmed, "sub-textures of trimmed textures are not supported")
 	mylib_assert((desc->x_init_px + desc->width_px) <= parent_desc->atlas->width_px)
 	mylib_assert((desc->y_init_px + desc->height_px) <= parent_desc->atlas->height_px)
 
@@ -952,6 +2965,155 @@ TextureInfo Renderer::create_sub_texture__ (const TextureInfo& parent, const uin
 
 // ---------------------------------------------------
 
+TextureInfo Renderer::create_render_target__ (const uint32_t width_px, const uint32_t height_px)
+{
+	mylib_assert_msg(!this->textures_loaded, "render targets must be created before end_texture_loading")
+	mylib_assert(width_px <= static_cast<uint32_t>(max_texture_size) && height_px <= static_cast<uint32_t>(max_texture_size))
+
+	Opengl_TextureDescriptor *desc = new(this->memory_manager.allocate_type<Opengl_TextureDescriptor>(1)) Opengl_TextureDescriptor;
+
+	/*
+		The target is not part of the atlas, it has its own texture of the
+		requested size, so it can't be sampled while it is being rendered,
+		and it doesn't waste a whole layer of the atlas.
+		It is only drawn by draw_rect2D, through program_render_target.
+	*/
+
+	desc->surface = nullptr;
+	desc->atlas = nullptr;
+	desc->indexed = false;
+	desc->palette = 0;
+	desc->x_init_px = 0;
+	desc->y_init_px = 0;
+	desc->width_px = width_px;
+	desc->height_px = height_px;
+	desc->trimmed = false;
+	desc->trim_ini = Vector2f(0, 0);
+	desc->trim_end = Vector2f(1, 1);
+
+	using enum Enums::TextureVertexPositionIndex;
+
+	desc->tex_coords[LeftTop] = Vector2f(0, 0);
+	desc->tex_coords[LeftBottom] = Vector2f(0, 1);
+	desc->tex_coords[RightTop] = Vector2f(1, 0);
+	desc->tex_coords[RightBottom] = Vector2f(1, 1);
+
+	// the target is mipmapped like the atlas, but a level can't be smaller than 1 pixel
+	desc->mip_levels = 1;
+
+	while (desc->mip_levels < static_cast<GLsizei>(this->atlas_mip_levels) && (std::max(width_px, height_px) >> desc->mip_levels) > 0)
+		desc->mip_levels++;
+
+	glGenTextures(1, &desc->texture_id);
+	state_cache.active_texture(GL_TEXTURE0 + ProgramRenderTarget::texture_unit);
+	state_cache.bind_texture(GL_TEXTURE_2D, desc->texture_id);
+	glTexStorage2D(GL_TEXTURE_2D, desc->mip_levels, GL_RGBA8, desc->width_px, desc->height_px);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (desc->mip_levels > 1) ? this->atlas_min_filter : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	state_cache.active_texture(GL_TEXTURE0);
+	ensure_no_error();
+
+	glGenRenderbuffers(1, &desc->depth_renderbuffer_id);
+	glBindRenderbuffer(GL_RENDERBUFFER, desc->depth_renderbuffer_id);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, desc->width_px, desc->height_px);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	ensure_no_error();
+
+	glGenFramebuffers(1, &desc->framebuffer_id);
+	glBindFramebuffer(GL_FRAMEBUFFER, desc->framebuffer_id);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, desc->texture_id, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, desc->depth_renderbuffer_id);
+	ensure_no_error();
+
+	mylib_assert_msg(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "incomplete framebuffer for render target")
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	dprintln("Render target of size ", desc->width_px, "x", desc->height_px, " created");
+
+	this->render_targets.push_back(desc);
+
+	TextureInfo tex_info = {
+		.data = desc,
+		.width_px = desc->width_px,
+		.height_px = desc->height_px,
+		.aspect_ratio = static_cast<fp_t>(desc->width_px) / static_cast<fp_t>(desc->height_px)
+		};
+	
+	return tex_info;
+}
+
+// ---------------------------------------------------
+
+void Renderer::begin_render_to_texture__ (TextureInfo& texture, const Vector2& world_init, const Vector2& world_size)
+{
+	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture.data);
+
+	mylib_assert_msg(desc->framebuffer_id != 0, "texture ", texture.id, " is not a render target")
+
+	// what was drawn so far in this frame goes to the screen
+
+	this->update_light_uniforms();
+	this->render_graph->reset();
+	this->add_vertex_buffer_passes(this->import_scene_target());
+	this->render_graph->compile();
+	this->execute_render_graph();
+	this->clear_buffers(VertexBufferBit);
+
+	this->saved_projection_matrix = this->program_triangle_color_uniforms.projection_matrix;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, desc->framebuffer_id);
+	glViewport(0, 0, desc->width_px, desc->height_px);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	ensure_no_error();
+
+	/*
+		world_init is mapped to the first row of the texture,
+		which the texture coordinates consider the top,
+		so we must not mirror the y axis here.
+		(0, 2) -> (-1, +1) opengl clip space
+	*/
+
+	this->set_projection_matrix(
+		(Matrix4::translate( Vector2(-1, -1) )
+		* Matrix4::scale( Vector2(fp(2) / world_size.x, fp(2) / world_size.y) ))
+		* Matrix4::translate(-world_init));
+}
+
+// ---------------------------------------------------
+
+void Renderer::end_render_to_texture__ (TextureInfo& texture)
+{
+	const Opengl_TextureDescriptor *desc = Mylib::any_cast<Opengl_TextureDescriptor*>(texture.data);
+
+	this->update_light_uniforms();
+	this->render_graph->reset();
+	this->add_vertex_buffer_passes(this->render_graph->import_framebuffer("cached-layer", desc->framebuffer_id, desc->width_px, desc->height_px));
+	this->render_graph->compile();
+	this->render_graph->execute(desc->framebuffer_id, desc->width_px, desc->height_px); // bound by begin_render_to_texture__
+	this->clear_buffers(VertexBufferBit);
+
+	// only level 0 was rendered, and only the texture of this target needs new mipmaps
+	if (desc->mip_levels > 1) {
+		state_cache.active_texture(GL_TEXTURE0 + ProgramRenderTarget::texture_unit);
+		state_cache.bind_texture(GL_TEXTURE_2D, desc->texture_id);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		state_cache.active_texture(GL_TEXTURE0);
+		ensure_no_error();
+	}
+
+	this->bind_scene_framebuffer();
+	glClearColor(this->background_color.r, this->background_color.g, this->background_color.b, 1);
+	ensure_no_error();
+
+	this->set_projection_matrix(this->saved_projection_matrix);
+}
+
+// ---------------------------------------------------
+
 } // namespace Graphics
 } // namespace Opengl
 } // namespace MyGlib
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include <algorithm>
+
+#include <my-game-lib/debug.h>
+#include <my-game-lib/opengl/opengl.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+namespace Opengl
+{
+
+// ---------------------------------------------------
+
+StateCache state_cache;
+
+// ---------------------------------------------------
+
+StateCache::StateCache ()
+{
+	// the GL context doesn't exist yet, so we know nothing
+	this->invalidate();
+}
+
+// ---------------------------------------------------
+
+void StateCache::invalidate ()
+{
+	this->program = unknown;
+	this->vertex_array = unknown;
+	this->n_buffer_targets = 0;
+	this->active_texture_unit = unknown;
+	this->textures_2d.fill(unknown);
+	this->textures_2d_array.fill(unknown);
+	this->blend = unknown;
+	this->depth_test = unknown;
+	this->cull_face = unknown;
+	this->scissor_test = unknown;
+}
+
+// ---------------------------------------------------
+
+void StateCache::use_program (const GLuint program)
+{
+	if (this->update(this->program, program))
+		glUseProgram(program);
+}
+
+void StateCache::bind_vertex_array (const GLuint vertex_array)
+{
+	if (!this->update(this->vertex_array, vertex_array))
+		return;
+
+	glBindVertexArray(vertex_array);
+
+	// the element array buffer binding is part of the vertex array
+	this->find_buffer_binding(GL_ELEMENT_ARRAY_BUFFER) = unknown;
+}
+
+// ---------------------------------------------------
+
+GLuint& StateCache::find_buffer_binding (const GLenum target)
+{
+	for (uint32_t i = 0; i < this->n_buffer_targets; i++) {
+		if (this->buffers[i].first == target)
+			return this->buffers[i].second;
+	}
+
+	mylib_assert(this->n_buffer_targets < max_buffer_targets)
+
+	this->buffers[this->n_buffer_targets] = std::make_pair(target, unknown);
+
+	return this->buffers[this->n_buffer_targets++].second;
+}
+
+void StateCache::bind_buffer (const GLenum target, const GLuint buffer)
+{
+	if (this->update(this->find_buffer_binding(target), buffer))
+		glBindBuffer(target, buffer);
+}
+
+void StateCache::bind_buffer_base (const GLenum target, const GLuint index, const GLuint buffer)
+{
+	// indexed bindings are not cached, but the call also binds the generic binding point
+	this->n_calls++;
+	glBindBufferBase(target, index, buffer);
+	this->find_buffer_binding(target) = buffer;
+}
+
+// ---------------------------------------------------
+
+void StateCache::active_texture (const GLenum unit)
+{
+	mylib_assert((unit - GL_TEXTURE0) < max_texture_units)
+
+	if (this->update(this->active_texture_unit, unit))
+		glActiveTexture(unit);
+}
+
+GLuint& StateCache::find_texture_binding (const GLenum target)
+{
+	// if we don't know the active unit, we can't know what is bound
+	if (this->active_texture_unit == unknown) {
+		glActiveTexture(GL_TEXTURE0);
+		this->active_texture_unit = GL_TEXTURE0;
+	}
+
+	const uint32_t unit = this->active_texture_unit - GL_TEXTURE0;
+
+	if (target == GL_TEXTURE_2D_ARRAY)
+		return this->textures_2d_array[unit];
+
+	mylib_assert(target == GL_TEXTURE_2D)
+
+	return this->textures_2d[unit];
+}
+
+void StateCache::bind_texture (const GLenum target, const GLuint texture)
+{
+	if (this->update(this->find_texture_binding(target), texture))
+		glBindTexture(target, texture);
+}
+
+// ---------------------------------------------------
+
+void StateCache::set_capability (const GLenum capability, const bool enabled)
+{
+	GLuint *cached;
+
+	switch (capability) {
+		case GL_BLEND:
+			cached = &this->blend;
+		break;
+
+		case GL_DEPTH_TEST:
+			cached = &this->depth_test;
+		break;
+
+		case GL_CULL_FACE:
+			cached = &this->cull_face;
+		break;
+
+		case GL_SCISSOR_TEST:
+			cached = &this->scissor_test;
+		break;
+
+		default:
+			mylib_throw_msg(NoMyGameLibGraphicsException, "capability not tracked by the state cache");
+	}
+
+	if (!this->update(*cached, enabled ? 1 : 0))
+		return;
+
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+// ---------------------------------------------------
+
+void StateCache::delete_buffers (const GLsizei n, const GLuint *buffers)
+{
+	glDeleteBuffers(n, buffers);
+
+	for (GLsizei i = 0; i < n; i++) {
+		for (uint32_t j = 0; j < this->n_buffer_targets; j++) {
+			if (this->buffers[j].second == buffers[i])
+				this->buffers[j].second = 0;
+		}
+	}
+}
+
+void StateCache::delete_vertex_arrays (const GLsizei n, const GLuint *vertex_arrays)
+{
+	glDeleteVertexArrays(n, vertex_arrays);
+
+	for (GLsizei i = 0; i < n; i++) {
+		if (this->vertex_array == vertex_arrays[i]) {
+			// the element array buffer binding is part of the vertex array
+			this->vertex_array = 0;
+			this->find_buffer_binding(GL_ELEMENT_ARRAY_BUFFER) = unknown;
+		}
+	}
+}
+
+void StateCache::delete_textures (const GLsizei n, const GLuint *textures)
+{
+	glDeleteTextures(n, textures);
+
+	for (GLsizei i = 0; i < n; i++) {
+		std::replace(this->textures_2d.begin(), this->textures_2d.end(), textures[i], GLuint(0));
+		std::replace(this->textures_2d_array.begin(), this->textures_2d_array.end(), textures[i], GLuint(0));
+	}
+}
+
+// ---------------------------------------------------
+
+} // end namespace Opengl
+} // end namespace Graphics
+} // end namespace MyGlib
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <cstdlib>
 #include <cmath>
 
@@ -8,6 +10,8 @@
 
 #include <my-game-lib/debug.h>
 #include <my-game-lib/sdl/sdl-driver.h>
+#include <my-game-lib/font.h>
+#include <my-game-lib/texture-atlas.h>
 
 // ---------------------------------------------------
 
@@ -23,8 +27,10 @@ namespace Graphics
 // ---------------------------------------------------
 
 struct SDL_TextureDescriptor {
-	//SDL_Surface *surface;
-	SDL_Texture *texture;
+	SDL_Surface *surface; // only until end_texture_loading packs it in an atlas page
+	SDL_Texture *texture; // atlas page, or the texture itself
+	SDL_FPoint tex_ini; // texture coordinates of the left top corner
+	SDL_FPoint tex_end; // texture coordinates of the right bottom corner
 };
 
 // ---------------------------------------------------
@@ -83,16 +89,19 @@ static void my_SDL_DrawCircle (SDL_Renderer *renderer, const int32_t centreX, co
 
 // ---------------------------------------------------
 
-static void my_SDL_DrawFilledCircle (SDL_Renderer *renderer, const int32_t centreX, const int32_t centreY, const int32_t radius)
+// two triangles, in the same order used by Rect2D::calculate_vertices
+
+static void fill_quad (std::span<SDL_Vertex> vertices, const SDL_FPoint& pos_ini, const SDL_FPoint& pos_end, const SDL_TextureDescriptor *desc, const SDL_Color& color) noexcept
 {
-	for (int32_t w = 0; w < radius * 2; w++) {
-		for (int32_t h = 0; h < radius * 2; h++) {
-			int32_t dx = radius - w; // horizontal offset
-			int32_t dy = radius - h; // vertical offset
-			if ((dx*dx + dy*dy) <= (radius * radius))
-				SDL_RenderDrawPoint(renderer, centreX + dx, centreY + dy);
-		}
-	}
+	const SDL_FPoint& tex_ini = desc->tex_ini;
+	const SDL_FPoint& tex_end = desc->tex_end;
+
+	vertices[0] = SDL_Vertex { .position = { pos_ini.x, pos_ini.y }, .color = color, .tex_coord = { tex_ini.x, tex_ini.y } }; // upper left
+	vertices[1] = SDL_Vertex { .position = { pos_ini.x, pos_end.y }, .color = color, .tex_coord = { tex_ini.x, tex_end.y } }; // down left
+	vertices[2] = SDL_Vertex { .position = { pos_end.x, pos_end.y }, .color = color, .tex_coord = { tex_end.x, tex_end.y } }; // down right
+	vertices[3] = vertices[0]; // upper left
+	vertices[4] = vertices[2]; // down right
+	vertices[5] = SDL_Vertex { .position = { pos_end.x, pos_ini.y }, .color = color, .tex_coord = { tex_end.x, tex_ini.y } }; // upper right
 }
 
 // ---------------------------------------------------
@@ -134,7 +143,8 @@ SDL_GraphicsDriver::SDL_GraphicsDriver (const InitParams& params)
 		mylib_throw_msg(NoMyGameLibGraphicsException, "error creating SDL window");
 	}
 	
-	this->renderer = SDL_CreateRenderer(this->sdl_window, -1, SDL_RENDERER_ACCELERATED);
+	// render target textures are used by cached layers
+	this->renderer = SDL_CreateRenderer(this->sdl_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
 
 	if (this->renderer == nullptr) [[unlikely]] {
 		dprintln("error creating SDL renderer", '\n', SDL_GetError());
@@ -155,6 +165,9 @@ SDL_GraphicsDriver::SDL_GraphicsDriver (const InitParams& params)
 
 SDL_GraphicsDriver::~SDL_GraphicsDriver ()
 {
+	for (SDL_Texture *atlas : this->atlases)
+		SDL_DestroyTexture(atlas);
+
 	SDL_DestroyRenderer(this->renderer);
 	SDL_DestroyWindow(this->sdl_window);
 }
@@ -170,6 +183,33 @@ void SDL_GraphicsDriver::wait_next_frame ()
 
 // ---------------------------------------------------
 
+std::span<SDL_Vertex> SDL_GraphicsDriver::alloc_vertices (SDL_Texture *texture, const uint32_t n)
+{
+	if (texture != this->vertices_texture) {
+		this->flush_vertices();
+		this->vertices_texture = texture;
+	}
+
+	const uint32_t first = this->vertices.size();
+
+	this->vertices.resize(first + n);
+
+	return std::span<SDL_Vertex>(this->vertices.data() + first, n);
+}
+
+void SDL_GraphicsDriver::flush_vertices ()
+{
+	if (this->vertices.empty())
+		return;
+
+	if (SDL_RenderGeometry(this->renderer, this->vertices_texture, this->vertices.data(), static_cast<int>(this->vertices.size()), nullptr, 0) < 0) [[unlikely]]
+		dprintln("error rendering geometry", '\n', SDL_GetError());
+
+	this->vertices.clear(); // keeps the capacity for the next frames
+}
+
+// ---------------------------------------------------
+
 void SDL_GraphicsDriver::draw_line3D (Line3D& line, const Vector& offset, const Color& color)
 {
 	mylib_throw_msg(GraphicsUnsupportedException, "SDL Renderer does not support 3D rendering");
@@ -190,6 +230,26 @@ void SDL_GraphicsDriver::draw_wire_cube3D (WireCube3D& cube, const Vector& offse
 	mylib_throw_msg(GraphicsUnsupportedException, "SDL Renderer does not support 3D rendering");
 }
 
+void SDL_GraphicsDriver::draw_voxel_chunk3D (VoxelChunk& chunk, const Vector& offset)
+{
+	mylib_throw_msg(GraphicsUnsupportedException, "SDL Renderer does not support 3D rendering");
+}
+
+void SDL_GraphicsDriver::draw_heightfield3D (Heightfield3D& heightfield, const Vector& offset)
+{
+	mylib_throw_msg(GraphicsUnsupportedException, "SDL Renderer does not support 3D rendering");
+}
+
+void SDL_GraphicsDriver::draw_mesh3D (Mesh3D& mesh, const Vector& offset, const Color& color)
+{
+	mylib_throw_msg(GraphicsUnsupportedException, "SDL Renderer does not support 3D rendering");
+}
+
+void SDL_GraphicsDriver::draw_mesh3D (Mesh3D& mesh, const Vector& offset, const TextureRenderOptions& texture_options)
+{
+	mylib_throw_msg(GraphicsUnsupportedException, "SDL Renderer does not support 3D rendering");
+}
+
 // ---------------------------------------------------
 
 void SDL_GraphicsDriver::draw_sphere3D (Sphere3D& sphere, const Vector& offset, const Color& color)
@@ -206,64 +266,107 @@ void SDL_GraphicsDriver::draw_sphere3D (Sphere3D& sphere, const Vector& offset,
 
 void SDL_GraphicsDriver::draw_circle2D (Circle2D& circle, const Vector& offset, const Color& color)
 {
+	// the circle is tessellated by the CircleFactory, the same way as in the OpenGL renderer
+
 	const SDL_Color sdl_color = to_sdl_color(color);
-	const Vector world_pos = offset;
-	const Vector4 clip_pos = this->projection_matrix * Vector4(world_pos.x, world_pos.y, 0, 1);
+	const uint32_t n_vertices = circle.get_n_vertices();
+	std::span<Vertex> shape_vertices = circle.get_local_rotated_vertices();
 
-/*	Game::ShapeRect rect(circle.get_radius()*2.0f, circle.get_radius()*2.0f);
-	rect.set_delta(circle.get_delta());
-	this->draw_rect(rect, offset, color);*/
+	mylib_assert(shape_vertices.size() == n_vertices)
 
-	SDL_SetRenderDrawColor(this->renderer, sdl_color.r, sdl_color.g, sdl_color.b, sdl_color.a);
+	std::span<SDL_Vertex> vertices = this->alloc_vertices(nullptr, n_vertices);
 
-	my_SDL_DrawFilledCircle(
-		renderer,
-		static_cast<int32_t>( clip_pos.x ),
-		static_cast<int32_t>( clip_pos.y ),
-		static_cast<int32_t>( circle.get_radius() * this->scale_factor )
-		);
+	for (uint32_t i=0; i<n_vertices; i++) {
+		vertices[i] = SDL_Vertex {
+			.position = this->project(offset + shape_vertices[i].pos),
+			.color = sdl_color,
+			.tex_coord = { 0, 0 }
+		};
+	}
 }
 
 // ---------------------------------------------------
 
-SDL_Rect SDL_GraphicsDriver::helper_calc_sdl_rect (Rect2D& rect, const Vector& world_pos)
+void SDL_GraphicsDriver::draw_rect2D (Rect2D& rect, const Vector& offset, const Color& color)
 {
-	SDL_Rect sdl_rect;
-
-	const Vector4 clip_pos = this->projection_matrix * Vector4(world_pos.x, world_pos.y, 0, 1);
-
-	sdl_rect.x = Mylib::Math::round_to_nearest<int>(clip_pos.x - (rect.get_w() * fp(0.5) * this->scale_factor));
-	sdl_rect.y = Mylib::Math::round_to_nearest<int>(clip_pos.y - (rect.get_h() * fp(0.5) * this->scale_factor));
-	sdl_rect.w = Mylib::Math::round_to_nearest<int>(rect.get_w() * this->scale_factor);
-	sdl_rect.h = Mylib::Math::round_to_nearest<int>(rect.get_h() * this->scale_factor);
+	const SDL_Color sdl_color = to_sdl_color(color);
+	constexpr uint32_t n_vertices = Rect2D::get_n_vertices();
+	std::span<Vertex> shape_vertices = rect.get_local_rotated_vertices();
 
-#if 0
-	dprint( "world_pos:" )
-	world_pos.println();
+	mylib_assert(shape_vertices.size() == n_vertices)
 
-	dprint( "clip_pos:" )
-	clip_pos.println();
-//exit(1);
-#endif
+	std::span<SDL_Vertex> vertices = this->alloc_vertices(nullptr, n_vertices);
 
-	return sdl_rect;
+	for (uint32_t i=0; i<n_vertices; i++) {
+		vertices[i] = SDL_Vertex {
+			.position = this->project(offset + shape_vertices[i].pos),
+			.color = sdl_color,
+			.tex_coord = { 0, 0 }
+		};
+	}
 }
 
-void SDL_GraphicsDriver::draw_rect2D (Rect2D& rect, const Vector& offset, const Color& color)
+void SDL_GraphicsDriver::draw_rect2D (Rect2D& rect, const Vector& offset, const TextureRenderOptions& texture_options)
 {
-	const SDL_Rect sdl_rect = this->helper_calc_sdl_rect(rect, offset);
-	const SDL_Color sdl_color = to_sdl_color(color);
+	const Vector2& size = rect.get_size();
+	const SDL_TextureDescriptor *desc = Mylib::any_cast<SDL_TextureDescriptor*>(this->select_texture(texture_options, offset, std::max(size.x, size.y)).data);
 
-	SDL_SetRenderDrawColor(this->renderer, sdl_color.r, sdl_color.g, sdl_color.b, sdl_color.a);
-	SDL_RenderFillRect(this->renderer, &sdl_rect);
+	mylib_assert_msg(desc->texture != nullptr, "textures loaded with begin_texture_loading can only be drawn after end_texture_loading")
+
+	constexpr uint32_t n_vertices = Rect2D::get_n_vertices();
+	constexpr SDL_Color white = { 255, 255, 255, 255 };
+	std::span<Vertex> shape_vertices = rect.get_local_rotated_vertices();
+
+	static_assert(n_vertices == 6);
+	mylib_assert(shape_vertices.size() == n_vertices)
+
+	std::span<SDL_Vertex> vertices = this->alloc_vertices(desc->texture, n_vertices);
+
+	for (uint32_t i=0; i<n_vertices; i++) {
+		vertices[i].position = this->project(offset + shape_vertices[i].pos);
+		vertices[i].color = white;
+	}
+
+	// we have to follow the same order used in Rect2D::calculate_vertices
+
+	vertices[0].tex_coord = { desc->tex_ini.x, desc->tex_ini.y }; // upper left
+	vertices[1].tex_coord = { desc->tex_ini.x, desc->tex_end.y }; // down left
+	vertices[2].tex_coord = { desc->tex_end.x, desc->tex_end.y }; // down right
+	vertices[3].tex_coord = { desc->tex_ini.x, desc->tex_ini.y }; // upper left
+	vertices[4].tex_coord = { desc->tex_end.x, desc->tex_end.y }; // down right
+	vertices[5].tex_coord = { desc->tex_end.x, desc->tex_ini.y }; // upper right
 }
 
-void SDL_GraphicsDriver::draw_rect2D (Rect2D& rect, const Vector& offset, const TextureRenderOptions& texture_options)
+// ---------------------------------------------------
+
+void SDL_GraphicsDriver::draw_text2D (const std::string_view text, const Vector& offset, const TextRenderOptions& text_options)
 {
-	const SDL_Rect sdl_rect = this->helper_calc_sdl_rect(rect, offset);
-	SDL_TextureDescriptor *desc = Mylib::any_cast<SDL_TextureDescriptor*>(texture_options.desc.info->data);
+	const Font::Layout& layout = text_options.font->get_layout(text);
+	const fp_t scale = text_options.line_height / static_cast<fp_t>(text_options.font->get_line_height_px());
+	const SDL_Color sdl_color = to_sdl_color(text_options.color);
+
+	// the SDL renderer is always y-down, so invert_y_axis is not used here
+
+	const Vector4 clip_pos = this->projection_matrix * Vector4(offset.x, offset.y, 0, 1);
+
+	// the color goes in the vertices, so glyphs of the same atlas page are batched
 
-	SDL_RenderCopy(this->renderer, desc->texture, nullptr, &sdl_rect);
+	for (const Font::GlyphQuad& glyph_quad : layout.quads) {
+		const Font::Glyph& glyph = *glyph_quad.glyph;
+		const SDL_TextureDescriptor *desc = Mylib::any_cast<SDL_TextureDescriptor*>(glyph.texture.info->data);
+
+		const SDL_FPoint pos_ini = {
+			.x = static_cast<float>(clip_pos.x + glyph_quad.pos_px.x * scale * this->scale_factor),
+			.y = static_cast<float>(clip_pos.y + glyph_quad.pos_px.y * scale * this->scale_factor)
+		};
+
+		const SDL_FPoint pos_end = {
+			.x = pos_ini.x + static_cast<float>(static_cast<fp_t>(glyph.width_px) * scale * this->scale_factor),
+			.y = pos_ini.y + static_cast<float>(static_cast<fp_t>(glyph.height_px) * scale * this->scale_factor)
+		};
+
+		fill_quad(this->alloc_vertices(desc->texture, 6), pos_ini, pos_end, desc, sdl_color);
+	}
 }
 
 // ---------------------------------------------------
@@ -275,6 +378,13 @@ void SDL_GraphicsDriver::setup_render_3D (const RenderArgs3D& args)
 
 // ---------------------------------------------------
 
+void SDL_GraphicsDriver::setup_viewports (const std::span<const ViewportArgs> viewports)
+{
+	mylib_throw_msg(GraphicsUnsupportedException, "SDL Renderer does not support viewports");
+}
+
+// ---------------------------------------------------
+
 void SDL_GraphicsDriver::setup_render_2D (const RenderArgs2D& args)
 {
 	using Vector = Vector2;
@@ -335,12 +445,16 @@ void SDL_GraphicsDriver::setup_render_2D (const RenderArgs2D& args)
 	this->projection_matrix = (translate_to_clip_init * scale) * translate_camera;
 	//this->projection_matrix = scale * translate_camera;
 //	dprintln( "final matrix:" ); dprintln( this->projection_matrix );
+
+	this->update_texture_lod_camera(args);
 }
 
 // ---------------------------------------------------
 
 void SDL_GraphicsDriver::render ()
 {
+	this->flush_vertices();
+
 #ifdef DEBUG_SHOW_CENTER_LINE
 {
 	const SDL_Color sdl_color = { 255, 0, 0, 255 };
@@ -356,7 +470,42 @@ void SDL_GraphicsDriver::render ()
 
 void SDL_GraphicsDriver::update_screen ()
 {
+	this->flush_vertices(); // in case render was not called
+
+	if (this->capture_callback) {
+		// SDL has no asynchronous readback, so this stalls the renderer
+		CapturedFrame frame = {
+			.pixels = std::vector<uint8_t>(this->window_width_px * this->window_height_px * 4),
+			.width_px = this->window_width_px,
+			.height_px = this->window_height_px,
+			.frame_number = this->frame_number
+		};
+
+		if (SDL_RenderReadPixels(this->renderer, nullptr, SDL_PIXELFORMAT_RGBA32, frame.pixels.data(), this->window_width_px * 4) == 0)
+			this->capture_callback(std::move(frame));
+		else
+			dprintln("error reading pixels for frame capture", '\n', SDL_GetError());
+	}
+
 	SDL_RenderPresent(this->renderer);
+
+	this->frame_number++;
+}
+
+// ---------------------------------------------------
+
+void SDL_GraphicsDriver::begin_frame_capture (FrameCaptureCallback callback)
+{
+	mylib_assert_msg(!this->capture_callback, "frame capture already started")
+
+	this->capture_callback = std::move(callback);
+}
+
+// ---------------------------------------------------
+
+void SDL_GraphicsDriver::end_frame_capture ()
+{
+	this->capture_callback = nullptr;
 }
 
 // ---------------------------------------------------
@@ -370,14 +519,83 @@ void SDL_GraphicsDriver::clear_buffers (const uint32_t flags)
 
 void SDL_GraphicsDriver::begin_texture_loading ()
 {
-
+	this->loading_textures = true;
 }
 
 // ---------------------------------------------------
 
 void SDL_GraphicsDriver::end_texture_loading ()
 {
+	int32_t atlas_size = max_atlas_size;
+
+	// 0 means no limit
+	if (this->renderer_info.max_texture_width > 0 && this->renderer_info.max_texture_height > 0)
+		atlas_size = std::min({ atlas_size, this->renderer_info.max_texture_width, this->renderer_info.max_texture_height });
+
+	// a transparent pixel between textures, so linear filtering doesn't bring the neighbours
+	TextureAtlasCreator atlas_creator(1);
+
+	for (auto& pair : this->textures) {
+		TextureInfo& texture = pair.second;
+		const SDL_TextureDescriptor *desc = Mylib::any_cast<SDL_TextureDescriptor*>(texture.data);
+
+		if (desc->surface != nullptr)
+			atlas_creator.add_texture(texture);
+	}
+
+	while (true) {
+		std::vector<TextureAtlasCreator::AtlasTexture> atlas = atlas_creator.create_atlas(atlas_size);
+
+		if (atlas.empty())
+			break;
+
+		// new surfaces are filled with zeros, so the empty areas are transparent
+
+		SDL_Surface *atlas_surface = SDL_CreateRGBSurfaceWithFormat(0, atlas_size, atlas_size, 32, SDL_PIXELFORMAT_ABGR8888);
+		mylib_assert_msg(atlas_surface != nullptr, "error creating surface", '\n', SDL_GetError())
+
+		for (auto& atlas_tex : atlas) {
+			SDL_TextureDescriptor *desc = Mylib::any_cast<SDL_TextureDescriptor*>(atlas_tex.texture->data);
+			SDL_Rect rect = {
+				.x = atlas_tex.x_ini,
+				.y = atlas_tex.y_ini,
+				.w = desc->surface->w,
+				.h = desc->surface->h
+			};
+
+			// copy the alpha channel instead of blending with the empty atlas
+			SDL_SetSurfaceBlendMode(desc->surface, SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(desc->surface, nullptr, atlas_surface, &rect);
+
+			desc->tex_ini = SDL_FPoint {
+				.x = static_cast<float>(rect.x) / static_cast<float>(atlas_size),
+				.y = static_cast<float>(rect.y) / static_cast<float>(atlas_size)
+			};
+
+			desc->tex_end = SDL_FPoint {
+				.x = static_cast<float>(rect.x + rect.w) / static_cast<float>(atlas_size),
+				.y = static_cast<float>(rect.y + rect.h) / static_cast<float>(atlas_size)
+			};
+
+			SDL_FreeSurface(desc->surface);
+			desc->surface = nullptr;
+		}
+
+		SDL_Texture *atlas_texture = SDL_CreateTextureFromSurface(this->renderer, atlas_surface);
+		mylib_assert_msg(atlas_texture != nullptr, "error converting surface to texture", '\n', SDL_GetError())
 
+		SDL_SetTextureBlendMode(atlas_texture, SDL_BLENDMODE_BLEND);
+		SDL_FreeSurface(atlas_surface);
+
+		for (auto& atlas_tex : atlas)
+			Mylib::any_cast<SDL_TextureDescriptor*>(atlas_tex.texture->data)->texture = atlas_texture;
+
+		this->atlases.push_back(atlas_texture);
+
+		dprintln("SDL atlas created with ", atlas.size(), " textures");
+	}
+
+	this->loading_textures = false;
 }
 
 // ---------------------------------------------------
@@ -386,11 +604,21 @@ TextureInfo SDL_GraphicsDriver::load_texture__ (SDL_Surface *surface)
 {
 	SDL_TextureDescriptor *desc = new(this->memory_manager.allocate_type<SDL_TextureDescriptor>(1)) SDL_TextureDescriptor;
 
-//	desc->surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA8888, 0);
-//	mylib_assert_exception_msg(desc->surface != nullptr, "error converting surface format", '\n', SDL_GetError())
+	desc->tex_ini = SDL_FPoint { .x = 0, .y = 0 };
+	desc->tex_end = SDL_FPoint { .x = 1, .y = 1 };
 
-	desc->texture = SDL_CreateTextureFromSurface(this->renderer, surface);
-	mylib_assert_msg(desc->texture != nullptr, "error converting surface to texture", '\n', SDL_GetError())
+	if (this->loading_textures) {
+		// packed in an atlas page by end_texture_loading
+		desc->surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ABGR8888, 0);
+		mylib_assert_msg(desc->surface != nullptr, "error converting surface format", '\n', SDL_GetError())
+
+		desc->texture = nullptr;
+	}
+	else {
+		desc->surface = nullptr;
+		desc->texture = SDL_CreateTextureFromSurface(this->renderer, surface);
+		mylib_assert_msg(desc->texture != nullptr, "error converting surface to texture", '\n', SDL_GetError())
+	}
 
 	return TextureInfo {
 		.data = desc,
@@ -416,5 +644,58 @@ TextureInfo SDL_GraphicsDriver::create_sub_texture__ (const TextureInfo& parent,
 
 // ---------------------------------------------------
 
+TextureInfo SDL_GraphicsDriver::create_render_target__ (const uint32_t width_px, const uint32_t height_px)
+{
+	SDL_TextureDescriptor *desc = new(this->memory_manager.allocate_type<SDL_TextureDescriptor>(1)) SDL_TextureDescriptor;
+
+	desc->surface = nullptr;
+	desc->tex_ini = SDL_FPoint { .x = 0, .y = 0 };
+	desc->tex_end = SDL_FPoint { .x = 1, .y = 1 };
+	desc->texture = SDL_CreateTexture(this->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width_px, height_px);
+	mylib_assert_msg(desc->texture != nullptr, "error creating render target texture", '\n', SDL_GetError())
+
+	SDL_SetTextureBlendMode(desc->texture, SDL_BLENDMODE_BLEND);
+
+	return TextureInfo {
+		.data = desc,
+		.width_px = static_cast<int32_t>(width_px),
+		.height_px = static_cast<int32_t>(height_px),
+		.aspect_ratio = static_cast<fp_t>(width_px) / static_cast<fp_t>(height_px)
+		};
+}
+
+// ---------------------------------------------------
+
+void SDL_GraphicsDriver::begin_render_to_texture__ (TextureInfo& texture, const Vector2& world_init, const Vector2& world_size)
+{
+	SDL_TextureDescriptor *desc = Mylib::any_cast<SDL_TextureDescriptor*>(texture.data);
+
+	this->saved_projection_matrix = this->projection_matrix;
+	this->saved_scale_factor = this->scale_factor;
+
+	this->flush_vertices(); // they belong to the previous target
+
+	SDL_SetRenderTarget(this->renderer, desc->texture);
+	SDL_SetRenderDrawColor(this->renderer, 0, 0, 0, 0);
+	SDL_RenderClear(this->renderer);
+
+	this->scale_factor = static_cast<fp_t>(texture.width_px) / world_size.x;
+	this->projection_matrix = Matrix4::scale(Vector2(this->scale_factor, static_cast<fp_t>(texture.height_px) / world_size.y)) * Matrix4::translate(-world_init);
+}
+
+// ---------------------------------------------------
+
+void SDL_GraphicsDriver::end_render_to_texture__ (TextureInfo& texture)
+{
+	this->flush_vertices();
+
+	SDL_SetRenderTarget(this->renderer, nullptr);
+
+	this->projection_matrix = this->saved_projection_matrix;
+	this->scale_factor = this->saved_scale_factor;
+}
+
+// ---------------------------------------------------
+
 } // namespace Graphics
 } // namespace MyGlib
\ No newline at end of file
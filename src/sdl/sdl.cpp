@@ -7,6 +7,7 @@
 
 #include <SDL.h>
 #include <SDL_image.h>
+#include <SDL_ttf.h>
 
 
 namespace MyGlib
@@ -52,12 +53,20 @@ void SDL_Driver_Init ()
 	}
 
 	dprintln("SDL Image Initialized");
+
+	if (TTF_Init() < 0) [[unlikely]] {
+		dprintln("SDL TTF_Error: ", TTF_GetError());
+		mylib_throw_msg(NoMyGameLibException, "SDL TTF could not initialize!");
+	}
+
+	dprintln("SDL TTF Initialized");
 }
 
 // ---------------------------------------------------
 
 void SDL_Driver_End ()
 {
+	TTF_Quit();
 	IMG_Quit();
 	SDL_Quit();
 }
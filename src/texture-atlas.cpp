@@ -16,18 +16,9 @@ namespace Graphics
 
 // ---------------------------------------------------
 
-struct EmptyArea {
-	int32_t x_ini;
-	int32_t y_ini;
-	int32_t x_end;
-	int32_t y_end;
-};
-
-// ---------------------------------------------------
-
-static std::list<EmptyArea>::iterator find_empty_area (std::list<EmptyArea>& empty_areas, const TextureInfo& texture)
+static std::list<TextureAtlasCreator::EmptyArea>::iterator find_empty_area (std::list<TextureAtlasCreator::EmptyArea>& empty_areas, const int32_t tex_w, const int32_t tex_h)
 {
-	std::list<EmptyArea>::iterator best_it = empty_areas.end();
+	std::list<TextureAtlasCreator::EmptyArea>::iterator best_it = empty_areas.end();
 	int32_t best_area = std::numeric_limits<int32_t>::max();
 
 	for (auto it = empty_areas.begin(); it != empty_areas.end(); it++) {
@@ -36,7 +27,7 @@ static std::list<EmptyArea>::iterator find_empty_area (std::list<EmptyArea>& emp
 		const int32_t h = empty_area.y_end - empty_area.y_ini;
 		const int32_t area = w * h;
 
-		if (w >= texture.width_px && h >= texture.height_px) {
+		if (w >= tex_w && h >= tex_h) {
 			// If we arrive here, we have found an empty area that fits the texture.
 			// Now, let's check if it's the best empty area.
 
@@ -52,14 +43,18 @@ static std::list<EmptyArea>::iterator find_empty_area (std::list<EmptyArea>& emp
 
 // ---------------------------------------------------
 
-void TextureAtlasCreator::add_texture (TextureInfo& texture)
+void TextureAtlasCreator::add_texture (TextureInfo& texture, const int32_t width_px, const int32_t height_px)
 {
-	this->textures.push_back(&texture);
+	this->textures.push_back( Entry {
+		.texture = &texture,
+		.width_px = width_px,
+		.height_px = height_px
+		});
 }
 
 // ---------------------------------------------------
 
-std::vector<TextureAtlasCreator::AtlasTexture> TextureAtlasCreator::create_atlas (const int32_t atlas_size)
+std::vector<TextureAtlasCreator::AtlasTexture> TextureAtlasCreator::create_atlas (const int32_t atlas_size_)
 {
 	std::vector<AtlasTexture> atlas;
 
@@ -67,22 +62,17 @@ std::vector<TextureAtlasCreator::AtlasTexture> TextureAtlasCreator::create_atlas
 		return atlas;
 
 	// sort textures by area
-	this->textures.sort([](const TextureInfo *a, const TextureInfo *b) -> bool {
-		return (a->width_px * a->height_px) > (b->width_px * b->height_px);
+	this->textures.sort([](const Entry& a, const Entry& b) -> bool {
+		return (a.width_px * a.height_px) > (b.width_px * b.height_px);
 	});
 
-	std::list<EmptyArea> empty_areas;
+	const int32_t padding_2x = this->padding_px * 2;
 
 	// check if all textures fit in the atlas
-	for (auto *tex_desc : this->textures)
-		mylib_assert_exception_msg_args((tex_desc->width_px <= atlas_size) && (tex_desc->height_px <= atlas_size), UnableToLoadTextureException, "Some textures do not fit in the Atlas", tex_desc->id)
+	for (const Entry& entry : this->textures)
+		mylib_assert_exception_msg_args(((entry.width_px + padding_2x) <= atlas_size_) && ((entry.height_px + padding_2x) <= atlas_size_), UnableToLoadTextureException, "Some textures do not fit in the Atlas", entry.texture->id)
 
-	empty_areas.push_back( EmptyArea {
-		.x_ini = 0,
-		.y_ini = 0,
-		.x_end = atlas_size,
-		.y_end = atlas_size
-		});
+	this->begin_atlas(atlas_size_);
 
 //	for (auto& tex_desc : this->textures)
 //		dprintln("Area ", (tex_desc.width_px * tex_desc.height_px), " ", tex_desc.width_px, "x", tex_desc.height_px);
@@ -92,73 +82,102 @@ std::vector<TextureAtlasCreator::AtlasTexture> TextureAtlasCreator::create_atlas
 		next_it = it;
 		next_it++; // list doesn't have operator+ overload
 
-		auto *tex_desc_ptr = *it;
-		auto& tex_desc = *tex_desc_ptr;
-
-		auto empty_area_it = find_empty_area(empty_areas, tex_desc);
+		std::optional<AtlasTexture> atlas_tex = this->insert_texture(*it->texture, it->width_px, it->height_px);
 
-		if (empty_area_it == empty_areas.end()) // no space for the texture, try next one
+		if (!atlas_tex) // no space for the texture, try next one
 			continue;
-		
-		auto& empty_area = *empty_area_it;
-
-		// We have found an empty area that fits the texture.
-		
-		// set the position of the texture in the atlas
-		const AtlasTexture atlas_tex = {
-			.texture = tex_desc_ptr,
-			.x_ini = empty_area.x_ini,
-			.y_ini = empty_area.y_ini
-		};
 
 		// add texture to atlas
-		atlas.push_back(atlas_tex);
+		atlas.push_back(*atlas_tex);
 
-		//dprintln("Texture of size", tex_desc.width_px, "x", tex_desc.height_px, " allocated at position ", tex_desc.pos_x_px, "x", tex_desc.pos_y_px);
+		// now that we found a place for the texture, we can remove it from the list
+		this->textures.erase(it);
+	}
 
-		// update empty space
+	return atlas;
+}
 
-		if (tex_desc.width_px == (empty_area.x_end - empty_area.x_ini)) {
-			// The texture fills the empty area horizontally.
-			// We have to check if the texture also fills the empty area vertically.
+// ---------------------------------------------------
 
-			if (tex_desc.height_px == (empty_area.y_end - empty_area.y_ini)) {
-				// The texture also fills the empty area vertically, so we can remove it from the empty areas list.
-				empty_areas.erase(empty_area_it);
-			}
-			else {
-				// The texture doesn't fill the empty area vertically, so we have to update the empty area.
-				empty_area.y_ini += tex_desc.height_px;
-			}
+void TextureAtlasCreator::begin_atlas (const int32_t atlas_size_)
+{
+	this->atlas_size = atlas_size_;
+
+	this->empty_areas.clear();
+
+	this->empty_areas.push_back( EmptyArea {
+		.x_ini = 0,
+		.y_ini = 0,
+		.x_end = this->atlas_size,
+		.y_end = this->atlas_size
+		});
+}
+
+// ---------------------------------------------------
+
+std::optional<TextureAtlasCreator::AtlasTexture> TextureAtlasCreator::insert_texture (TextureInfo& texture, const int32_t width_px, const int32_t height_px)
+{
+	// space reserved for the texture, including the gutter
+	const int32_t tex_w = width_px + this->padding_px * 2;
+	const int32_t tex_h = height_px + this->padding_px * 2;
+
+	auto empty_area_it = find_empty_area(this->empty_areas, tex_w, tex_h);
+
+	if (empty_area_it == this->empty_areas.end())
+		return std::nullopt;
+	
+	auto& empty_area = *empty_area_it;
+
+	// We have found an empty area that fits the texture.
+	
+	// set the position of the texture in the atlas
+	const AtlasTexture atlas_tex = {
+		.texture = &texture,
+		.x_ini = empty_area.x_ini + this->padding_px,
+		.y_ini = empty_area.y_ini + this->padding_px
+	};
+
+	//dprintln("Texture of size", width_px, "x", height_px, " allocated at position ", atlas_tex.x_ini, "x", atlas_tex.y_ini);
+
+	// update empty space
+
+	if (tex_w == (empty_area.x_end - empty_area.x_ini)) {
+		// The texture fills the empty area horizontally.
+		// We have to check if the texture also fills the empty area vertically.
+
+		if (tex_h == (empty_area.y_end - empty_area.y_ini)) {
+			// The texture also fills the empty area vertically, so we can remove it from the empty areas list.
+			this->empty_areas.erase(empty_area_it);
 		}
 		else {
-			// The texture doesn't fill the empty area horizontally.
-
-			if (tex_desc.height_px == (empty_area.y_end - empty_area.y_ini)) {
-				// The texture fills the empty area vertically, so we can remove it from the empty areas list.
-				empty_area.x_ini += tex_desc.width_px;
-			} else {
-				// The texture doesn't fill the empty area vertically, so we have to update the empty area.
-				// It also doesn't fill the empty area horizontally, so we have to add a new empty area.
-
-				// add empty area below the texture
-				empty_areas.push_back( EmptyArea {
-					.x_ini = empty_area.x_ini,
-					.y_ini = empty_area.y_ini + tex_desc.height_px,
-					.x_end = empty_area.x_ini + tex_desc.width_px,
-					.y_end = empty_area.y_end
-					});
-				
-				// update empty area to the right of the texture
-				empty_area.x_ini += tex_desc.width_px;
-			}
+			// The texture doesn't fill the empty area vertically, so we have to update the empty area.
+			empty_area.y_ini += tex_h;
+		}
+	}
+	else {
+		// The texture doesn't fill the empty area horizontally.
+
+		if (tex_h == (empty_area.y_end - empty_area.y_ini)) {
+			// The texture fills the empty area vertically, so we can remove it from the empty areas list.
+			empty_area.x_ini += tex_w;
+		} else {
+			// The texture doesn't fill the empty area vertically, so we have to update the empty area.
+			// It also doesn't fill the empty area horizontally, so we have to add a new empty area.
+
+			// add empty area below the texture
+			this->empty_areas.push_back( EmptyArea {
+				.x_ini = empty_area.x_ini,
+				.y_ini = empty_area.y_ini + tex_h,
+				.x_end = empty_area.x_ini + tex_w,
+				.y_end = empty_area.y_end
+				});
+			
+			// update empty area to the right of the texture
+			empty_area.x_ini += tex_w;
 		}
-
-		// now that we found a place for the texture, we can remove it from the list
-		this->textures.erase(it);
 	}
 
-	return atlas;
+	return atlas_tex;
 }
 
 // ---------------------------------------------------
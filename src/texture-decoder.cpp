@@ -0,0 +1,114 @@
+#include <SDL_image.h>
+
+#include <my-game-lib/texture-decoder.h>
+#include <my-game-lib/debug.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+TextureDecoder::TextureDecoder (const uint32_t n_threads, const Uint32 pixel_format_)
+	: pixel_format(pixel_format_)
+{
+	mylib_assert(n_threads > 0)
+
+	for (uint32_t i = 0; i < n_threads; i++)
+		this->threads.emplace_back(&TextureDecoder::thread_main, this);
+
+	dprintln("texture decoder started with ", n_threads, " threads");
+}
+
+TextureDecoder::~TextureDecoder ()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->running = false;
+		this->pending.clear();
+	}
+
+	this->condition.notify_all();
+
+	for (std::thread& thread : this->threads)
+		thread.join();
+
+	for (Job& job : this->decoded) {
+		if (job.surface != nullptr)
+			SDL_FreeSurface(job.surface);
+	}
+}
+
+// ---------------------------------------------------
+
+void TextureDecoder::push (TextureInfo& texture, std::string fname, Manager::TextureLoadedCallback callback)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		this->pending.push_back( Job {
+			.texture = &texture,
+			.fname = std::move(fname),
+			.callback = std::move(callback),
+			.surface = nullptr
+		} );
+	}
+
+	this->condition.notify_one();
+}
+
+// ---------------------------------------------------
+
+bool TextureDecoder::pop_decoded (Job& job)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	if (this->decoded.empty())
+		return false;
+
+	job = std::move(this->decoded.front());
+	this->decoded.pop_front();
+
+	return true;
+}
+
+// ---------------------------------------------------
+
+void TextureDecoder::thread_main ()
+{
+	while (true) {
+		Job job;
+
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			this->condition.wait(lock, [this] () { return !this->pending.empty() || !this->running; });
+
+			if (!this->running)
+				break;
+
+			job = std::move(this->pending.front());
+			this->pending.pop_front();
+		}
+
+		SDL_Surface *surface = IMG_Load(job.fname.data());
+
+		if (surface != nullptr) {
+			job.surface = SDL_ConvertSurfaceFormat(surface, this->pixel_format, 0);
+			SDL_FreeSurface(surface);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->decoded.push_back(std::move(job));
+		}
+	}
+}
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include <algorithm>
+
+#include <my-game-lib/voxel.h>
+#include <my-game-lib/debug.h>
+#include <my-game-lib/exception.h>
+
+// ---------------------------------------------------
+
+namespace MyGlib
+{
+namespace Graphics
+{
+
+// ---------------------------------------------------
+
+/*
+	For each surface, the axis perpendicular to it and the axes
+	that point to the right (u) and to the top (v) of the texture,
+	with u x v = normal, so the quads are counter-clockwise.
+*/
+
+struct SurfaceAxes {
+	uint32_t axis;
+	int32_t sign;
+	uint32_t u_axis;
+	int32_t u_sign;
+	uint32_t v_axis;
+	int32_t v_sign;
+};
+
+// indexed by Cube3D::SurfacePositionIndex
+static constexpr std::array<SurfaceAxes, 6> surface_axes = {
+	SurfaceAxes { .axis = 2, .sign = -1, .u_axis = 0, .u_sign = -1, .v_axis = 1, .v_sign = +1 }, // Front
+	SurfaceAxes { .axis = 2, .sign = +1, .u_axis = 0, .u_sign = +1, .v_axis = 1, .v_sign = +1 }, // Back
+	SurfaceAxes { .axis = 0, .sign = -1, .u_axis = 2, .u_sign = +1, .v_axis = 1, .v_sign = +1 }, // Left
+	SurfaceAxes { .axis = 0, .sign = +1, .u_axis = 2, .u_sign = -1, .v_axis = 1, .v_sign = +1 }, // Right
+	SurfaceAxes { .axis = 1, .sign = +1, .u_axis = 0, .u_sign = +1, .v_axis = 2, .v_sign = -1 }, // Top
+	SurfaceAxes { .axis = 1, .sign = -1, .u_axis = 0, .u_sign = +1, .v_axis = 2, .v_sign = +1 }  // Bottom
+};
+
+// ---------------------------------------------------
+
+VoxelChunk::VoxelChunk (Manager& manager_, const uint32_t size_x_, const uint32_t size_y_, const uint32_t size_z_, const fp_t voxel_size_)
+	: manager(manager_),
+	  size_x(size_x_),
+	  size_y(size_y_),
+	  size_z(size_z_),
+	  voxel_size(voxel_size_)
+{
+	mylib_assert(this->size_x > 0 && this->size_y > 0 && this->size_z > 0)
+
+	const std::array<uint32_t, 3> dims = { this->size_x, this->size_y, this->size_z };
+
+	this->voxels.resize(this->size_x * this->size_y * this->size_z, empty);
+	this->materials.resize(1);
+
+	uint32_t n_slices = 0;
+
+	for (uint32_t s = 0; s < surface_axes.size(); s++) {
+		this->first_slice[s] = n_slices;
+		n_slices += dims[ surface_axes[s].axis ];
+	}
+
+	// an empty chunk has no faces, so nothing is dirty
+	this->slices.resize(n_slices);
+	this->dirty_slices.resize(n_slices, false);
+
+	this->manager.create_voxel_chunk(*this);
+}
+
+VoxelChunk::~VoxelChunk ()
+{
+	this->manager.destroy_voxel_chunk(*this);
+}
+
+// ---------------------------------------------------
+
+void VoxelChunk::set_voxel (const uint32_t x, const uint32_t y, const uint32_t z, const Material material)
+{
+	mylib_assert(x < this->size_x && y < this->size_y && z < this->size_z)
+
+	Material& voxel = this->voxels[this->get_voxel_index(x, y, z)];
+
+	if (voxel == material)
+		return;
+
+	voxel = material;
+
+	// The faces of the voxel itself, and the faces of its
+	// neighbors that touch it.
+
+	const std::array<int32_t, 3> coords = { static_cast<int32_t>(x), static_cast<int32_t>(y), static_cast<int32_t>(z) };
+
+	for (uint32_t s = 0; s < surface_axes.size(); s++) {
+		const int32_t layer = coords[ surface_axes[s].axis ];
+
+		this->mark_dirty(static_cast<Surface>(s), layer);
+		this->mark_dirty(static_cast<Surface>(s), layer - surface_axes[s].sign);
+	}
+}
+
+void VoxelChunk::fill (const Material material)
+{
+	std::fill(this->voxels.begin(), this->voxels.end(), material);
+	std::fill(this->dirty_slices.begin(), this->dirty_slices.end(), true);
+
+	this->n_dirty_slices = this->dirty_slices.size();
+}
+
+// ---------------------------------------------------
+
+void VoxelChunk::set_material (const Material material, const std::array<TextureRenderOptions, 6>& textures)
+{
+	mylib_assert_msg(material != empty, "material 0 means empty voxel")
+
+	if (material >= this->materials.size())
+		this->materials.resize(material + 1);
+
+	this->materials[material] = textures;
+
+	// the textures are part of the mesh kept by the backends
+	this->mesh_version++;
+}
+
+// ---------------------------------------------------
+
+void VoxelChunk::mark_dirty (const Surface surface, const int32_t layer) noexcept
+{
+	const std::array<uint32_t, 3> dims = { this->size_x, this->size_y, this->size_z };
+
+	if (layer < 0 || layer >= static_cast<int32_t>(dims[ surface_axes[surface].axis ]))
+		return;
+
+	const uint32_t i = this->first_slice[surface] + layer;
+
+	if (!this->dirty_slices[i]) {
+		this->dirty_slices[i] = true;
+		this->n_dirty_slices++;
+	}
+}
+
+// ---------------------------------------------------
+
+bool VoxelChunk::update_mesh ()
+{
+	if (this->n_dirty_slices == 0)
+		return false;
+
+	const std::array<uint32_t, 3> dims = { this->size_x, this->size_y, this->size_z };
+
+	for (uint32_t s = 0; s < surface_axes.size(); s++) {
+		for (uint32_t layer = 0; layer < dims[ surface_axes[s].axis ]; layer++) {
+			const uint32_t i = this->first_slice[s] + layer;
+
+			if (!this->dirty_slices[i])
+				continue;
+
+			this->n_quads -= this->slices[i].size();
+			this->mesh_slice(static_cast<Surface>(s), layer);
+			this->n_quads += this->slices[i].size();
+
+			this->dirty_slices[i] = false;
+		}
+	}
+
+	this->n_dirty_slices = 0;
+	this->mesh_version++;
+
+	return true;
+}
+
+// ---------------------------------------------------
+
+void VoxelChunk::mesh_slice (const Surface surface, const uint32_t layer)
+{
+	const SurfaceAxes& axes = surface_axes[surface];
+	const std::array<uint32_t, 3> dims = { this->size_x, this->size_y, this->size_z };
+	const uint32_t nu = dims[axes.u_axis];
+	const uint32_t nv = dims[axes.v_axis];
+	const int32_t neighbor_layer = static_cast<int32_t>(layer) + axes.sign;
+	const bool has_neighbor_layer = (neighbor_layer >= 0) && (neighbor_layer < static_cast<int32_t>(dims[axes.axis]));
+
+	std::vector<Quad>& quads = this->slices[ this->first_slice[surface] + layer ];
+
+	quads.clear();
+
+	// visible faces of the slice
+
+	this->mask.resize(nu * nv);
+
+	for (uint32_t j = 0; j < nv; j++) {
+		for (uint32_t i = 0; i < nu; i++) {
+			std::array<uint32_t, 3> pos;
+
+			pos[axes.axis] = layer;
+			pos[axes.u_axis] = i;
+			pos[axes.v_axis] = j;
+
+			Material m = this->get_voxel(pos[0], pos[1], pos[2]);
+
+			if (m != empty && has_neighbor_layer) {
+				pos[axes.axis] = neighbor_layer;
+
+				if (this->get_voxel(pos[0], pos[1], pos[2]) != empty)
+					m = empty;
+			}
+
+			this->mask[i + j*nu] = m;
+		}
+	}
+
+	// merge the faces into rectangles, growing first along u and then along v
+
+	const fp_t plane = static_cast<fp_t>(layer + ((axes.sign > 0) ? 1 : 0)) * this->voxel_size;
+
+	auto make_point = [&axes, plane, this] (const uint32_t u, const uint32_t v) -> Point {
+		std::array<fp_t, 3> coords;
+
+		coords[axes.axis] = plane;
+		coords[axes.u_axis] = static_cast<fp_t>(u) * this->voxel_size;
+		coords[axes.v_axis] = static_cast<fp_t>(v) * this->voxel_size;
+
+		return Point(coords[0], coords[1], coords[2]);
+	};
+
+	std::array<fp_t, 3> normal = { 0, 0, 0 };
+	normal[axes.axis] = static_cast<fp_t>(axes.sign);
+
+	for (uint32_t j = 0; j < nv; j++) {
+		for (uint32_t i = 0; i < nu; ) {
+			const Material m = this->mask[i + j*nu];
+
+			if (m == empty) {
+				i++;
+				continue;
+			}
+
+			uint32_t w = 1;
+
+			while ((i + w) < nu && this->mask[(i + w) + j*nu] == m)
+				w++;
+
+			uint32_t h = 1;
+
+			for (; (j + h) < nv; h++) {
+				const Material *row = this->mask.data() + (j + h)*nu + i;
+
+				if (!std::all_of(row, row + w, [m] (const Material other) -> bool { return other == m; }))
+					break;
+			}
+
+			for (uint32_t jj = j; jj < (j + h); jj++)
+				std::fill_n(this->mask.data() + jj*nu + i, w, empty);
+
+			const uint32_t left = (axes.u_sign > 0) ? i : (i + w);
+			const uint32_t right = (axes.u_sign > 0) ? (i + w) : i;
+			const uint32_t bottom = (axes.v_sign > 0) ? j : (j + h);
+			const uint32_t top = (axes.v_sign > 0) ? (j + h) : j;
+
+			quads.push_back( Quad {
+				.corners = {
+					make_point(left, top),
+					make_point(left, bottom),
+					make_point(right, bottom),
+					make_point(right, top)
+				},
+				.normal = Vector(normal[0], normal[1], normal[2]),
+				.n_tiles = Vector2(static_cast<fp_t>(w), static_cast<fp_t>(h)),
+				.surface = surface,
+				.material = m
+			} );
+
+			i += w;
+		}
+	}
+}
+
+// ---------------------------------------------------
+
+} // end namespace Graphics
+} // end namespace MyGlib
@@ -1,6 +1,8 @@
 #include <chrono>
 #include <thread>
 #include <string_view>
+#include <numbers>
+#include <array>
 
 #include <my-game-lib/my-game-lib.h>
 
@@ -22,6 +24,7 @@ using MyGlib::Graphics::Circle2D;
 using MyGlib::Graphics::Line3D;
 using MyGlib::Graphics::WireCube3D;
 using MyGlib::Graphics::TextureDescriptor;
+using MyGlib::Graphics::TextureSetDescriptor;
 
 using Colors = MyGlib::Graphics::Colors;
 
@@ -95,6 +98,7 @@ fp_t far_cube_angular_vel = Mylib::Math::degrees_to_radians(fp(45));
 
 Sphere3D sphere(2);
 Sphere3D earth(2);
+Sphere3D moon(0.5);
 
 Point camera_pos(-0.5, -0.5, 10);
 Point camera_vector(0, 0, -1);
@@ -120,6 +124,8 @@ TextureDescriptor tree_texture;
 TextureDescriptor yoshi_texture;
 TextureDescriptor zelda_texture;
 TextureDescriptor box_texture;
+TextureSetDescriptor earth_textures;
+TextureSetDescriptor moon_textures;
 
 void setup ()
 {
@@ -155,6 +161,11 @@ void setup ()
 	box_texture = renderer->load_texture("tests-assets/box.png");
 	renderer->end_texture_loading();
 
+	earth_textures = renderer->create_texture_set("earth", std::array{ earth_high_texture, earth_medium_texture, earth_low_texture });
+	earth_textures.info->lod_bias = std::numbers::pi_v<fp_t>;
+	moon_textures = renderer->create_texture_set("moon", std::array{ moon_high_texture, moon_medium_texture, moon_low_texture });
+	moon_textures.info->lod_bias = std::numbers::pi_v<fp_t>;
+
 	half_samus_texture = renderer->create_sub_texture(samus_texture, 0, 0, samus_texture.info->width_px / 2, samus_texture.info->height_px);
 	
 	samus_rect.set_size(1.0, 1.0 / samus_texture.info->aspect_ratio);
@@ -265,7 +276,8 @@ void render ()
 		renderer->draw_cube3D(cube_color, Vector(3, -3, -1), Colors::red);
 		renderer->draw_wire_cube3D(WireCube3D(1), cube_pos+Vector(2, 0, 0), Colors::white);
 		renderer->draw_sphere3D(sphere, Vector(2.5, 1.5, 0), Colors::green);
-		renderer->draw_sphere3D(earth, Vector(-4, 0, 0), { .desc = earth_medium_texture });
+		renderer->draw_sphere3D(earth, Vector(-4, 0, 0), { .set = earth_textures });
+		renderer->draw_sphere3D(moon, Vector(-1, 2.5, -2), { .set = moon_textures });
 
 		// we render the far cube twice because part of it is
 		// in the first frustum and part of it is in the second frustum
@@ -299,12 +311,70 @@ void quit_callback (const MyGlib::Event::Quit::Type& event)
 	alive = false;
 }
 
+/*
+	Checks that all triangles of a shape are counter-clockwise
+	when seen from the direction of their normals.
+	Required since closed meshes are rendered with back-face culling.
+*/
+
+bool check_winding (const std::string_view name, MyGlib::Graphics::Shape& shape)
+{
+	const auto vertices = shape.get_local_vertices();
+	uint32_t n_wrong = 0;
+
+	for (uint32_t i = 0; i + 2 < vertices.size(); i += 3) {
+		const Vector& a = vertices[i].pos;
+		const Vector& b = vertices[i+1].pos;
+		const Vector& c = vertices[i+2].pos;
+		const Vector ab = b - a;
+		const Vector ac = c - a;
+		const Vector normal = vertices[i].normal + vertices[i+1].normal + vertices[i+2].normal;
+
+		const Vector cross(
+			ab.y*ac.z - ab.z*ac.y,
+			ab.z*ac.x - ab.x*ac.z,
+			ab.x*ac.y - ab.y*ac.x
+		);
+
+		const fp_t area = cross.x*cross.x + cross.y*cross.y + cross.z*cross.z;
+
+		// degenerate triangles (e.g. at the poles of the sphere) have no winding
+		if (area < fp(1e-12))
+			continue;
+
+		if ((cross.x*normal.x + cross.y*normal.y + cross.z*normal.z) <= fp(0)) {
+			std::cout << name << ": triangle " << (i / 3) << " is clockwise" << std::endl;
+			n_wrong++;
+		}
+	}
+
+	std::cout << name << ": " << (vertices.size() / 3) << " triangles, " << n_wrong << " with wrong winding" << std::endl;
+
+	return (n_wrong == 0);
+}
+
+int run_winding_tests ()
+{
+	Cube3D cube(1, 2, 3);
+	Rect2D rect(2, 1);
+	Sphere3D sphere(1);
+	bool ok = true;
+
+	ok &= check_winding("Cube3D", cube);
+	ok &= check_winding("Rect2D", rect);
+	ok &= check_winding("Sphere3D", sphere);
+
+	return ok ? 0 : 1;
+}
+
 int main (int argc, char **argv)
 {
 	MyGlib::Graphics::Manager::Type graphics_type;
 
 	if (argc == 2) {
-		if (std::string_view(argv[1]) == "opengl")
+		if (std::string_view(argv[1]) == "winding")
+			return run_winding_tests();
+		else if (std::string_view(argv[1]) == "opengl")
 			graphics_type = MyGlib::Graphics::Manager::Type::Opengl;
 		else if (std::string_view(argv[1]) == "sdl")
 			graphics_type = MyGlib::Graphics::Manager::Type::SDL;
@@ -314,7 +384,7 @@ int main (int argc, char **argv)
 		}
 	}
 	else {
-		std::cout << "Usage: " << argv[0] << " [opengl|sdl]" << std::endl;
+		std::cout << "Usage: " << argv[0] << " [opengl|sdl|winding]" << std::endl;
 		return 1;
 	}
 